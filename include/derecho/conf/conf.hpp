@@ -29,12 +29,28 @@ private:
 #define CONF_DERECHO_RDMC_PORT "DERECHO/rdmc_port"
 #define CONF_DERECHO_HEARTBEAT_MS "DERECHO/heartbeat_ms"
 #define CONF_DERECHO_SST_POLL_CQ_TIMEOUT_MS "DERECHO/sst_poll_cq_timeout_ms"
+#define CONF_DERECHO_SST_IDLE_POLICY "DERECHO/sst_idle_policy"
+#define CONF_DERECHO_SST_IDLE_SPIN_US "DERECHO/sst_idle_spin_us"
+#define CONF_DERECHO_SST_IDLE_SLEEP_US "DERECHO/sst_idle_sleep_us"
+#define CONF_DERECHO_SST_PREDICATE_THREADS "DERECHO/sst_predicate_threads"
 #define CONF_DERECHO_DISABLE_PARTITIONING_SAFETY "DERECHO/disable_partitioning_safety"
+#define CONF_DERECHO_MAX_DELIVERY_BATCH_SIZE "DERECHO/max_delivery_batch_size"
+#define CONF_DERECHO_SMC_PACKING_MAX_BYTES "DERECHO/smc_packing_max_bytes"
+#define CONF_DERECHO_SMC_PACKING_MAX_DELAY_US "DERECHO/smc_packing_max_delay_us"
+#define CONF_DERECHO_P2P_WORKER_THREADS "DERECHO/p2p_worker_threads"
+#define CONF_DERECHO_P2P_IDLE_POLICY "DERECHO/p2p_idle_policy"
+#define CONF_DERECHO_P2P_IDLE_SPIN_US "DERECHO/p2p_idle_spin_us"
+#define CONF_DERECHO_P2P_IDLE_SLEEP_US "DERECHO/p2p_idle_sleep_us"
+#define CONF_DERECHO_P2P_IDLE_POLL_US "DERECHO/p2p_idle_poll_us"
+#define CONF_DERECHO_RPC_CALLBACK_THREADS "DERECHO/rpc_callback_threads"
+#define CONF_DERECHO_PERSISTENCE_LINGER_US "DERECHO/persistence_linger_us"
+#define CONF_DERECHO_PERSISTENCE_THREADS "DERECHO/persistence_threads"
 
 #define CONF_SUBGROUP_DEFAULT_MAX_PAYLOAD_SIZE "SUBGROUP/DEFAULT/max_payload_size"
 #define CONF_SUBGROUP_DEFAULT_MAX_SMC_PAYLOAD_SIZE "SUBGROUP/DEFAULT/max_smc_payload_size"
 #define CONF_SUBGROUP_DEFAULT_BLOCK_SIZE "SUBGROUP/DEFAULT/block_size"
 #define CONF_SUBGROUP_DEFAULT_WINDOW_SIZE "SUBGROUP/DEFAULT/window_size"
+#define CONF_SUBGROUP_DEFAULT_SMC_RING_SIZE "SUBGROUP/DEFAULT/smc_ring_size"
 #define CONF_SUBGROUP_DEFAULT_RDMC_SEND_ALGORITHM "SUBGROUP/DEFAULT/rdmc_send_algorithm"
 
 #define CONF_RDMA_PROVIDER "RDMA/provider"
@@ -46,6 +62,9 @@ private:
 #define CONF_PERS_RESET "PERS/reset"
 #define CONF_PERS_MAX_LOG_ENTRY "PERS/max_log_entry"
 #define CONF_PERS_MAX_DATA_SIZE "PERS/max_data_size"
+#define CONF_PERS_WRITE_MODE "PERS/write_mode"
+#define CONF_PERS_SEGMENT_SIZE "PERS/segment_size"
+#define CONF_PERS_DIRECT_BUFFER_SIZE "PERS/direct_buffer_size"
 #define CONF_LOGGER_DEFAULT_LOG_NAME "LOGGER/default_log_name"
 #define CONF_LOGGER_DEFAULT_LOG_LEVEL "LOGGER/default_log_level"
 
@@ -61,12 +80,28 @@ private:
             {CONF_DERECHO_RDMC_PORT, "31675"},
             {CONF_SUBGROUP_DEFAULT_RDMC_SEND_ALGORITHM, "binomial_send"},
             {CONF_DERECHO_SST_POLL_CQ_TIMEOUT_MS, "2000"},
+            {CONF_DERECHO_SST_IDLE_POLICY, "sleep"},
+            {CONF_DERECHO_SST_IDLE_SPIN_US, "1000"},
+            {CONF_DERECHO_SST_IDLE_SLEEP_US, "1000"},
+            {CONF_DERECHO_SST_PREDICATE_THREADS, "1"},
             {CONF_DERECHO_DISABLE_PARTITIONING_SAFETY, "true"},
+            {CONF_DERECHO_MAX_DELIVERY_BATCH_SIZE, "0"},
+            {CONF_DERECHO_SMC_PACKING_MAX_BYTES, "0"},
+            {CONF_DERECHO_SMC_PACKING_MAX_DELAY_US, "50"},
+            {CONF_DERECHO_P2P_WORKER_THREADS, "1"},
+            {CONF_DERECHO_P2P_IDLE_POLICY, "spin"},
+            {CONF_DERECHO_P2P_IDLE_SPIN_US, "1000"},
+            {CONF_DERECHO_P2P_IDLE_SLEEP_US, "1000"},
+            {CONF_DERECHO_P2P_IDLE_POLL_US, "100"},
+            {CONF_DERECHO_RPC_CALLBACK_THREADS, "1"},
+            {CONF_DERECHO_PERSISTENCE_LINGER_US, "0"},
+            {CONF_DERECHO_PERSISTENCE_THREADS, "1"},
             // [SUBGROUP/<subgroupname>]
             {CONF_SUBGROUP_DEFAULT_MAX_PAYLOAD_SIZE, "10240"},
             {CONF_SUBGROUP_DEFAULT_MAX_SMC_PAYLOAD_SIZE, "10240"},
             {CONF_SUBGROUP_DEFAULT_BLOCK_SIZE, "1048576"},
             {CONF_SUBGROUP_DEFAULT_WINDOW_SIZE, "16"},
+            {CONF_SUBGROUP_DEFAULT_SMC_RING_SIZE, "0"},
             {CONF_DERECHO_HEARTBEAT_MS, "1"},
             // [RDMA]
             {CONF_RDMA_PROVIDER, "sockets"},
@@ -79,6 +114,9 @@ private:
             {CONF_PERS_RESET, "false"},
             {CONF_PERS_MAX_LOG_ENTRY, "1048576"}, // 1M log entries.
             {CONF_PERS_MAX_DATA_SIZE, "549755813888"}, // 512G total data size.
+            {CONF_PERS_WRITE_MODE, "mmap"},
+            {CONF_PERS_SEGMENT_SIZE, "0"}, // one ring buffer file for the log and one for the data.
+            {CONF_PERS_DIRECT_BUFFER_SIZE, "1048576"}, // 1MB for the unwritten tail of the log, and of the data.
             // [LOGGER]
             {CONF_LOGGER_DEFAULT_LOG_NAME, "derecho_debug"},
             {CONF_LOGGER_DEFAULT_LOG_LEVEL, "info"}};
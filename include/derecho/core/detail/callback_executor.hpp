@@ -0,0 +1,55 @@
+/**
+ * @file callback_executor.hpp
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace derecho {
+
+namespace rpc {
+
+/**
+ * A small pool of threads that runs the continuations of asynchronous RPC
+ * calls, so that a caller can have many calls outstanding without a thread
+ * blocked on each one, and a continuation can block without holding up the
+ * RPC thread that received the reply. Tasks are run in the order they were
+ * posted, but with more than one thread, two tasks may run concurrently.
+ * The threads are only started when the first task is posted.
+ */
+class CallbackExecutor {
+    const uint32_t num_threads;
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex tasks_mutex;
+    std::condition_variable tasks_cv;
+    bool shutdown = false;
+    std::once_flag threads_started;
+
+    void worker_loop(uint32_t worker_num);
+
+public:
+    /**
+     * @param num_threads The number of threads to run tasks on; at least one
+     * is always used.
+     */
+    explicit CallbackExecutor(uint32_t num_threads);
+    /** Stops the threads; tasks that have not started yet are discarded. */
+    ~CallbackExecutor();
+
+    /**
+     * Queues a task to run on one of the executor's threads. Tasks posted
+     * after the executor has started shutting down are discarded.
+     */
+    void post(std::function<void()> task);
+};
+
+}  // namespace rpc
+}  // namespace derecho
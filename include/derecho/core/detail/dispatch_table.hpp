@@ -0,0 +1,142 @@
+/**
+ * @file dispatch_table.hpp
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include "rpc_utils.hpp"
+
+namespace derecho {
+
+namespace rpc {
+
+/**
+ * A read-only copy of the RPC receivers map, arranged for fast lookup of the
+ * handler for an incoming message. Handlers are indexed first by subgroup ID
+ * and by whether they handle calls or replies, which needs no comparisons at
+ * all, and then kept in a small sorted array per subgroup, so a lookup is a
+ * binary search over contiguous entries instead of a walk down a tree of
+ * 4-field keys. The entries hold their own copies of the handlers, so the
+ * table must be rebuilt whenever the map changes, but the map can then be
+ * changed without invalidating a handler that is being run.
+ *
+ * Rebuilding publishes a new copy of the table rather than modifying the
+ * current one, so a receive thread can look up handlers while a new
+ * subgroup's handlers are being registered. A replaced copy is retired, and
+ * freed by a later rebuild once no handler returned by find() is still held.
+ */
+class DispatchTable {
+    struct entry {
+        FunctionTag function_id;
+        subgroup_type_id_t class_id;
+        receive_fun_t handler;
+    };
+    static bool entry_less(const entry& lhs, const entry& rhs) {
+        return std::tie(lhs.function_id, lhs.class_id) < std::tie(rhs.function_id, rhs.class_id);
+    }
+    /** Indexed by subgroup ID, then by Opcode::is_reply */
+    using table_t = std::vector<std::array<std::vector<entry>, 2>>;
+    /** The current copy of the table, read by find() */
+    std::atomic<const table_t*> current_table{nullptr};
+    /** Owns the current copy of the table */
+    std::unique_ptr<const table_t> owned_table;
+    /** Replaced copies of the table that a held handler may still point into */
+    std::vector<std::unique_ptr<const table_t>> retired_tables;
+    /** The number of handlers returned by find() that are still held */
+    mutable std::atomic<uint32_t> active_lookups{0};
+    /** Serializes calls to rebuild() */
+    std::mutex rebuild_mutex;
+
+public:
+    /**
+     * A handler returned by find(). The copy of the table it points into is
+     * not freed until it is destroyed, so it should not be held for longer
+     * than it takes to run the handler.
+     */
+    class handler_ref {
+        const receive_fun_t* handler;
+        std::atomic<uint32_t>* active_lookups;
+
+    public:
+        handler_ref(const receive_fun_t* handler, std::atomic<uint32_t>* active_lookups)
+                : handler(handler), active_lookups(active_lookups) {}
+        handler_ref(handler_ref&& other)
+                : handler(other.handler), active_lookups(other.active_lookups) {
+            other.active_lookups = nullptr;
+        }
+        handler_ref(const handler_ref&) = delete;
+        handler_ref& operator=(const handler_ref&) = delete;
+        ~handler_ref() {
+            if(active_lookups) {
+                active_lookups->fetch_sub(1, std::memory_order_release);
+            }
+        }
+        explicit operator bool() const { return handler != nullptr; }
+        const receive_fun_t& operator*() const { return *handler; }
+    };
+
+    /**
+     * Replaces the contents of the table with the handlers in receivers.
+     */
+    void rebuild(const std::map<Opcode, receive_fun_t>& receivers) {
+        std::unique_ptr<table_t> new_table = std::make_unique<table_t>();
+        table_t& entries = *new_table;
+        for(const auto& receiver : receivers) {
+            const Opcode& opcode = receiver.first;
+            if(opcode.subgroup_id >= entries.size()) {
+                entries.resize(opcode.subgroup_id + 1);
+            }
+            entries[opcode.subgroup_id][opcode.is_reply].push_back(
+                    entry{opcode.function_id, opcode.class_id, receiver.second});
+        }
+        for(auto& subgroup_entries : entries) {
+            for(auto& direction_entries : subgroup_entries) {
+                std::sort(direction_entries.begin(), direction_entries.end(), entry_less);
+            }
+        }
+        std::lock_guard<std::mutex> lock(rebuild_mutex);
+        current_table.store(new_table.get(), std::memory_order_seq_cst);
+        if(owned_table) {
+            retired_tables.emplace_back(std::move(owned_table));
+        }
+        owned_table = std::move(new_table);
+        //find() counts itself before it loads current_table, so once no lookup
+        //is counted, every later one must be reading the new copy
+        if(active_lookups.load(std::memory_order_seq_cst) == 0) {
+            retired_tables.clear();
+        }
+    }
+
+    /**
+     * @return The handler registered for opcode, which is empty if there is none.
+     */
+    handler_ref find(const Opcode& opcode) const {
+        active_lookups.fetch_add(1, std::memory_order_seq_cst);
+        const table_t* entries = current_table.load(std::memory_order_seq_cst);
+        const receive_fun_t* handler = nullptr;
+        if(entries && opcode.subgroup_id < entries->size()) {
+            const std::vector<entry>& candidates = (*entries)[opcode.subgroup_id][opcode.is_reply];
+            auto found = std::lower_bound(candidates.begin(), candidates.end(), opcode,
+                                          [](const entry& lhs, const Opcode& rhs) {
+                                              return std::tie(lhs.function_id, lhs.class_id) < std::tie(rhs.function_id, rhs.class_id);
+                                          });
+            if(found != candidates.end() && found->function_id == opcode.function_id
+               && found->class_id == opcode.class_id) {
+                handler = &found->handler;
+            }
+        }
+        return handler_ref(handler, &active_lookups);
+    }
+};
+
+}  // namespace rpc
+}  // namespace derecho
@@ -0,0 +1,76 @@
+/**
+ * @file mpsc_queue.hpp
+ */
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace derecho {
+
+/**
+ * An unbounded queue that hands values from any number of producer threads to
+ * exactly one consumer thread without taking a lock. Values are kept in a
+ * linked list: a producer claims the tail with a single atomic exchange and
+ * then links its node behind the previous tail, so producers never wait for
+ * each other or for the consumer. The consumer owns the head, which is always
+ * a node whose value has already been popped (initially a dummy node), and
+ * frees nodes as it moves past them. T must be default-constructible.
+ *
+ * A value whose push has not returned yet may not be visible to pop(), even
+ * if values pushed after it by other producers are. The links are written
+ * with sequentially consistent stores, as a QueueWorker requires.
+ */
+template <typename T>
+class MPSCQueue {
+private:
+    struct node {
+        std::atomic<node*> next{nullptr};
+        T value;
+    };
+    /** The node whose value was popped last; accessed only by the consumer */
+    alignas(64) node* head;
+    /** The node that was pushed last; exchanged by the producers */
+    alignas(64) std::atomic<node*> tail;
+
+public:
+    MPSCQueue() : head(new node), tail(head) {}
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    ~MPSCQueue() {
+        while(head != nullptr) {
+            node* next = head->next.load(std::memory_order_relaxed);
+            delete head;
+            head = next;
+        }
+    }
+
+    /** Called by any producer. */
+    void push(T&& value) {
+        node* new_node = new node;
+        new_node->value = std::move(value);
+        node* prev_tail = tail.exchange(new_node, std::memory_order_acq_rel);
+        prev_tail->next.store(new_node);
+    }
+
+    /** Called by the consumer. Returns false if the queue is empty. */
+    bool pop(T& value) {
+        node* next = head->next.load(std::memory_order_acquire);
+        if(next == nullptr) {
+            return false;
+        }
+        value = std::move(next->value);
+        delete head;
+        head = next;
+        return true;
+    }
+
+    /** Called by the consumer. */
+    bool empty() const {
+        return head->next.load() == nullptr;
+    }
+};
+
+}  // namespace derecho
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <assert.h>
+#include <atomic>
 #include <condition_variable>
 #include <functional>
+#include <future>
 #include <list>
 #include <map>
 #include <memory>
@@ -10,7 +12,6 @@
 #include <optional>
 #include <ostream>
 #include <queue>
-#include <set>
 #include <tuple>
 #include <vector>
 
@@ -19,6 +20,7 @@
 #include "connection_manager.hpp"
 #include "derecho_internal.hpp"
 #include "derecho_sst.hpp"
+#include "sequence_ring.hpp"
 #include <derecho/conf/conf.hpp>
 #include <derecho/mutils-serialization/SerializationMacros.hpp>
 #include <derecho/mutils-serialization/SerializationSupport.hpp>
@@ -53,6 +55,17 @@ struct __attribute__((__packed__)) header {
     bool cooked_send;
 };
 
+/**
+ * The header used instead of header for SST multicast messages in subgroups
+ * that pack small messages into shared slots (see DERECHO/smc_packing_max_bytes).
+ * Receivers tell the two apart by header_size.
+ */
+struct __attribute__((__packed__)) packed_header : public header {
+    /** The distance in bytes from this message to the next one in the same
+     * slot; 0 for the last (or only) message in the slot. */
+    uint32_t packed_next_offset;
+};
+
 /**
  * Bundles together a set of low-level parameters for configuring Derecho groups.
  * All of the parameters except max payload size and block size have sensible
@@ -62,6 +75,8 @@ struct __attribute__((__packed__)) header {
 struct DerechoParams : public mutils::ByteRepresentable {
     long long unsigned int max_msg_size;
     long long unsigned int sst_max_msg_size;
+    /** The size of each sender's SMC byte ring, or 0 to use window_size fixed SMC slots */
+    long long unsigned int sst_ring_size;
     long long unsigned int block_size;
     unsigned int window_size;
     unsigned int heartbeat_ms;
@@ -81,6 +96,16 @@ struct DerechoParams : public mutils::ByteRepresentable {
         return max_msg_size;
     }
 
+    /**
+     * The part of an SMC ring that is kept free for null messages. A null can
+     * be sent while the window is full of real messages, but the window also
+     * bounds this node's undelivered nulls, each of which takes at most a
+     * record plus a wrap-around gap smaller than a record.
+     */
+    static uint64_t smc_ring_reserve(unsigned int window_size) {
+        return 2 * window_size * sst::ring_layout::record_size(sizeof(header));
+    }
+
     static rdmc::send_algorithm send_algorithm_from_string(const std::string& rdmc_send_algorithm_string) {
         if(rdmc_send_algorithm_string == "binomial_send") {
             return rdmc::send_algorithm::BINOMIAL_SEND;
@@ -101,8 +126,12 @@ struct DerechoParams : public mutils::ByteRepresentable {
                   unsigned int window_size,
                   unsigned int heartbeat_ms,
                   rdmc::send_algorithm rdmc_send_algorithm,
-                  uint32_t rpc_port)
+                  uint32_t rpc_port,
+                  long long unsigned int smc_ring_size = 0)
             : sst_max_msg_size(max_smc_payload_size + sizeof(header)),
+              sst_ring_size(smc_ring_size ? sst::ring_layout::ring_size(smc_ring_size, sst_max_msg_size,
+                                                                        smc_ring_reserve(window_size))
+                                          : 0),
               block_size(block_size),
               window_size(window_size),
               heartbeat_ms(heartbeat_ms),
@@ -138,6 +167,14 @@ struct DerechoParams : public mutils::ByteRepresentable {
         uint32_t timeout_ms = getConfUInt32(CONF_DERECHO_HEARTBEAT_MS);
         const std::string& algorithm = getConfString(prefix + Conf::subgroupProfileFields[4]);
         uint32_t rpc_port = getConfUInt32(CONF_DERECHO_RPC_PORT);
+        // optional, so that existing profiles keep their fixed slots
+        uint64_t smc_ring_size = hasCustomizedConfKey(prefix + "smc_ring_size")
+                                         ? getConfUInt64(prefix + "smc_ring_size")
+                                         : 0;
+        // With packing, SST multicast slots need room for the larger packed_header
+        if(getConfUInt64(CONF_DERECHO_SMC_PACKING_MAX_BYTES) > 0) {
+            max_smc_payload_size += sizeof(packed_header) - sizeof(header);
+        }
 
         return DerechoParams{
                 max_payload_size,
@@ -147,11 +184,12 @@ struct DerechoParams : public mutils::ByteRepresentable {
                 timeout_ms,
                 DerechoParams::send_algorithm_from_string(algorithm),
                 rpc_port,
+                smc_ring_size,
         };
     }
 
     DEFAULT_SERIALIZATION_SUPPORT(DerechoParams, max_msg_size, sst_max_msg_size, block_size, window_size,
-                                  heartbeat_ms, rdmc_send_algorithm, rpc_port);
+                                  heartbeat_ms, rdmc_send_algorithm, rpc_port, sst_ring_size);
 };
 
 /**
@@ -231,6 +269,88 @@ struct SubgroupSettings {
     DerechoParams profile;
 };
 
+/** A send requested with MulticastGroup::send_async that is waiting for a free buffer */
+struct AsyncSend {
+    long long unsigned int payload_size;
+    std::function<void(char* buf)> msg_generator;
+    bool cooked_send;
+    /** Called with true once the message has been sent, or with false if the group is wedged first */
+    std::function<void(bool)> on_done;
+};
+
+/**
+ * The state of the messages of one subgroup, from the time a send buffer is
+ * handed out until the message is persisted. All of it is guarded by mutex, so
+ * that sending, receiving and delivering in one subgroup never contend with any
+ * other subgroup. A thread never holds the mutexes of two subgroups at once,
+ * except for the view-change constructor, which takes all of the old group's.
+ */
+struct SubgroupMessageState {
+    std::mutex mutex;
+    /** Stores message buffers not currently in use */
+    std::vector<MessageBuffer> free_message_buffers;
+    /** Index to be used the next time get_sendbuffer_ptr is called.
+     * When next_send is not none, then next_send.index = future_message_index-1 */
+    message_id_t future_message_index = 0;
+    /** The message that will be sent when send is called the next time.
+     * It is std::nullopt when there is no message to send. */
+    std::optional<RDMCMessage> next_send;
+    /** True while an SST multicast buffer has been handed out but not yet sent */
+    bool pending_sst_send = false;
+    /** Messages that are ready to be sent, but must wait until the current send finishes. */
+    std::queue<RDMCMessage> pending_sends;
+    /** The message that is currently being sent out using RDMC, or std::nullopt otherwise. */
+    std::optional<RDMCMessage> current_send;
+    /** Messages that are currently being received, organized by sender ID */
+    std::map<node_id_t, RDMCMessage> current_receives;
+    /** Messages that have finished sending/receiving but aren't yet globally stable,
+     * organized by sequence number */
+    SequenceRing<RDMCMessage> locally_stable_rdmc_messages;
+    /** Same store as locally_stable_rdmc_messages, but for SST messages */
+    SequenceRing<SSTMessage> locally_stable_sst_messages;
+    /** Send timestamps of this node's own messages that are not yet persisted (or,
+     * in unordered mode, not yet stable), organized by message index. It starts
+     * with as many slots as the other stores, and grows if persistence falls
+     * far enough behind that more own messages are pending. */
+    SequenceRing<uint64_t> pending_message_timestamps;
+    /** This node's own messages that are waiting to be persisted, as a map from
+     * sequence number to message index */
+    std::map<message_id_t, message_id_t> pending_persistence;
+    /** Messages that are currently being written to persistent storage */
+    SequenceRing<RDMCMessage> non_persistent_messages;
+    /** Messages that are currently being written to persistent storage */
+    SequenceRing<SSTMessage> non_persistent_sst_messages;
+    /** The index of this node's next message that the sender predicate waits to see delivered */
+    message_id_t next_message_to_deliver = 0;
+    /** True if the message in next_send is to be sent by RDMC, false if by SST multicast */
+    bool last_transfer_medium = false;
+    /** Notified by the send-space predicate when a blocked send may find a free buffer */
+    std::condition_variable send_space_cv;
+    /** The number of sends parked on send_space_cv plus the number of queued async sends.
+     * Atomic so that the send-space predicate can read it without taking mutex. */
+    std::atomic<uint32_t> num_waiting_sends{0};
+    /** The size of the SST multicast buffer that the last send failed to get, or 0
+     * if the last send got one; read by the send-space predicate without taking mutex */
+    std::atomic<uint64_t> smc_blocked_size{0};
+    /** Sends requested with send_async that are waiting for a free buffer, in the order they were requested */
+    std::queue<AsyncSend> async_sends;
+    /** The SST multicast slot that small messages are currently being packed
+     * into, or nullptr if there is no open pack */
+    char* open_pack = nullptr;
+    /** The number of bytes of open_pack used so far */
+    uint64_t open_pack_size = 0;
+    /** The offset in open_pack of the last message packed into it */
+    uint64_t open_pack_last_offset = 0;
+    /** The time at which open_pack was opened; written before pack_is_open is set,
+     * and atomic because the pack-flush predicate reads it without taking mutex */
+    std::atomic<uint64_t> open_pack_start_time{0};
+    /** Mirrors open_pack != nullptr, so the pack-flush predicate can check it without taking mutex */
+    std::atomic<bool> pack_is_open{false};
+    /** If the subgroup uses SMC byte rings, the offset in each sender's ring
+     * (indexed by sender rank) at which this node expects its next record */
+    std::vector<uint64_t> smc_ring_read_offsets;
+};
+
 /** Implements the low-level mechanics of tracking multicasts in a Derecho group,
  * using RDMC to deliver messages and SST to track their arrival and stability.
  * This class should only be used as part of a Group, since it does not know how
@@ -265,46 +385,28 @@ private:
     uint16_t rdmc_group_num_offset;
     /** false if RDMC groups haven't been created successfully */
     bool rdmc_sst_groups_created = false;
-    /** Stores message buffers not currently in use. Protected by
-     * msg_state_mtx */
-    std::map<uint32_t, std::vector<MessageBuffer>> free_message_buffers;
-
-    /** Index to be used the next time get_sendbuffer_ptr is called.
-     * When next_message is not none, then next_message.index = future_message_index-1 */
-    std::vector<message_id_t> future_message_indices;
-
-    /** next_message is the message that will be sent when send is called the next time.
-     * It is std::nullopt when there is no message to send. */
-    std::vector<std::optional<RDMCMessage>> next_sends;
-    std::map<uint32_t, bool> pending_sst_sends;
-    /** Messages that are ready to be sent, but must wait until the current send finishes. */
-    std::vector<std::queue<RDMCMessage>> pending_sends;
-    /** Vector of messages that are currently being sent out using RDMC, or boost::none otherwise. */
-    /** one per subgroup */
-    std::vector<std::optional<RDMCMessage>> current_sends;
-
-    /** Messages that are currently being received. */
-    std::map<std::pair<subgroup_id_t, node_id_t>, RDMCMessage> current_receives;
-
-    /** Messages that have finished sending/receiving but aren't yet globally stable.
-     * Organized by [subgroup number] -> [sequence number] -> [message] */
-    std::map<subgroup_id_t, std::map<message_id_t, RDMCMessage>> locally_stable_rdmc_messages;
-    /** Same map as locally_stable_rdmc_messages, but for SST messages */
-    std::map<subgroup_id_t, std::map<message_id_t, SSTMessage>> locally_stable_sst_messages;
-    std::map<subgroup_id_t, std::set<uint64_t>> pending_message_timestamps;
-    std::map<subgroup_id_t, std::map<message_id_t, uint64_t>> pending_persistence;
-    /** Messages that are currently being written to persistent storage */
-    std::map<subgroup_id_t, std::map<message_id_t, RDMCMessage>> non_persistent_messages;
-    /** Messages that are currently being written to persistent storage */
-    std::map<subgroup_id_t, std::map<message_id_t, SSTMessage>> non_persistent_sst_messages;
-
-    std::vector<message_id_t> next_message_to_deliver;
-    std::mutex msg_state_mtx;
+    /** The message state of each subgroup, indexed by subgroup number. */
+    std::vector<std::unique_ptr<SubgroupMessageState>> subgroup_states;
+    /** Guards sender_wakeups; never held while taking a subgroup's state mutex. */
+    std::mutex sender_mtx;
     std::condition_variable sender_cv;
+    /** Incremented (under sender_mtx) every time the sender thread should re-check the subgroups */
+    uint64_t sender_wakeups = 0;
 
     /** The time, in milliseconds, that a sender can wait to send a message before it is considered failed. */
     unsigned int sender_timeout;
 
+    /** The maximum number of messages delivered by a single pass of delivery_trigger,
+     * or 0 if the whole stable prefix should be delivered at once. 1 delivers
+     * messages one at a time, which is the same as not batching. */
+    const unsigned int max_delivery_batch_size;
+
+    /** The number of bytes of small messages that a sender packs into one SST
+     * multicast slot before sending it, or 0 if packing is disabled. */
+    const uint64_t smc_packing_max_bytes;
+    /** The longest time, in nanoseconds, that a pack may stay open before it is sent */
+    const uint64_t smc_packing_max_delay_ns;
+
     /** Indicates that the group is being destroyed. */
     std::atomic<bool> thread_shutdown{false};
     /** The background thread that sends messages with RDMC. */
@@ -325,8 +427,6 @@ private:
     std::list<pred_handle> persistence_pred_handles;
     std::list<pred_handle> sender_pred_handles;
 
-    std::vector<bool> last_transfer_medium;
-
     /** post the next version to a subgroup just before deliver a message so
      * that the user code know the current version being handled. */
     subgroup_post_next_version_func_t post_next_version_callback;
@@ -337,6 +437,8 @@ private:
     /** Continuously waits for a new pending send, then sends it. This function
      * implements the sender thread. */
     void send_loop();
+    /** Wakes up the sender thread so that it re-checks every subgroup for a message to send. */
+    void wake_sender_thread();
 
     uint64_t get_time();
 
@@ -346,6 +448,13 @@ private:
 
     bool create_rdmc_sst_groups();
     void initialize_sst_row();
+    /**
+     * Sizes the sequence-indexed message stores of a subgroup so that every
+     * message that can be in flight under its sending window has its own slot.
+     * @param subgroup_num The subgroup ID
+     * @param subgroup_settings The settings of this node's shard of that subgroup
+     */
+    void initialize_message_stores(subgroup_id_t subgroup_num, const SubgroupSettings& subgroup_settings);
     void register_predicates();
 
     /**
@@ -376,24 +485,26 @@ private:
      * @param msg The message that should cause a new version to be registered
      * with PersistenceManager
      * @param subgroup_num The ID of the subgroup this message is in
+     * @param seq_num The sequence number of the message within the subgroup
      * @param version The version assigned to the message
      * @param msg_ts The timestamp of this message
      * @return true if a new version was created
      * false if the message is a null message
      */
-    bool version_message(RDMCMessage& msg, const subgroup_id_t& subgroup_num,
+    bool version_message(RDMCMessage& msg, const subgroup_id_t& subgroup_num, const message_id_t seq_num,
         const persistent::version_t& version, const uint64_t& msg_timestamp);
     /**
      * Same as the other version_message, but for the SSTMessage type.
      * @param msg The message that should cause a new version to be registered
      * with PersistenceManager
      * @param subgroup_num The ID of the subgroup this message is in
+     * @param seq_num The sequence number of the message within the subgroup
      * @param version The version assigned to the message
      * @param msg_ts The timestamp of this message
      * @return true if a new version was created
      * false if the message is a null message
      */
-    bool version_message(SSTMessage& msg, const subgroup_id_t& subgroup_num,
+    bool version_message(SSTMessage& msg, const subgroup_id_t& subgroup_num, const message_id_t seq_num,
         const persistent::version_t& version, const uint64_t& msg_timestamp);
 
     uint32_t get_num_senders(const std::vector<int>& shard_senders) {
@@ -411,6 +522,12 @@ private:
     /* Predicate functions for receiving and delivering messages, parameterized by subgroup.
      * register_predicates will create and bind one of these for each subgroup. */
 
+    /**
+     * Delivers the globally stable prefix of locally stable messages in a
+     * subgroup as one batch, bounded by max_delivery_batch_size. The batch
+     * results in a single delivered_num update and at most one persistence
+     * request, regardless of the number of messages it contains.
+     */
     void delivery_trigger(subgroup_id_t subgroup_num, const SubgroupSettings& subgroup_settings,
                           const uint32_t num_shard_members, DerechoSST& sst);
 
@@ -419,7 +536,7 @@ private:
                              uint32_t num_shard_senders, uint32_t sender_rank,
                              volatile char* data, uint64_t size);
 
-    bool receiver_predicate(const SubgroupSettings& subgroup_settings,
+    bool receiver_predicate(subgroup_id_t subgroup_num, const SubgroupSettings& subgroup_settings,
                             const std::map<uint32_t, uint32_t>& shard_ranks_by_sender_rank,
                             uint32_t num_shard_senders, const DerechoSST& sst);
 
@@ -433,6 +550,30 @@ private:
     /* Get a pointer into the current buffer, to write data into it before sending
      * Now this is a private function, called by send internally */
     char* get_sendbuffer_ptr(subgroup_id_t subgroup_num, long long unsigned int payload_size, bool cooked_send);
+    /** True if the flow-control window of the subgroup leaves room for this node's next message */
+    bool send_window_open(subgroup_id_t subgroup_num, const SubgroupSettings& subgroup_settings);
+    /** Sends one message if a buffer is free; the caller must hold the subgroup's state mutex. */
+    bool try_send_locked(subgroup_id_t subgroup_num, long long unsigned int payload_size,
+                         const std::function<void(char* buf)>& msg_generator, bool cooked_send);
+    /** Sends as many queued async sends as there are free buffers for, in order.
+     * The caller must hold the subgroup's state mutex. */
+    void send_queued_async(subgroup_id_t subgroup_num);
+    /**
+     * Returns a buffer of msg_size bytes for this node's next SST multicast
+     * message, appending it to the subgroup's open pack if it fits, or else
+     * sending the open pack and starting a new one in a fresh slot.
+     * The caller must hold the subgroup's state mutex.
+     * @return A pointer to the message's buffer, or nullptr if no slot is free
+     */
+    char* get_pack_buffer(subgroup_id_t subgroup_num, uint64_t msg_size);
+    /** True if the subgroup packs its small SST multicast messages, which only
+     * ordered subgroups do; such messages then carry a packed_header. */
+    bool packs_smc_messages(const SubgroupSettings& subgroup_settings) const {
+        return smc_packing_max_bytes > 0 && subgroup_settings.mode != Mode::UNORDERED;
+    }
+    /** Sends the subgroup's open pack, if there is one, with only its used bytes.
+     * The caller must hold the subgroup's state mutex. */
+    void flush_pack(subgroup_id_t subgroup_num);
 
 public:
     /**
@@ -485,10 +626,43 @@ public:
     void register_rpc_callback(rpc_handler_t handler) { rpc_callback = std::move(handler); }
 
     void deliver_messages_upto(const std::vector<int32_t>& max_indices_for_senders, subgroup_id_t subgroup_num, uint32_t num_shard_senders);
-    /** Send now internally calls get_sendbuffer_ptr.
-	The user function that generates the message is supplied to send */
+    /**
+     * Reserves a buffer for this node's next message in the subgroup, calls
+     * msg_generator to fill it, and sends it. If no buffer is free, it parks the
+     * calling thread until the send-space predicate reports that the window
+     * has opened, rather than spinning on the subgroup's lock.
+     * @return true if the message was sent, false if the group was wedged first
+     */
     bool send(subgroup_id_t subgroup_num, long long unsigned int payload_size,
               const std::function<void(char* buf)>& msg_generator, bool cooked_send);
+    /**
+     * Like send, but returns false right away instead of waiting if no buffer
+     * is free, if earlier send_async requests are still queued, or if the
+     * group is wedged. msg_generator is only called if the message is sent.
+     */
+    bool try_send(subgroup_id_t subgroup_num, long long unsigned int payload_size,
+                  const std::function<void(char* buf)>& msg_generator, bool cooked_send);
+    /**
+     * Like send, but never blocks: if no buffer is free, the request is queued
+     * and msg_generator is later called, and the message sent, by the SST
+     * predicate thread of the subgroup once the window opens. Queued requests
+     * are sent in the order they were made, and msg_generator must stay valid
+     * until then.
+     * @return a future that becomes true when the message is sent, or false
+     * if the group is wedged before it could be sent
+     */
+    std::future<bool> send_async(subgroup_id_t subgroup_num, long long unsigned int payload_size,
+                                 std::function<void(char* buf)> msg_generator, bool cooked_send);
+    /**
+     * Same as send_async above, but instead of returning a future, calls
+     * on_done with true once the message is sent, or with false if the group
+     * is wedged first. on_done may be called on the SST predicate thread or
+     * by wedge(), while the subgroup's state is locked, so it must not block
+     * or send in this group.
+     */
+    void send_async(subgroup_id_t subgroup_num, long long unsigned int payload_size,
+                    std::function<void(char* buf)> msg_generator, bool cooked_send,
+                    std::function<void(bool)> on_done);
     bool check_pending_sst_sends(subgroup_id_t subgroup_num);
 
     const uint64_t compute_global_stability_frontier(subgroup_id_t subgroup_num);
@@ -46,11 +46,39 @@ class P2PConnections {
     std::vector<std::unique_ptr<resources>> res_vec;
     uint64_t p2p_buf_size;
     std::map<REQUEST_TYPE, std::vector<std::atomic<uint64_t>>> incoming_seq_nums_map, outgoing_seq_nums_map;
+    /** The incoming sequence numbers of each reply type last reported back to each sender */
+    std::map<REQUEST_TYPE, std::vector<uint64_t>> reported_seq_nums_map;
+    /** The number of P2P_REPLY slots from each node that held a piece of a chunked reply other than the last */
+    std::vector<std::atomic<uint64_t>> incoming_partial_replies;
+    /**
+     * The number of P2P_REQUEST slots to each node claimed by senders, which
+     * is ahead of outgoing_seq_nums_map while claimed requests are being
+     * filled in. Senders claim slots with a compare-and-swap on it, so
+     * concurrent senders never get the same slot or more slots than credits.
+     */
+    std::vector<std::atomic<uint64_t>> claimed_request_seq_nums;
+    /** The number of messages of any type sent to each node, which is also written to its doorbell */
+    std::vector<std::atomic<uint64_t>> outgoing_doorbells;
+    /** The number of messages of any type consumed from each node */
+    std::vector<uint64_t> incoming_doorbells;
+    /** The number of messages of any type consumed from all nodes */
+    std::atomic<uint64_t> num_consumed{0};
+    /** Counts calls to probe_all, to decide when to check every slot instead of just the doorbells */
+    uint32_t num_probes = 0;
+    /** How often (in calls to probe_all) every slot is checked regardless of the doorbells */
+    static constexpr uint32_t full_probe_interval = 64;
     std::vector<REQUEST_TYPE> prev_mode;
     std::atomic<bool> thread_shutdown{false};
     std::thread timeout_thread;
     uint64_t getOffsetSeqNum(REQUEST_TYPE type, uint64_t seq_num);
     uint64_t getOffsetBuf(REQUEST_TYPE type, uint64_t seq_num);
+    uint64_t getOffsetConsumed(REQUEST_TYPE type);
+    uint64_t getOffsetDoorbell();
+    void report_consumed(uint32_t rank, REQUEST_TYPE type);
+    /** Writes the first size bytes of the slot of the given type and sequence number to rank, then its sequence number */
+    void write_slot(uint32_t rank, REQUEST_TYPE type, uint64_t seq_num, uint64_t size);
+    /** Tells rank how many messages of any type have been sent to it, after num_messages more */
+    void ring_doorbell(uint32_t rank, uint64_t num_messages);
     char* probe(uint32_t rank);
     REQUEST_TYPE last_type;
     uint32_t last_rank;
@@ -64,10 +92,81 @@ public:
     void shutdown_failures_thread();
     uint32_t get_node_rank(uint32_t node_id);
     uint64_t get_max_p2p_size();
+    /**
+     * Looks for a new message from any node. Each sender rings a doorbell,
+     * a count of the messages it has sent, after every message, so only the
+     * nodes whose doorbell is ahead of what has been consumed from them are
+     * probed. Since two threads sending to the same node may write its
+     * doorbell out of order, every slot of every node is still checked once
+     * in a while.
+     */
     std::optional<std::pair<uint32_t, char*>> probe_all();
     void update_incoming_seq_num();
+    /**
+     * @return The number of messages of any type consumed so far, including
+     * the null replies that probe_all consumes by itself. A caller waiting for
+     * replies can compare this before and after probing to tell whether any
+     * arrived.
+     */
+    uint64_t get_num_consumed() const;
+    /**
+     * Records that the message most recently returned by probe_all is a piece
+     * of a reply that continues in later slots, so that it is not counted as
+     * a reply when pacing P2P requests.
+     */
+    void mark_partial_reply();
+    /**
+     * Gets the buffer for the next reply of the given type to rank. Requests
+     * are sent through claim_request_slots instead.
+     * @return nullptr if remote_slot_free is false
+     */
     char* get_sendbuffer_ptr(uint32_t rank, REQUEST_TYPE type);
-    void send(uint32_t rank);
+    /**
+     * @return The number of P2P requests that can be sent to rank right now.
+     * Each request takes a credit when its slot is claimed, which is returned
+     * when its reply arrives, and there is one credit per P2P_REQUEST slot in
+     * the window.
+     */
+    uint32_t request_credits(uint32_t rank);
+    /**
+     * Atomically takes up to max_requests request credits for rank, claiming
+     * the P2P_REQUEST slots that go with them.
+     * @param first_seq_num Set to the sequence number of the first slot claimed
+     * @return The number of slots claimed, which is 0 if there are no credits
+     */
+    uint32_t claim_request_slots(uint32_t rank, uint32_t max_requests, uint64_t& first_seq_num);
+    /**
+     * Gives back the num_slots request slots to rank starting at
+     * first_seq_num, which must be the last ones claimed so far.
+     * @return false if other slots have been claimed since, in which case the
+     * slots must be sent anyway, since the receiver reads them in order
+     */
+    bool unclaim_request_slots(uint32_t rank, uint64_t first_seq_num, uint32_t num_slots);
+    /**
+     * Gets the buffer for the claimed P2P_REQUEST slot to rank with the
+     * given sequence number.
+     */
+    char* get_request_buffer(uint32_t rank, uint64_t seq_num);
+    /**
+     * Sends the sizes.size() claimed P2P requests to rank starting at
+     * first_seq_num, whose buffers were filled in through get_request_buffer;
+     * sizes[i] is the number of bytes used in the buffer for first_seq_num + i.
+     * The doorbell is rung once, after all of them are in place.
+     */
+    void send_requests(uint32_t rank, uint64_t first_seq_num, const std::vector<uint64_t>& sizes);
+    /**
+     * Checks whether rank has consumed enough of the messages of the given
+     * reply type sent to it that one more can be sent without overwriting an
+     * unread slot. Chunked replies, and replies from several threads, can get
+     * ahead of the receiver, so every reply waits for this. Receivers report
+     * their progress lazily, every half window, so this is conservative.
+     */
+    bool remote_slot_free(uint32_t rank, REQUEST_TYPE type);
+    /**
+     * Sends the message in the buffer last returned by get_sendbuffer_ptr for
+     * rank, writing only its first size bytes and then the sequence number.
+     */
+    void send(uint32_t rank, uint64_t size);
     void debug_print();
 };
 }  // namespace sst
@@ -7,13 +7,17 @@
 
 #include <atomic>
 #include <chrono>
-#include <errno.h>
-#include <queue>
-#include <semaphore.h>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 #include "../replicated.hpp"
 #include "derecho_internal.hpp"
+#include "mpsc_queue.hpp"
+#include "queue_worker.hpp"
 #include "view_manager.hpp"
 #include <derecho/persistent/Persistent.hpp>
 #include <derecho/utils/logger.hpp>
@@ -24,19 +28,31 @@ using persistence_request_t = std::tuple<subgroup_id_t, persistent::version_t>;
 
 /**
  * PersistenceManager is responsible for persisting all the data in a group.
+ * Requests are handled by a pool of persistent threads, and each subgroup is
+ * always handled by the same thread, so the persisted_num updates of a
+ * subgroup stay in order while independent logs are flushed concurrently.
+ * Requests are handled in batches: a persistent thread drains every request
+ * queued for it, persists only the highest version requested for each
+ * subgroup, and publishes that version in persisted_num once. The persistence
+ * callback is likewise called once per subgroup and batch, with the highest
+ * version, which implies that all earlier versions are persisted too.
  */
 class PersistenceManager {
 private:
-    /** Thread handle */
-    std::thread persist_thread;
-    /** A flag to singal the persistent thread to shutdown; set to true when the group is destroyed. */
+    /** A flag to singal the persistent threads to shutdown; set to true when the group is destroyed. */
     std::atomic<bool> thread_shutdown;
-    /** The semaphore for persistence request the persistent thread */
-    sem_t persistence_request_sem;
-    /** a queue for the requests */
-    std::queue<persistence_request_t> persistence_request_queue;
-    /** lock for persistence request queue */
-    std::atomic_flag prq_lock = ATOMIC_FLAG_INIT;
+    /**
+     * How long a persistent thread waits after being woken up before it
+     * drains its queue, so that more versions are covered by the same flush.
+     */
+    const std::chrono::microseconds persistence_linger;
+    /**
+     * A persistent thread and its queue of requests. The threads that deliver
+     * messages are the producers of the queue.
+     */
+    using persistence_worker_state = QueueWorker<MPSCQueue<persistence_request_t>>;
+    /** The persistent threads; a subgroup's requests go to worker subgroup_id % size() */
+    std::vector<std::unique_ptr<persistence_worker_state>> persistence_workers;
 
     /** persistence callback */
     persistence_callback_t persistence_callback;
@@ -45,6 +61,12 @@ private:
     /** View Manager pointer. Need to access the SST for the purpose of updating persisted_num*/
     ViewManager* view_manager;
 
+    /** The body of a persistent thread. */
+    void persistence_worker(uint32_t worker_num);
+
+    /** Persists a subgroup up to version, then publishes it in persisted_num. */
+    void persist(subgroup_id_t subgroup_id, persistent::version_t version);
+
 public:
     /** Constructor
      * @param objects_map reference to the objects_by_subgroup_id from Group.
@@ -60,7 +82,7 @@ public:
 
     void set_view_manager(ViewManager& view_manager);
 
-    /** Start the persistent thread. */
+    /** Start the persistent threads. */
     void start();
 
     /** post a persistence request */
@@ -70,8 +92,8 @@ public:
     void make_version(const subgroup_id_t& subgroup_id,
                       const persistent::version_t& version, const HLC& mhlc);
 
-    /** shutdown the thread 
-     * @wait - wait till the thread finished or not.
+    /** shutdown the threads; each one finishes the requests already queued for it first.
+     * @wait - wait till the threads finished or not.
      */
     void shutdown(bool wait);
 
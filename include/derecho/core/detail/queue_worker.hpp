@@ -0,0 +1,71 @@
+/**
+ * @file queue_worker.hpp
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace derecho {
+
+/**
+ * A thread that consumes a lock-free queue, such as an SPSCQueue or an
+ * MPSCQueue, and sleeps on a condition variable while the queue is empty.
+ * Producers push without taking a lock, and only take the mutex to wake the
+ * worker when it has announced that it is going to sleep.
+ *
+ * The worker sets its sleeping flag before it checks the queue for the last
+ * time, and a producer checks the flag after its push. Both the flag and the
+ * queue's indices are accessed with sequentially consistent operations, so
+ * either the worker's last check sees the new value or the producer sees the
+ * flag; in the second case the producer's notification cannot be lost,
+ * because the worker holds the mutex from its last check until it waits.
+ */
+template <typename Queue>
+class QueueWorker {
+private:
+    /** Set by the worker while it waits on cv, so the producers know to notify it */
+    std::atomic<bool> sleeping{false};
+    std::mutex mutex;
+    std::condition_variable cv;
+
+public:
+    Queue queue;
+    std::thread thread;
+
+    template <typename... QueueArgs>
+    explicit QueueWorker(QueueArgs&&... queue_args) : queue(std::forward<QueueArgs>(queue_args)...) {}
+
+    /** Called by a producer after each successful push. */
+    void notify() {
+        if(sleeping) {
+            std::lock_guard<std::mutex> lock(mutex);
+            cv.notify_one();
+        }
+    }
+
+    /**
+     * Called by the worker when it finds the queue empty. Returns once the
+     * queue is not empty or stop() returns true; whoever makes stop() true
+     * must call wake() afterwards.
+     */
+    template <typename StopPredicate>
+    void wait(StopPredicate stop) {
+        std::unique_lock<std::mutex> lock(mutex);
+        sleeping = true;
+        cv.wait(lock, [&]() { return !queue.empty() || stop(); });
+        sleeping = false;
+    }
+
+    /** Wakes the worker whether or not the queue is empty, e.g. to shut it down. */
+    void wake() {
+        std::lock_guard<std::mutex> lock(mutex);
+        cv.notify_one();
+    }
+};
+
+}  // namespace derecho
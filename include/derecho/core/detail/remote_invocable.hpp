@@ -6,9 +6,11 @@
 
 #pragma once
 
+#include <cstring>
 #include <functional>
 #include <numeric>
 #include <type_traits>
+#include <vector>
 
 #include "rpc_utils.hpp"
 #include <derecho/mutils-serialization/SerializationSupport.hpp>
@@ -104,6 +106,25 @@ struct RemoteInvoker<Tag, std::function<Ret(Args...)>> {
         PendingResults<Ret>& pending;
     };
 
+    /**
+     * Computes the size of the RPC message that send() will construct for
+     * the given arguments, which is the size it will ask out_alloc for. If
+     * the arguments can only be sized by walking them, they are serialized
+     * into staging in that walk instead, and send_prepared() copies them from
+     * there rather than walking them again.
+     * @param staging A buffer for the serialized arguments, which must be
+     * passed unchanged to send_prepared()
+     * @param remote_args The arguments to be used when calling the remote-invocable function
+     */
+    std::size_t prepare_args(remote_invocation_utilities::StagingBuffer& staging, const std::decay_t<Args>&... remote_args) {
+        if constexpr(all_sized_without_walk<Args...>) {
+            return sizeof(std::size_t) + (std::size_t{0} + ... + mutils::bytes_size(remote_args));
+        } else {
+            remote_invocation_utilities::serialize_to_staging(staging, remote_args...);
+            return sizeof(std::size_t) + staging.size();
+        }
+    }
+
     /**
      * Called to construct an RPC message to send that will invoke the remote-
      * invocable function targeted by this RemoteInvoker.
@@ -113,19 +134,35 @@ struct RemoteInvoker<Tag, std::function<Ret(Args...)>> {
      */
     send_return send(const std::function<char*(int)>& out_alloc,
                      const std::decay_t<Args>&... remote_args) {
+        remote_invocation_utilities::StagingBuffer& staging = remote_invocation_utilities::thread_staging_buffer();
+        const std::size_t size = prepare_args(staging, remote_args...);
+        send_return sent = send_prepared(size, staging, out_alloc, remote_args...);
+        staging.trim();
+        return sent;
+    }
+
+    /**
+     * Same as send(), for a caller that has already called prepare_args() for
+     * these arguments, e.g. because it needed the size of the message before
+     * it could allocate it.
+     * @param size The size returned by prepare_args()
+     * @param staging The buffer given to prepare_args()
+     */
+    send_return send_prepared(std::size_t size, const remote_invocation_utilities::StagingBuffer& staging,
+                              const std::function<char*(int)>& out_alloc,
+                              const std::decay_t<Args>&... remote_args) {
         // auto invocation_id = mutils::long_rand();
         std::size_t invocation_id = invocation_id_sequencer++;
         invocation_id %= MAX_CONCURRENT_RPCS_PER_INVOKER;
-        std::size_t size = mutils::bytes_size(invocation_id);
-        {
-            auto t = {std::size_t{0}, std::size_t{0}, mutils::bytes_size(remote_args)...};
-            size += std::accumulate(t.begin(), t.end(), 0);
-        }
         char* serialized_args = out_alloc(size);
         {
             auto v = serialized_args + mutils::to_bytes(invocation_id, serialized_args);
-            auto check_size = mutils::bytes_size(invocation_id) + serialize_all(v, remote_args...);
-            assert_always(check_size == size);
+            if constexpr(all_sized_without_walk<Args...>) {
+                auto check_size = mutils::bytes_size(invocation_id) + serialize_all(v, remote_args...);
+                assert_always(check_size == size);
+            } else {
+                memcpy(v, staging.data(), staging.size());
+            }
         }
 
         // lock_t l{map_lock};
@@ -183,7 +220,9 @@ struct RemoteInvoker<Tag, std::function<Ret(Args...)>> {
             results_vector[invocation_id].set_exception(nid, std::make_exception_ptr(remote_exception_occurred{nid}));
         } else {
             dbg_default_trace("Received an RPC response for invocation ID {} from node {}", invocation_id, nid);
-            results_vector[invocation_id].set_value(nid, *mutils::from_bytes<Ret>(dsm, response + 1 + sizeof(invocation_id)));
+            // the response buffer is reused once this returns, so the value has to be
+            // copied out of it, but it can then be moved rather than copied again
+            results_vector[invocation_id].set_value(nid, std::move(*mutils::from_bytes<Ret>(dsm, response + 1 + sizeof(invocation_id))));
         }
         return recv_ret{Opcode(), 0, nullptr, nullptr};
     }
@@ -203,20 +242,18 @@ struct RemoteInvoker<Tag, std::function<Ret(Args...)>> {
     /**
      * Entry point for responses; called when a message is received that
      * contains a response to this RemoteInvocable function's RPC call.
-     * @param dsm
+     * @param dsm The RPCManager's DeserializationManager
      * @param nid The ID of the node that sent the response
      * @param response The byte buffer containing the response message
      * @param f
      * @return A recv_ret containing nothing of value.
      */
-    inline recv_ret receive_response(  //mutils::DeserializationManager* dsm,
-            mutils::RemoteDeserialization_v* rdv,
+    inline recv_ret receive_response(
+            mutils::DeserializationManager* dsm,
             const node_id_t& nid, const char* response,
             const std::function<char*(int)>& f) {
         constexpr std::is_same<void, Ret>* choice{nullptr};
-        //        return receive_response(choice, dsm, nid, response, f);
-        mutils::DeserializationManager dsm{*rdv};
-        return receive_response(choice, &dsm, nid, response, f);
+        return receive_response(choice, dsm, nid, response, f);
     }
 
     /**
@@ -294,11 +331,24 @@ struct RemoteInvocable<Tag, std::function<Ret(Args...)>> {
         auto recv_buf = _recv_buf + sizeof(long int);
         try {
             const auto result = mutils::deserialize_and_run(dsm, recv_buf, remote_invocable_function);
-            const auto result_size = mutils::bytes_size(result) + sizeof(long int) + 1;
-            auto out = out_alloc(result_size);
+            const std::size_t result_offset = sizeof(invocation_id) + 1;
+            std::size_t result_size;
+            char* out;
+            if constexpr(sized_without_walk<std::decay_t<decltype(result)>>::value) {
+                result_size = mutils::bytes_size(result) + result_offset;
+                out = out_alloc(result_size);
+                mutils::to_bytes(result, out + result_offset);
+            } else {
+                //Walk the result only once, to serialize it; that also gives its size
+                remote_invocation_utilities::StagingBuffer& staging = remote_invocation_utilities::thread_staging_buffer();
+                remote_invocation_utilities::serialize_to_staging(staging, result);
+                result_size = staging.size() + result_offset;
+                out = out_alloc(result_size);
+                memcpy(out + result_offset, staging.data(), staging.size());
+                staging.trim();
+            }
             out[0] = false;
             ((long int*)(out + 1))[0] = invocation_id;
-            mutils::to_bytes(result, out + sizeof(invocation_id) + 1);
             dbg_default_trace("Ready to send an RPC reply for invocation ID {} to node {}", invocation_id, caller);
             return recv_ret{reply_opcode, result_size, out, nullptr};
         } catch(...) {
@@ -328,20 +378,18 @@ struct RemoteInvocable<Tag, std::function<Ret(Args...)>> {
      * Entry point for handling an RPC function call to this RemoteInvocable
      * function. Called when a message is received that contains a request to
      * call this function.
-     * @param dsm
+     * @param dsm The RPCManager's DeserializationManager
      * @param who The node that sent the message
      * @param recv_buf The buffer containing the received message
      * @param out_alloc A function that can allocate a buffer for the response message
      * @return
      */
-    inline recv_ret receive_call(  //mutils::DeserializationManager* dsm,
-            mutils::RemoteDeserialization_v* rdv,
+    inline recv_ret receive_call(
+            mutils::DeserializationManager* dsm,
             const node_id_t& who, const char* recv_buf,
             const std::function<char*(int)>& out_alloc) {
         constexpr std::is_same<Ret, void>* choice{nullptr};
-        //      return this->receive_call(choice, dsm, who, recv_buf, out_alloc);
-        mutils::DeserializationManager dsm{*rdv};
-        return this->receive_call(choice, &dsm, who, recv_buf, out_alloc);
+        return this->receive_call(choice, dsm, who, recv_buf, out_alloc);
     }
 
     /**
@@ -593,16 +641,18 @@ public:
             : RemoteInvocablePairs<WrappedFuns...>(type_id, instance_id, rvrs, fs.fun...),
               nid(nid) {}
 
+    /**
+     * Computes the size of the message, including its header, that send()
+     * will construct for these arguments, serializing them into staging if
+     * that is what it takes to size them. Pass the size and staging on to
+     * send_prepared() to build the message without walking them again.
+     */
     template <FunctionTag Tag, typename... Args>
-    std::size_t get_size_for_ordered_send(Args&&... a) {
-        //only used for size calculation
-        long int invocation_id = 0;
-        std::size_t function_call_size = mutils::bytes_size(invocation_id);
-        {
-            function_call_size += (0 + ... + mutils::bytes_size(a));
-        }
+    std::size_t prepare_ordered_send(remote_invocation_utilities::StagingBuffer& staging, Args&&... a) {
+        constexpr std::integral_constant<FunctionTag, Tag>* choice{nullptr};
         //Add the header_size that send() adds to the invoker's out_alloc
-        return function_call_size + remote_invocation_utilities::header_space();
+        return this->get_invoker(choice, a...).prepare_args(staging, std::forward<Args>(a)...)
+               + remote_invocation_utilities::header_space();
     }
 
     template <FunctionTag Tag, typename... Args>
@@ -623,12 +673,29 @@ public:
      */
     template <FunctionTag Tag, typename... Args>
     auto send(const std::function<char*(int)>& out_alloc, Args&&... args) {
+        remote_invocation_utilities::StagingBuffer& staging = remote_invocation_utilities::thread_staging_buffer();
+        auto sent = send_prepared<Tag>(prepare_ordered_send<Tag>(staging, args...), staging,
+                                       out_alloc, std::forward<Args>(args)...);
+        staging.trim();
+        return sent;
+    }
+
+    /**
+     * Same as send(), given the size of the message that
+     * prepare_ordered_send() computed for the same arguments.
+     * @param message_size The size of the message, including its header
+     * @param staging The buffer given to prepare_ordered_send()
+     */
+    template <FunctionTag Tag, typename... Args>
+    auto send_prepared(std::size_t message_size, const remote_invocation_utilities::StagingBuffer& staging,
+                       const std::function<char*(int)>& out_alloc, Args&&... args) {
         using namespace remote_invocation_utilities;
 
         constexpr std::integral_constant<FunctionTag, Tag>* choice{nullptr};
         auto& invoker = this->get_invoker(choice, args...);
         const auto header_size = header_space();
-        auto sent_return = invoker.send(
+        auto sent_return = invoker.send_prepared(
+                message_size - header_size, staging,
                 [&out_alloc, &header_size](std::size_t size) {
                     return out_alloc(size + header_size) + header_size;
                 },
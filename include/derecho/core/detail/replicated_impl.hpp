@@ -1,8 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <functional>
+#include <iterator>
 #include <mutex>
+#include <optional>
+#include <tuple>
 #include <utility>
+#include <vector>
 
 #include "../replicated.hpp"
 
@@ -75,24 +80,18 @@ template <typename T>
 template <rpc::FunctionTag tag, typename... Args>
 auto Replicated<T>::p2p_send(node_id_t dest_node, Args&&... args) {
     if(is_valid()) {
-        assert(dest_node != node_id);
-        if(group_rpc_manager.view_manager.get_current_view().get().rank_of(dest_node) == -1) {
-            throw invalid_node_exception("Cannot send a p2p request to node "
-                    + std::to_string(dest_node) + ": it is not a member of the Group.");
-        }
-        auto return_pair = wrapped_this->template send<tag>(
-                [this, &dest_node](size_t size) -> char* {
-                    const std::size_t max_payload_size = group_rpc_manager.view_manager.get_max_payload_sizes().at(subgroup_id);
-                    if(size <= max_payload_size) {
-                        return (char*)group_rpc_manager.get_sendbuffer_ptr(dest_node,
-                                                                           sst::REQUEST_TYPE::P2P_REQUEST);
-                    } else {
-                        return nullptr;
-                    }
-                },
-                std::forward<Args>(args)...);
-        group_rpc_manager.finish_p2p_send(dest_node, subgroup_id, return_pair.pending);
-        return std::move(return_pair.results);
+        return group_rpc_manager.template p2p_send<tag>(*wrapped_this, subgroup_id, dest_node,
+                                                        std::forward<Args>(args)...);
+    } else {
+        throw empty_reference_exception{"Attempted to use an empty Replicated<T>"};
+    }
+}
+
+template <typename T>
+template <rpc::FunctionTag tag, typename ArgsRange>
+auto Replicated<T>::p2p_send_batch(node_id_t dest_node, const ArgsRange& args_range) {
+    if(is_valid()) {
+        return group_rpc_manager.template p2p_send_batch<tag>(*wrapped_this, subgroup_id, dest_node, args_range);
     } else {
         throw empty_reference_exception{"Attempted to use an empty Replicated<T>"};
     }
@@ -102,16 +101,22 @@ template <typename T>
 template <rpc::FunctionTag tag, typename... Args>
 auto Replicated<T>::ordered_send(Args&&... args) {
     if(is_valid()) {
-        size_t payload_size_for_multicast_send = wrapped_this->template get_size_for_ordered_send<tag>(std::forward<Args>(args)...);
+        //Arguments that can only be sized by walking them are serialized into
+        //staging here, and the serializer copies them from there
+        rpc::remote_invocation_utilities::StagingBuffer& staging = rpc::remote_invocation_utilities::thread_staging_buffer();
+        size_t payload_size_for_multicast_send = wrapped_this->template prepare_ordered_send<tag>(staging, std::forward<Args>(args)...);
 
         using Ret = typename std::remove_pointer<decltype(wrapped_this->template getReturnType<tag>(
                 std::forward<Args>(args)...))>::type;
-        rpc::QueryResults<Ret>* results_ptr;
-        rpc::PendingResults<Ret>* pending_ptr;
+        std::optional<rpc::QueryResults<Ret>> results;
+        const std::size_t max_payload_size = group_rpc_manager.view_manager.get_max_payload_sizes().at(subgroup_id);
+        //This lambda may run on the subgroup's SST predicate thread once the send
+        //window opens, so it must not touch the view; this thread waits for it.
+        //It registers the PendingResults as soon as the message has its place in
+        //the send order, so they are matched with deliveries in the same order.
         auto serializer = [&](char* buffer) {
-            //By the time this lambda runs, the current thread will be holding a read lock on view_mutex
-            const std::size_t max_payload_size = group_rpc_manager.view_manager.get_max_payload_sizes().at(subgroup_id);
-            auto send_return_struct = wrapped_this->template send<tag>(
+            auto send_return_struct = wrapped_this->template send_prepared<tag>(
+                    payload_size_for_multicast_send, staging,
                     [&buffer, &max_payload_size](size_t size) -> char* {
                         if(size <= max_payload_size) {
                             return buffer;
@@ -120,17 +125,152 @@ auto Replicated<T>::ordered_send(Args&&... args) {
                         }
                     },
                     std::forward<Args>(args)...);
-            results_ptr = new rpc::QueryResults<Ret>(std::move(send_return_struct.results));
-            pending_ptr = &send_return_struct.pending;
+            results.emplace(std::move(send_return_struct.results));
+            group_rpc_manager.finish_rpc_send(subgroup_id, send_return_struct.pending);
         };
 
+        //Submit the send without waiting for a buffer, so that a full send window
+        //does not hold the view read lock and delay a view change. If the view is
+        //wedged before the message goes out, resubmit it in the next view.
         std::shared_lock<std::shared_timed_mutex> view_read_lock(group_rpc_manager.view_manager.view_mutex);
-        group_rpc_manager.view_manager.view_change_cv.wait(view_read_lock, [&]() {
-            return group_rpc_manager.view_manager.curr_view
-                    ->multicast_group->send(subgroup_id, payload_size_for_multicast_send, serializer, true);
-        });
-        group_rpc_manager.finish_rpc_send(subgroup_id, *pending_ptr);
-        return std::move(*results_ptr);
+        while(true) {
+            const int32_t submitted_vid = group_rpc_manager.view_manager.curr_view->vid;
+            std::future<bool> sent = group_rpc_manager.view_manager.curr_view->multicast_group->send_async(
+                    subgroup_id, payload_size_for_multicast_send, serializer, true);
+            view_read_lock.unlock();
+            if(sent.get()) {
+                break;
+            }
+            view_read_lock.lock();
+            group_rpc_manager.view_manager.view_change_cv.wait(view_read_lock, [&]() {
+                return group_rpc_manager.view_manager.curr_view->vid != submitted_vid;
+            });
+        }
+        staging.trim();
+        return std::move(*results);
+    } else {
+        throw empty_reference_exception{"Attempted to use an empty Replicated<T>"};
+    }
+}
+
+template <typename T>
+template <rpc::FunctionTag tag, typename... Args>
+auto Replicated<T>::try_ordered_send(Args&&... args) {
+    if(is_valid()) {
+        //Arguments that can only be sized by walking them are serialized into
+        //staging here, and the serializer copies them from there
+        rpc::remote_invocation_utilities::StagingBuffer& staging = rpc::remote_invocation_utilities::thread_staging_buffer();
+        size_t payload_size_for_multicast_send = wrapped_this->template prepare_ordered_send<tag>(staging, std::forward<Args>(args)...);
+
+        using Ret = typename std::remove_pointer<decltype(wrapped_this->template getReturnType<tag>(
+                std::forward<Args>(args)...))>::type;
+        std::optional<rpc::QueryResults<Ret>> results;
+        const std::size_t max_payload_size = group_rpc_manager.view_manager.get_max_payload_sizes().at(subgroup_id);
+        //Only called if the message gets a buffer, on this thread
+        auto serializer = [&](char* buffer) {
+            auto send_return_struct = wrapped_this->template send_prepared<tag>(
+                    payload_size_for_multicast_send, staging,
+                    [&buffer, &max_payload_size](size_t size) -> char* {
+                        if(size <= max_payload_size) {
+                            return buffer;
+                        } else {
+                            return nullptr;
+                        }
+                    },
+                    std::forward<Args>(args)...);
+            results.emplace(std::move(send_return_struct.results));
+            group_rpc_manager.finish_rpc_send(subgroup_id, send_return_struct.pending);
+        };
+
+        //try_lock, so that a pending view change does not block this thread either
+        std::shared_lock<std::shared_timed_mutex> view_read_lock(group_rpc_manager.view_manager.view_mutex, std::try_to_lock);
+        if(view_read_lock.owns_lock()) {
+            group_rpc_manager.view_manager.curr_view->multicast_group->try_send(
+                    subgroup_id, payload_size_for_multicast_send, serializer, true);
+        }
+        staging.trim();
+        return results;
+    } else {
+        throw empty_reference_exception{"Attempted to use an empty Replicated<T>"};
+    }
+}
+
+template <typename T>
+template <rpc::FunctionTag tag, typename Callback, typename... Args>
+void Replicated<T>::ordered_send_async(Callback&& on_reply, Args&&... args) {
+    if(is_valid()) {
+        using Ret = typename std::remove_pointer<decltype(wrapped_this->template getReturnType<tag>(
+                std::forward<Args>(args)...))>::type;
+        //The message may be sent after this function returns, so the send owns
+        //the callback and a copy of the arguments
+        auto call = std::make_shared<std::pair<std::decay_t<Callback>, std::tuple<std::decay_t<Args>...>>>(
+                std::forward<Callback>(on_reply), std::make_tuple(std::forward<Args>(args)...));
+        submit_ordered_send_async<tag, Ret>(std::move(call));
+    } else {
+        throw empty_reference_exception{"Attempted to use an empty Replicated<T>"};
+    }
+}
+
+template <typename T>
+template <rpc::FunctionTag tag, typename Ret, typename Call>
+void Replicated<T>::submit_ordered_send_async(std::shared_ptr<Call> call) {
+    std::shared_lock<std::shared_timed_mutex> view_read_lock(group_rpc_manager.view_manager.view_mutex);
+    View& curr_view = *group_rpc_manager.view_manager.curr_view;
+    rpc::node_list_t shard_members;
+    try {
+        shard_members = curr_view.subgroup_shard_views.at(subgroup_id).at(curr_view.my_subgroups.at(subgroup_id)).members;
+        //The serializer may run after this returns, so it shares the staging buffer
+        auto staging = std::make_shared<rpc::remote_invocation_utilities::StagingBuffer>();
+        const std::size_t payload_size = std::apply([this, &staging](const auto&... args) {
+            return wrapped_this->template prepare_ordered_send<tag>(*staging, args...);
+        },
+                                                    call->second);
+        const std::size_t max_payload_size = group_rpc_manager.view_manager.get_max_payload_sizes().at(subgroup_id);
+        if(payload_size > max_payload_size) {
+            throw derecho_exception("Cannot send an RPC message of " + std::to_string(payload_size)
+                                    + " bytes; the maximum payload size is " + std::to_string(max_payload_size));
+        }
+        //Like ordered_send's, the serializer may run on the subgroup's SST predicate thread
+        curr_view.multicast_group->send_async(
+                subgroup_id, payload_size,
+                [this, call, payload_size, staging](char* buffer) {
+                    auto send_return_struct = std::apply([&](const auto&... args) {
+                        return wrapped_this->template send_prepared<tag>(
+                                payload_size, *staging, [buffer](size_t size) -> char* { return buffer; }, args...);
+                    },
+                                                         call->second);
+                    group_rpc_manager.finish_rpc_send(subgroup_id, send_return_struct.pending);
+                    rpc::run_on_replies(send_return_struct.results, call->first, group_rpc_manager.callback_executor);
+                },
+                true,
+                [this, call](bool sent) {
+                    if(sent) {
+                        return;
+                    }
+                    //The view was wedged first. This runs inside wedge(), so resubmit
+                    //the message on a callback thread once the next view is installed,
+                    //without holding that thread until then.
+                    group_rpc_manager.post_after_view_change([this, call]() {
+                        submit_ordered_send_async<tag, Ret>(call);
+                    });
+                });
+    } catch(...) {
+        rpc::run_on_failure<Ret>(shard_members, std::current_exception(), call->first,
+                                 group_rpc_manager.callback_executor);
+    }
+}
+
+template <typename T>
+template <rpc::FunctionTag tag, typename Callback, typename... Args>
+void Replicated<T>::p2p_send_async(node_id_t dest_node, Callback&& on_reply, Args&&... args) {
+    if(is_valid()) {
+        using Ret = typename std::remove_pointer<decltype(wrapped_this->template getReturnType<tag>(
+                std::forward<Args>(args)...))>::type;
+        //The request may be sent after this function returns, so the send owns
+        //the callback and a copy of the arguments
+        auto call = std::make_shared<std::pair<std::decay_t<Callback>, std::tuple<std::decay_t<Args>...>>>(
+                std::forward<Callback>(on_reply), std::make_tuple(std::forward<Args>(args)...));
+        group_rpc_manager.template p2p_send_async<tag, Ret>(*wrapped_this, subgroup_id, dest_node, std::move(call));
     } else {
         throw empty_reference_exception{"Attempted to use an empty Replicated<T>"};
     }
@@ -211,30 +351,23 @@ ExternalCaller<T>::ExternalCaller(uint32_t type_id, node_id_t nid, subgroup_id_t
           wrapped_this(group_rpc_manager.make_remote_invoker<T>(type_id, subgroup_id,
                                                                 T::register_functions())) {}
 
-//This is literally copied and pasted from Replicated<T>. I wish I could let them share code with inheritance,
-//but I'm afraid that will introduce unnecessary overheads.
+//Like Replicated<T>, this leaves the sending itself to RPCManager
 template <typename T>
 template <rpc::FunctionTag tag, typename... Args>
 auto ExternalCaller<T>::p2p_send(node_id_t dest_node, Args&&... args) {
     if(is_valid()) {
-        assert(dest_node != node_id);
-        if(group_rpc_manager.view_manager.get_current_view().get().rank_of(dest_node) == -1) {
-            throw invalid_node_exception("Cannot send a p2p request to node "
-                    + std::to_string(dest_node) + ": it is not a member of the Group.");
-        }
-        auto return_pair = wrapped_this->template send<tag>(
-                [this, &dest_node](size_t size) -> char* {
-                    const std::size_t max_payload_size = group_rpc_manager.view_manager.get_max_payload_sizes().at(subgroup_id);
-                    if(size <= max_payload_size) {
-                        return (char*)group_rpc_manager.get_sendbuffer_ptr(dest_node,
-                                                                           sst::REQUEST_TYPE::P2P_REQUEST);
-                    } else {
-                        return nullptr;
-                    }
-                },
-                std::forward<Args>(args)...);
-        group_rpc_manager.finish_p2p_send(dest_node, subgroup_id, return_pair.pending);
-        return std::move(return_pair.results);
+        return group_rpc_manager.template p2p_send<tag>(*wrapped_this, subgroup_id, dest_node,
+                                                        std::forward<Args>(args)...);
+    } else {
+        throw empty_reference_exception{"Attempted to use an empty Replicated<T>"};
+    }
+}
+
+template <typename T>
+template <rpc::FunctionTag tag, typename ArgsRange>
+auto ExternalCaller<T>::p2p_send_batch(node_id_t dest_node, const ArgsRange& args_range) {
+    if(is_valid()) {
+        return group_rpc_manager.template p2p_send_batch<tag>(*wrapped_this, subgroup_id, dest_node, args_range);
     } else {
         throw empty_reference_exception{"Attempted to use an empty Replicated<T>"};
     }
@@ -6,19 +6,27 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
 #include <exception>
 #include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <tuple>
 #include <vector>
 
 #include "../derecho_type_definitions.hpp"
 #include "../view.hpp"
 #include "derecho_internal.hpp"
+#include "dispatch_table.hpp"
 #include "p2p_connections.hpp"
+#include "queue_worker.hpp"
 #include "remote_invocable.hpp"
 #include "rpc_utils.hpp"
+#include "spsc_queue.hpp"
 #include "view_manager.hpp"
 #include <derecho/mutils-serialization/SerializationSupport.hpp>
 #include <derecho/utils/logger.hpp>
@@ -48,10 +56,15 @@ class RPCManager {
      * from the targets of an earlier remote call.
      * Note that a FunctionID is (class ID, subgroup ID, Function Tag). */
     std::unique_ptr<std::map<Opcode, receive_fun_t>> receivers;
-    /** An emtpy DeserializationManager, in case we need it later. */
-    // mutils::DeserializationManager dsm{{}};
+    /** The receivers, arranged for fast lookup by receive_message. */
+    DispatchTable dispatch_table;
     // Weijia: I prefer the deserialization context vector.
     mutils::RemoteDeserialization_v rdv;
+    /**
+     * A DeserializationManager holding the contexts in rdv, shared by all
+     * the receive functions so they do not build one per message.
+     */
+    mutils::DeserializationManager dsm{{}};
 
     template <typename T>
     friend class ::derecho::Replicated;  //Give only Replicated access to view_manager
@@ -74,6 +87,28 @@ class RPCManager {
     //Both maps contain one list of PendingResults references per subgroup
     std::map<subgroup_id_t, std::queue<PendingBase_ref>> pending_results_to_fulfill;
     std::map<subgroup_id_t, std::list<PendingBase_ref>> fulfilled_pending_results;
+    /**
+     * Guards the RPC_REPLY send buffers. rpc_message_handler can run on several
+     * SST predicate threads at once (one per predicate partition), and two of
+     * them may be replying to the same node.
+     */
+    std::mutex rpc_reply_mutex;
+
+    /**
+     * Follows the RPC header of each piece of a chunked reply, which carries
+     * the reply's payload in order across as many P2P slots as it needs.
+     */
+    struct reply_chunk_header {
+        /** The size of the whole reply payload */
+        uint64_t total_size;
+        /** The sst::REQUEST_TYPE of the slots the chunks are sent in */
+        uint32_t request_type;
+    };
+    /**
+     * Chunked replies being reassembled, by sender and request type. Only
+     * accessed by the P2P listening thread.
+     */
+    std::map<std::pair<node_id_t, uint32_t>, std::vector<char>> partial_replies;
 
     /** This is not accessed outside invocations of rpc_message_handler,
      * it's just a member so it won't be newly allocated every time. */
@@ -86,8 +121,39 @@ class RPCManager {
     std::condition_variable thread_start_cv;
     std::atomic<bool> thread_shutdown{false};
     std::thread rpc_thread;
-    /** p2p send and queries are queued in fifo worker */
-    std::thread fifo_worker_thread;
+    /** What the P2P listening thread does once no message has arrived for p2p_idle_spin_us */
+    const sst::IdlePolicy p2p_idle_policy;
+    const uint32_t p2p_idle_spin_us;
+    /** The sleep time, or the maximum sleep time, of the SLEEP and BACKOFF idle policies */
+    const uint32_t p2p_idle_sleep_us;
+    /**
+     * The longest the BLOCK idle policy waits before polling again. Incoming
+     * messages are written by RDMA and cannot wake the thread, so this bounds
+     * how late they are noticed.
+     */
+    const uint32_t p2p_idle_poll_us;
+    /** Incremented to wake the P2P listening thread under the BLOCK idle policy */
+    uint64_t p2p_wakeup_generation = 0;
+    /** The last value of p2p_wakeup_generation seen by the P2P listening thread */
+    uint64_t p2p_seen_generation = 0;
+    std::mutex p2p_wakeup_mutex;
+    std::condition_variable p2p_wakeup_cv;
+    /**
+     * The number of threads in reserve_p2p_requests, plus the number of sends
+     * in p2p_credit_retries, waiting for replies to return request credits
+     */
+    std::atomic<uint32_t> p2p_credit_waiters{0};
+    /** Incremented by the P2P listening thread when it consumes messages while there are waiters */
+    uint64_t p2p_credit_generation = 0;
+    std::mutex p2p_credit_mutex;
+    std::condition_variable p2p_credit_cv;
+    /** Asynchronous P2P sends that found no request credit, to try again once one is returned; guarded by p2p_credit_mutex */
+    std::vector<std::function<bool()>> p2p_credit_retries;
+    /** Tasks to post to callback_executor once the next view is installed */
+    std::vector<std::function<void()>> next_view_tasks;
+    std::mutex next_view_tasks_mutex;
+    /** Runs the reply callbacks of asynchronous sends, such as Replicated<T>::ordered_send_async */
+    CallbackExecutor callback_executor;
     struct fifo_req {
         node_id_t sender_id;
         char* msg_buf;
@@ -101,15 +167,63 @@ class RPCManager {
                                           msg_buf(_msg_buf),
                                           buffer_size(_buffer_size) {}
     };
-    std::queue<fifo_req> fifo_queue;
-    std::mutex fifo_queue_mutex;
-    std::condition_variable fifo_queue_cv;
+    /**
+     * A thread that handles p2p sends and queries in fifo order. The P2P
+     * listening thread is the only producer of its queue.
+     */
+    using fifo_worker_state = QueueWorker<SPSCQueue<fifo_req>>;
+    /** The maximum number of requests queued for one worker; further requests for it
+     * are left in their P2P slots, which holds back their senders */
+    static constexpr std::size_t fifo_queue_capacity = 4096;
+    /** p2p send and queries are queued in fifo workers. All the requests from a
+     * sender go to the same worker, so they are handled (and replied to) in order,
+     * while requests from different senders can be handled in parallel. */
+    std::vector<std::unique_ptr<fifo_worker_state>> fifo_workers;
 
     /** Listens for P2P RPC calls over the RDMA P2P connections and handles them. */
     void p2p_receive_loop();
 
+    /**
+     * Pauses the P2P listening thread between two idle polls, according to
+     * the configured idle policy. idle_backoff_us is the current sleep time
+     * under the BACKOFF policy.
+     * @return True if the thread was woken by wake_p2p_receive_loop, in which
+     * case it should spin again because replies are on their way.
+     */
+    bool p2p_idle_wait(uint32_t& idle_backoff_us);
+
+    /**
+     * Wakes the P2P listening thread if it is blocked under the BLOCK idle
+     * policy. Called after sending an RPC message that expects replies.
+     */
+    void wake_p2p_receive_loop();
+
+    /**
+     * Sends a reply that is too large for one P2P slot as a sequence of
+     * chunks, waiting for the destination to free up reply slots as needed.
+     * Gives up on the reply if the destination is suspected while waiting.
+     * @param dest_id The ID of the node the reply is for
+     * @param type The type of P2P slot the reply goes in
+     * @param reply_buf A buffer containing the whole reply, including its header
+     */
+    void send_chunked_reply(node_id_t dest_id, sst::REQUEST_TYPE type, const char* reply_buf);
+
+    /**
+     * Waits until dest_id has a free slot for a reply of the given type, and
+     * returns its buffer. The wait ends early if dest_id is suspected of having
+     * failed, since it would then never free the slot. The caller must hold
+     * the view lock, or be running on an SST predicate thread.
+     * @return The reply buffer, or nullptr if dest_id is suspected, in which
+     * case the reply should be dropped
+     */
+    char* get_reply_buffer(node_id_t dest_id, sst::REQUEST_TYPE type);
+
+    /** True if node_id has failed, or is suspected of failure by any member,
+     * in the current view. Same locking requirement as get_reply_buffer. */
+    bool node_suspected(node_id_t node_id);
+
     /** Handle Non-cascading P2P Send and P2P Queries in fifo*/
-    void fifo_worker();
+    void fifo_worker(uint32_t worker_num);
 
     /**
      * Handler to be called by rpc_process_loop each time it receives a
@@ -117,8 +231,11 @@ class RPCManager {
      * @param sender_id The ID of the node that sent the message
      * @param msg_buf A buffer containing the message
      * @param buffer_size The size of the buffer, in bytes
+     * @return False if the message is a request and its worker's queue is full,
+     * in which case the message has not been handled and must be left in its
+     * slot to be handled later; true otherwise
      */
-    void p2p_message_handler(node_id_t sender_id, char* msg_buf, uint32_t buffer_size);
+    bool p2p_message_handler(node_id_t sender_id, char* msg_buf, uint32_t buffer_size);
 
     /**
      * Processes an RPC message for any of the functions managed by this RPCManager,
@@ -159,9 +276,15 @@ public:
               receivers(new std::decay_t<decltype(*receivers)>()),
               view_manager(group_view_manager),
               connections(std::make_unique<sst::P2PConnections>(sst::P2PParams{nid, {nid}, group_view_manager.view_max_window_size, group_view_manager.view_max_payload_size})),
-              replySendBuffer(new char[group_view_manager.view_max_payload_size + sizeof(header)]) {
+              replySendBuffer(new char[group_view_manager.view_max_payload_size + sizeof(header)]),
+              p2p_idle_policy(sst::idle_policy_from_string(getConfString(CONF_DERECHO_P2P_IDLE_POLICY))),
+              p2p_idle_spin_us(getConfUInt32(CONF_DERECHO_P2P_IDLE_SPIN_US)),
+              p2p_idle_sleep_us(getConfUInt32(CONF_DERECHO_P2P_IDLE_SLEEP_US)),
+              p2p_idle_poll_us(getConfUInt32(CONF_DERECHO_P2P_IDLE_POLL_US)),
+              callback_executor(getConfUInt32(CONF_DERECHO_RPC_CALLBACK_THREADS)) {
         if(deserialization_context_ptr != nullptr) {
             rdv.push_back(deserialization_context_ptr);
+            dsm.register_ctx(deserialization_context_ptr);
         }
         rpc_thread = std::thread(&RPCManager::p2p_receive_loop, this);
     }
@@ -200,11 +323,13 @@ public:
         //FunctionTuple is a std::tuple of partial_wrapped<Tag, Ret, UserProvidedClass, Args>,
         //which is the result of the user calling tag<Tag>(&UserProvidedClass::method) on each RPC method
         //Use callFunc to unpack the tuple into a variadic parameter pack for build_remoteinvocableclass
-        return mutils::callFunc([&](const auto&... unpacked_functions) {
+        auto remote_invocable_class = mutils::callFunc([&](const auto&... unpacked_functions) {
             return build_remote_invocable_class<UserProvidedClass>(nid, type_id, instance_id, *receivers,
                                                                    bind_to_instance(cls, unpacked_functions)...);
         },
-                                funs);
+                                                       funs);
+        dispatch_table.rebuild(*receivers);
+        return remote_invocable_class;
     }
 
     void destroy_remote_invocable_class(uint32_t instance_id);
@@ -229,7 +354,7 @@ public:
      */
     template <typename UserProvidedClass, typename FunctionTuple>
     auto make_remote_invoker(uint32_t type_id, uint32_t instance_id, FunctionTuple funs) {
-        return mutils::callFunc([&](const auto&... unpacked_functions) {
+        auto remote_invoker = mutils::callFunc([&](const auto&... unpacked_functions) {
             //Supply the template parameters for build_remote_invoker_for_class by
             //asking bind_to_instance for the type of the wrapped<> that corresponds to each partial_wrapped<>
             return build_remote_invoker_for_class<UserProvidedClass,
@@ -237,7 +362,9 @@ public:
                                                                             unpacked_functions))...>(nid, type_id,
                                                                                                      instance_id, *receivers);
         },
-                                funs);
+                                               funs);
+        dispatch_table.rebuild(*receivers);
+        return remote_invoker;
     }
 
     /**
@@ -275,23 +402,239 @@ public:
     bool finish_rpc_send(subgroup_id_t subgroup_id, PendingBase& pending_results_handle);
 
     /**
-     * Retrieves a buffer for sending P2P messages from the RPCManager's pool of
-     * P2P RDMA connections. After filling it with data, the next call to
-     * finish_p2p_send will send it.
-     * @param dest_id The ID of the node that the P2P message will be sent to
-     * @param type The type of P2P message that will be sent
+     * A range of P2P request slots to one node, claimed by reserve_p2p_requests.
+     */
+    struct p2p_reservation {
+        node_id_t dest_id;
+        /** The sequence number of the first slot */
+        uint64_t first_seq_num;
+        uint32_t num_slots;
+    };
+
+    /**
+     * Reserves P2P request slots for a batch of messages to a node. Each
+     * request takes a credit that its reply returns, so this blocks until
+     * fewer than a window's worth of requests to the node are awaiting
+     * replies. It waits on a condition variable that the P2P listening thread
+     * notifies when it consumes messages, without holding the view lock.
+     * The credits are taken atomically, so threads sending to the same node
+     * at once each get their own slots.
+     * @param dest_id The ID of the node the messages will be sent to
+     * @param max_requests The number of messages the caller wants to send
+     * @return The slots reserved, between 1 and max_requests of them. The
+     * caller fills them with get_batch_sendbuffer_ptr and must then pass the
+     * reservation to finish_p2p_batch_send, even if it fills none of them.
+     */
+    p2p_reservation reserve_p2p_requests(node_id_t dest_id, uint32_t max_requests);
+
+    /**
+     * Same as reserve_p2p_requests, but never blocks.
+     * @return The slots reserved, of which there are none if there are no
+     * request credits for dest_id right now
+     */
+    p2p_reservation try_reserve_p2p_requests(node_id_t dest_id, uint32_t max_requests);
+
+    /**
+     * Runs attempt, which tries to send P2P requests without blocking and
+     * returns false if there was no request credit for them. In that case
+     * attempt is kept and run again on callback_executor after the P2P
+     * listening thread next consumes replies or a new view is installed, as
+     * many times as it takes, so no thread blocks waiting for the credit.
      */
-    volatile char* get_sendbuffer_ptr(uint32_t dest_id, sst::REQUEST_TYPE type);
+    void send_with_p2p_credit(std::function<bool()> attempt);
 
     /**
-     * Sends the next P2P message buffer over an RDMA connection to the specified node,
-     * and registers the "promise object" in pending_results_handle to await its reply.
-     * @param dest_node The node to send the message to
+     * Wakes the threads waiting in reserve_p2p_requests and posts the sends
+     * waiting in p2p_credit_retries, after request credits may have been
+     * returned.
+     */
+    void p2p_credits_returned();
+
+    /**
+     * Posts task to callback_executor once the next view is installed, e.g.
+     * to resubmit a send that the current view was wedged before sending.
+     */
+    void post_after_view_change(std::function<void()> task);
+
+    /**
+     * Retrieves the buffer for one message of a batch whose slots were
+     * reserved by reserve_p2p_requests.
+     * @param reservation The slots reserved for the batch
+     * @param index The position of the message in the batch
+     */
+    volatile char* get_batch_sendbuffer_ptr(const p2p_reservation& reservation, uint32_t index);
+
+    /**
+     * Sends a batch of P2P requests prepared in the buffers returned by
+     * get_batch_sendbuffer_ptr, and registers their "promise objects" to
+     * await the replies. The remote node is notified once for the whole batch.
+     * If the batch uses fewer slots than were reserved, the rest are given
+     * back: their credits are returned directly if no slots were reserved
+     * after them, and otherwise they are sent as no-op requests whose null
+     * replies return the credits, since the remote node reads slots in order.
+     * @param reservation The slots reserved for the batch
      * @param dest_subgroup_id The subgroup ID of the subgroup that node is in
-     * @param pending_results_handle A reference to the "promise object" in the
-     * send_return for this send.
+     * @param message_sizes The size of each message, including its header;
+     * message i is in the slot with index i
+     * @param pending_results_handles The "promise object" of each message
+     */
+    void finish_p2p_batch_send(const p2p_reservation& reservation, subgroup_id_t dest_subgroup_id,
+                               const std::vector<uint64_t>& message_sizes,
+                               const std::vector<PendingBase_ref>& pending_results_handles);
+
+    /**
+     * Sends a P2P request to dest_node invoking the RPC function identified by
+     * tag; this implements Replicated<T>::p2p_send and ExternalCaller<T>::p2p_send.
+     * @param invoker The RemoteInvocableClass or RemoteInvokerForClass of the
+     * Replicated<T> or ExternalCaller<T>, which serializes the call
+     * @param subgroup_id The subgroup dest_node is in
+     * @param dest_node The node to send the request to
+     * @param args The arguments to the RPC function
+     * @return The QueryResults for the request
+     */
+    template <FunctionTag tag, typename Invoker, typename... Args>
+    auto p2p_send(Invoker& invoker, subgroup_id_t subgroup_id, node_id_t dest_node, Args&&... args) {
+        const std::array<std::tuple<Args&&...>, 1> single_call{std::forward_as_tuple(std::forward<Args>(args)...)};
+        return std::move(p2p_send_batch<tag>(invoker, subgroup_id, dest_node, single_call).front());
+    }
+
+    /**
+     * Sends a batch of P2P requests to dest_node invoking the RPC function
+     * identified by tag, one per element of args_range; this implements
+     * Replicated<T>::p2p_send_batch and ExternalCaller<T>::p2p_send_batch.
+     * The requests are sent in batches of as many as there are request
+     * credits for. If serializing a request throws, the requests before it
+     * are still sent, and its batch's remaining slots are given back.
+     * @param invoker The RemoteInvocableClass or RemoteInvokerForClass of the
+     * Replicated<T> or ExternalCaller<T>, which serializes the calls
+     * @param subgroup_id The subgroup dest_node is in
+     * @param dest_node The node to send the requests to
+     * @param args_range The arguments of each call, as in Replicated<T>::p2p_send_batch
+     * @return A std::vector of the QueryResults for each request, in order
+     */
+    template <FunctionTag tag, typename Invoker, typename ArgsRange>
+    auto p2p_send_batch(Invoker& invoker, subgroup_id_t subgroup_id, node_id_t dest_node, const ArgsRange& args_range) {
+        check_p2p_destination(dest_node);
+        using std::begin;
+        using std::end;
+        //Only used for its return type, which has the type of the results
+        auto send_one = [&invoker](const auto&... args) {
+            return invoker.template send<tag>(std::function<char*(size_t)>{}, args...);
+        };
+        std::vector<decltype(std::apply(send_one, batch_call_args(*begin(args_range))).results)> results;
+        std::size_t remaining = std::distance(begin(args_range), end(args_range));
+        results.reserve(remaining);
+        auto next_args = begin(args_range);
+        while(remaining > 0) {
+            const p2p_reservation reservation = reserve_p2p_requests(
+                    dest_node, static_cast<uint32_t>(std::min<std::size_t>(remaining, UINT32_MAX)));
+            send_on_reservation<tag>(invoker, subgroup_id, reservation, next_args, results);
+            remaining -= reservation.num_slots;
+        }
+        return results;
+    }
+
+    /**
+     * Sends a P2P request to dest_node like p2p_send, but without blocking:
+     * call->first, the callback, is run on callback_executor with the reply
+     * as in run_on_replies. If there is no request credit for dest_node, the
+     * request is sent from a callback thread once one is returned. If the
+     * request cannot be sent, the callback gets the exception instead, as in
+     * run_on_failure. This implements Replicated<T>::p2p_send_async.
+     * @param call The callback and a tuple of the arguments to the RPC
+     * function, which the send shares since it may outlive the caller
+     * @tparam Ret The return type of the RPC function
+     */
+    template <FunctionTag tag, typename Ret, typename Invoker, typename Call>
+    void p2p_send_async(Invoker& invoker, subgroup_id_t subgroup_id, node_id_t dest_node, std::shared_ptr<Call> call) {
+        try {
+            check_p2p_destination(dest_node);
+        } catch(...) {
+            run_on_failure<Ret>({dest_node}, std::current_exception(), call->first, callback_executor);
+            return;
+        }
+        //Without a credit, the send is tried again when one is returned rather
+        //than waiting for it on a callback thread
+        send_with_p2p_credit([this, &invoker, subgroup_id, dest_node, call]() {
+            try {
+                const p2p_reservation reservation = try_reserve_p2p_requests(dest_node, 1);
+                if(reservation.num_slots == 0) {
+                    return false;
+                }
+                const std::array<std::reference_wrapper<const typename Call::second_type>, 1> single_call{std::cref(call->second)};
+                auto next_args = single_call.begin();
+                std::vector<QueryResults<Ret>> results;
+                send_on_reservation<tag>(invoker, subgroup_id, reservation, next_args, results);
+                run_on_replies(results.front(), call->first, callback_executor);
+            } catch(...) {
+                run_on_failure<Ret>({dest_node}, std::current_exception(), call->first, callback_executor);
+            }
+            return true;
+        });
+    }
+
+private:
+    /**
+     * @throws invalid_node_exception if dest_node is not a member of the Group
      */
-    void finish_p2p_send(node_id_t dest_node, subgroup_id_t dest_subgroup_id, PendingBase& pending_results_handle);
+    void check_p2p_destination(node_id_t dest_node) {
+        assert(dest_node != nid);
+        if(view_manager.get_current_view().get().rank_of(dest_node) == -1) {
+            throw invalid_node_exception("Cannot send a p2p request to node "
+                                         + std::to_string(dest_node) + ": it is not a member of the Group.");
+        }
+    }
+
+    /**
+     * Serializes one request into each slot of reservation, taking the
+     * arguments from next_args onward and appending the QueryResults to
+     * results, then sends them. If serializing a request throws, the requests
+     * before it are still sent and the rest of the slots are given back.
+     */
+    template <FunctionTag tag, typename Invoker, typename ArgsIterator, typename ResultsVector>
+    void send_on_reservation(Invoker& invoker, subgroup_id_t subgroup_id, const p2p_reservation& reservation,
+                             ArgsIterator& next_args, ResultsVector& results) {
+        const std::size_t max_payload_size = view_manager.get_max_payload_sizes().at(subgroup_id);
+        std::vector<uint64_t> message_sizes;
+        message_sizes.reserve(reservation.num_slots);
+        std::vector<PendingBase_ref> pending_results_handles;
+        pending_results_handles.reserve(reservation.num_slots);
+        try {
+            for(uint32_t index = 0; index < reservation.num_slots; ++index, ++next_args) {
+                uint64_t message_size = 0;
+                auto return_pair = std::apply([&](const auto&... args) {
+                    return invoker.template send<tag>(
+                            [&](size_t size) -> char* {
+                                message_size = size;
+                                if(size <= max_payload_size) {
+                                    return (char*)get_batch_sendbuffer_ptr(reservation, index);
+                                } else {
+                                    return nullptr;
+                                }
+                            },
+                            args...);
+                },
+                                              batch_call_args(unwrap_call_args(*next_args)));
+                message_sizes.push_back(message_size);
+                pending_results_handles.emplace_back(return_pair.pending);
+                results.emplace_back(std::move(return_pair.results));
+            }
+        } catch(...) {
+            //Send the requests already serialized and give back the other slots
+            finish_p2p_batch_send(reservation, subgroup_id, message_sizes, pending_results_handles);
+            throw;
+        }
+        finish_p2p_batch_send(reservation, subgroup_id, message_sizes, pending_results_handles);
+    }
+
+    template <typename Element>
+    static const Element& unwrap_call_args(const std::reference_wrapper<const Element>& element) {
+        return element.get();
+    }
+    template <typename Element>
+    static const Element& unwrap_call_args(const Element& element) {
+        return element;
+    }
 };
 
 //Now that RPCManager is finished being declared, we can declare these convenience types
@@ -6,14 +6,22 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
+#include <cstring>
 #include <exception>
 #include <functional>
 #include <future>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <set>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <tuple>
 #include <type_traits>
@@ -23,6 +31,7 @@
 
 #include "../derecho_exception.hpp"
 #include "../derecho_type_definitions.hpp"
+#include "callback_executor.hpp"
 #include "derecho_internal.hpp"
 #include <derecho/mutils-serialization/SerializationSupport.hpp>
 #include <derecho/utils/logger.hpp>
@@ -132,167 +141,597 @@ struct recv_ret {
  * some RPC message is received.
  */
 using receive_fun_t = std::function<recv_ret(
-        //        mutils::DeserializationManager* dsm,
-        mutils::RemoteDeserialization_v* rdv, const node_id_t&, const char* recv_buf,
+        mutils::DeserializationManager* dsm, const node_id_t&, const char* recv_buf,
         const std::function<char*(int)>& out_alloc)>;
 
+template <typename Ret>
+class ReplyState;
+
+template <typename Ret>
+class ReplyStateRef;
+
 /**
- * The type of map contained in a QueryResults::ReplyMap. The template parameter
- * should be the return type of the query.
+ * The eventual reply of one node to an RPC function call, which behaves like a
+ * std::future for that reply: get() blocks until the reply arrives, then
+ * returns its value or rethrows the exception the node sent back. Unlike a
+ * std::future it lives in an array inside the call's ReplyState, so there is
+ * no allocation or shared state per node.
+ * @tparam Ret The return type of the RPC function
  */
-template <typename T>
-using reply_map = std::map<node_id_t, std::future<T>>;
+template <typename Ret>
+class ReplySlot {
+    friend class ReplyState<Ret>;
+    using value_type = std::conditional_t<std::is_void<Ret>::value, char, std::remove_const_t<Ret>>;
+    /** A reply is recorded by moving the status from EMPTY to WRITING and then
+     * to HAS_VALUE or HAS_EXCEPTION, so only one thread can record it */
+    enum status_t : uint8_t { EMPTY,
+                              WRITING,
+                              HAS_VALUE,
+                              HAS_EXCEPTION,
+                              RETRIEVED };
+    ReplyState<Ret>* state = nullptr;
+    std::atomic<uint8_t> status{EMPTY};
+    /** Set once the reply has been handed to the ReplyState's reply callback */
+    std::atomic<bool> callback_done{false};
+    std::optional<value_type> value;
+    std::exception_ptr exception;
+
+public:
+    /**
+     * @return True if the reply has not been retrieved with get() yet, like
+     * std::future::valid()
+     */
+    bool valid() const {
+        return status != RETRIEVED;
+    }
+
+    /** @return True if the reply has arrived, so get() will not block */
+    bool is_ready() const {
+        const uint8_t current_status = status;
+        return current_status != EMPTY && current_status != WRITING;
+    }
+
+    /** Blocks until the reply arrives. */
+    void wait() {
+        state->wait_until([this]() { return is_ready(); });
+    }
+
+    /**
+     * Blocks until the reply arrives or the timeout expires.
+     * @return std::future_status::ready if the reply arrived, or
+     * std::future_status::timeout
+     */
+    template <typename Rep, typename Period>
+    std::future_status wait_for(const std::chrono::duration<Rep, Period>& timeout) {
+        return state->wait_until([this]() { return is_ready(); }, timeout)
+                       ? std::future_status::ready
+                       : std::future_status::timeout;
+    }
+
+    /**
+     * Blocks until the reply arrives, then returns it, moving it out of the
+     * slot. Like std::future::get(), this can only be called once.
+     */
+    Ret get() {
+        wait();
+        assert(valid());
+        if(status.exchange(RETRIEVED) == HAS_EXCEPTION) {
+            std::rethrow_exception(exception);
+        }
+        if constexpr(!std::is_void<Ret>::value) {
+            return std::move(*value);
+        }
+    }
+};
 
 /**
- * Data structure that (indirectly) holds a set of futures for a single RPC
- * function call; there is one future for each node contacted to make the
- * call, and it will eventually contain that node's reply. The futures are
- * actually stored inside an internal struct of type ReplyMap, which can be
- * retrieved with the get() method. The ReplyMap will not be returned until
- * it is "fulfilled" by the sender, which should happen when the RPC call
- * is delivered in the current View (and thus, the current View is the set
- * of nodes who should reply to the RPC).
- * @tparam Ret The return type of the RPC function that this query invoked
+ * The replies to a single RPC function call, as seen by the caller: one
+ * ReplySlot per node that the call was sent to, sorted by node ID. Iterating
+ * over it yields pairs of a node ID and its ReplySlot, like the std::map of
+ * futures that it replaces.
+ * @tparam Ret The return type of the RPC function
  */
 template <typename Ret>
-class QueryResults {
+class ReplyMap {
+    ReplyState<Ret>* state;
+
 public:
-    using map_fut = std::future<std::unique_ptr<reply_map<Ret>>>;
-    using map = reply_map<Ret>;
-    using type = Ret;
+    ReplyMap(ReplyState<Ret>* state) : state(state) {}
+    ReplyMap(const ReplyMap&) = delete;
+    ReplyMap(ReplyMap&& rm) : state(rm.state) {}
+
+    bool valid(const node_id_t& nid) {
+        auto* slot = state->find(nid);
+        assert(state->size() == 0 || slot != nullptr);
+        return slot && slot->second.valid();
+    }
 
-    class ReplyMap {
-    private:
-        QueryResults& parent;
+    /*
+      returns true if we sent to this node,
+      regardless of whether this node has replied.
+    */
+    bool contains(const node_id_t& nid) { return state->find(nid) != nullptr; }
 
-    public:
-        map rmap;
+    auto begin() { return state->slots_begin(); }
 
-        ReplyMap(QueryResults& qr) : parent(qr){};
-        ReplyMap(const ReplyMap&) = delete;
-        ReplyMap(ReplyMap&& rm) : parent(rm.parent), rmap(std::move(rm.rmap)) {}
+    auto end() { return state->slots_end(); }
 
-        bool valid(const node_id_t& nid) {
-            assert(rmap.size() == 0 || rmap.count(nid) != 0);
-            return (rmap.size() > 0) && rmap.at(nid).valid();
+    /**
+     * Blocks until node nid's reply arrives, then returns it.
+     * @throws The exception the call failed with, if it could not be sent,
+     * or std::out_of_range if it was not sent to nid
+     */
+    Ret get(const node_id_t& nid) {
+        state->wait_for_map();
+        state->check_failed();
+        auto* slot = state->find(nid);
+        if(!slot) {
+            throw std::out_of_range("ReplyMap::get: the RPC call was not sent to node " + std::to_string(nid));
         }
+        return slot->second.get();
+    }
+};
 
-        /*
-          returns true if we sent to this node,
-          regardless of whether this node has replied.
-        */
-        bool contains(const node_id_t& nid) { return rmap.count(nid); }
+/**
+ * Specialization of ReplyMap for void functions, which do not generate
+ * replies. It simply records the set of nodes to which the RPC was sent, and
+ * iterating over it yields their IDs.
+ */
+template <>
+class ReplyMap<void> {
+    ReplyState<void>* state;
 
-        auto begin() { return std::begin(rmap); }
+public:
+    ReplyMap(ReplyState<void>* state) : state(state) {}
+    ReplyMap(const ReplyMap&) = delete;
+    ReplyMap(ReplyMap&& rm) : state(rm.state) {}
 
-        auto end() { return std::end(rmap); }
+    inline bool valid(const node_id_t& nid);
 
-        Ret get(const node_id_t& nid) {
-            if(rmap.size() == 0) {
-                assert(parent.pending_rmap.valid());
-                rmap = std::move(*parent.pending_rmap.get());
-            }
-            assert(rmap.size() > 0);
-            assert(rmap.count(nid));
-            assert(rmap.at(nid).valid());
-            return rmap.at(nid).get();
-        }
-    };
+    /*
+      returns true if we sent to this node,
+      regardless of whether this node has replied.
+    */
+    inline bool contains(const node_id_t& nid);
+
+    inline std::vector<node_id_t>::const_iterator begin();
+
+    inline std::vector<node_id_t>::const_iterator end();
+};
 
-    map_fut pending_rmap;
+/**
+ * The state shared by the two ends of a single RPC function call: the
+ * PendingResults that the RPC threads record replies in, and the QueryResults
+ * that the caller reads them from. It holds an array of reply slots, one per
+ * node the call was sent to, which is allocated once the set of nodes is known
+ * and kept for the next call that reuses this state. A reply is recorded with
+ * an atomic store to its slot, so no lock is taken unless some thread is
+ * blocked waiting for replies, and no allocation is needed per node.
+ * @tparam Ret The return type of the RPC function
+ */
+template <typename Ret>
+class ReplyState : public std::enable_shared_from_this<ReplyState<Ret>> {
+public:
+    using slot_t = std::pair<node_id_t, ReplySlot<Ret>>;
 
 private:
-    ReplyMap replies{*this};
+    enum map_status_t : uint8_t { MAP_PENDING,
+                                  MAP_READY,
+                                  MAP_FAILED };
+    /** Whether the set of destination nodes is known yet */
+    std::atomic<uint8_t> map_status{MAP_PENDING};
+    /** The exception to give the caller if the call could not be sent */
+    std::exception_ptr map_exception;
+    /** The IDs of the destination nodes, sorted */
+    std::vector<node_id_t> nodes;
+    /** One slot per destination node, in the same order as nodes; unused for void functions */
+    std::unique_ptr<slot_t[]> slots;
+    std::size_t slots_capacity = 0;
+    /** The number of destination nodes that have not replied yet */
+    std::atomic<uint32_t> num_outstanding{0};
+    /** The number of threads blocked in wait_until; if 0, recording a reply takes no lock */
+    std::atomic<uint32_t> num_waiters{0};
+    std::mutex wait_mutex;
+    std::condition_variable wait_cv;
+    /** Set, under wait_mutex, once every node has replied or the call has failed */
+    std::atomic<bool> completed{false};
+    /** Called once the call has completed, on the thread that completed it */
+    std::function<void(ReplyState&)> completion_callback;
+    /** Called with each node's slot once its reply arrives, on the thread that records it */
+    std::function<void(ReplyState&, slot_t&)> reply_callback;
+    /** Set, after reply_callback, if there is one; replies recorded earlier are caught up then */
+    std::atomic<bool> has_reply_callback{false};
+    /**
+     * The number of references to this state from the caller's side of the
+     * call (see ReplyStateRef), plus one while a thread is completing the
+     * call. The owning PendingResults only reuses the state once the call is
+     * complete and this has dropped to 0.
+     */
+    std::atomic<uint32_t> num_users{0};
+    friend class ReplyStateRef<Ret>;
+
+    /** Wakes any threads blocked in wait_until, if there are any */
+    void notify_waiters() {
+        if(num_waiters > 0) {
+            std::lock_guard<std::mutex> lock(wait_mutex);
+            wait_cv.notify_all();
+        }
+    }
+
+    void complete() {
+        //Counted as a user before completed is set, so the state is not reused under the callback
+        num_users.fetch_add(1, std::memory_order_relaxed);
+        std::function<void(ReplyState&)> callback;
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex);
+            completed = true;
+            callback = std::move(completion_callback);
+            wait_cv.notify_all();
+        }
+        if(callback) {
+            callback(*this);
+        }
+        num_users.fetch_sub(1, std::memory_order_release);
+    }
+
+    /**
+     * Hands a slot whose reply has arrived to the reply callback, unless the
+     * callback is not set yet or has already had it; the flag in the slot
+     * settles the race between the thread recording the reply and the thread
+     * setting the callback.
+     */
+    void run_reply_callback(slot_t& slot) {
+        if(has_reply_callback && !slot.second.callback_done.exchange(true)) {
+            reply_callback(*this, slot);
+        }
+    }
+
+    /**
+     * Claims node nid's slot for recording its reply, waiting for the set of
+     * destination nodes to be known first if necessary.
+     * @return The slot, or nullptr if there is no slot for nid or another
+     * thread has already claimed it
+     */
+    slot_t* claim_slot(const node_id_t& nid) {
+        wait_for_map();
+        slot_t* slot = find(nid);
+        uint8_t expected = ReplySlot<Ret>::EMPTY;
+        if(!slot || !slot->second.status.compare_exchange_strong(expected, ReplySlot<Ret>::WRITING)) {
+            return nullptr;
+        }
+        return slot;
+    }
+
+    /** Records that one more node has replied, completing the call if it was the last */
+    void reply_arrived(slot_t& slot) {
+        notify_waiters();
+        run_reply_callback(slot);
+        if(num_outstanding.fetch_sub(1) == 1) {
+            complete();
+        }
+    }
 
 public:
-    QueryResults(map_fut pm) : pending_rmap(std::move(pm)) {}
-    QueryResults(QueryResults&& o)
-            : pending_rmap{std::move(o.pending_rmap)},
-              replies{std::move(o.replies)} {}
-    QueryResults(const QueryResults&) = delete;
+    /**
+     * Gets the state ready for another call, keeping the memory allocated for
+     * the reply slots. Must only be called once nothing else refers to it.
+     */
+    void reset() {
+        map_status = MAP_PENDING;
+        map_exception = nullptr;
+        nodes.clear();
+        num_outstanding = 0;
+        completed = false;
+        completion_callback = nullptr;
+        has_reply_callback = false;
+        reply_callback = nullptr;
+    }
 
     /**
-     * Wait the specified duration; if a ReplyMap is available
-     * after that duration, return it. Otherwise return nullptr.
+     * Records the set of nodes the call was sent to, which are the nodes that
+     * will reply. Replies that arrived earlier are waiting for this.
      */
-    template <typename Time>
-    ReplyMap* wait(Time t) {
-        if(replies.rmap.size() == 0) {
-            if(pending_rmap.wait_for(t) == std::future_status::ready) {
-                replies.rmap = std::move(*pending_rmap.get());
-                return &replies;
-            } else
-                return nullptr;
-        } else
-            return &replies;
+    void fulfill(const node_list_t& who) {
+        nodes.assign(who.begin(), who.end());
+        std::sort(nodes.begin(), nodes.end());
+        if constexpr(!std::is_void<Ret>::value) {
+            if(slots_capacity < nodes.size()) {
+                slots = std::make_unique<slot_t[]>(nodes.size());
+                slots_capacity = nodes.size();
+            }
+            for(std::size_t i = 0; i < nodes.size(); ++i) {
+                slots[i].first = nodes[i];
+                slots[i].second.state = this;
+                slots[i].second.value.reset();
+                slots[i].second.exception = nullptr;
+                slots[i].second.callback_done = false;
+                slots[i].second.status = ReplySlot<Ret>::EMPTY;
+            }
+            num_outstanding = nodes.size();
+        }
+        map_status = MAP_READY;
+        notify_waiters();
+        if(std::is_void<Ret>::value || nodes.empty()) {
+            complete();
+        }
     }
 
     /**
-     * Block until the ReplyMap is fulfilled, then return the map by reference.
-     * The ReplyMap is only valid as long as this QueryResults remains in
-     * scope, and cannot be copied.
+     * Records that the call could not be sent, so there will be no replies.
+     * The caller gets the exception when it asks for the replies.
      */
-    ReplyMap& get() {
-        using namespace std::chrono;
-        while(true) {
-            if(auto rmap = wait(5min)) {
-                return *rmap;
+    void fail(std::exception_ptr e) {
+        map_exception = e;
+        map_status = MAP_FAILED;
+        complete();
+    }
+
+    bool is_fulfilled() const {
+        return map_status == MAP_READY;
+    }
+
+    /** Rethrows the exception passed to fail(), if the call failed */
+    void check_failed() const {
+        if(map_status == MAP_FAILED) {
+            std::rethrow_exception(map_exception);
+        }
+    }
+
+    /** @return True if the set of destination nodes is known, or the call failed */
+    bool is_settled() const {
+        return map_status != MAP_PENDING;
+    }
+
+    /** @return True if every node has replied, or the call failed */
+    bool is_complete() const {
+        return completed;
+    }
+
+    /**
+     * @return True if the call is complete and nothing but its PendingResults
+     * refers to the state any more, so it can be reset for another call. The
+     * acquire load makes everything the last user did with it visible.
+     */
+    bool is_reusable() const {
+        //completed is read first, since complete() counts itself as a user before setting it
+        return completed && num_users.load(std::memory_order_acquire) == 0;
+    }
+
+    /**
+     * Blocks the calling thread until predicate returns true. The predicate
+     * is rechecked whenever a reply arrives or the set of nodes becomes known.
+     */
+    template <typename Predicate>
+    void wait_until(const Predicate& predicate) {
+        if(predicate()) {
+            return;
+        }
+        // registering as a waiter before checking again means a reply recorded
+        // after that check is sure to notify this thread
+        num_waiters++;
+        {
+            std::unique_lock<std::mutex> lock(wait_mutex);
+            wait_cv.wait(lock, predicate);
+        }
+        num_waiters--;
+    }
+
+    /**
+     * Same as wait_until(const Predicate&), but gives up after the timeout.
+     * @return The final value of the predicate
+     */
+    template <typename Predicate, typename Rep, typename Period>
+    bool wait_until(const Predicate& predicate, const std::chrono::duration<Rep, Period>& timeout) {
+        if(predicate()) {
+            return true;
+        }
+        num_waiters++;
+        bool result;
+        {
+            std::unique_lock<std::mutex> lock(wait_mutex);
+            result = wait_cv.wait_for(lock, timeout, predicate);
+        }
+        num_waiters--;
+        return result;
+    }
+
+    /** Blocks until the set of destination nodes is known or the call has failed */
+    void wait_for_map() {
+        wait_until([this]() { return is_settled(); });
+    }
+
+    /**
+     * Registers a function to call once every node has replied or the call
+     * has failed. If that has already happened, it is called right away on
+     * the calling thread; otherwise it is called on the thread that records
+     * the last reply, which is an RPC thread, so it should not block.
+     */
+    void on_complete(std::function<void(ReplyState&)> callback) {
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex);
+            if(!completed) {
+                completion_callback = std::move(callback);
+                return;
             }
         }
+        callback(*this);
+    }
+
+    /**
+     * Registers a function to call with each node's slot once its reply (or
+     * exception) has arrived, on the thread that records it. Replies that are
+     * already in are handed to it right away, on the calling thread, as soon
+     * as the set of destination nodes is known. Only one such function can be
+     * registered per call, and it is called once per node.
+     */
+    void on_each_reply(std::function<void(ReplyState&, slot_t&)> callback) {
+        assert(!has_reply_callback);
+        reply_callback = std::move(callback);
+        has_reply_callback = true;
+        if(is_fulfilled()) {
+            for(std::size_t i = 0; i < nodes.size(); ++i) {
+                if(slots[i].second.is_ready()) {
+                    run_reply_callback(slots[i]);
+                }
+            }
+        }
+    }
+
+    std::size_t size() const {
+        return nodes.size();
+    }
+
+    const std::vector<node_id_t>& get_nodes() const {
+        return nodes;
+    }
+
+    bool contains(const node_id_t& nid) const {
+        return std::binary_search(nodes.begin(), nodes.end(), nid);
+    }
+
+    /** @return The slot for node nid, or nullptr if the call was not sent to it */
+    slot_t* find(const node_id_t& nid) {
+        if(map_status != MAP_READY) {
+            return nullptr;
+        }
+        auto position = std::lower_bound(nodes.begin(), nodes.end(), nid);
+        if(position == nodes.end() || *position != nid) {
+            return nullptr;
+        }
+        return &slots[position - nodes.begin()];
+    }
+
+    slot_t* slots_begin() {
+        return slots.get();
+    }
+
+    slot_t* slots_end() {
+        return slots.get() + (map_status == MAP_READY ? nodes.size() : 0);
+    }
+
+    /**
+     * Records node nid's reply. If the set of destination nodes is not known
+     * yet, this waits for it, because nid's slot is not known until then.
+     * @return False if there is no slot for nid or it already has a reply
+     */
+    template <typename V>
+    bool set_value(const node_id_t& nid, V&& v) {
+        slot_t* slot = claim_slot(nid);
+        if(!slot) {
+            return false;
+        }
+        slot->second.value.emplace(std::forward<V>(v));
+        slot->second.status = ReplySlot<Ret>::HAS_VALUE;
+        reply_arrived(*slot);
+        return true;
+    }
+
+    /**
+     * Records that node nid replied with an exception, or will not reply.
+     * @return False if there is no slot for nid or it already has a reply
+     */
+    bool set_exception(const node_id_t& nid, std::exception_ptr e) {
+        slot_t* slot = claim_slot(nid);
+        if(!slot) {
+            return false;
+        }
+        slot->second.exception = e;
+        slot->second.status = ReplySlot<Ret>::HAS_EXCEPTION;
+        reply_arrived(*slot);
+        return true;
+    }
+
+    /** Sets the exception for every node that has not replied yet */
+    void set_exception_for_outstanding(std::exception_ptr e) {
+        //The loop may complete the call before it reaches the last node
+        num_users.fetch_add(1, std::memory_order_relaxed);
+        for(const node_id_t& nid : nodes) {
+            set_exception(nid, e);
+        }
+        num_users.fetch_sub(1, std::memory_order_release);
     }
 };
 
 /**
- * Specialization of QueryResults for void functions, which do not generate
- * replies. Here the "reply map" is actually a set, and simply records the set
- * of nodes to which the RPC was sent. The internal ReplyMap is fulfilled when
- * the set of nodes that received the RPC is known, which is when the RPC
- * message was delivered in the current View.
+ * A shared reference to a ReplyState from the caller's side of the call: its
+ * QueryResults, or a reply callback queued on an executor. While one exists,
+ * the PendingResults that owns the state does not reuse it for another call.
+ * Dropping the reference publishes, with release ordering, everything its
+ * holder did with the state.
  */
-template <>
-class QueryResults<void> {
-public:
-    using map_fut = std::future<std::unique_ptr<std::set<node_id_t>>>;
-    using map = std::set<node_id_t>;
-    using type = void;
-
-    class ReplyMap {
-    private:
-        QueryResults& parent;
+template <typename Ret>
+class ReplyStateRef {
+    std::shared_ptr<ReplyState<Ret>> state;
 
-    public:
-        map rmap;
+public:
+    explicit ReplyStateRef(std::shared_ptr<ReplyState<Ret>> state) : state(std::move(state)) {
+        if(this->state) {
+            this->state->num_users.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    ReplyStateRef(const ReplyStateRef& other) : ReplyStateRef(other.state) {}
+    ReplyStateRef(ReplyStateRef&& other) : state(std::move(other.state)) {}
+    ReplyStateRef& operator=(const ReplyStateRef&) = delete;
+    ~ReplyStateRef() {
+        if(state) {
+            state->num_users.fetch_sub(1, std::memory_order_release);
+        }
+    }
 
-        ReplyMap(QueryResults& qr) : parent(qr){};
-        ReplyMap(const ReplyMap&) = delete;
-        ReplyMap(ReplyMap&& rm) : parent(rm.parent), rmap(std::move(rm.rmap)) {}
+    ReplyState<Ret>* get() const {
+        return state.get();
+    }
+    ReplyState<Ret>* operator->() const {
+        return state.get();
+    }
+};
 
-        bool valid(const node_id_t& nid) {
-            assert(rmap.size() == 0 || rmap.count(nid) != 0);
-            return (rmap.size() > 0) && rmap.count(nid) > 0;
-        }
+bool ReplyMap<void>::valid(const node_id_t& nid) {
+    assert(state->size() == 0 || state->contains(nid));
+    return state->contains(nid);
+}
 
-        /*
-          returns true if we sent to this node,
-          regardless of whether this node has replied.
-        */
-        bool contains(const node_id_t& nid) { return rmap.count(nid); }
+bool ReplyMap<void>::contains(const node_id_t& nid) {
+    return state->contains(nid);
+}
 
-        auto begin() { return std::begin(rmap); }
+std::vector<node_id_t>::const_iterator ReplyMap<void>::begin() {
+    return state->get_nodes().begin();
+}
 
-        auto end() { return std::end(rmap); }
-    };
+std::vector<node_id_t>::const_iterator ReplyMap<void>::end() {
+    return state->get_nodes().end();
+}
 
-    map_fut pending_rmap;
+/**
+ * Data structure that (indirectly) holds a set of futures for a single RPC
+ * function call; there is one future for each node contacted to make the
+ * call, and it will eventually contain that node's reply. The futures are
+ * actually stored inside an internal struct of type ReplyMap, which can be
+ * retrieved with the get() method. The ReplyMap will not be returned until
+ * it is "fulfilled" by the sender, which should happen when the RPC call
+ * is delivered in the current View (and thus, the current View is the set
+ * of nodes who should reply to the RPC). For a void function, the ReplyMap
+ * is just the set of nodes to which the RPC was delivered.
+ * @tparam Ret The return type of the RPC function that this query invoked
+ */
+template <typename Ret>
+class QueryResults {
+public:
+    using type = Ret;
+    using ReplyMap = rpc::ReplyMap<Ret>;
 
 private:
-    ReplyMap replies{*this};
+    ReplyStateRef<Ret> state;
+    ReplyMap replies;
 
 public:
-    QueryResults(map_fut pm) : pending_rmap(std::move(pm)) {}
+    QueryResults(std::shared_ptr<ReplyState<Ret>> state)
+            : state(std::move(state)),
+              replies(this->state.get()) {}
     QueryResults(QueryResults&& o)
-            : pending_rmap{std::move(o.pending_rmap)},
-              replies{std::move(o.replies)} {}
+            : state{std::move(o.state)},
+              replies{state.get()} {}
     QueryResults(const QueryResults&) = delete;
 
     /**
@@ -301,14 +740,11 @@ public:
      */
     template <typename Time>
     ReplyMap* wait(Time t) {
-        if(replies.rmap.size() == 0) {
-            if(pending_rmap.wait_for(t) == std::future_status::ready) {
-                replies.rmap = std::move(*pending_rmap.get());
-                return &replies;
-            } else
-                return nullptr;
-        } else
-            return &replies;
+        if(!state->wait_until([this]() { return state->is_settled(); }, t)) {
+            return nullptr;
+        }
+        state->check_failed();
+        return &replies;
     }
 
     /**
@@ -317,15 +753,99 @@ public:
      * scope, and cannot be copied.
      */
     ReplyMap& get() {
-        using namespace std::chrono;
-        while(true) {
-            if(auto rmap = wait(5min)) {
-                return *rmap;
-            }
-        }
+        state->wait_for_map();
+        state->check_failed();
+        return replies;
+    }
+
+    /**
+     * Registers a function to be called with the ReplyMap once every node has
+     * replied, instead of blocking for the replies. If they are all in
+     * already, the function is called right away. Otherwise it is called on
+     * the RPC thread that receives the last reply, so it must not block, and
+     * any exceptions it throws are not caught. It may be called after this
+     * QueryResults has gone out of scope, but the ReplyMap it is given is only
+     * valid during the call. If the call could not be sent, calling get() on
+     * the ReplyMap's entries rethrows the reason.
+     */
+    void then(std::function<void(ReplyMap&)> callback) {
+        state->on_complete([callback = std::move(callback)](ReplyState<Ret>& completed_state) {
+            ReplyMap reply_map(&completed_state);
+            callback(reply_map);
+        });
+    }
+
+    /**
+     * Same as then(std::function<void(ReplyMap&)>), but the callback is run
+     * on one of executor's threads rather than the RPC thread, so it may
+     * block. The ReplyMap it is given remains valid until it returns.
+     */
+    void then(std::function<void(ReplyMap&)> callback, CallbackExecutor& executor) {
+        state->on_complete([callback = std::move(callback), &executor](ReplyState<Ret>& completed_state) {
+            executor.post([callback, state = ReplyStateRef<Ret>(completed_state.shared_from_this())]() {
+                ReplyMap reply_map(state.get());
+                callback(reply_map);
+            });
+        });
+    }
+
+    /**
+     * Registers a function to be called on one of executor's threads with
+     * each node's ID and ReplySlot as soon as that node's reply arrives, so
+     * the caller can act on the first replies without waiting for the rest.
+     * Calling get() on the slot returns the reply without blocking, or
+     * rethrows the exception that took its place. Only one such function can
+     * be registered per call. For void functions, which get no replies, use
+     * then() instead.
+     */
+    void for_each_reply(std::function<void(node_id_t, ReplySlot<Ret>&)> callback, CallbackExecutor& executor) {
+        static_assert(!std::is_void<Ret>::value, "Void RPC functions do not send replies");
+        state->on_each_reply([callback = std::move(callback), &executor](ReplyState<Ret>& reply_state,
+                                                                         typename ReplyState<Ret>::slot_t& slot) {
+            executor.post([callback, &slot, state = ReplyStateRef<Ret>(reply_state.shared_from_this())]() {
+                callback(slot.first, slot.second);
+            });
+        });
     }
 };
 
+/**
+ * Arranges for callback to be run on executor's threads when the replies to
+ * an RPC call arrive. If callback accepts a ReplyMap, it is called once with
+ * all the replies, as with QueryResults::then; if it accepts a node ID and a
+ * ReplySlot, it is called once per reply, as with
+ * QueryResults::for_each_reply.
+ */
+template <typename Ret, typename Callback>
+void run_on_replies(QueryResults<Ret>& results, Callback&& callback, CallbackExecutor& executor) {
+    if constexpr(std::is_invocable<Callback, typename QueryResults<Ret>::ReplyMap&>::value) {
+        results.then(std::forward<Callback>(callback), executor);
+    } else {
+        static_assert(std::is_invocable<Callback, node_id_t, ReplySlot<Ret>&>::value,
+                      "An RPC reply callback must accept either a ReplyMap& or a node_id_t and a ReplySlot&");
+        results.for_each_reply(std::forward<Callback>(callback), executor);
+    }
+}
+
+/**
+ * Runs callback as run_on_replies would for a call to nodes that could not be
+ * sent: every node's reply is the exception e, so calling get() on it
+ * rethrows e. For a void function there are no replies to carry e, so the
+ * callback gets an empty ReplyMap.
+ */
+template <typename Ret, typename Callback>
+void run_on_failure(const node_list_t& nodes, std::exception_ptr e, Callback&& callback, CallbackExecutor& executor) {
+    auto failed_state = std::make_shared<ReplyState<Ret>>();
+    if constexpr(std::is_void<Ret>::value) {
+        failed_state->fail(e);
+    } else {
+        failed_state->fulfill(nodes);
+        failed_state->set_exception_for_outstanding(e);
+    }
+    QueryResults<Ret> results(failed_state);
+    run_on_replies(results, std::forward<Callback>(callback), executor);
+}
+
 /**
  * Abstract base type for PendingResults. This allows us to store a pointer to
  * any template specialization of PendingResults without knowing the template
@@ -342,63 +862,39 @@ public:
 };
 
 /**
- * Data structure that holds a set of promises for a single RPC function call;
- * the promises transmit one response (either a value or an exception) for
- * each node that was called. The future ends of these promises are stored in
- * a corresponding QueryResults object.
+ * Data structure that records the responses to a single RPC function call,
+ * one response (either a value or an exception) for each node that was
+ * called, in the ReplyState it shares with the corresponding QueryResults.
+ * The RemoteInvoker keeps a fixed array of these and reuses them, and each
+ * one reuses its ReplyState too once the caller has dropped the QueryResults
+ * for the previous call, so an RPC call normally allocates nothing here.
  * @tparam Ret The return type of the RPC function, which is the type of a
  * response's value.
  */
 template <typename Ret>
 class PendingResults : public PendingBase {
 private:
-    /** A promise for a map containing one future for each reply to the RPC function
-     * call. The future end of this promise lives in QueryResults, and is fulfilled
-     * when the RPC function call is actually sent and the set of repliers is known. */
-    std::promise<std::unique_ptr<reply_map<Ret>>> promise_for_pending_map;
-
-    std::promise<std::map<node_id_t, std::promise<Ret>>> promise_for_reply_promises;
-    /** A future for a map containing one promise for each reply to the RPC function
-     * call. It will be fulfilled when fulfill_map is called, which means the RPC
-     * function call was actually sent and the set of destination nodes is known. */
-    std::future<std::map<node_id_t, std::promise<Ret>>> reply_promises_are_ready;
-    std::mutex reply_promises_are_ready_mutex;
-    std::map<node_id_t, std::promise<Ret>> reply_promises;
-
-    bool map_fulfilled = false;
-    std::set<node_id_t> dest_nodes, responded_nodes;
+    std::shared_ptr<ReplyState<Ret>> state;
 
 public:
-    PendingResults()
-            : reply_promises_are_ready(promise_for_reply_promises.get_future()) {}
     virtual ~PendingResults() {}
 
     /**
      * Constructs and returns a QueryResults representing the "future" end of
-     * the response promises in this PendingResults.
+     * the responses in this PendingResults.
      * @return A new QueryResults holding a set of futures for this RPC function call
      */
     QueryResults<Ret> get_future() {
-        return QueryResults<Ret>{promise_for_pending_map.get_future()};
+        return QueryResults<Ret>{state};
     }
 
     /**
-     * Fill pending_map and reply_promises with one promise/future pair for
-     * each node that was contacted in this RPC call
+     * Sets up one reply slot for each node that was contacted in this RPC call
      * @param who A list of nodes from which to expect responses.
      */
     void fulfill_map(const node_list_t& who) {
         dbg_default_trace("Got a call to fulfill_map for PendingResults<{}>", typeid(Ret).name());
-        std::unique_ptr<reply_map<Ret>> futures_map = std::make_unique<reply_map<Ret>>();
-        std::map<node_id_t, std::promise<Ret>> promises_map;
-        for(const auto& e : who) {
-            futures_map->emplace(e, promises_map[e].get_future());
-        }
-        dest_nodes.insert(who.begin(), who.end());
-        dbg_default_trace("Setting a value for reply_promises_are_ready");
-        promise_for_reply_promises.set_value(std::move(promises_map));
-        promise_for_pending_map.set_value(std::move(futures_map));
-        map_fulfilled = true;
+        state->fulfill(who);
     }
 
     /**
@@ -406,63 +902,44 @@ public:
      * removed from its subgroup/shard, and can no longer expect responses.
      */
     void set_exception_for_caller_removed() {
-        if(!map_fulfilled) {
-            promise_for_pending_map.set_exception(
-                    std::make_exception_ptr(sender_removed_from_group_exception{}));
-        } else {
-            if(reply_promises.size() == 0) {
-                reply_promises = std::move(reply_promises_are_ready.get());
-            }
+        if(!state->is_fulfilled()) {
+            state->fail(std::make_exception_ptr(sender_removed_from_group_exception{}));
+        } else if constexpr(!std::is_void<Ret>::value) {
             //Set exceptions for any nodes that have not yet responded
-            for(auto& node_and_promise : reply_promises) {
-                if(responded_nodes.find(node_and_promise.first)
-                   == responded_nodes.end()) {
-                    node_and_promise.second.set_exception(
-                            std::make_exception_ptr(sender_removed_from_group_exception{}));
-                }
-            }
+            state->set_exception_for_outstanding(
+                    std::make_exception_ptr(sender_removed_from_group_exception{}));
         }
     }
 
     void set_exception_for_removed_node(const node_id_t& removed_nid) {
-        assert(map_fulfilled);
-        if(dest_nodes.find(removed_nid) != dest_nodes.end()
-           && responded_nodes.find(removed_nid) == responded_nodes.end()) {
-            set_exception(removed_nid,
-                          std::make_exception_ptr(
-                                  node_removed_from_group_exception{removed_nid}));
+        assert(state->is_fulfilled());
+        if constexpr(!std::is_void<Ret>::value) {
+            state->set_exception(removed_nid,
+                                 std::make_exception_ptr(
+                                         node_removed_from_group_exception{removed_nid}));
         }
     }
 
     /**
-     * Fulfills a promise for a single node's reply by setting the value that
-     * the node returned for the RPC call
+     * Fulfills the reply slot for a single node by setting the value that
+     * the node returned for the RPC call. If the RPC call has not been
+     * delivered yet, this waits until the set of destination nodes is known.
      * @param nid The node that responded to the RPC call
      * @param v The value that it returned as the result of the RPC function
      */
-    void set_value(const node_id_t& nid, const Ret& v) {
-        std::lock_guard<std::mutex> lock(reply_promises_are_ready_mutex);
-        responded_nodes.insert(nid);
-        if(reply_promises.size() == 0) {
-            dbg_default_trace("PendingResults<{}>::set_value about to wait on reply_promises_are_ready", typeid(Ret).name());
-            dbg_default_flush();
-            reply_promises = std::move(reply_promises_are_ready.get());
-        }
-        reply_promises.at(nid).set_value(v);
+    template <typename V>
+    void set_value(const node_id_t& nid, V&& v) {
+        state->set_value(nid, std::forward<V>(v));
     }
 
     /**
-     * Fulfills a promise for a single node's reply by setting an exception that
+     * Fulfills the reply slot for a single node by setting an exception that
      * was thrown by the RPC function call.
      * @param nid The node that responded to the RPC call with an exception
      * @param e The exception_ptr that the RPC function call returned
      */
     void set_exception(const node_id_t& nid, const std::exception_ptr e) {
-        responded_nodes.insert(nid);
-        if(reply_promises.size() == 0) {
-            reply_promises = std::move(reply_promises_are_ready.get());
-        }
-        reply_promises.at(nid).set_exception(e);
+        state->set_exception(nid, e);
     }
 
     /**
@@ -470,72 +947,66 @@ public:
      * responded, either by sending a reply or by being removed from the group
      */
     bool all_responded() const {
-        return map_fulfilled && (responded_nodes == dest_nodes);
+        return state->is_fulfilled() && state->is_complete();
     }
 
     /**
-     * reset this object.
+     * reset this object. The ReplyState is reused if the last call is over
+     * and its QueryResults and reply callbacks are gone; otherwise it is left
+     * to them.
      */
     void reset() {
-        promise_for_pending_map = std::promise<std::unique_ptr<reply_map<Ret>>>();
-        promise_for_reply_promises = std::promise<std::map<node_id_t, std::promise<Ret>>>();
-        reply_promises_are_ready = promise_for_reply_promises.get_future();
-        // reply_promises_are_ready_mutex
-        reply_promises.clear();
-        map_fulfilled = false;
-        dest_nodes.clear();
-        responded_nodes.clear();
+        if(state && state->is_reusable()) {
+            state->reset();
+        } else {
+            state = std::make_shared<ReplyState<Ret>>();
+        }
     }
 };
 
+template <typename T>
+struct is_std_tuple : std::false_type {};
+template <typename... Ts>
+struct is_std_tuple<std::tuple<Ts...>> : std::true_type {};
+
 /**
- * Specialization of PendingResults for void functions, which do not generate
- * replies. Its only functionality is to fulfill the "reply map" in its
- * corresponding QueryResults<void>, which is just a set of nodes to which the
- * RPC message was delivered.
+ * Gets the arguments of one call in a batch of P2P sends as a tuple. An
+ * element of the batch that is a std::tuple holds all the arguments of its
+ * call; any other element is the only argument (so a call whose only argument
+ * is itself a tuple must wrap it in another one).
  */
-template <>
-class PendingResults<void> : public PendingBase {
-private:
-    std::promise<std::unique_ptr<std::set<node_id_t>>> promise_for_pending_map;
-    bool map_fulfilled = false;
-
-public:
-    QueryResults<void> get_future() {
-        return QueryResults<void>(promise_for_pending_map.get_future());
-    }
-
-    void fulfill_map(const node_list_t& sent_nodes) {
-        auto nodes_sent_set = std::make_unique<std::set<node_id_t>>();
-        for(const node_id_t& node : sent_nodes) {
-            nodes_sent_set->emplace(node);
-        }
-        promise_for_pending_map.set_value(std::move(nodes_sent_set));
-        map_fulfilled = true;
+template <typename Element>
+decltype(auto) batch_call_args(const Element& element) {
+    if constexpr(is_std_tuple<Element>::value) {
+        return (element);
+    } else {
+        return std::forward_as_tuple(element);
     }
+}
 
-    void set_exception_for_removed_node(const node_id_t&) {}
+/**
+ * Utility functions for manipulating the headers of RPC messages
+ */
+/**
+ * True for the types whose serialized size mutils::bytes_size computes without
+ * walking the value: PODs, strings, and vectors of PODs. RPC arguments and
+ * results of these types are sized and then written straight into the
+ * message; any other type is serialized once into a staging buffer, which
+ * gives its size, and copied into the message from there. Specialize it for
+ * a ByteRepresentable class whose bytes_size() takes constant time.
+ */
+template <typename T>
+struct sized_without_walk : std::is_pod<T> {};
 
-    void set_exception_for_caller_removed() {
-        if(!map_fulfilled) {
-            promise_for_pending_map.set_exception(
-                    std::make_exception_ptr(sender_removed_from_group_exception()));
-        }
-    }
+template <>
+struct sized_without_walk<std::string> : std::true_type {};
 
-    bool all_responded() const {
-        return map_fulfilled;
-    }
+template <typename T>
+struct sized_without_walk<std::vector<T>> : std::is_pod<T> {};
 
-    void reset() {
-        promise_for_pending_map = std::promise<std::unique_ptr<std::set<node_id_t>>>();
-        map_fulfilled = false;
-    }
-};
+template <typename... Ts>
+constexpr bool all_sized_without_walk = (true && ... && sized_without_walk<std::decay_t<Ts>>::value);
 
-/**
- * Utility functions for manipulating the headers of RPC messages
- */
 namespace remote_invocation_utilities {
 #define RPC_HEADER_FLAG_TST(f, name) \
     ((f) & (((uint32_t)1L) << (_RPC_HEADER_FLAG_##name)))
@@ -546,7 +1017,12 @@ namespace remote_invocation_utilities {
 
 // add new rpc header flags here.
 #define _RPC_HEADER_FLAG_CASCADE (0)
-#define _RPC_HEADER_FLAG_RESERVED (1)
+// the message is one piece of a reply too large for a single P2P slot
+#define _RPC_HEADER_FLAG_CHUNK (1)
+// the message is a P2P request that fills a slot given back by its sender; it
+// only gets a null reply, which returns the sender's credit for the slot
+#define _RPC_HEADER_FLAG_NOOP (2)
+#define _RPC_HEADER_FLAG_RESERVED (3)
 
 inline std::size_t header_space() {
     return sizeof(std::size_t) + sizeof(Opcode) + sizeof(node_id_t) + sizeof(uint32_t);
@@ -587,6 +1063,68 @@ inline void retrieve_header(mutils::RemoteDeserialization_v* rdv,
     offset += sizeof(from);
     flags = reinterpret_cast<const uint32_t*>(reply_buf + offset)[0];
 }
+
+/**
+ * A growable buffer that RPC arguments and results are serialized into when
+ * they can only be sized by walking them. The buffer is kept between
+ * messages, unless a large message made it grow past retain_size.
+ */
+class StagingBuffer {
+    std::unique_ptr<char[]> buffer;
+    std::size_t capacity = 0;
+    std::size_t used = 0;
+
+public:
+    /** Buffers that grew larger than this are freed by trim() */
+    static constexpr std::size_t retain_size = 1024 * 1024;
+
+    const char* data() const { return buffer.get(); }
+    std::size_t size() const { return used; }
+    void clear() { used = 0; }
+
+    void append(char const* const bytes, std::size_t size) {
+        if(used + size > capacity) {
+            const std::size_t new_capacity = std::max(2 * capacity, used + size);
+            std::unique_ptr<char[]> new_buffer(new char[new_capacity]);
+            if(used > 0) {
+                memcpy(new_buffer.get(), buffer.get(), used);
+            }
+            buffer = std::move(new_buffer);
+            capacity = new_capacity;
+        }
+        memcpy(buffer.get() + used, bytes, size);
+        used += size;
+    }
+
+    /** Empties the buffer, and frees it if it grew past retain_size. */
+    void trim() {
+        used = 0;
+        if(capacity > retain_size) {
+            buffer.reset();
+            capacity = 0;
+        }
+    }
+};
+
+/**
+ * Serializes the values one after another into staging, replacing its
+ * contents. Each value is walked once, and the size of staging afterwards is
+ * their serialized size, so they need not be sized with bytes_size first.
+ */
+template <typename... Values>
+void serialize_to_staging(StagingBuffer& staging, const Values&... values) {
+    staging.clear();
+    const std::function<void(char const* const, std::size_t)> append = [&staging](char const* const bytes, std::size_t size) {
+        staging.append(bytes, size);
+    };
+    (mutils::post_object(append, values), ...);
+}
+
+/** The staging buffer of the calling thread, for messages that are built where they are serialized */
+inline StagingBuffer& thread_staging_buffer() {
+    thread_local StagingBuffer staging;
+    return staging;
+}
 }  // namespace remote_invocation_utilities
 
 }  // namespace rpc
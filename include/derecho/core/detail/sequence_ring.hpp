@@ -0,0 +1,151 @@
+/**
+ * @file sequence_ring.hpp
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace derecho {
+
+/**
+ * A store for values keyed by a dense, non-negative sequence number, such as
+ * the messages inside a subgroup's delivery window. The value for sequence
+ * number seq lives in slot (seq % capacity), so inserting, finding and erasing
+ * an entry never allocates and never chases pointers. Since the sequence
+ * numbers that are live at the same time are bounded by the sending window,
+ * the capacity chosen at construction is normally enough; if an insertion does
+ * collide with a different live sequence number, the ring doubles its capacity
+ * rather than overwrite the older entry.
+ */
+template <typename T, typename Seq = int32_t>
+class SequenceRing {
+private:
+    /** The sequence number stored in each slot, or -1 if the slot is empty */
+    std::vector<Seq> keys;
+    std::vector<T> values;
+    std::size_t count;
+    /** The lowest and highest sequence numbers currently stored, valid only if count > 0 */
+    Seq min_seq;
+    Seq max_seq;
+
+    std::size_t slot_of(Seq seq_num) const {
+        return static_cast<std::size_t>(seq_num) % keys.size();
+    }
+
+    void grow() {
+        std::vector<Seq> old_keys = std::move(keys);
+        std::vector<T> old_values = std::move(values);
+        keys.assign(old_keys.size() * 2, -1);
+        values = std::vector<T>(old_values.size() * 2);
+        for(std::size_t i = 0; i < old_keys.size(); ++i) {
+            if(old_keys[i] != -1) {
+                keys[slot_of(old_keys[i])] = old_keys[i];
+                values[slot_of(old_keys[i])] = std::move(old_values[i]);
+            }
+        }
+    }
+
+public:
+    explicit SequenceRing(std::size_t capacity = 1)
+            : keys(capacity > 0 ? capacity : 1, -1),
+              values(capacity > 0 ? capacity : 1),
+              count(0),
+              min_seq(0),
+              max_seq(0) {}
+    SequenceRing(SequenceRing&&) = default;
+    SequenceRing& operator=(SequenceRing&&) = default;
+
+    bool empty() const { return count == 0; }
+    std::size_t size() const { return count; }
+    std::size_t capacity() const { return keys.size(); }
+
+    /** Returns a pointer to the value stored for seq_num, or nullptr if there is none. */
+    T* find(Seq seq_num) {
+        const std::size_t slot = slot_of(seq_num);
+        return keys[slot] == seq_num ? &values[slot] : nullptr;
+    }
+
+    /** Stores value under seq_num, replacing any value already stored for seq_num. */
+    T& insert(Seq seq_num, T value) {
+        assert(seq_num >= 0);
+        while(keys[slot_of(seq_num)] != -1 && keys[slot_of(seq_num)] != seq_num) {
+            grow();
+        }
+        const std::size_t slot = slot_of(seq_num);
+        if(keys[slot] == -1) {
+            if(count == 0) {
+                min_seq = max_seq = seq_num;
+            } else {
+                min_seq = std::min(min_seq, seq_num);
+                max_seq = std::max(max_seq, seq_num);
+            }
+            count++;
+        }
+        keys[slot] = seq_num;
+        values[slot] = std::move(value);
+        return values[slot];
+    }
+
+    /** Removes the value stored for seq_num, if there is one. */
+    void erase(Seq seq_num) {
+        const std::size_t slot = slot_of(seq_num);
+        if(keys[slot] != seq_num) {
+            return;
+        }
+        keys[slot] = -1;
+        values[slot] = T{};
+        count--;
+        if(count > 0 && seq_num == min_seq) {
+            while(keys[slot_of(min_seq)] != min_seq) {
+                min_seq++;
+            }
+        } else if(count > 0 && seq_num == max_seq) {
+            while(keys[slot_of(max_seq)] != max_seq) {
+                max_seq--;
+            }
+        }
+    }
+
+    /** The lowest sequence number currently stored. The ring must not be empty. */
+    Seq front_seq() const {
+        assert(count > 0);
+        return min_seq;
+    }
+
+    /** The value with the lowest sequence number currently stored. The ring must not be empty. */
+    T& front() {
+        assert(count > 0);
+        return values[slot_of(min_seq)];
+    }
+
+    void clear() {
+        for(std::size_t slot = 0; slot < keys.size(); ++slot) {
+            if(keys[slot] != -1) {
+                keys[slot] = -1;
+                values[slot] = T{};
+            }
+        }
+        count = 0;
+    }
+
+    /** Calls f(seq_num, value) on each stored value, in increasing order of sequence number. */
+    template <typename F>
+    void for_each(F&& f) {
+        if(count == 0) {
+            return;
+        }
+        for(Seq seq_num = min_seq; seq_num <= max_seq; ++seq_num) {
+            T* value = find(seq_num);
+            if(value) {
+                f(seq_num, *value);
+            }
+        }
+    }
+};
+
+}  // namespace derecho
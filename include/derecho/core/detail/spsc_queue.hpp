@@ -0,0 +1,62 @@
+/**
+ * @file spsc_queue.hpp
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace derecho {
+
+/**
+ * A bounded queue that hands values from exactly one producer thread to
+ * exactly one consumer thread without taking a lock. The producer only writes
+ * tail and the consumer only writes head, so a push and a pop never contend
+ * for the same cache line. The indices are updated with sequentially
+ * consistent stores, as a QueueWorker requires.
+ */
+template <typename T>
+class SPSCQueue {
+private:
+    /** One slot more than the capacity, so that a full queue can be told from an empty one */
+    std::vector<T> slots;
+    /** The index of the next value to pop; written only by the consumer */
+    alignas(64) std::atomic<std::size_t> head{0};
+    /** The index of the next free slot; written only by the producer */
+    alignas(64) std::atomic<std::size_t> tail{0};
+
+public:
+    explicit SPSCQueue(std::size_t capacity) : slots(capacity + 1) {}
+
+    /** Called by the producer. Returns false, without moving value, if the queue is full. */
+    bool push(T&& value) {
+        const std::size_t current_tail = tail.load(std::memory_order_relaxed);
+        const std::size_t next_tail = (current_tail + 1) % slots.size();
+        if(next_tail == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots[current_tail] = std::move(value);
+        tail.store(next_tail);
+        return true;
+    }
+
+    /** Called by the consumer. Returns false if the queue is empty. */
+    bool pop(T& value) {
+        const std::size_t current_head = head.load(std::memory_order_relaxed);
+        if(current_head == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = std::move(slots[current_head]);
+        head.store((current_head + 1) % slots.size());
+        return true;
+    }
+
+    bool empty() const {
+        return head.load() == tail.load();
+    }
+};
+
+}  // namespace derecho
@@ -98,6 +98,18 @@ private:
     persistent::version_t next_version = INVALID_VERSION;
     uint64_t next_timestamp_us = 0;
 
+    /**
+     * Submits an ordered_send_async call to the multicast group without
+     * waiting for a send buffer. If the view is wedged before the message is
+     * sent, it is resubmitted from a callback thread once the next view is
+     * installed, and no thread waits for that view in the meantime; if it
+     * cannot be sent at all, the callback gets the exception.
+     * @param call The callback and a tuple of the arguments to the RPC function
+     * @tparam Ret The return type of the RPC function
+     */
+    template <rpc::FunctionTag tag, typename Ret, typename Call>
+    void submit_ordered_send_async(std::shared_ptr<Call> call);
+
 public:
     /**
      * Constructs a Replicated<T> that enables sending and receiving RPC
@@ -183,6 +195,23 @@ public:
     template <rpc::FunctionTag tag, typename... Args>
     auto p2p_send(node_id_t dest_node, Args&&... args);
 
+    /**
+     * Sends a batch of peer-to-peer messages to a single member of the
+     * subgroup that replicates this Replicated<T>, each invoking the RPC
+     * function identified by the FunctionTag template parameter. Instead of
+     * waiting for a free slot before each message, this reserves as many
+     * slots as are free (up to the number of messages left), fills them all,
+     * and sends them together, so the requests are pipelined up to the P2P
+     * window size.
+     * @param dest_node The ID of the node that the P2P messages should be sent to
+     * @param args_range A range with one element per call; an element is the
+     * call's only argument, or a std::tuple of its arguments
+     * @return A std::vector of rpc::QueryResults<Ret>, one per call in the
+     * order of args_range, where Ret is the return type of the RPC function
+     */
+    template <rpc::FunctionTag tag, typename ArgsRange>
+    auto p2p_send_batch(node_id_t dest_node, const ArgsRange& args_range);
+
     /**
      * Sends a multicast to the entire subgroup that replicates this Replicated<T>,
      * invoking the RPC function identified by the FunctionTag template parameter.
@@ -195,6 +224,51 @@ public:
     template <rpc::FunctionTag tag, typename... Args>
     auto ordered_send(Args&&... args);
 
+    /**
+     * Sends a multicast to the entire subgroup like ordered_send, but only if
+     * it can be sent right away: if the send window is full (or the view is
+     * being changed), it returns an empty optional instead of waiting, and
+     * nothing is sent.
+     * @param args The arguments to the RPC function
+     * @return An std::optional<rpc::QueryResults<Ret>>, where Ret is the
+     * return type of the RPC function being invoked, that is empty if the
+     * message was not sent.
+     */
+    template <rpc::FunctionTag tag, typename... Args>
+    auto try_ordered_send(Args&&... args);
+
+    /**
+     * Sends a multicast to the entire subgroup like ordered_send, but instead
+     * of returning a QueryResults for the caller to block on, arranges for
+     * on_reply to be called on one of Derecho's RPC callback threads (see
+     * DERECHO/rpc_callback_threads) as the replies arrive. If on_reply accepts
+     * a QueryResults<Ret>::ReplyMap&, it is called once, when every member
+     * has replied; if it accepts a node_id_t and an rpc::ReplySlot<Ret>&, it
+     * is called once per member, as soon as that member's reply arrives.
+     * This never waits for the send window: the arguments are copied, and the
+     * message is serialized and sent once there is room for it. If it cannot
+     * be sent, on_reply is still called, and get() on each member's reply
+     * rethrows the reason.
+     * @param on_reply The function to call with the replies
+     * @param args The arguments to the RPC function
+     */
+    template <rpc::FunctionTag tag, typename Callback, typename... Args>
+    void ordered_send_async(Callback&& on_reply, Args&&... args);
+
+    /**
+     * Sends a peer-to-peer message like p2p_send, but instead of returning a
+     * QueryResults for the caller to block on, arranges for on_reply to be
+     * called on one of Derecho's RPC callback threads when the reply arrives,
+     * as in ordered_send_async. If there is no request credit for dest_node,
+     * the request is sent from a callback thread once there is one, so this
+     * never blocks; failures reach on_reply as in ordered_send_async.
+     * @param dest_node The ID of the node that the P2P message should be sent to
+     * @param on_reply The function to call with the reply
+     * @param args The arguments to the RPC function being invoked
+     */
+    template <rpc::FunctionTag tag, typename Callback, typename... Args>
+    void p2p_send_async(node_id_t dest_node, Callback&& on_reply, Args&&... args);
+
     /**
      * Submits a call to send a "raw" (byte array) message in a multicast to
      * this object's subgroup; the message will be generated by invoking msg_generator
@@ -345,6 +419,21 @@ public:
     template <rpc::FunctionTag tag, typename... Args>
     auto p2p_send(node_id_t dest_node, Args&&... args);
 
+    /**
+     * Sends a batch of peer-to-peer messages to a single member of the
+     * subgroup that this ExternalCaller<T> connects to, each invoking the RPC
+     * function identified by the FunctionTag template parameter. The messages
+     * are sent in groups as large as the free P2P slots allow, as in
+     * Replicated<T>::p2p_send_batch.
+     * @param dest_node The ID of the node that the P2P messages should be sent to
+     * @param args_range A range with one element per call; an element is the
+     * call's only argument, or a std::tuple of its arguments
+     * @return A std::vector of rpc::QueryResults<Ret>, one per call in the
+     * order of args_range, where Ret is the return type of the RPC function
+     */
+    template <rpc::FunctionTag tag, typename ArgsRange>
+    auto p2p_send_batch(node_id_t dest_node, const ArgsRange& args_range);
+
     bool is_valid() const { return true; }
 };
 
@@ -493,7 +493,7 @@ template <typename...T>
 void post_object(const std::function<void(char const *const, std::size_t)> &f,
                  const std::tuple<T...> &t) {
   //std::apply(std::bind(post_object_helper<T...>,f,/*variadic template?*/), t);
-  std::apply([f](T...args){
+  std::apply([&f](const T&...args){
       post_object_helper(f,args...);
     }, t);
 }
@@ -567,47 +567,44 @@ std::size_t to_bytes(const T &t, char *v) {
 std::size_t to_bytes(const std::vector<bool> &vec, char *v);
 
 template <typename T> std::size_t to_bytes(const std::vector<T> &vec, char *v) {
-  auto size = bytes_size(vec);
+  // post_to_buffer counts what it writes, so the size needs no separate walk
   std::size_t index = 0;
   post_object(post_to_buffer(index, v), vec);
-  return size;
+  return index;
 }
 
 template <typename T>
 std::size_t to_bytes(const std::list<T> &list, char *buffer) {
-  auto size = bytes_size(list);
   std::size_t offset = 0;
   post_object(post_to_buffer(offset, buffer), list);
-  return size;
+  return offset;
 }
 
 template <typename T, typename V>
 std::size_t to_bytes(const std::pair<T, V> &pair, char *buffer) {
   std::size_t index = 0;
   post_object(post_to_buffer(index, buffer), pair);
-  return bytes_size(pair);
+  return index;
 }
 
 template <typename...T>
 std::size_t to_bytes(const std::tuple<T...> &tuple, char *buffer) {
   std::size_t index = 0;
   post_object(post_to_buffer(index, buffer),tuple);
-  return bytes_size(tuple);
+  return index;
 }
 
 template <typename T> std::size_t to_bytes(const std::set<T> &s, char *_v) {
   std::size_t index = 0;
-  auto size = bytes_size(s);
   post_object(post_to_buffer(index, _v), s);
-  return size;
+  return index;
 }
 
 template <typename K, typename V>
 std::size_t to_bytes(const std::map<K, V> &m, char *buffer) {
   std::size_t index = 0;
-  std::size_t size = bytes_size(m);
   post_object(post_to_buffer(index, buffer), m);
-  return size;
+  return index;
 }
 // end to_bytes section
 
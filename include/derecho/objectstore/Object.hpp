@@ -24,6 +24,9 @@ using namespace std::chrono_literals;
 namespace objectstore {
 
 class Blob : public mutils::ByteRepresentable {
+    // true if bytes belongs to someone else, such as an RPC receive buffer
+    bool is_temporary;
+
 public:
     char* bytes;
     std::size_t size;
@@ -31,6 +34,10 @@ public:
     // constructor - copy to own the data
     Blob(const char* const b, const decltype(size) s);
 
+    // view constructor - refer to data owned by someone else without copying
+    // it. The data must outlive the Blob; copies of the Blob own their data.
+    Blob(char* const b, const decltype(size) s, bool temporary);
+
     // copy constructor - copy to own the data
     Blob(const Blob& other);
 
@@ -60,11 +67,17 @@ public:
 
     static std::unique_ptr<Blob> from_bytes(mutils::DeserializationManager*, const char* const v);
 
-    // from_bytes_noalloc() implementation borrowed from mutils-serialization.
-    mutils::context_ptr<Blob> from_bytes_noalloc(
+    // from_bytes_noalloc() returns a view of the serialized bytes, so an RPC
+    // handler taking a const Blob& reads them straight from the receive buffer.
+    static mutils::context_ptr<Blob> from_bytes_noalloc(
         mutils::DeserializationManager* ctx,
-        const char* const v, 
+        const char* const v,
         mutils::context_ptr<Blob> = mutils::context_ptr<Blob>{});
+
+    static mutils::context_ptr<const Blob> from_bytes_noalloc_const(
+        mutils::DeserializationManager* ctx,
+        const char* const v,
+        mutils::context_ptr<const Blob> = mutils::context_ptr<const Blob>{});
 };
 
 using OID = uint64_t;
@@ -86,6 +99,9 @@ public:
     // constructor 0.5 : copy constructor
     Object(const std::tuple<persistent::version_t,uint64_t> _ver, const OID& _oid, const Blob& _blob);
 
+    // constructor 0.75 : move the blob in
+    Object(const std::tuple<persistent::version_t,uint64_t> _ver, const OID& _oid, Blob&& _blob);
+
     // constructor 1 : copy consotructor
     Object(const uint64_t _oid, const char* const _b, const std::size_t _s);
 
@@ -103,7 +119,20 @@ public:
     // constructor 4 : default invalid constructor
     Object();
 
-    DEFAULT_SERIALIZATION_SUPPORT(Object, ver, oid, blob);
+    DEFAULT_SERIALIZE(ver, oid, blob);
+    DEFAULT_DESERIALIZE(Object, ver, oid, blob);
+    void ensure_registered(mutils::DeserializationManager&) {}
+
+    // the blob of an Object deserialized without allocation is a view of the serialized bytes
+    static mutils::context_ptr<Object> from_bytes_noalloc(
+        mutils::DeserializationManager* ctx,
+        const char* const v,
+        mutils::context_ptr<Object> = mutils::context_ptr<Object>{});
+
+    static mutils::context_ptr<const Object> from_bytes_noalloc_const(
+        mutils::DeserializationManager* ctx,
+        const char* const v,
+        mutils::context_ptr<const Object> = mutils::context_ptr<const Object>{});
 };
 
 inline std::ostream& operator<<(std::ostream& out, const Blob& b) {
@@ -129,4 +158,15 @@ inline std::ostream& operator<<(std::ostream& out, const Object& o) {
 }
 
 }  // namespace objectstore
+
+namespace derecho {
+namespace rpc {
+// Sizing a Blob or an Object only adds up a few fixed-size fields, so RPCs
+// write them straight into the message rather than staging them first.
+template <>
+struct sized_without_walk<objectstore::Blob> : std::true_type {};
+template <>
+struct sized_without_walk<objectstore::Object> : std::true_type {};
+}  // namespace rpc
+}  // namespace derecho
 #endif  //OBJECT_HPP
@@ -1,9 +1,11 @@
 #ifndef FILE_PERSIST_LOG_HPP
 #define FILE_PERSIST_LOG_HPP
 
+#include "LogStorage.hpp"
 #include "PersistLog.hpp"
 #include "util.hpp"
 #include <derecho/utils/logger.hpp>
+#include <memory>
 #include <pthread.h>
 #include <string>
 
@@ -15,6 +17,9 @@ namespace persistent {
 #define SWAP_FILE_SUFFIX "swp"
 
 // meta header format
+// The meta file holds two copies (slots) of the header. They are written
+// alternately, each one stamped with a sequence number and a CRC, so a torn
+// write can only damage the older copy; load() picks the newest valid one.
 typedef union meta_header {
     struct {
         int64_t head;  // the head index
@@ -22,6 +27,8 @@ typedef union meta_header {
         int64_t ver;   // the latest version number.
                        // uint64_t d_head;  // the data head offset
                        // uint64_t d_tail;  // the data tail offset
+        uint64_t seq;  // number of times the header has been persisted; only valid in the file.
+        uint32_t crc;  // CRC of the fields above; only valid in the file.
     } fields;
     uint8_t bytes[256];
     bool operator==(const union meta_header& other) {
@@ -34,7 +41,7 @@ typedef union log_entry {
     struct {
         int64_t ver;     // version of the data
         uint64_t dlen;   // length of the data
-        uint64_t ofst;   // offset of the data in the memory buffer
+        uint64_t ofst;   // offset of the data in the data storage
         uint64_t hlc_r;  // realtime component of hlc
         uint64_t hlc_l;  // logic component of hlc
     } fields;
@@ -51,34 +58,31 @@ typedef union log_entry {
 #define MAX_LOG_SIZE (sizeof(LogEntry) * MAX_LOG_ENTRY)
 #define MAX_DATA_SIZE (this->m_iMaxDataSize)
 #define META_SIZE (sizeof(MetaHeader))
+#define NUM_META_SLOTS (2)
+#define META_FILE_SIZE (META_SIZE * NUM_META_SLOTS)
 
 // helpers:
 ///// READ or WRITE LOCK on LOG REQUIRED to use the following MACROs!!!!
 #define META_HEADER ((MetaHeader*)(&(this->m_currMetaHeader)))
 #define META_HEADER_PERS ((MetaHeader*)(&(this->m_persMetaHeader)))
-#define LOG_ENTRY_ARRAY ((LogEntry*)(this->m_pLog))
 
 #define NUM_USED_SLOTS (META_HEADER->fields.tail - META_HEADER->fields.head)
 // #define NUM_USED_SLOTS_PERS   (META_HEADER_PERS->tail - META_HEADER_PERS->head)
 #define NUM_FREE_SLOTS (MAX_LOG_ENTRY - 1 - NUM_USED_SLOTS)
 // #define NUM_FREE_SLOTS_PERS   (MAX_LOG_ENTRY - 1 - NUM_USERD_SLOTS_PERS)
 
-#define LOG_ENTRY_AT(idx) (LOG_ENTRY_ARRAY + (int)((idx) % MAX_LOG_ENTRY))
+#define LOG_ENTRY_OFST(idx) ((uint64_t)(idx) * sizeof(LogEntry))
+#define LOG_ENTRY_AT(idx) ((LogEntry*)this->m_pLogStorage->at(LOG_ENTRY_OFST(idx)))
 #define NEXT_LOG_ENTRY LOG_ENTRY_AT(META_HEADER->fields.tail)
-#define NEXT_LOG_ENTRY_PERS LOG_ENTRY_AT( \
-        MAX(META_HEADER_PERS->fields.tail, META_HEADER->fields.head))
 #define CURR_LOG_IDX ((NUM_USED_SLOTS == 0) ? -1 : META_HEADER->fields.tail - 1)
-#define LOG_ENTRY_DATA(e) ((void*)((uint8_t*)this->m_pData + (e)->fields.ofst % MAX_DATA_SIZE))
+#define LOG_ENTRY_DATA(e) (this->m_pDataStorage->at((e)->fields.ofst))
 
 #define NEXT_DATA_OFST ((CURR_LOG_IDX == -1) ? 0 : (LOG_ENTRY_AT(CURR_LOG_IDX)->fields.ofst + LOG_ENTRY_AT(CURR_LOG_IDX)->fields.dlen))
-#define NEXT_DATA ((void*)((uint64_t) this->m_pData + NEXT_DATA_OFST % MAX_DATA_SIZE))
-#define NEXT_DATA_PERS ((NEXT_LOG_ENTRY > NEXT_LOG_ENTRY_PERS) ? LOG_ENTRY_DATA(NEXT_LOG_ENTRY_PERS) : NULL)
 
 #define NUM_USED_BYTES ((NUM_USED_SLOTS == 0) ? 0 : (LOG_ENTRY_AT(CURR_LOG_IDX)->fields.ofst + LOG_ENTRY_AT(CURR_LOG_IDX)->fields.dlen - LOG_ENTRY_AT(META_HEADER->fields.head)->fields.ofst))
 #define NUM_FREE_BYTES (MAX_DATA_SIZE - NUM_USED_BYTES)
 
 #define PAGE_SIZE (getpagesize())
-#define ALIGN_TO_PAGE(x) ((void*)(((uint64_t)(x)) - ((uint64_t)(x)) % PAGE_SIZE))
 
 // declaration for binary search util. see cpp file for comments.
 template <typename TKey, typename KeyGetter>
@@ -103,16 +107,23 @@ protected:
     const uint64_t m_iMaxLogEntry;
     // max data size
     const uint64_t m_iMaxDataSize;
-
-    // the log file descriptor
-    int m_iLogFileDesc;
-    // the data file descriptor
-    int m_iDataFileDesc;
-
-    // memory mapped Log RingBuffer
-    void* m_pLog;
-    // memory mapped Data RingBuffer
-    void* m_pData;
+    // write the log and data files with O_DIRECT instead of msync(),
+    // see CONF_PERS_WRITE_MODE
+    const bool m_bDirectIO;
+    // the size of the buffers for the unwritten records with m_bDirectIO,
+    // see CONF_PERS_DIRECT_BUFFER_SIZE
+    const uint64_t m_iDirectBufferSize;
+    // size of the log and data segment files, or 0 for ring buffer files,
+    // see CONF_PERS_SEGMENT_SIZE
+    const uint64_t m_iSegmentSize;
+
+    // the meta file descriptor
+    int m_iMetaFileDesc;
+
+    // the log entries, indexed by LOG_ENTRY_OFST()
+    std::unique_ptr<LogStorage> m_pLogStorage;
+    // the data, indexed by the ofst field of the log entries
+    std::unique_ptr<LogStorage> m_pDataStorage;
     // read/write lock
     pthread_rwlock_t m_rwlock;
     // persistent lock
@@ -158,13 +169,29 @@ protected:
     // file failed.
     virtual void load() noexcept(false);
 
+    // give back the space of the trimmed log entries and data, we assume
+    // FPL_WRLOCK and FPL_PERS_LOCK are acquired.
+    virtual void release() noexcept(false);
+
     // reset the logs. This will remove the existing persisted data.
     virtual void reset() noexcept(false);
 
     // Persistent the Metadata header, we assume
-    // FPL_PERS_LOCK is acquired.
+    // FPL_PERS_LOCK is acquired. The header is written over the older of
+    // the two slots in the meta file and synced with fdatasync().
     virtual void persistMetaHeaderAtomically(MetaHeader*) noexcept(false);
 
+    /**
+     * Read the newest valid meta header slot from a meta file.
+     * A file that is exactly one header long is in the old format, with no
+     * sequence number or CRC; its header is returned with seq set to 0.
+     * @PARAM fd the meta file descriptor
+     * @PARAM header the header read from the file
+     * @RETURN false if the file cannot be read, has neither size, or has no
+     *         valid slot.
+     */
+    static bool readMetaHeader(int fd, MetaHeader& header) noexcept(true);
+
 public:
     //Constructor
     FilePersistLog(const std::string& name, const std::string& dataPath) noexcept(false);
@@ -185,6 +212,8 @@ public:
     virtual version_t getEarliestVersion() noexcept(false);
     virtual version_t getLatestVersion() noexcept(false);
     virtual const version_t getLastPersisted() noexcept(false);
+    virtual void pinEntries() noexcept(false);
+    virtual void unpinEntries() noexcept(false);
     virtual const void* getEntryByIndex(const int64_t& eno) noexcept(false);
     virtual const void* getEntry(const version_t& ver) noexcept(false);
     virtual const void* getEntry(const HLC& hlc) noexcept(false);
@@ -226,6 +255,13 @@ public:
                 FPL_PERS_UNLOCK;
                 throw e;
             }
+            try {
+                release();
+            } catch(uint64_t e) {
+                FPL_UNLOCK;
+                FPL_PERS_UNLOCK;
+                throw e;
+            }
             FPL_PERS_UNLOCK;
             //TODO:remove delete entries from the index. This is tricky because
             // HLC order and idex order does not agree with each other.
@@ -245,14 +281,13 @@ public:
     static const uint64_t getMinimumLatestPersistedVersion(const std::string& prefix);
 
 private:
-     /** verify the existence of the meta file */
-     bool checkOrCreateMetaFile() noexcept(false);
-
-     /** verify the existence of the log file */
-     bool checkOrCreateLogFile() noexcept(false);
+     /**
+      * Write META_HEADER to both slots of a new meta file, and replace the
+      * meta file with it. Used to create the meta file and to convert an
+      * old-format one. Note: requires FPL_PERS_LOCK.
+      */
+     void writeMetaFile() noexcept(false);
 
-     /** verify the existence of the data file */
-     bool checkOrCreateDataFile() noexcept(false);
 
     /**
      * Get the minimum index greater than a given version
@@ -341,10 +376,9 @@ private:
 #ifndef NDEBUG
     //dbg functions
     void dbgDumpMeta() {
-        dbg_default_trace("m_pData={0},m_pLog={1}", (void*)this->m_pData, (void*)this->m_pLog);
         dbg_default_trace("MEAT_HEADER:head={0},tail={1}", (int64_t)META_HEADER->fields.head, (int64_t)META_HEADER->fields.tail);
         dbg_default_trace("MEAT_HEADER_PERS:head={0},tail={1}", (int64_t)META_HEADER_PERS->fields.head, (int64_t)META_HEADER_PERS->fields.tail);
-        dbg_default_trace("NEXT_LOG_ENTRY={0},NEXT_LOG_ENTRY_PERS={1}", (void*)NEXT_LOG_ENTRY, (void*)NEXT_LOG_ENTRY_PERS);
+        dbg_default_trace("NEXT_LOG_ENTRY={0},NEXT_DATA_OFST={1}", (void*)NEXT_LOG_ENTRY, NEXT_DATA_OFST);
     }
 #endif  //NDEBUG
 };
@@ -0,0 +1,297 @@
+#ifndef LOG_STORAGE_HPP
+#define LOG_STORAGE_HPP
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace persistent {
+
+// LogStorage is the memory and the file(s) behind one of the two arrays of a
+// FilePersistLog: the log entries or their data. Bytes are addressed by
+// offsets that grow as the log grows; a storage maps them to memory and to
+// its files. The caller (FilePersistLog) serializes calls with its locks:
+// at() is called with the log read- or write-locked; place() and release()
+// with the log write-locked; flush() and release() under the persistent lock.
+// A reader may keep using an address from at() after unlocking the log, as
+// long as it pinned the storage first: memory the storage stops using while
+// it is pinned is only freed once the last pin is dropped.
+class LogStorage {
+private:
+    // protects m_iPins and m_retired
+    std::mutex m_pinMutex;
+    // the number of pins held
+    uint64_t m_iPins = 0;
+    // the memory to free once no pin is held
+    std::vector<std::shared_ptr<void>> m_retired;
+
+protected:
+    /** check if a pin is held. */
+    bool pinned();
+    /** free memory that readers may still use, now or once no pin is held. */
+    void retire(std::shared_ptr<void> memory);
+
+public:
+    virtual ~LogStorage() {}
+
+    /**
+     * Keep the addresses returned by at() valid until the matching unpin().
+     * Called without the log locks; calls may nest.
+     */
+    void pin();
+    void unpin();
+
+    /**
+     * Get the address of the byte at an offset. The bytes of a record placed
+     * with place() are contiguous in memory.
+     * @PARAM ofst the offset
+     * @RETURN the address, or nullptr if no memory holds that offset.
+     */
+    virtual void* at(const uint64_t& ofst) = 0;
+
+    /**
+     * Get the offset where a record should be written, and make sure there
+     * is memory for it.
+     * @PARAM ofst the offset right after the previous record
+     * @PARAM len the size of the record
+     * @RETURN the offset of the record, which is ofst or larger.
+     */
+    virtual uint64_t place(const uint64_t& ofst, const uint64_t& len) noexcept(false) = 0;
+
+    /**
+     * Make a range of offsets durable.
+     * @PARAM begin the start of the range
+     * @PARAM end the end of the range
+     */
+    virtual void flush(const uint64_t& begin, const uint64_t& end) noexcept(false) = 0;
+
+    /**
+     * Load the persisted state from the files. Called once, by
+     * FilePersistLog::load(), with the range of offsets in use.
+     * @PARAM begin the start of the range in use
+     * @PARAM end the end of the range in use
+     */
+    virtual void load(const uint64_t& begin, const uint64_t& end) noexcept(false) = 0;
+
+    /**
+     * Give back the memory and disk space for the offsets below ofst, which
+     * have been trimmed. A storage may keep them.
+     * @PARAM ofst the start of the range still in use
+     */
+    virtual void release(const uint64_t& ofst) noexcept(false) = 0;
+};
+
+// DirectWriteBuffer holds the tail of a storage written with direct I/O: the
+// offsets from a block-aligned start, which have not been written to the
+// files yet or share a block with ones that have not. The other offsets are
+// read from read-only mappings of the files, which O_DIRECT writes keep
+// coherent. Writing a range out only rewrites the partly written block at
+// its start. The buffer has a fixed capacity, and only grows past it for a
+// record that does not fit; once a record runs past its end, place() writes
+// the buffer out and moves it to the record.
+class DirectWriteBuffer {
+public:
+    /**
+     * Read or write the range [ofst, ofst + len) of the files, where ofst
+     * and len are multiples of the block size.
+     */
+    using file_io_t = std::function<void(const uint64_t& ofst, void* buf, const uint64_t& len)>;
+
+protected:
+    // the capacity, unless a larger record is placed
+    const uint64_t m_iCapacity;
+    // the alignment of O_DIRECT writes
+    const uint64_t m_iBlockSize;
+    const file_io_t m_writeFile;
+    const file_io_t m_readFile;
+    // the buffer and its size
+    std::shared_ptr<uint8_t> m_pBuffer;
+    uint64_t m_iBufferSize;
+    // the first offset in the buffer, a multiple of m_iBlockSize
+    uint64_t m_iStart;
+    // the end of the last record placed
+    uint64_t m_iEnd;
+    // the offsets [m_iStart, m_iClean) are in the files already
+    uint64_t m_iClean;
+
+    /** allocate a buffer of a size. */
+    static std::shared_ptr<uint8_t> allocate(const uint64_t& size) noexcept(false);
+
+public:
+    DirectWriteBuffer(const uint64_t& capacity, const uint64_t& blockSize,
+                      const file_io_t& writeFile, const file_io_t& readFile) noexcept(false);
+
+    /**
+     * Get the address of the byte at an offset.
+     * @PARAM ofst the offset
+     * @RETURN the address, or nullptr if the offset is not in the buffer.
+     */
+    void* at(const uint64_t& ofst) const;
+
+    /**
+     * Make room for a record, writing the buffer out first if it moves.
+     * @PARAM ofst the offset of the record
+     * @PARAM len the size of the record
+     * @PARAM pinned readers may hold addresses in the buffer, so it cannot
+     *        be reused for other offsets
+     * @RETURN the buffer it replaced, to be retired, or nullptr.
+     */
+    std::shared_ptr<uint8_t> place(const uint64_t& ofst, const uint64_t& len, bool pinned) noexcept(false);
+
+    /**
+     * Write a range of offsets to the files.
+     * @PARAM begin the start of the range
+     * @PARAM end the end of the range
+     */
+    void flush(const uint64_t& begin, const uint64_t& end) noexcept(false);
+
+    /**
+     * Start the buffer at the end of the persisted offsets, when loading.
+     * @PARAM end the end of the range in use
+     */
+    void load(const uint64_t& end) noexcept(false);
+};
+
+// RingLogStorage keeps all the offsets in one preallocated file used as a
+// ring buffer: offset ofst lives at ofst % size. The file is mapped twice,
+// back to back, so a record that wraps around the end is still contiguous.
+// With direct I/O, the mappings are read-only, the records not written yet
+// are in a DirectWriteBuffer, and flush() writes them with O_DIRECT instead
+// of calling msync().
+class RingLogStorage : public LogStorage {
+protected:
+    // full file name
+    const std::string m_sFile;
+    // size of the ring buffer
+    const uint64_t m_iSize;
+    // write with O_DIRECT
+    bool m_bDirectIO;
+    // the file descriptor
+    int m_iFileDesc;
+    // the ring buffer, mapped twice
+    void* m_pBase;
+    // the tail of the log, with m_bDirectIO
+    std::unique_ptr<DirectWriteBuffer> m_pBuffer;
+    // the offsets below this were released
+    uint64_t m_iReleased;
+    // protects m_pBuffer against concurrent place() and flush()
+    std::mutex m_mutex;
+
+    /** read or write a range of the file, wrapping around its end. */
+    void readFile(uint64_t ofst, void* buf, uint64_t len) noexcept(false);
+    void writeFile(uint64_t ofst, const void* buf, uint64_t len) noexcept(false);
+
+public:
+    RingLogStorage(const std::string& file, const uint64_t& size, bool directIO,
+                   const uint64_t& bufferSize) noexcept(false);
+    virtual ~RingLogStorage() noexcept(true);
+
+    virtual void* at(const uint64_t& ofst);
+    virtual uint64_t place(const uint64_t& ofst, const uint64_t& len) noexcept(false);
+    virtual void flush(const uint64_t& begin, const uint64_t& end) noexcept(false);
+    virtual void load(const uint64_t& begin, const uint64_t& end) noexcept(false);
+    virtual void release(const uint64_t& ofst) noexcept(false);
+};
+
+// SegmentedLogStorage keeps the offsets in segment files of a fixed size
+// (or a multiple of it, for a record larger than a segment), named
+// <file>.<n> for the segment starting at offset n * segment size. Segments
+// are created and mapped as the log grows, and unlinked and unmapped once
+// they are trimmed, so neither the address space nor the disk space used is
+// bounded by the maximum size of the log. A record never spans two segments.
+// A segment file is created under a temporary name and only renamed into
+// place once it has its full size, so a crash cannot leave a short one.
+// A trimmed segment is unlinked at once, and unmapped with the last pin.
+class SegmentedLogStorage : public LogStorage {
+protected:
+    struct Segment {
+        // the first offset in the segment
+        uint64_t start;
+        // the size of the segment
+        uint64_t length;
+        // full file name
+        std::string file;
+        // the file descriptor
+        int fileDesc;
+        // the mapping, read-only with direct I/O
+        void* base;
+
+        ~Segment();
+    };
+
+    // the directory of the segment files
+    const std::string m_sDataPath;
+    // the name of the segment files, without the segment number
+    const std::string m_sFileName;
+    // size of a segment
+    const uint64_t m_iSegmentSize;
+    // write with O_DIRECT
+    bool m_bDirectIO;
+    // the capacity of m_pBuffer
+    const uint64_t m_iBufferSize;
+    // the tail of the log, with m_bDirectIO, created with the first segment
+    std::unique_ptr<DirectWriteBuffer> m_pBuffer;
+    // the segment index: the segment holding offsets [i * m_iSegmentSize,
+    // (i + 1) * m_iSegmentSize) is m_segments[i - m_iFirstSlot], or nullptr.
+    // A segment larger than m_iSegmentSize has several slots.
+    std::deque<std::shared_ptr<Segment>> m_segments;
+    uint64_t m_iFirstSlot;
+    // a segment file was created since the directory was last synced
+    bool m_bDirDirty;
+    // protects m_segments and m_pBuffer against concurrent place() and flush()
+    std::mutex m_mutex;
+
+    /** the segment holding an offset, or nullptr. */
+    std::shared_ptr<Segment> find(const uint64_t& ofst) const;
+    /** open a segment file, creating it if create is true, and map it. */
+    std::shared_ptr<Segment> openSegment(const uint64_t& start, const uint64_t& length, bool create) noexcept(false);
+    /** add a segment to the index. */
+    void insertSegment(const std::shared_ptr<Segment>& segment);
+    /** remove the segments overlapping [begin, end) from the index and retire them. */
+    void removeSegments(const uint64_t& begin, const uint64_t& end) noexcept(false);
+    /** unlink a segment removed from the index, and unmap it once it is not pinned. */
+    void retireSegment(const std::shared_ptr<Segment>& segment) noexcept(false);
+    /** read or write a range of the segments, skipping the gaps between them. */
+    void readFile(uint64_t ofst, void* buf, uint64_t len) noexcept(false);
+    void writeFile(uint64_t ofst, const void* buf, uint64_t len) noexcept(false);
+
+public:
+    SegmentedLogStorage(const std::string& dataPath, const std::string& fileName,
+                        const uint64_t& segmentSize, bool directIO, const uint64_t& bufferSize) noexcept(false);
+    virtual ~SegmentedLogStorage() noexcept(true) {}
+
+    virtual void* at(const uint64_t& ofst);
+    virtual uint64_t place(const uint64_t& ofst, const uint64_t& len) noexcept(false);
+    virtual void flush(const uint64_t& begin, const uint64_t& end) noexcept(false);
+    virtual void load(const uint64_t& begin, const uint64_t& end) noexcept(false);
+    virtual void release(const uint64_t& ofst) noexcept(false);
+
+    /**
+     * Check if a file name is the name of a segment file.
+     * @PARAM name the name of a file in the directory
+     * @PARAM fileName the name of the segment files, without the segment number
+     * @PARAM number the segment number, if it is
+     */
+    static bool isSegmentFile(const std::string& name, const std::string& fileName, uint64_t& number);
+
+    /**
+     * Check if a storage has any segment file.
+     * @PARAM dataPath the directory of the segment files
+     * @PARAM fileName the name of the segment files, without the segment number
+     */
+    static bool hasFiles(const std::string& dataPath, const std::string& fileName) noexcept(false);
+
+    /**
+     * Remove all the segment files of a storage, and the one being created.
+     * @PARAM dataPath the directory of the segment files
+     * @PARAM fileName the name of the segment files, without the segment number
+     */
+    static void removeFiles(const std::string& dataPath, const std::string& fileName) noexcept(false);
+};
+}
+
+#endif  //LOG_STORAGE_HPP
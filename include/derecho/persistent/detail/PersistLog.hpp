@@ -116,6 +116,14 @@ public:
     // return the last persisted value
     virtual const version_t getLastPersisted() noexcept(false) = 0;
 
+    /**
+     * Keep the entries returned by getEntryByIndex() and getEntry() readable
+     * until the matching unpinEntries(), even if the log is trimmed or
+     * truncated meanwhile. Calls may nest.
+     */
+    virtual void pinEntries() noexcept(false) = 0;
+    virtual void unpinEntries() noexcept(false) = 0;
+
     // Get a version by entry number return both length and buffer
     virtual const void *getEntryByIndex(const int64_t &eno) noexcept(false) = 0;
 
@@ -192,6 +200,21 @@ public:
      */
     virtual void truncate(const version_t &ver) noexcept(false) = 0;
 };
+
+// Pins the entries of a log while in scope, see PersistLog::pinEntries().
+class EntryPin {
+    PersistLog &log;
+
+public:
+    EntryPin(PersistLog &_log) : log(_log) {
+        log.pinEntries();
+    }
+    ~EntryPin() {
+        log.unpinEntries();
+    }
+    EntryPin(const EntryPin &) = delete;
+    EntryPin &operator=(const EntryPin &) = delete;
+};
 }
 
 #endif  //PERSIST_LOG_HPP
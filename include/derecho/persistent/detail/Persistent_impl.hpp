@@ -254,6 +254,7 @@ auto Persistent<ObjectType, storageType>::getByIndex(
             return f(*this->getByIndex(idx, dm));
         }
     else {
+        EntryPin pin(*this->m_pLog);
         return mutils::deserialize_and_run<ObjectType>(dm, (char*)this->m_pLog->getEntryByIndex(idx), fun);
     }
 };
@@ -268,6 +269,7 @@ std::unique_ptr<ObjectType> Persistent<ObjectType, storageType>::getByIndex(
             // ObjectType* ot = new ObjectType{};
             std::unique_ptr<ObjectType> p = ObjectType::create(dm);
             // TODO: accelerate this by checkpointing
+            EntryPin pin(*this->m_pLog);
             for(int64_t i = this->m_pLog->getEarliestIndex(); i <= idx; i++) {
                 const char* entry_data = (const char*)this->m_pLog->getEntryByIndex(i);
                 p->applyDelta(entry_data);
@@ -276,6 +278,7 @@ std::unique_ptr<ObjectType> Persistent<ObjectType, storageType>::getByIndex(
             return p;
         }
     else {
+        EntryPin pin(*this->m_pLog);
         return mutils::from_bytes<ObjectType>(dm, (char const*)this->m_pLog->getEntryByIndex(idx));
     }
 };
@@ -287,6 +290,7 @@ auto Persistent<ObjectType, storageType>::get(
         const int64_t& ver,
         const Func& fun,
         mutils::DeserializationManager* dm) noexcept(false) {
+    EntryPin pin(*this->m_pLog);
     char* pdat = (char*)this->m_pLog->getEntry(ver);
     if(pdat == nullptr) {
         throw PERSIST_EXP_INV_VERSION;
@@ -316,6 +320,7 @@ std::unique_ptr<ObjectType> Persistent<ObjectType, storageType>::get(
             return getByIndex(idx, dm);
         }
     else {
+        EntryPin pin(*this->m_pLog);
         return mutils::from_bytes<ObjectType>(dm, (const char*)this->m_pLog->getEntryByIndex(idx));
     }
 }
@@ -358,6 +363,7 @@ auto Persistent<ObjectType, storageType>::get(
             return getByIndex(idx, fun, dm);
         }
     else {
+        EntryPin pin(*this->m_pLog);
         char* pdat = (char*)this->m_pLog->getEntry(hlc);
         if(pdat == nullptr) {
             throw PERSIST_EXP_INV_HLC;
@@ -384,6 +390,7 @@ std::unique_ptr<ObjectType> Persistent<ObjectType, storageType>::get(
             return getByIndex(idx, dm);
         }
     else {
+        EntryPin pin(*this->m_pLog);
         char const* pdat = (char const*)this->m_pLog->getEntry(hlc);
         if(pdat == nullptr) {
             throw PERSIST_EXP_INV_HLC;
@@ -2,6 +2,9 @@
 #define PERSISTENT_UTIL_HPP
 
 #include "../PersistException.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <derecho/conf/conf.hpp>
 #include <errno.h>
 #include <fcntl.h>
@@ -37,6 +40,20 @@ inline std::string getPersFilePath() {
     return std::string(derecho::getConfString(CONF_PERS_FILE_PATH));
 }
 
+// How FilePersistLog writes its log and data files:
+// "mmap" - through shared mappings of the files, flushed with msync();
+// "direct" - with O_DIRECT writes of the new records from a bounded buffer.
+// Return true for "direct".
+inline bool getPersDirectIO() noexcept(false) {
+    std::string mode = derecho::getConfString(CONF_PERS_WRITE_MODE);
+    if(mode == "mmap") {
+        return false;
+    } else if(mode == "direct") {
+        return true;
+    }
+    throw PERSIST_EXP_INV_WRITE_MODE;
+}
+
 // verify the existence of a folder
 // Check if directory exists or not. Create it on absence.
 // return error if creating failed
@@ -54,6 +71,41 @@ inline void checkOrCreateDir(const std::string& dirPath) noexcept(false) {
     }
 }
 
+// make the creation or removal of files in a folder durable
+inline void syncDir(const std::string& dirPath) noexcept(false) {
+    int fd = open(dirPath.c_str(), O_RDONLY | O_DIRECTORY);
+    if(fd < 0) {
+        throw PERSIST_EXP_OPEN_FILE(errno);
+    }
+    if(fsync(fd) != 0) {
+        int err = errno;
+        close(fd);
+        throw PERSIST_EXP_FSYNC(err);
+    }
+    close(fd);
+}
+
+// CRC-32 (the IEEE 802.3 polynomial) of a buffer, used to validate on-disk headers
+inline uint32_t computeCRC32(const void* buf, size_t len) {
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> t;
+        for(uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for(int k = 0; k < 8; k++) {
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    const uint8_t* p = static_cast<const uint8_t*>(buf);
+    for(size_t i = 0; i < len; i++) {
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
 // verify the existence of a regular file
 inline bool checkRegularFile(const std::string& file) noexcept(false) {
     struct stat sb;
@@ -7,13 +7,19 @@
 #pragma once
 
 #include <chrono>
+#include <climits>
 #include <condition_variable>
+#include <linux/futex.h>
 #include <memory>
 #include <mutex>
 #include <pthread.h>
+#include <string>
+#include <string.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <thread>
 #include <time.h>
+#include <unistd.h>
 #include <vector>
 
 #include "poll_utils.hpp"
@@ -29,6 +35,7 @@ namespace sst {
 template <typename DerivedSST>
 SST<DerivedSST>::~SST() {
     thread_shutdown = true;
+    wake_predicate_thread();
     for(auto& thread : background_threads) {
         if(thread.joinable()) thread.join();
     }
@@ -50,89 +57,169 @@ void SST<DerivedSST>::start_predicate_evaluation() {
     thread_start_cv.notify_all();
 }
 
+/**
+ * Copies a word of SST memory into a predicate's snapshot, and returns true if
+ * it differed from the copy already there.
+ */
+template <typename Word>
+inline bool refresh_snapshot(char* snapshot_pos, const char* current) {
+    Word current_value, snapshot_value;
+    memcpy(&current_value, current, sizeof(Word));
+    memcpy(&snapshot_value, snapshot_pos, sizeof(Word));
+    if(current_value == snapshot_value) {
+        return false;
+    }
+    memcpy(snapshot_pos, &current_value, sizeof(Word));
+    return true;
+}
+
+/**
+ * Decides whether a predicate needs to be evaluated on this pass of the
+ * predicate engine. A predicate with no declared dependencies always does; one
+ * with dependencies does only if it has never been evaluated, was true the last
+ * time it was evaluated, or some of the SST memory it depends on has changed
+ * since then. As a side effect, this refreshes the predicate's snapshot of that
+ * memory, so it must be called immediately before evaluating the predicate.
+ */
+template <typename DerivedSST>
+bool SST<DerivedSST>::needs_evaluation(typename Predicates<DerivedSST>::predicate_entry& entry) {
+    if(entry.dependencies.empty()) {
+        return true;
+    }
+    if(entry.never_evaluated) {
+        for(const auto& dependency : entry.dependencies) {
+            for(const auto row_index : dependency.row_indices) {
+                const std::size_t offset = row_index * rowLen + dependency.offset;
+                if(!entry.watched_ranges.empty()
+                   && entry.watched_ranges.back().first + entry.watched_ranges.back().second == offset) {
+                    entry.watched_ranges.back().second += dependency.size;
+                } else {
+                    entry.watched_ranges.emplace_back(offset, dependency.size);
+                }
+            }
+        }
+    }
+    bool changed = entry.never_evaluated || entry.last_result;
+    char* snapshot_pos = entry.snapshot.data();
+    for(const auto& range : entry.watched_ranges) {
+        const char* current = const_cast<char*>(rows) + range.first;
+        bool range_changed;
+        // ranges holding a single counter are compared without calling memcmp
+        if(range.second == sizeof(uint32_t)) {
+            range_changed = refresh_snapshot<uint32_t>(snapshot_pos, current);
+        } else if(range.second == sizeof(uint64_t)) {
+            range_changed = refresh_snapshot<uint64_t>(snapshot_pos, current);
+        } else {
+            range_changed = memcmp(snapshot_pos, current, range.second) != 0;
+            if(range_changed) {
+                memcpy(snapshot_pos, current, range.second);
+            }
+        }
+        changed |= range_changed;
+        snapshot_pos += range.second;
+    }
+    entry.never_evaluated = false;
+    return changed;
+}
+
 /**
  * This function is run in a detached background thread to detect predicate
  * events. It continuously evaluates predicates one by one, and runs the
- * trigger functions for each predicate that fires. In addition, it
- * continuously evaluates named functions one by one, and updates the local
- * row's observed values of those functions.
+ * trigger functions for each predicate that fires. Predicates that declared
+ * their dependencies are only re-evaluated when needs_evaluation() says their
+ * inputs may have changed. There is one such thread per predicate partition,
+ * and each one evaluates only the predicates of its own partition.
  */
 template <typename DerivedSST>
-void SST<DerivedSST>::detect() {
-    pthread_setname_np(pthread_self(), "sst_detect");
+void SST<DerivedSST>::detect(uint32_t partition_num) {
+    if(partition_num == 0) {
+        pthread_setname_np(pthread_self(), "sst_detect");
+    } else {
+        pthread_setname_np(pthread_self(), ("sst_detect_" + std::to_string(partition_num)).c_str());
+    }
     if(!thread_start) {
         std::unique_lock<std::mutex> lock(thread_start_mutex);
         thread_start_cv.wait(lock, [this]() { return thread_start; });
     }
+    auto& partition = *predicates.partitions[partition_num];
+    {
+        std::lock_guard<std::mutex> lock(partition.predicate_mutex);
+        partition.detect_thread = std::this_thread::get_id();
+    }
+    // Runs a trigger with the predicate lock released, marking the partition
+    // busy so that Predicates::wait_for_triggers() can wait for it
+    auto run_trigger = [&](std::unique_lock<std::mutex>& predicates_lock,
+                           const std::shared_ptr<typename Predicates<DerivedSST>::trig>& trigger) {
+        partition.trigger_running = true;
+        predicates_lock.unlock();
+        (*trigger)(*derived_this);
+        predicates_lock.lock();
+        partition.trigger_running = false;
+        partition.trigger_done.notify_all();
+    };
     struct timespec last_time, cur_time;
     clock_gettime(CLOCK_REALTIME, &last_time);
+    uint32_t idle_backoff_us = 1;
 
     while(!thread_shutdown) {
         bool predicate_fired = false;
         // Take the predicate lock before reading the predicate lists
-        std::unique_lock<std::mutex> predicates_lock(predicates.predicate_mutex);
+        std::unique_lock<std::mutex> predicates_lock(partition.predicate_mutex);
 
         // one time predicates need to be evaluated only until they become true
-        for(auto& pred : predicates.one_time_predicates) {
-            if(pred != nullptr && (pred->first(*derived_this) == true)) {
+        for(auto& pred : partition.one_time_predicates) {
+            if(pred != nullptr && needs_evaluation(*pred) && (pred->predicate(*derived_this) == true)) {
                 predicate_fired = true;
                 // Copy the trigger pointer locally, so it can continue running without
                 // segfaulting even if this predicate gets deleted when we unlock predicates_lock
-                std::shared_ptr<typename Predicates<DerivedSST>::trig> trigger(pred->second);
-                predicates_lock.unlock();
-                (*trigger)(*derived_this);
-                predicates_lock.lock();
+                std::shared_ptr<typename Predicates<DerivedSST>::trig> trigger(pred->trigger);
+                run_trigger(predicates_lock, trigger);
                 // erase the predicate as it was just found to be true
                 pred.reset();
             }
         }
 
         // recurrent predicates are evaluated each time they are found to be true
-        for(auto& pred : predicates.recurrent_predicates) {
-            if(pred != nullptr && (pred->first(*derived_this) == true)) {
+        for(auto& pred : partition.recurrent_predicates) {
+            if(pred == nullptr || !needs_evaluation(*pred)) {
+                continue;
+            }
+            pred->last_result = pred->predicate(*derived_this);
+            if(pred->last_result) {
                 predicate_fired = true;
-                std::shared_ptr<typename Predicates<DerivedSST>::trig> trigger(pred->second);
-                predicates_lock.unlock();
-                (*trigger)(*derived_this);
-                predicates_lock.lock();
+                std::shared_ptr<typename Predicates<DerivedSST>::trig> trigger(pred->trigger);
+                run_trigger(predicates_lock, trigger);
             }
         }
 
         // transition predicates are only evaluated when they change from false to true
-        // We need to use iterators here because we need to iterate over two lists in parallel
-        auto pred_it = predicates.transition_predicates.begin();
-        auto pred_state_it = predicates.transition_predicate_states.begin();
-        while(pred_it != predicates.transition_predicates.end()) {
-            if(*pred_it != nullptr) {
-                //*pred_state_it is the previous state of the predicate at *pred_it
-                bool curr_pred_state = (*pred_it)->first(*derived_this);
-                if(curr_pred_state == true && *pred_state_it == false) {
-                    predicate_fired = true;
-                    std::shared_ptr<typename Predicates<DerivedSST>::trig> trigger(
-                            (*pred_it)->second);
-                    predicates_lock.unlock();
-                    (*trigger)(*derived_this);
-                    predicates_lock.lock();
-                }
-                *pred_state_it = curr_pred_state;
-
-                ++pred_it;
-                ++pred_state_it;
+        for(auto& pred : partition.transition_predicates) {
+            if(pred == nullptr || !needs_evaluation(*pred)) {
+                continue;
+            }
+            //pred->last_result is the previous state of the predicate
+            bool curr_pred_state = pred->predicate(*derived_this);
+            bool prev_pred_state = pred->last_result;
+            pred->last_result = curr_pred_state;
+            if(curr_pred_state == true && prev_pred_state == false) {
+                predicate_fired = true;
+                std::shared_ptr<typename Predicates<DerivedSST>::trig> trigger(pred->trigger);
+                run_trigger(predicates_lock, trigger);
             }
         }
 
         if(predicate_fired) {
             // update last time
             clock_gettime(CLOCK_REALTIME, &last_time);
-        } else {
+            idle_backoff_us = 1;
+        } else if(idle_policy != IdlePolicy::SPIN) {
             clock_gettime(CLOCK_REALTIME, &cur_time);
-            // check if the system has been inactive for enough time to induce sleep
-            double time_elapsed_in_ms = (cur_time.tv_sec - last_time.tv_sec) * 1e3
-                                        + (cur_time.tv_nsec - last_time.tv_nsec) / 1e6;
-            if(time_elapsed_in_ms > 1) {
+            // check if the system has been inactive for enough time to stop spinning
+            double time_elapsed_in_us = (cur_time.tv_sec - last_time.tv_sec) * 1e6
+                                        + (cur_time.tv_nsec - last_time.tv_nsec) / 1e3;
+            if(time_elapsed_in_us > idle_spin_us) {
                 predicates_lock.unlock();
-                using namespace std::chrono_literals;
-                std::this_thread::sleep_for(1ms);
+                idle_wait(idle_backoff_us);
                 predicates_lock.lock();
             }
         }
@@ -140,9 +227,68 @@ void SST<DerivedSST>::detect() {
     }
 }
 
+/**
+ * Pauses the predicate thread between two idle passes, according to the
+ * configured idle policy. Must be called without holding the predicate lock.
+ * idle_backoff_us is the calling thread's current sleep time under the BACKOFF
+ * policy.
+ */
+template <typename DerivedSST>
+void SST<DerivedSST>::idle_wait(uint32_t& idle_backoff_us) {
+    switch(idle_policy) {
+        case IdlePolicy::SPIN:
+            break;
+        case IdlePolicy::YIELD:
+            std::this_thread::yield();
+            break;
+        case IdlePolicy::SLEEP:
+            std::this_thread::sleep_for(std::chrono::microseconds(idle_sleep_us));
+            break;
+        case IdlePolicy::BACKOFF:
+            std::this_thread::sleep_for(std::chrono::microseconds(idle_backoff_us));
+            idle_backoff_us = std::min(idle_backoff_us * 2, idle_sleep_us);
+            break;
+        case IdlePolicy::BLOCK: {
+            // Announce the wait before reading the generation, so that a wakeup
+            // either sees the count or changes the generation the futex waits on.
+            num_blocked_predicate_threads++;
+            const uint32_t generation = wakeup_generation;
+            if(!thread_shutdown) {
+                struct timespec timeout;
+                timeout.tv_sec = idle_sleep_us / 1000000;
+                timeout.tv_nsec = (idle_sleep_us % 1000000) * 1000;
+                syscall(SYS_futex, reinterpret_cast<uint32_t*>(&wakeup_generation), FUTEX_WAIT_PRIVATE,
+                        generation, &timeout, nullptr, 0);
+            }
+            num_blocked_predicate_threads--;
+            break;
+        }
+    }
+}
+
+/**
+ * Wakes the predicate threads that are blocked under the BLOCK idle policy.
+ * This is called after local events that may make a predicate true; remote
+ * writes to the SST cannot call it, which is why the thread never blocks for
+ * longer than idle_sleep_us.
+ */
+template <typename DerivedSST>
+void SST<DerivedSST>::wake_predicate_thread() {
+    if(idle_policy != IdlePolicy::BLOCK) {
+        return;
+    }
+    wakeup_generation++;
+    if(num_blocked_predicate_threads > 0) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&wakeup_generation), FUTEX_WAKE_PRIVATE,
+                INT_MAX, nullptr, nullptr, 0);
+    }
+}
+
 template <typename DerivedSST>
 void SST<DerivedSST>::put(const std::vector<uint32_t> receiver_ranks, size_t offset, size_t size) {
     assert(offset + size <= rowLen);
+    // the local row has changed, so local predicates may have become true
+    wake_predicate_thread();
     for(auto index : receiver_ranks) {
         // don't write to yourself or a frozen row
         if(index == my_index || row_is_frozen[index]) {
@@ -241,6 +387,7 @@ void SST<DerivedSST>::put_with_completion(const std::vector<uint32_t> receiver_r
     for(auto index : failed_node_indexes) {
         freeze(index);
     }
+    wake_predicate_thread();
 }
 
 template <typename DerivedSST>
@@ -1,7 +1,9 @@
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cstdlib>
 #include <ctime>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <map>
@@ -12,6 +14,51 @@
 #include "sst.hpp"
 
 namespace sst {
+/**
+ * The layout of a multicast_group's slots in byte-ring mode. Each message takes
+ * a record [sequence number][message size][message], padded to a multiple of 8
+ * bytes, at the next free offset of the sender's ring. The sequence number of
+ * message n (counting from 0) is n + 1. A record never wraps around the end of
+ * the ring; if it does not fit, the sender writes n + 1 with wrap_flag set in
+ * place of the sequence number, and the record starts at offset 0 instead.
+ * The word after each record is cleared along with the record, because a
+ * receiver looks there for the next one, and stale message bytes could
+ * otherwise pass for its sequence number.
+ */
+struct ring_layout {
+    static constexpr uint64_t wrap_flag = 1ull << 63;
+    static constexpr uint64_t size_offset = sizeof(uint64_t);
+    static constexpr uint64_t data_offset = 2 * sizeof(uint64_t);
+
+    static uint64_t record_size(uint64_t msg_size) {
+        return data_offset + ((msg_size + 7) & ~7ull);
+    }
+
+    /**
+     * Returns the ring size to use when requested_size bytes are asked for: a
+     * multiple of 8 that can hold the largest message, the word after it, and
+     * reserve_size bytes.
+     */
+    static uint64_t ring_size(uint64_t requested_size, uint64_t max_msg_size, uint64_t reserve_size) {
+        return std::max<uint64_t>((requested_size + 7) & ~7ull,
+                                  record_size(max_msg_size) + sizeof(uint64_t) + reserve_size);
+    }
+
+    /**
+     * Looks for message msg_num of a sender at the offset of its ring where a
+     * receiver expects the next record, following a wrap marker if there is one.
+     * @return The offset of the message's record, or -1 if it has not arrived yet
+     */
+    static int64_t find_record(volatile char* ring, uint64_t offset, uint64_t msg_num) {
+        uint64_t seq = (uint64_t&)ring[offset];
+        if(seq == ((msg_num + 1) | wrap_flag)) {
+            offset = 0;
+            seq = (uint64_t&)ring[offset];
+        }
+        return seq == msg_num + 1 ? offset : -1;
+    }
+};
+
 template <typename sstType>
 class multicast_group {
     // number of messages for which get_buffer has been called
@@ -47,32 +94,158 @@ class multicast_group {
     uint32_t num_senders;
     // window size
     const uint32_t window_size;
-    // maximum size that the SST can send
+    // maximum size that the SST can send, including the two words of each slot.
+    // A slot is laid out as [message size][message][sequence number], so the
+    // size and the used part of the message are one contiguous range
     const uint64_t max_msg_size;
 
+    // in byte-ring mode, the size of each sender's ring; 0 in fixed-slot mode
+    const uint64_t ring_size;
+    // bytes of the ring that only get_buffer(msg_size, true) may use
+    const uint64_t ring_reserve;
+    // returns the key of this node's last record that every member is done
+    // with, so that its ring bytes can be reused; defaults to the number of the
+    // last message every member has received
+    const std::function<long long int()> num_released;
+    // bytes taken from the ring so far, and bytes given back, counted from the start
+    uint64_t ring_head = 0;
+    uint64_t ring_tail = 0;
+    // the release key and the value of ring_head after each unreleased record;
+    // the key is compared against num_released(), and is the record's message
+    // number unless get_buffer or set_last_buffer_size was given one
+    std::deque<std::pair<long long int, uint64_t>> ring_ends;
+    // a record returned by get_buffer but not yet sent
+    struct queued_record {
+        uint64_t offset;
+        // the offset of the wrap marker written before the record, or -1
+        int64_t wrap_offset;
+    };
+    std::deque<queued_record> queued_records;
+
     std::thread timeout_thread;
 
+    long long int min_num_received() {
+        long long int min_multicast_num = sst->num_received_sst[my_row][num_received_offset + my_sender_index];
+        for(auto i : row_indices) {
+            long long int num_received_sst_copy = sst->num_received_sst[i][num_received_offset + my_sender_index];
+            min_multicast_num = std::min(min_multicast_num, num_received_sst_copy);
+        }
+        return min_multicast_num;
+    }
+
+    // the number of bytes a record of msg_size bytes would take from the ring
+    // now, counting the gap left before it if it has to wrap around
+    uint64_t ring_bytes_needed(uint64_t msg_size) const {
+        const uint64_t record_size = ring_layout::record_size(msg_size);
+        const uint64_t position = ring_head % ring_size;
+        return (position + record_size > ring_size ? ring_size - position : 0) + record_size;
+    }
+
+    // true if a record of msg_size bytes fits in the ring, giving back the bytes
+    // of released records if it does not fit otherwise
+    bool ring_has_room(uint64_t msg_size, bool use_reserve) {
+        const uint64_t reserve = use_reserve ? 0 : ring_reserve;
+        while(true) {
+            // the word after the record must be free too, since send() clears it
+            if(ring_head + ring_bytes_needed(msg_size) + sizeof(uint64_t) + reserve - ring_tail <= ring_size) {
+                return true;
+            }
+            const long long int released = num_released ? num_released() : min_num_received();
+            if(ring_ends.empty() || ring_ends.front().first > released) {
+                return false;
+            }
+            while(!ring_ends.empty() && ring_ends.front().first <= released) {
+                ring_tail = ring_ends.front().second;
+                ring_ends.pop_front();
+            }
+        }
+    }
+
+    volatile char* get_ring_buffer(uint64_t msg_size, bool use_reserve, long long int release_key) {
+        if(!ring_has_room(msg_size, use_reserve)) {
+            return nullptr;
+        }
+        const uint64_t position = ring_head % ring_size;
+        const uint64_t bytes_needed = ring_bytes_needed(msg_size);
+        queued_num++;
+        queued_record record{position, -1};
+        if(bytes_needed > ring_layout::record_size(msg_size)) {
+            record = {0, (int64_t)position};
+        }
+        ring_head += bytes_needed;
+        ring_ends.emplace_back(release_key >= 0 ? release_key : queued_num, ring_head);
+        queued_records.push_back(record);
+        (uint64_t&)sst->slots[my_row][slots_offset + record.offset + ring_layout::size_offset] = msg_size;
+        return &sst->slots[my_row][slots_offset + record.offset + ring_layout::data_offset];
+    }
+
     void initialize() {
         for(auto i : row_indices) {
             for(uint j = num_received_offset; j < num_received_offset + num_senders; ++j) {
                 sst->num_received_sst[i][j] = -1;
             }
-            for(uint j = 0; j < window_size; ++j) {
-                sst->slots[i][slots_offset + max_msg_size * j] = 0;
-                (uint64_t&)sst->slots[i][slots_offset + (max_msg_size * (j + 1)) - sizeof(uint64_t)] = 0;
+            if(ring_size) {
+                for(uint64_t offset = 0; offset < ring_size; offset += sizeof(uint64_t)) {
+                    (uint64_t&)sst->slots[i][slots_offset + offset] = 0;
+                }
+            } else {
+                for(uint j = 0; j < window_size; ++j) {
+                    (uint64_t&)sst->slots[i][slots_offset + max_msg_size * j] = 0;
+                    (uint64_t&)sst->slots[i][slots_offset + (max_msg_size * (j + 1)) - sizeof(uint64_t)] = 0;
+                }
             }
         }
         sst->sync_with_members(row_indices);
     }
 
+    void send_ring_record() {
+        const queued_record record = queued_records.front();
+        queued_records.pop_front();
+        num_sent++;
+        const uint64_t record_start = slots_offset + record.offset;
+        const uint64_t msg_size = (uint64_t&)sst->slots[my_row][record_start + ring_layout::size_offset];
+        const uint64_t record_end = record.offset + ring_layout::record_size(msg_size);
+        // markers are only written here, since clearing the word after the previous
+        // record could otherwise erase one that get_buffer had already placed there
+        if(record.wrap_offset >= 0) {
+            (uint64_t&)sst->slots[my_row][slots_offset + record.wrap_offset] = num_sent | ring_layout::wrap_flag;
+            sst->put((char*)std::addressof(sst->slots[0][slots_offset + record.wrap_offset]) - sst->getBaseAddress(),
+                     sizeof(uint64_t));
+        }
+        // offset 0 always starts a record, so it never needs to be cleared
+        uint64_t write_size = sizeof(uint64_t) + msg_size;
+        if(record_end < ring_size) {
+            (uint64_t&)sst->slots[my_row][slots_offset + record_end] = 0;
+            write_size = record_end + sizeof(uint64_t) - (record.offset + ring_layout::size_offset);
+        }
+        (uint64_t&)sst->slots[my_row][record_start] = num_sent;
+        // as with fixed slots, the sequence number is written after the rest of the record
+        sst->put((char*)std::addressof(sst->slots[0][record_start + ring_layout::size_offset]) - sst->getBaseAddress(),
+                 write_size);
+        sst->put((char*)std::addressof(sst->slots[0][record_start]) - sst->getBaseAddress(),
+                 sizeof(uint64_t));
+    }
+
 public:
+    /**
+     * @param ring_size If nonzero, the sender's slots form a byte ring of this
+     * size (as returned by ring_layout::ring_size) instead of window_size
+     * fixed slots, so that each message only takes its own size.
+     * @param ring_reserve In byte-ring mode, the number of bytes that are kept
+     * free for get_buffer calls that set use_reserve.
+     * @param num_released In byte-ring mode, a function returning the release
+     * key (see get_buffer) of this node's last record whose bytes may be reused.
+     */
     multicast_group(std::shared_ptr<sstType> sst,
                     std::vector<uint32_t> row_indices,
                     uint32_t window_size,
                     uint64_t max_msg_size,
                     std::vector<int> is_sender = {},
                     uint32_t num_received_offset = 0,
-                    uint32_t slots_offset = 0)
+                    uint32_t slots_offset = 0,
+                    uint64_t ring_size = 0,
+                    uint64_t ring_reserve = 0,
+                    std::function<long long int()> num_released = nullptr)
             : my_row(sst->get_local_index()),
               sst(sst),
               row_indices(row_indices),
@@ -87,7 +260,10 @@ public:
               slots_offset(slots_offset),
               num_members(row_indices.size()),
               window_size(window_size),
-              max_msg_size(max_msg_size + 2 * sizeof(uint64_t)) {
+              max_msg_size(max_msg_size + 2 * sizeof(uint64_t)),
+              ring_size(ring_size),
+              ring_reserve(ring_reserve),
+              num_released(std::move(num_released)) {
         // find my_member_index
         for(uint i = 0; i < num_members; ++i) {
             if(row_indices[i] == my_row) {
@@ -111,23 +287,31 @@ public:
         initialize();
     }
 
-    volatile char* get_buffer(uint64_t msg_size) {
+    /**
+     * Returns a buffer for the next message, of msg_size bytes, or nullptr if
+     * there is no room until more messages have been received.
+     * @param use_reserve In byte-ring mode, allows the buffer to be taken from
+     * the reserved part of the ring
+     * @param release_key In byte-ring mode, the value num_released() must reach
+     * before the buffer's bytes are reused, or -1 to use the message's number.
+     * Keys must not decrease from one buffer to the next.
+     */
+    volatile char* get_buffer(uint64_t msg_size, bool use_reserve = false, long long int release_key = -1) {
         assert(my_sender_index >= 0);
         std::lock_guard<std::mutex> lock(msg_send_mutex);
         assert(msg_size <= max_msg_size);
+        if(ring_size) {
+            return get_ring_buffer(msg_size, use_reserve, release_key);
+        }
         while(true) {
             if(queued_num - finished_multicasts_num < window_size) {
                 queued_num++;
                 uint32_t slot = queued_num % window_size;
                 // set size appropriately
-                (uint64_t&)sst->slots[my_row][slots_offset + (max_msg_size * (slot + 1)) - 2 * sizeof(uint64_t)] = msg_size;
-                return &sst->slots[my_row][slots_offset + (max_msg_size * slot)];
+                (uint64_t&)sst->slots[my_row][slots_offset + max_msg_size * slot] = msg_size;
+                return &sst->slots[my_row][slots_offset + max_msg_size * slot + sizeof(uint64_t)];
             } else {
-                long long int min_multicast_num = sst->num_received_sst[my_row][num_received_offset + my_sender_index];
-                for(auto i : row_indices) {
-                    long long int num_received_sst_copy = sst->num_received_sst[i][num_received_offset + my_sender_index];
-                    min_multicast_num = std::min(min_multicast_num, num_received_sst_copy);
-                }
+                long long int min_multicast_num = min_num_received();
                 if(finished_multicasts_num == min_multicast_num) {
                     return nullptr;
                 } else {
@@ -137,15 +321,68 @@ public:
         }
     }
 
+    /**
+     * Returns true if a get_buffer call for msg_size bytes would not fail for
+     * lack of space right now, so that a sender can wait for that instead of
+     * retrying get_buffer.
+     */
+    bool has_room(uint64_t msg_size) {
+        std::lock_guard<std::mutex> lock(msg_send_mutex);
+        if(ring_size) {
+            return ring_has_room(msg_size, false);
+        }
+        return queued_num - finished_multicasts_num < window_size
+               || queued_num - min_num_received() < window_size;
+    }
+
+    /**
+     * Changes the message size recorded for the buffer most recently returned
+     * by get_buffer, which must not have been sent yet. Used when a sender
+     * fills a slot incrementally and only knows its final size at send time.
+     * @param release_key If not -1, replaces the buffer's release key (see
+     * get_buffer), for a buffer that ended up carrying more than one message
+     */
+    void set_last_buffer_size(uint64_t msg_size, long long int release_key = -1) {
+        std::lock_guard<std::mutex> lock(msg_send_mutex);
+        assert(queued_num >= (long long int)num_sent);
+        assert(msg_size <= max_msg_size - 2 * sizeof(uint64_t));
+        if(ring_size) {
+            // a smaller message gives the unused end of its record back to the ring
+            const uint64_t record_offset = queued_records.back().offset;
+            const uint64_t old_size = (uint64_t&)sst->slots[my_row][slots_offset + record_offset + ring_layout::size_offset];
+            assert(msg_size <= old_size);
+            const uint64_t freed = ring_layout::record_size(old_size) - ring_layout::record_size(msg_size);
+            ring_head -= freed;
+            ring_ends.back().second -= freed;
+            if(release_key >= 0) {
+                ring_ends.back().first = release_key;
+            }
+            (uint64_t&)sst->slots[my_row][slots_offset + record_offset + ring_layout::size_offset] = msg_size;
+            return;
+        }
+        uint32_t slot = queued_num % window_size;
+        (uint64_t&)sst->slots[my_row][slots_offset + max_msg_size * slot] = msg_size;
+    }
+
     void send() {
+        if(ring_size) {
+            send_ring_record();
+            return;
+        }
         uint32_t slot = num_sent % window_size;
         num_sent++;
-        ((uint64_t&)sst->slots[my_row][slots_offset + max_msg_size * (slot + 1) - sizeof(uint64_t)])++;
+        const uint64_t slot_start = slots_offset + max_msg_size * slot;
+        const uint64_t msg_size = (uint64_t&)sst->slots[my_row][slot_start];
+        ((uint64_t&)sst->slots[my_row][slot_start + max_msg_size - sizeof(uint64_t)])++;
+        // Only the size and the bytes of the slot in use are written. The sequence
+        // number still goes in a separate, later write: RDMA does not order the
+        // placement of bytes within one write, so a receiver that polls it could
+        // otherwise see it before the message
         sst->put(
-                (char*)std::addressof(sst->slots[0][slots_offset + max_msg_size * slot]) - sst->getBaseAddress(),
-                max_msg_size - sizeof(uint64_t));
+                (char*)std::addressof(sst->slots[0][slot_start]) - sst->getBaseAddress(),
+                sizeof(uint64_t) + msg_size);
         sst->put(
-                (char*)std::addressof(sst->slots[0][slots_offset + slot * max_msg_size]) - sst->getBaseAddress() + max_msg_size - sizeof(uint64_t),
+                (char*)std::addressof(sst->slots[0][slot_start]) - sst->getBaseAddress() + max_msg_size - sizeof(uint64_t),
                 sizeof(uint64_t));
     }
 
@@ -1,10 +1,15 @@
 #pragma once
 
 #include <algorithm>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <list>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include "sst.hpp"
 
@@ -25,44 +30,104 @@ enum class PredicateType {
     TRANSITION
 };
 
+/**
+ * Describes some of the SST memory that a predicate reads: the bytes
+ * [offset, offset + size) of each of the rows in row_indices, where offset is
+ * relative to the start of a row. SST::dependency() builds these from fields.
+ */
+struct PredicateDependency {
+    std::vector<uint32_t> row_indices;
+    std::size_t offset;
+    std::size_t size;
+};
+
 template <class DerivedSST>
 class Predicates {
     using pred = std::function<bool(const DerivedSST&)>;
     using trig = std::function<void(DerivedSST&)>;
-    using pred_list = std::list<std::unique_ptr<std::pair<pred, std::shared_ptr<trig>>>>;
-    /** Predicate list for one-time predicates. */
-    pred_list one_time_predicates;
-    /** Predicate list for recurrent predicates */
-    pred_list recurrent_predicates;
-    /** Predicate list for transition predicates */
-    pred_list transition_predicates;
-    /** Contains one entry for every predicate in `transition_predicates`, in parallel. */
-    std::list<bool> transition_predicate_states;
+
+    /** A registered predicate, its trigger, and what the predicate engine knows about its inputs. */
+    struct predicate_entry {
+        pred predicate;
+        std::shared_ptr<trig> trigger;
+        /** The SST memory the predicate reads. If empty, the predicate is evaluated on every pass. */
+        std::vector<PredicateDependency> dependencies;
+        /** The memory described by dependencies, as (offset from the start of the table, size)
+         * ranges with adjacent ranges merged; filled in by the SST on the first evaluation. */
+        std::vector<std::pair<std::size_t, std::size_t>> watched_ranges;
+        /** A copy of the memory described by dependencies, as of the last evaluation. */
+        std::vector<char> snapshot;
+        /** True until the predicate has been evaluated once. */
+        bool never_evaluated;
+        /** The result of the last evaluation; for transition predicates, this is the previous state. */
+        bool last_result;
+
+        predicate_entry(pred predicate, trig trigger, std::vector<PredicateDependency> dependencies)
+                : predicate(std::move(predicate)),
+                  trigger(std::make_shared<trig>(std::move(trigger))),
+                  dependencies(std::move(dependencies)),
+                  never_evaluated(true),
+                  last_result(false) {
+            std::size_t snapshot_size = 0;
+            for(const auto& dependency : this->dependencies) {
+                snapshot_size += dependency.size * dependency.row_indices.size();
+            }
+            snapshot.resize(snapshot_size);
+        }
+    };
+
+    using pred_list = std::list<std::unique_ptr<predicate_entry>>;
+
+    /** The predicates evaluated by one predicate evaluation thread. */
+    struct predicate_partition {
+        /** Predicate list for one-time predicates. */
+        pred_list one_time_predicates;
+        /** Predicate list for recurrent predicates */
+        pred_list recurrent_predicates;
+        /** Predicate list for transition predicates */
+        pred_list transition_predicates;
+        std::mutex predicate_mutex;
+        /** True while the detect thread runs a trigger with predicate_mutex released */
+        bool trigger_running = false;
+        /** Notified, under predicate_mutex, when a trigger finishes */
+        std::condition_variable trigger_done;
+        /** The thread that evaluates this partition */
+        std::thread::id detect_thread;
+    };
+    /** One partition per predicate evaluation thread. Never resized after construction. */
+    std::vector<std::unique_ptr<predicate_partition>> partitions;
     // SST needs to read these predicate lists directly
     friend class SST<DerivedSST>;
 
-    std::mutex predicate_mutex;
-
 public:
+    /** @param num_partitions The number of threads that will evaluate these predicates */
+    explicit Predicates(uint32_t num_partitions = 1) {
+        for(uint32_t i = 0; i < std::max(num_partitions, 1u); ++i) {
+            partitions.emplace_back(std::make_unique<predicate_partition>());
+        }
+    }
+
     class pred_handle {
         bool valid;
         typename pred_list::iterator iter;
         PredicateType type;
+        uint32_t partition;
         friend class Predicates;
 
     public:
-        pred_handle() : valid(false), type(PredicateType::ONE_TIME) {}
-        pred_handle(typename pred_list::iterator iter, PredicateType type)
-                : valid{true}, iter{iter}, type{type} {}
+        pred_handle() : valid(false), type(PredicateType::ONE_TIME), partition(0) {}
+        pred_handle(typename pred_list::iterator iter, PredicateType type, uint32_t partition)
+                : valid{true}, iter{iter}, type{type}, partition{partition} {}
         pred_handle(pred_handle&) = delete;
         pred_handle(pred_handle&& other)
-                : pred_handle(std::move(other.iter), other.type) {
+                : pred_handle(std::move(other.iter), other.type, other.partition) {
             other.valid = false;
         }
         pred_handle& operator=(pred_handle&) = delete;
         pred_handle& operator=(pred_handle&& other) {
             iter = std::move(other.iter);
             type = other.type;
+            partition = other.partition;
             valid = true;
             other.valid = false;
             return *this;
@@ -74,7 +139,30 @@ public:
 
     /** Inserts a single (predicate, trigger) pair to the appropriate predicate list. */
     pred_handle insert(pred predicate, trig trigger,
-                       PredicateType type = PredicateType::ONE_TIME);
+                       PredicateType type = PredicateType::ONE_TIME) {
+        return insert(predicate, trigger, type, {});
+    }
+
+    /**
+     * Inserts a (predicate, trigger) pair whose predicate only reads the SST
+     * memory described by dependencies, plus any state that only its own
+     * trigger changes. The predicate engine skips evaluating such a predicate
+     * while none of that memory has changed since its last evaluation, unless
+     * the predicate was true at its last evaluation.
+     */
+    pred_handle insert(pred predicate, trig trigger, PredicateType type,
+                       std::vector<PredicateDependency> dependencies) {
+        return insert(predicate, trigger, type, std::move(dependencies), 0);
+    }
+
+    /**
+     * Inserts a (predicate, trigger) pair with dependencies (which may be empty)
+     * into the partition for partition_key. Predicates with the same key are
+     * always evaluated by the same thread, in insertion order; predicates in
+     * different partitions may be evaluated, and their triggers run, concurrently.
+     */
+    pred_handle insert(pred predicate, trig trigger, PredicateType type,
+                       std::vector<PredicateDependency> dependencies, uint32_t partition_key);
 
     /** Inserts a predicate with a list of triggers (which will be run in
      * sequence) to the appropriate predicate list. */
@@ -92,6 +180,14 @@ public:
 
     /** Deletes all predicates, including evolvers and their triggers. */
     void clear();
+
+    /**
+     * Waits until no partition is running a trigger, except the partition of
+     * the calling thread if it is a detect thread. After remove() returns, the
+     * removed predicate's trigger may still be running on another partition's
+     * thread; calling this afterwards guarantees that it has finished.
+     */
+    void wait_for_triggers();
 };
 
 /**
@@ -105,27 +201,29 @@ public:
  * PredicateType::ONE_TIME
  */
 template <class DerivedSST>
-auto Predicates<DerivedSST>::insert(pred predicate, trig trigger, PredicateType type) -> pred_handle {
-    std::lock_guard<std::mutex> lock(predicate_mutex);
+auto Predicates<DerivedSST>::insert(pred predicate, trig trigger, PredicateType type,
+                                    std::vector<PredicateDependency> dependencies,
+                                    uint32_t partition_key) -> pred_handle {
+    auto entry = std::make_unique<predicate_entry>(std::move(predicate), std::move(trigger),
+                                                   std::move(dependencies));
+    const uint32_t partition_num = partition_key % partitions.size();
+    predicate_partition& partition = *partitions[partition_num];
+    std::lock_guard<std::mutex> lock(partition.predicate_mutex);
     if(type == PredicateType::ONE_TIME) {
-        one_time_predicates.push_back(std::make_unique<std::pair<pred, std::shared_ptr<trig>>>(
-                predicate, std::make_shared<trig>(trigger)));
-        return pred_handle(--one_time_predicates.end(), type);
+        partition.one_time_predicates.push_back(std::move(entry));
+        return pred_handle(--partition.one_time_predicates.end(), type, partition_num);
     } else if(type == PredicateType::RECURRENT) {
-        recurrent_predicates.push_back(std::make_unique<std::pair<pred, std::shared_ptr<trig>>>(
-                predicate, std::make_shared<trig>(trigger)));
-        return pred_handle(--recurrent_predicates.end(), type);
+        partition.recurrent_predicates.push_back(std::move(entry));
+        return pred_handle(--partition.recurrent_predicates.end(), type, partition_num);
     } else {
-        transition_predicates.push_back(std::make_unique<std::pair<pred, std::shared_ptr<trig>>>(
-                predicate, std::make_shared<trig>(trigger)));
-        transition_predicate_states.push_back(false);
-        return pred_handle(--transition_predicates.end(), type);
+        partition.transition_predicates.push_back(std::move(entry));
+        return pred_handle(--partition.transition_predicates.end(), type, partition_num);
     }
 }
 
 template <class DerivedSST>
 void Predicates<DerivedSST>::remove(pred_handle& handle) {
-    std::lock_guard<std::mutex> lock(predicate_mutex);
+    std::lock_guard<std::mutex> lock(partitions[handle.partition]->predicate_mutex);
     if(!handle.is_valid()) {
         return;
     }
@@ -135,14 +233,27 @@ void Predicates<DerivedSST>::remove(pred_handle& handle) {
 
 template <class DerivedSST>
 void Predicates<DerivedSST>::clear() {
-    std::lock_guard<std::mutex> lock(predicate_mutex);
-    using ptr_to_pred = std::unique_ptr<std::pair<pred, std::shared_ptr<trig>>>;
-    std::for_each(one_time_predicates.begin(), one_time_predicates.end(),
-                  [](ptr_to_pred& ptr) { ptr.reset(); });
-    std::for_each(recurrent_predicates.begin(), recurrent_predicates.end(),
-                  [](ptr_to_pred& ptr) { ptr.reset(); });
-    std::for_each(transition_predicates.begin(), transition_predicates.end(),
-                  [](ptr_to_pred& ptr) { ptr.reset(); });
+    using ptr_to_pred = std::unique_ptr<predicate_entry>;
+    for(auto& partition : partitions) {
+        std::lock_guard<std::mutex> lock(partition->predicate_mutex);
+        std::for_each(partition->one_time_predicates.begin(), partition->one_time_predicates.end(),
+                      [](ptr_to_pred& ptr) { ptr.reset(); });
+        std::for_each(partition->recurrent_predicates.begin(), partition->recurrent_predicates.end(),
+                      [](ptr_to_pred& ptr) { ptr.reset(); });
+        std::for_each(partition->transition_predicates.begin(), partition->transition_predicates.end(),
+                      [](ptr_to_pred& ptr) { ptr.reset(); });
+    }
+}
+
+template <class DerivedSST>
+void Predicates<DerivedSST>::wait_for_triggers() {
+    for(auto& partition : partitions) {
+        std::unique_lock<std::mutex> lock(partition->predicate_mutex);
+        if(partition->detect_thread == std::this_thread::get_id()) {
+            continue;
+        }
+        partition->trigger_done.wait(lock, [&partition]() { return !partition->trigger_running; });
+    }
 }
 
 } /* namespace sst */
@@ -120,6 +120,36 @@ public:
 
 typedef std::function<void(uint32_t)> failure_upcall_t;
 
+/** What the predicate evaluation thread does once no predicate has fired for a while. */
+enum class IdlePolicy {
+    /** Keep evaluating predicates without pause. */
+    SPIN,
+    /** Yield the CPU between passes. */
+    YIELD,
+    /** Sleep for a fixed time between passes. */
+    SLEEP,
+    /** Sleep between passes, doubling the sleep time after each idle pass up to a maximum. */
+    BACKOFF,
+    /** Block until a local put or completion wakes the thread, or a maximum time passes. */
+    BLOCK
+};
+
+inline IdlePolicy idle_policy_from_string(const std::string& idle_policy_string) {
+    if(idle_policy_string == "spin") {
+        return IdlePolicy::SPIN;
+    } else if(idle_policy_string == "yield") {
+        return IdlePolicy::YIELD;
+    } else if(idle_policy_string == "sleep") {
+        return IdlePolicy::SLEEP;
+    } else if(idle_policy_string == "backoff") {
+        return IdlePolicy::BACKOFF;
+    } else if(idle_policy_string == "block") {
+        return IdlePolicy::BLOCK;
+    } else {
+        throw "wrong value for SST idle policy: " + idle_policy_string + ". Check your config file.";
+    }
+}
+
 /** Constructor parameter pack for SST. */
 struct SSTParams {
     const std::vector<uint32_t>& members;
@@ -174,7 +204,10 @@ private:
     std::vector<std::thread> background_threads;
     std::atomic<bool> thread_shutdown;
 
-    void detect();
+    void detect(uint32_t partition_num);
+    bool needs_evaluation(typename Predicates<DerivedSST>::predicate_entry& entry);
+    void idle_wait(uint32_t& idle_backoff_us);
+    void wake_predicate_thread();
 
 public:
     Predicates<DerivedSST> predicates;
@@ -183,6 +216,15 @@ public:
 private:
     /** timeout settings for poll completion queue */
     const uint32_t poll_cq_timeout_ms;
+    /** What the predicate thread does once no predicate has fired for idle_spin_us */
+    const IdlePolicy idle_policy;
+    const uint32_t idle_spin_us;
+    /** The sleep time of the SLEEP policy, and the longest wait of the BACKOFF and BLOCK policies */
+    const uint32_t idle_sleep_us;
+    /** Futex word for the BLOCK policy, incremented by every wakeup */
+    std::atomic<uint32_t> wakeup_generation;
+    /** The number of predicate threads that may be blocked on wakeup_generation */
+    std::atomic<uint32_t> num_blocked_predicate_threads;
     /** Pointer to memory where the SST rows are stored. */
     volatile char* rows;
     // char* snapshot;
@@ -227,7 +269,13 @@ public:
     SST(DerivedSST* derived_class_pointer, const SSTParams& params)
             : derived_this(derived_class_pointer),
               thread_shutdown(false),
+              predicates(derecho::getConfUInt32(CONF_DERECHO_SST_PREDICATE_THREADS)),
               poll_cq_timeout_ms(derecho::getConfUInt32(CONF_DERECHO_SST_POLL_CQ_TIMEOUT_MS)),
+              idle_policy(idle_policy_from_string(derecho::getConfString(CONF_DERECHO_SST_IDLE_POLICY))),
+              idle_spin_us(derecho::getConfUInt32(CONF_DERECHO_SST_IDLE_SPIN_US)),
+              idle_sleep_us(derecho::getConfUInt32(CONF_DERECHO_SST_IDLE_SLEEP_US)),
+              wakeup_generation(0),
+              num_blocked_predicate_threads(0),
               members(params.members),
               num_members(members.size()),
               all_indices(num_members),
@@ -292,8 +340,9 @@ public:
             }
         }
 
-        std::thread detector(&SST::detect, this);
-        background_threads.push_back(std::move(detector));
+        for(uint32_t partition_num = 0; partition_num < predicates.partitions.size(); ++partition_num) {
+            background_threads.emplace_back(&SST::detect, this, partition_num);
+        }
     }
 
     ~SST();
@@ -380,6 +429,22 @@ public:
         put_with_completion(all_indices, offset, size);
     }
 
+    /** Describes a field, in some of the rows, as a dependency of a predicate. */
+    template <typename T>
+    PredicateDependency dependency(SSTField<T>& field, std::vector<uint32_t> row_indices) {
+        return {std::move(row_indices), static_cast<size_t>(field.get_base() - getBaseAddress()), sizeof(T)};
+    }
+
+    /** Describes a single element of a vector field, in some of the rows, as a dependency of a predicate. */
+    template <typename T>
+    PredicateDependency dependency(SSTFieldVector<T>& vec_field, std::size_t index,
+                                   std::vector<uint32_t> row_indices) {
+        return {std::move(row_indices),
+                static_cast<size_t>(const_cast<char*>(reinterpret_cast<volatile char*>(std::addressof(vec_field[0][index])))
+                                    - getBaseAddress()),
+                sizeof(T)};
+    }
+
     /** Writes a contiguous subset of the local row to some of the remote nodes. */
     void put(const std::vector<uint32_t> receiver_ranks, size_t offset, size_t size);
 
@@ -1,3 +1,4 @@
+#include <chrono>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -83,10 +84,36 @@ int main(int argc, char* argv[]) {
             break;
     }
 
+    // Delivery time of each version, to measure how long it takes to persist it.
+    // The persistence thread may persist many versions at once (group commit),
+    // so each persistence callback covers every version since the previous one.
+    std::vector<std::chrono::steady_clock::time_point> delivery_times(total_num_messages);
+    persistent::version_t last_persisted_version = -1;
+    uint64_t num_persistence_callbacks = 0;
+    double total_persist_latency_us = 0;
+    double max_persist_latency_us = 0;
+
     derecho::CallbackSet callback_set{
-            nullptr,  //we don't need the stability_callback here
+            [&](derecho::subgroup_id_t subgroup, node_id_t sender_id, derecho::message_id_t index,
+                std::optional<std::pair<char*, long long int>> data, persistent::version_t ver) {
+                if(ver >= 0 && ver < total_num_messages) {
+                    delivery_times[ver] = std::chrono::steady_clock::now();
+                }
+            },
             [&](derecho::subgroup_id_t subgroup, persistent::version_t ver) {
+                auto now = std::chrono::steady_clock::now();
+                num_persistence_callbacks++;
+                for(persistent::version_t v = last_persisted_version + 1; v <= ver && v < total_num_messages; v++) {
+                    double latency_us = std::chrono::duration<double, std::micro>(now - delivery_times[v]).count();
+                    total_persist_latency_us += latency_us;
+                    max_persist_latency_us = std::max(max_persist_latency_us, latency_us);
+                }
+                last_persisted_version = std::max(last_persisted_version, ver);
                 if(ver == (total_num_messages - 1)) {
+                    std::cout << "(pers)flushes:" << num_persistence_callbacks << ", "
+                              << (double)total_num_messages / num_persistence_callbacks << " versions per flush." << std::endl;
+                    std::cout << "(pers)latency:" << total_persist_latency_us / total_num_messages << " us average, "
+                              << max_persist_latency_us << " us maximum." << std::endl;
                     if(is_sending) {
                         clock_gettime(CLOCK_REALTIME, &t3);
                         int64_t nsec = ((int64_t)t3.tv_sec - t1.tv_sec) * 1000000000 + t3.tv_nsec - t1.tv_nsec;
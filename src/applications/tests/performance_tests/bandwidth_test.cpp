@@ -2,7 +2,9 @@
  * This test measures the bandwidth of Derecho raw (uncooked) sends in GB/s as a function of
  * 1. the number of nodes 2. the number of senders (all sending, half nodes sending, one sending)
  * 3. message size 4. window size 5. number of messages sent per sender
- * 6. delivery mode (atomic multicast or unordered)
+ * 6. delivery mode (atomic multicast or unordered) 7. message size (optional), which together with
+ * SUBGROUP/DEFAULT/max_smc_payload_size decides how full each SMC slot is
+ * (smc_payload_sweep.sh repeats the test over a range of max_smc_payload_size values)
  * The test waits for every node to join and then each sender starts sending messages continuously
  * in the only subgroup that consists of all the nodes
  * Upon completion, the results are appended to file data_derecho_bw on the leader
@@ -34,29 +36,38 @@ struct exp_result {
     uint num_messages;
     uint delivery_mode;
     double bw;
+    long long unsigned int max_smc_payload_size;
 
     void print(std::ofstream& fout) {
         fout << num_nodes << " " << num_senders_selector << " "
              << max_msg_size << " " << window_size << " "
              << num_messages << " " << delivery_mode << " "
-             << bw << endl;
+             << bw << " " << max_smc_payload_size << endl;
     }
 };
 
 int main(int argc, char* argv[]) {
-    if(argc < 5 || (argc > 5 && strcmp("--", argv[argc - 5]))) {
+    // the test arguments come last, after "--" if there is a derecho-config-list
+    int first_arg = 1;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp("--", argv[i]) == 0) {
+            first_arg = i + 1;
+        }
+    }
+    if(argc - first_arg < 4 || argc - first_arg > 5) {
         cout << "Invalid command line arguments." << endl;
-        cout << "USAGE:" << argv[0] << "[ derecho-config-list -- ] num_nodes, num_senders_selector (0 - all senders, 1 - half senders, 2 - one sender), num_messages, delivery_mode (0 - ordered mode, 1 - unordered mode)" << endl;
+        cout << "USAGE:" << argv[0] << "[ derecho-config-list -- ] num_nodes, num_senders_selector (0 - all senders, 1 - half senders, 2 - one sender), num_messages, delivery_mode (0 - ordered mode, 1 - unordered mode)[, message_size (default: max payload size)]" << endl;
         cout << "Thank you" << endl;
         return -1;
     }
     pthread_setname_np(pthread_self(), "bw_test");
 
     // initialize the special arguments for this test
-    const uint num_nodes = std::stoi(argv[argc - 4]);
-    const uint num_senders_selector = std::stoi(argv[argc - 3]);
-    const uint num_messages = std::stoi(argv[argc - 2]);
-    const uint delivery_mode = std::stoi(argv[argc - 1]);
+    const uint num_nodes = std::stoi(argv[first_arg]);
+    const uint num_senders_selector = std::stoi(argv[first_arg + 1]);
+    const uint num_messages = std::stoi(argv[first_arg + 2]);
+    const uint delivery_mode = std::stoi(argv[first_arg + 3]);
+    const long long unsigned int message_size = (argc - first_arg > 4) ? std::stoull(argv[first_arg + 4]) : 0;
 
     // Read configurations from the command line options as well as the default config file
     Conf::initialize(argc, argv);
@@ -142,7 +153,8 @@ int main(int argc, char* argv[]) {
     auto members_order = group.get_members();
     uint32_t node_rank = group.get_my_rank();
 
-    long long unsigned int max_msg_size = getConfUInt64(CONF_SUBGROUP_DEFAULT_MAX_PAYLOAD_SIZE);
+    long long unsigned int max_msg_size = message_size ? message_size
+                                                       : getConfUInt64(CONF_SUBGROUP_DEFAULT_MAX_PAYLOAD_SIZE);
 
     // this function sends all the messages
     auto send_all = [&]() {
@@ -191,7 +203,8 @@ int main(int argc, char* argv[]) {
     if(node_rank == 0) {
         log_results(exp_result{num_nodes, num_senders_selector, max_msg_size,
                                getConfUInt32(CONF_SUBGROUP_DEFAULT_WINDOW_SIZE), num_messages,
-                               delivery_mode, avg_bw},
+                               delivery_mode, avg_bw,
+                               getConfUInt64(CONF_SUBGROUP_DEFAULT_MAX_SMC_PAYLOAD_SIZE)},
                     "data_derecho_bw");
     }
 
@@ -3,6 +3,9 @@
  * 1. the number of nodes 2. message size
  * 3. the number of senders (all sending, half nodes sending, one sending)
  * 4. delivery mode (atomic multicast or unordered)
+ * The message size is the max payload size unless it is given; together with
+ * SUBGROUP/DEFAULT/max_smc_payload_size it decides how full each SMC slot is
+ * (smc_payload_sweep.sh repeats the test over a range of max_smc_payload_size values)
  * The test waits for every node to join and then each sender starts sending messages continuously
  * in the only subgroup that consists of all the nodes
  * Upon completion, the results are appended to file data_latency on the leader
@@ -37,32 +40,41 @@ struct exp_result {
     uint32_t delivery_mode;
     double latency;
     double stddev;
+    long long unsigned int max_smc_payload_size;
 
     void print(std::ofstream& fout) {
         fout << num_nodes << " " << max_msg_size << " "
 	     << num_senders_selector << " "
              << delivery_mode << " " << latency << " "
-             << stddev << endl;
+             << stddev << " " << max_smc_payload_size << endl;
     }
 };
 
 int main(int argc, char* argv[]) {
-  if(argc < 4 || (argc > 4 && strcmp("--", argv[argc - 4]))) {
+    // the test arguments come last, after "--" if there is a derecho-config-list
+    int first_arg = 1;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp("--", argv[i]) == 0) {
+            first_arg = i + 1;
+        }
+    }
+    if(argc - first_arg < 3 || argc - first_arg > 4) {
         cout << "Insufficient number of command line arguments" << endl;
-        cout << "USAGE:" << argv[0] << "[ derecho-config-list -- ] num_nodes, num_senders_selector (0 - all senders, 1 - half senders, 2 - one sender), delivery_mode (0 - ordered mode, 1 - unordered mode)" << endl;
+        cout << "USAGE:" << argv[0] << "[ derecho-config-list -- ] num_nodes, num_senders_selector (0 - all senders, 1 - half senders, 2 - one sender), delivery_mode (0 - ordered mode, 1 - unordered mode)[, message_size (default: max payload size)]" << endl;
         return -1;
     }
     pthread_setname_np(pthread_self(), "latency_test");
 
     // initialize the special arguments for this test
-    uint32_t num_nodes = std::stoi(argv[argc - 3]);
-    const uint32_t num_senders_selector = std::stoi(argv[argc - 2]);
-    const uint32_t delivery_mode = std::stoi(argv[argc - 1]);
+    uint32_t num_nodes = std::stoi(argv[first_arg]);
+    const uint32_t num_senders_selector = std::stoi(argv[first_arg + 1]);
+    const uint32_t delivery_mode = std::stoi(argv[first_arg + 2]);
+    const uint64_t message_size = (argc - first_arg > 3) ? std::stoull(argv[first_arg + 3]) : 0;
 
     // Read configurations from the command line options as well as the default config file
     Conf::initialize(argc, argv);
 
-    const uint64_t msg_size = getConfUInt64(CONF_SUBGROUP_DEFAULT_MAX_PAYLOAD_SIZE);
+    const uint64_t msg_size = message_size ? message_size : getConfUInt64(CONF_SUBGROUP_DEFAULT_MAX_PAYLOAD_SIZE);
 
     uint32_t num_messages = 1000;
     // used by the sending nodes to track time of delivery of messages
@@ -207,7 +219,9 @@ int main(int argc, char* argv[]) {
 
     // log the result at the leader node
     if(my_rank == 0) {
-        log_results(exp_result{num_nodes, msg_size, num_senders_selector, delivery_mode, avg_latency, avg_std_dev}, "data_latency");
+        log_results(exp_result{num_nodes, msg_size, num_senders_selector, delivery_mode, avg_latency, avg_std_dev,
+                               getConfUInt64(CONF_SUBGROUP_DEFAULT_MAX_SMC_PAYLOAD_SIZE)},
+                    "data_latency");
     }
     managed_group.barrier_sync();
     managed_group.leave();
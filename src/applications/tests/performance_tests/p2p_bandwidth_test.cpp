@@ -0,0 +1,127 @@
+/*
+ * This test measures the latency and bandwidth of Derecho P2P sends as a function of
+ * the payload size. The node ranked 1 sends num_messages P2P queries, each carrying
+ * a payload of the given size, to the node ranked 0; it first sends them one at a time,
+ * waiting for each reply, then sends them back to back and waits for all the replies, and
+ * finally sends them all with a single p2p_send_batch call and waits for all the replies.
+ * Upon completion, the results are appended to file data_p2p_bw on the sender
+ */
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <derecho/core/derecho.hpp>
+#include "log_results.hpp"
+
+using std::cout;
+using std::endl;
+
+using namespace derecho;
+
+struct exp_result {
+    uint64_t payload_size;
+    uint num_messages;
+    double latency_us;
+    double bw;
+    double batch_bw;
+
+    void print(std::ofstream& fout) {
+        fout << payload_size << " " << num_messages << " "
+             << latency_us << " " << bw << " " << batch_bw << endl;
+    }
+};
+
+/**
+ * A replicated object whose only function accepts a payload and returns
+ * its size, so that replies stay small whatever the payload size.
+ */
+struct PayloadSink {
+    uint64_t receive(const std::string& payload) const {
+        return payload.size();
+    }
+
+    REGISTER_RPC_FUNCTIONS(PayloadSink, receive);
+};
+
+int main(int argc, char* argv[]) {
+    if(argc < 3 || (argc > 3 && strcmp("--", argv[argc - 3]))) {
+        cout << "Invalid command line arguments." << endl;
+        cout << "USAGE:" << argv[0] << "[ derecho-config-list -- ] payload_size num_messages" << endl;
+        cout << "Thank you" << endl;
+        return -1;
+    }
+    pthread_setname_np(pthread_self(), "p2p_bw_test");
+
+    const uint64_t payload_size = std::stoull(argv[argc - 2]);
+    const uint num_messages = std::stoi(argv[argc - 1]);
+
+    Conf::initialize(argc, argv);
+
+    SubgroupInfo subgroup_info{[](const std::vector<std::type_index>& subgroup_type_order,
+                                  const std::unique_ptr<View>& prev_view, View& curr_view) {
+        if(curr_view.num_members < 2) {
+            throw subgroup_provisioning_exception();
+        }
+        subgroup_shard_layout_t subgroup_vector(1);
+        std::vector<node_id_t> first_2_nodes(&curr_view.members[0], &curr_view.members[0] + 2);
+        subgroup_vector[0].emplace_back(curr_view.make_subview(first_2_nodes));
+        curr_view.next_unassigned_rank = std::max(curr_view.next_unassigned_rank, 2);
+        subgroup_allocation_map_t subgroup_allocation;
+        subgroup_allocation.emplace(std::type_index(typeid(PayloadSink)), std::move(subgroup_vector));
+        return subgroup_allocation;
+    }};
+
+    Group<PayloadSink> group(CallbackSet{}, subgroup_info, nullptr,
+                             std::vector<view_upcall_t>{},
+                             [](persistent::PersistentRegistry*) { return std::make_unique<PayloadSink>(); });
+
+    cout << "Finished constructing/joining Group" << endl;
+    const uint32_t node_rank = group.get_my_rank();
+
+    if(node_rank == 1) {
+        Replicated<PayloadSink>& sink_handle = group.get_subgroup<PayloadSink>();
+        const node_id_t receiver_id = group.get_members()[0];
+        const std::string payload(payload_size, 'a');
+
+        // round trips, one message in flight at a time
+        auto start_time = std::chrono::steady_clock::now();
+        for(uint i = 0; i < num_messages; ++i) {
+            auto results = sink_handle.p2p_send<RPC_NAME(receive)>(receiver_id, payload);
+            results.get().get(receiver_id);
+        }
+        auto end_time = std::chrono::steady_clock::now();
+        double latency_us = std::chrono::duration<double, std::micro>(end_time - start_time).count() / num_messages;
+
+        // back to back, as many messages in flight as the P2P window allows
+        std::vector<rpc::QueryResults<uint64_t>> pending;
+        pending.reserve(num_messages);
+        start_time = std::chrono::steady_clock::now();
+        for(uint i = 0; i < num_messages; ++i) {
+            pending.emplace_back(sink_handle.p2p_send<RPC_NAME(receive)>(receiver_id, payload));
+        }
+        for(auto& results : pending) {
+            results.get().get(receiver_id);
+        }
+        end_time = std::chrono::steady_clock::now();
+        long long int nanoseconds_elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count();
+        double bw = (payload_size * num_messages + 0.0) / nanoseconds_elapsed;
+
+        // batched, filling every free slot in the P2P window at once
+        const std::vector<std::string> payloads(num_messages, payload);
+        start_time = std::chrono::steady_clock::now();
+        auto batch_results = sink_handle.p2p_send_batch<RPC_NAME(receive)>(receiver_id, payloads);
+        for(auto& results : batch_results) {
+            results.get().get(receiver_id);
+        }
+        end_time = std::chrono::steady_clock::now();
+        nanoseconds_elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count();
+        double batch_bw = (payload_size * num_messages + 0.0) / nanoseconds_elapsed;
+
+        log_results(exp_result{payload_size, num_messages, latency_us, bw, batch_bw}, "data_p2p_bw");
+    }
+
+    group.barrier_sync();
+    group.leave();
+}
@@ -0,0 +1,150 @@
+/*
+ * This test measures the cost of one pass of the SST predicate evaluation thread
+ * as a function of 1. the number of subgroups and 2. the way predicates are registered
+ * (0 - a predicate that is always true, with the check in the trigger, 1 - a real
+ * predicate, 2 - a real predicate with declared dependencies).
+ * It needs only the local node: it builds a single-row SST with one sequence-number
+ * entry per subgroup, and registers for each subgroup a recurrent predicate that
+ * "delivers" new sequence numbers, much like the delivery predicate of a
+ * MulticastGroup. It then reports
+ * 1. the average time of a pass over all predicates, measured by a predicate that
+ *    counts passes, and
+ * 2. the average time from bumping the sequence number of a subgroup until its
+ *    predicate has fired.
+ * Each subgroup's predicate is inserted with its subgroup number as the partition key,
+ * so running with --DERECHO/sst_predicate_threads=N spreads the subgroups over N
+ * evaluation threads; the pass time is then that of the first thread.
+ * The results are appended to file data_predicate_scaling
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <derecho/conf/conf.hpp>
+#include <derecho/sst/sst.hpp>
+#include <derecho/utils/time.h>
+
+#include "log_results.hpp"
+
+using std::cout;
+using std::endl;
+
+class PredicateScalingSST : public sst::SST<PredicateScalingSST> {
+public:
+    sst::SSTFieldVector<int32_t> seq_num;
+    sst::SSTFieldVector<int32_t> delivered_num;
+    PredicateScalingSST(const sst::SSTParams& params, uint32_t num_subgroups)
+            : SST<PredicateScalingSST>(this, params),
+              seq_num(num_subgroups),
+              delivered_num(num_subgroups) {
+        SSTInit(seq_num, delivered_num);
+        for(uint32_t i = 0; i < num_subgroups; ++i) {
+            seq_num[0][i] = -1;
+            delivered_num[0][i] = -1;
+        }
+    }
+};
+
+struct exp_result {
+    uint32_t num_subgroups;
+    uint32_t predicate_style;
+    double pass_time;
+    double latency;
+
+    void print(std::ofstream& fout) {
+        fout << num_subgroups << " " << predicate_style << " "
+             << pass_time << " " << latency << endl;
+    }
+};
+
+exp_result run_experiment(const std::vector<uint32_t>& members, uint32_t num_subgroups, uint32_t predicate_style) {
+    const uint32_t num_trials = 1000;
+    PredicateScalingSST sst(sst::SSTParams(members, members[0]), num_subgroups);
+
+    for(uint32_t subgroup_num = 0; subgroup_num < num_subgroups; ++subgroup_num) {
+        auto delivery_pred = [subgroup_num](const PredicateScalingSST& sst) {
+            return sst.seq_num[0][subgroup_num] > sst.delivered_num[0][subgroup_num];
+        };
+        auto delivery_trig = [subgroup_num](PredicateScalingSST& sst) {
+            sst.delivered_num[0][subgroup_num] = sst.seq_num[0][subgroup_num];
+        };
+        if(predicate_style == 0) {
+            sst.predicates.insert([](const PredicateScalingSST&) { return true; },
+                                  [delivery_pred, delivery_trig](PredicateScalingSST& sst) {
+                                      if(delivery_pred(sst)) {
+                                          delivery_trig(sst);
+                                      }
+                                  },
+                                  sst::PredicateType::RECURRENT, {}, subgroup_num);
+        } else if(predicate_style == 1) {
+            sst.predicates.insert(delivery_pred, delivery_trig, sst::PredicateType::RECURRENT, {}, subgroup_num);
+        } else {
+            sst.predicates.insert(delivery_pred, delivery_trig, sst::PredicateType::RECURRENT,
+                                  {sst.dependency(sst.seq_num, subgroup_num, {0}),
+                                   sst.dependency(sst.delivered_num, subgroup_num, {0})},
+                                  subgroup_num);
+        }
+    }
+    // fires on every pass, which also keeps the evaluation thread from sleeping
+    std::atomic<uint64_t> num_passes{0};
+    sst.predicates.insert([](const PredicateScalingSST&) { return true; },
+                          [&num_passes](PredicateScalingSST&) { num_passes++; },
+                          sst::PredicateType::RECURRENT);
+
+    sst.start_predicate_evaluation();
+    uint64_t total_latency = 0;
+    const uint64_t start_time = get_time();
+    const uint64_t start_passes = num_passes;
+    for(uint32_t trial = 0; trial < num_trials; ++trial) {
+        const uint32_t subgroup_num = trial % num_subgroups;
+        const uint64_t send_time = get_time();
+        sst.seq_num[0][subgroup_num]++;
+        while(sst.delivered_num[0][subgroup_num] != sst.seq_num[0][subgroup_num]) {
+        }
+        total_latency += get_time() - send_time;
+    }
+    const uint64_t elapsed_time = get_time() - start_time;
+    const uint64_t elapsed_passes = num_passes - start_passes;
+    sst.predicates.clear();
+
+    // times in microseconds
+    return {num_subgroups, predicate_style,
+            elapsed_passes ? elapsed_time / 1000.0 / elapsed_passes : 0.0,
+            total_latency / 1000.0 / num_trials};
+}
+
+int main(int argc, char* argv[]) {
+    int first_arg = 1;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp("--", argv[i]) == 0) {
+            first_arg = i + 1;
+        }
+    }
+    if(first_arg >= argc) {
+        cout << "Insufficient number of command line arguments" << endl;
+        cout << "USAGE:" << argv[0] << " [ derecho-config-list -- ] num_subgroups [num_subgroups ...]" << endl;
+        return -1;
+    }
+    pthread_setname_np(pthread_self(), "predicate_test");
+
+    // Read configurations from the command line options as well as the default config file
+    derecho::Conf::initialize(argc, argv);
+    const std::vector<uint32_t> members{derecho::getConfUInt32(CONF_DERECHO_LOCAL_ID)};
+
+    for(int arg = first_arg; arg < argc; ++arg) {
+        const uint32_t num_subgroups = std::stoi(argv[arg]);
+        for(uint32_t predicate_style = 0; predicate_style < 3; ++predicate_style) {
+            exp_result result = run_experiment(members, num_subgroups, predicate_style);
+            cout << "subgroups: " << result.num_subgroups
+                 << ", predicate style: " << predicate_style
+                 << ", pass time (us): " << result.pass_time
+                 << ", trigger latency (us): " << result.latency << endl;
+            log_results(result, "data_predicate_scaling");
+        }
+    }
+}
@@ -0,0 +1,93 @@
+/*
+ * This test measures how long it takes to find the handler for an incoming RPC message.
+ * It registers num_functions handlers in each of num_subgroups subgroups, then looks up
+ * num_lookups randomly chosen opcodes, first in the std::map that RPCManager registers
+ * handlers in and then in the DispatchTable that RPCManager::receive_message searches.
+ * Upon completion, the results are appended to file data_rpc_dispatch
+ */
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <derecho/core/detail/dispatch_table.hpp>
+#include "log_results.hpp"
+
+using std::cout;
+using std::endl;
+
+using namespace derecho;
+using namespace derecho::rpc;
+
+struct exp_result {
+    uint32_t num_subgroups;
+    uint32_t num_functions;
+    uint64_t num_lookups;
+    double map_ns_per_lookup;
+    double table_ns_per_lookup;
+
+    void print(std::ofstream& fout) {
+        fout << num_subgroups << " " << num_functions << " " << num_lookups << " "
+             << map_ns_per_lookup << " " << table_ns_per_lookup << endl;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    if(argc < 4) {
+        std::cout << "Usage: " << argv[0] << " <num_subgroups> <num_functions> <num_lookups>" << std::endl;
+        return -1;
+    }
+    const uint32_t num_subgroups = std::stoul(argv[1]);
+    const uint32_t num_functions = std::stoul(argv[2]);
+    const uint64_t num_lookups = std::stoull(argv[3]);
+
+    // Function tags are hashes of the function names, so use random ones
+    std::mt19937_64 random_engine(num_subgroups * num_functions);
+    std::vector<Opcode> opcodes;
+    std::map<Opcode, receive_fun_t> receivers;
+    for(subgroup_id_t subgroup_id = 0; subgroup_id < num_subgroups; ++subgroup_id) {
+        for(uint32_t function = 0; function < num_functions; ++function) {
+            const FunctionTag function_id = random_engine();
+            for(bool is_reply : {false, true}) {
+                Opcode opcode{static_cast<subgroup_type_id_t>(subgroup_id % 4), subgroup_id, function_id, is_reply};
+                receivers.emplace(opcode, [](mutils::DeserializationManager*, const node_id_t&, const char*,
+                                             const std::function<char*(int)>&) { return recv_ret{}; });
+                opcodes.push_back(opcode);
+            }
+        }
+    }
+    DispatchTable dispatch_table;
+    dispatch_table.rebuild(receivers);
+
+    std::vector<std::size_t> lookup_order(num_lookups);
+    std::uniform_int_distribution<std::size_t> pick_opcode(0, opcodes.size() - 1);
+    for(auto& index : lookup_order) {
+        index = pick_opcode(random_engine);
+    }
+
+    // Count the handlers found so the lookups cannot be optimized away
+    uint64_t map_found = 0;
+    auto start_time = std::chrono::steady_clock::now();
+    for(const auto& index : lookup_order) {
+        map_found += receivers.find(opcodes[index]) != receivers.end();
+    }
+    auto map_time = std::chrono::steady_clock::now() - start_time;
+
+    uint64_t table_found = 0;
+    start_time = std::chrono::steady_clock::now();
+    for(const auto& index : lookup_order) {
+        table_found += static_cast<bool>(dispatch_table.find(opcodes[index]));
+    }
+    auto table_time = std::chrono::steady_clock::now() - start_time;
+    if(map_found != num_lookups || table_found != num_lookups) {
+        std::cout << "DispatchTable did not find every handler in the receivers map!" << std::endl;
+        return -1;
+    }
+
+    const double map_ns = std::chrono::duration<double, std::nano>(map_time).count() / num_lookups;
+    const double table_ns = std::chrono::duration<double, std::nano>(table_time).count() / num_lookups;
+    cout << "std::map lookup: " << map_ns << " ns, DispatchTable lookup: " << table_ns << " ns" << endl;
+    log_results(exp_result{num_subgroups, num_functions, num_lookups, map_ns, table_ns}, "data_rpc_dispatch");
+}
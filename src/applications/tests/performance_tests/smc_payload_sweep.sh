@@ -0,0 +1,22 @@
+#!/bin/bash
+# Runs bandwidth_test or latency_test once for each max_smc_payload_size value,
+# with the message size fixed, to show how the width of the SMC slots affects
+# performance when a message fills only part of its slot. Start it on every
+# node at the same time, with the same arguments; each run appends one line to
+# data_derecho_bw or data_latency on the leader, ending with the slot width.
+# The widths are taken from SMC_PAYLOAD_SIZES.
+if [ $# -lt 2 ] || { [ "$1" != "bandwidth_test" ] && [ "$1" != "latency_test" ]; }; then
+    echo "USAGE: $0 bandwidth_test|latency_test test-arguments..."
+    echo "The test arguments should include the message size. The default"
+    echo "SMC_PAYLOAD_SIZES are \"1024 4096 16384 65536\"."
+    exit 1
+fi
+test_name=$1
+shift 1
+smc_payload_sizes=${SMC_PAYLOAD_SIZES:-1024 4096 16384 65536}
+
+for smc_payload_size in $smc_payload_sizes; do
+    "$(dirname "$0")"/$test_name --SUBGROUP/DEFAULT/max_smc_payload_size=$smc_payload_size -- "$@" || exit 1
+    # give the other nodes time to leave before the next group forms
+    sleep 5
+done
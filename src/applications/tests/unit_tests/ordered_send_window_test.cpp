@@ -0,0 +1,119 @@
+#include <derecho/core/derecho.hpp>
+#include <derecho/mutils-serialization/SerializationSupport.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Checks ordered_send when many more messages are in flight than the send
+ * window holds: several threads on every node send at once, so most sends
+ * are queued until the window opens, and every one must still be delivered
+ * exactly once, in the same order everywhere, with its reply.
+ */
+
+#ifdef __CDT_PARSER__
+#define REGISTER_RPC_FUNCTIONS(...)
+#define RPC_NAME(...) 0ULL
+#endif
+
+class SendCounter : public mutils::ByteRepresentable {
+    std::map<uint32_t, uint32_t> counts;
+    uint64_t total;
+
+public:
+    /** Counts one message from sender and returns the total number of messages counted so far */
+    uint64_t count(const uint32_t& sender) {
+        counts[sender]++;
+        return ++total;
+    }
+    std::map<uint32_t, uint32_t> get_counts() const {
+        return counts;
+    }
+
+    SendCounter(const std::map<uint32_t, uint32_t>& counts = {}, uint64_t total = 0)
+            : counts(counts), total(total) {}
+
+    DEFAULT_SERIALIZATION_SUPPORT(SendCounter, counts, total);
+    REGISTER_RPC_FUNCTIONS(SendCounter, count, get_counts);
+};
+
+using derecho::fixed_even_shards;
+using derecho::one_subgroup_policy;
+
+int main(int argc, char** argv) {
+    if(argc < 4) {
+        std::cout << "Usage: " << argv[0] << " <num_nodes> <num_threads> <msgs_per_thread> [configuration options...]" << std::endl;
+        return 1;
+    }
+    const uint32_t num_nodes = std::stoi(argv[1]);
+    const uint32_t num_threads = std::stoi(argv[2]);
+    const uint32_t msgs_per_thread = std::stoi(argv[3]);
+    derecho::Conf::initialize(argc, argv);
+
+    derecho::SubgroupInfo subgroup_function(derecho::DefaultSubgroupAllocator({
+        {std::type_index(typeid(SendCounter)), one_subgroup_policy(fixed_even_shards(1, num_nodes))}
+    }));
+    auto counter_factory = [](persistent::PersistentRegistry*) { return std::make_unique<SendCounter>(); };
+
+    derecho::Group<SendCounter> group(derecho::CallbackSet{}, subgroup_function, nullptr,
+                                      std::vector<derecho::view_upcall_t>{},
+                                      counter_factory);
+    const uint32_t my_id = derecho::getConfUInt32(CONF_DERECHO_LOCAL_ID);
+    derecho::Replicated<SendCounter>& counter = group.get_subgroup<SendCounter>();
+
+    // Each thread sends all of its messages before waiting for any reply. Each
+    // reply is the position of that message in the delivery order, which must
+    // agree at every member; a failed send shows up as a missing reply.
+    std::vector<char> thread_ok(num_threads, true);
+    std::vector<std::thread> senders;
+    for(uint32_t t = 0; t < num_threads; ++t) {
+        senders.emplace_back([&, t]() {
+            std::vector<derecho::rpc::QueryResults<uint64_t>> sent;
+            for(uint32_t i = 0; i < msgs_per_thread; ++i) {
+                sent.emplace_back(counter.ordered_send<RPC_NAME(count)>(my_id));
+            }
+            for(auto& results : sent) {
+                uint32_t num_replies = 0;
+                uint64_t position = 0;
+                for(auto& reply_pair : results.get()) {
+                    uint64_t reply = reply_pair.second.get();
+                    if(num_replies++ > 0 && reply != position) {
+                        thread_ok[t] = false;
+                    }
+                    position = reply;
+                }
+                if(num_replies != num_nodes) {
+                    thread_ok[t] = false;
+                }
+            }
+        });
+    }
+    for(auto& sender : senders) {
+        sender.join();
+    }
+    group.barrier_sync();
+
+    bool passed = std::all_of(thread_ok.begin(), thread_ok.end(), [](char ok) { return ok; });
+    auto results = counter.ordered_send<RPC_NAME(get_counts)>();
+    for(auto& reply_pair : results.get()) {
+        std::map<uint32_t, uint32_t> counts = reply_pair.second.get();
+        if(counts.size() != num_nodes) {
+            passed = false;
+        }
+        for(const auto& count_pair : counts) {
+            if(count_pair.second != num_threads * msgs_per_thread) {
+                std::cout << "Node " << reply_pair.first << " counted " << count_pair.second
+                          << " messages from node " << count_pair.first << std::endl;
+                passed = false;
+            }
+        }
+    }
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    group.barrier_sync();
+    group.leave();
+    return passed ? 0 : 1;
+}
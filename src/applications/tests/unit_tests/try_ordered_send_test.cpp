@@ -0,0 +1,108 @@
+#include <derecho/core/derecho.hpp>
+#include <derecho/mutils-serialization/SerializationSupport.hpp>
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Checks try_ordered_send: every node sends without waiting for the send
+ * window, so some attempts find it full and must return without sending.
+ * Every attempt that did send must be delivered exactly once everywhere,
+ * and no other message may be delivered.
+ */
+
+#ifdef __CDT_PARSER__
+#define REGISTER_RPC_FUNCTIONS(...)
+#define RPC_NAME(...) 0ULL
+#endif
+
+class SendCounter : public mutils::ByteRepresentable {
+    std::map<uint32_t, uint32_t> counts;
+
+public:
+    /** Counts one message from sender and returns the number of messages counted from it so far */
+    uint32_t count(const uint32_t& sender) {
+        return ++counts[sender];
+    }
+    std::map<uint32_t, uint32_t> get_counts() const {
+        return counts;
+    }
+
+    SendCounter(const std::map<uint32_t, uint32_t>& counts = {}) : counts(counts) {}
+
+    DEFAULT_SERIALIZATION_SUPPORT(SendCounter, counts);
+    REGISTER_RPC_FUNCTIONS(SendCounter, count, get_counts);
+};
+
+using derecho::fixed_even_shards;
+using derecho::one_subgroup_policy;
+
+int main(int argc, char** argv) {
+    if(argc < 3) {
+        std::cout << "Usage: " << argv[0] << " <num_nodes> <num_msgs> [configuration options...]" << std::endl;
+        return 1;
+    }
+    const uint32_t num_nodes = std::stoi(argv[1]);
+    const uint32_t num_msgs = std::stoi(argv[2]);
+    derecho::Conf::initialize(argc, argv);
+
+    derecho::SubgroupInfo subgroup_function(derecho::DefaultSubgroupAllocator({
+        {std::type_index(typeid(SendCounter)), one_subgroup_policy(fixed_even_shards(1, num_nodes))}
+    }));
+    auto counter_factory = [](persistent::PersistentRegistry*) { return std::make_unique<SendCounter>(); };
+
+    derecho::Group<SendCounter> group(derecho::CallbackSet{}, subgroup_function, nullptr,
+                                      std::vector<derecho::view_upcall_t>{},
+                                      counter_factory);
+    const uint32_t my_id = derecho::getConfUInt32(CONF_DERECHO_LOCAL_ID);
+    derecho::Replicated<SendCounter>& counter = group.get_subgroup<SendCounter>();
+
+    // Attempt num_msgs sends back to back, keeping the replies of those that
+    // were sent; a full window shows up as an empty result.
+    std::vector<derecho::rpc::QueryResults<uint32_t>> sent;
+    uint32_t num_full = 0;
+    for(uint32_t i = 0; i < num_msgs; ++i) {
+        auto results = counter.try_ordered_send<RPC_NAME(count)>(my_id);
+        if(results) {
+            sent.emplace_back(std::move(*results));
+        } else {
+            num_full++;
+        }
+    }
+    std::cout << "Sent " << sent.size() << " of " << num_msgs << " messages; the window was full "
+              << num_full << " times" << std::endl;
+
+    // The n-th message sent must be the n-th one counted from this node
+    bool passed = !sent.empty();
+    uint32_t expected = 0;
+    for(auto& results : sent) {
+        expected++;
+        uint32_t num_replies = 0;
+        for(auto& reply_pair : results.get()) {
+            num_replies++;
+            if(reply_pair.second.get() != expected) {
+                passed = false;
+            }
+        }
+        if(num_replies != num_nodes) {
+            passed = false;
+        }
+    }
+    group.barrier_sync();
+
+    auto results = counter.ordered_send<RPC_NAME(get_counts)>();
+    for(auto& reply_pair : results.get()) {
+        std::map<uint32_t, uint32_t> counts = reply_pair.second.get();
+        if(counts[my_id] != sent.size()) {
+            std::cout << "Node " << reply_pair.first << " counted " << counts[my_id]
+                      << " messages from this node" << std::endl;
+            passed = false;
+        }
+    }
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    group.barrier_sync();
+    group.leave();
+    return passed ? 0 : 1;
+}
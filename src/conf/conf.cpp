@@ -39,13 +39,29 @@ struct option Conf::long_options[] = {
         MAKE_LONG_OPT_ENTRY(CONF_DERECHO_RDMC_PORT),
         MAKE_LONG_OPT_ENTRY(CONF_DERECHO_HEARTBEAT_MS),
         MAKE_LONG_OPT_ENTRY(CONF_DERECHO_SST_POLL_CQ_TIMEOUT_MS),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_SST_IDLE_POLICY),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_SST_IDLE_SPIN_US),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_SST_IDLE_SLEEP_US),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_SST_PREDICATE_THREADS),
         MAKE_LONG_OPT_ENTRY(CONF_DERECHO_DISABLE_PARTITIONING_SAFETY),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_MAX_DELIVERY_BATCH_SIZE),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_SMC_PACKING_MAX_BYTES),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_SMC_PACKING_MAX_DELAY_US),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_P2P_WORKER_THREADS),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_P2P_IDLE_POLICY),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_P2P_IDLE_SPIN_US),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_P2P_IDLE_SLEEP_US),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_P2P_IDLE_POLL_US),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_RPC_CALLBACK_THREADS),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_PERSISTENCE_LINGER_US),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_PERSISTENCE_THREADS),
         // [SUBGROUP/<subgroup name>]
         MAKE_LONG_OPT_ENTRY(CONF_SUBGROUP_DEFAULT_RDMC_SEND_ALGORITHM),
         MAKE_LONG_OPT_ENTRY(CONF_SUBGROUP_DEFAULT_MAX_PAYLOAD_SIZE),
         MAKE_LONG_OPT_ENTRY(CONF_SUBGROUP_DEFAULT_MAX_SMC_PAYLOAD_SIZE),
         MAKE_LONG_OPT_ENTRY(CONF_SUBGROUP_DEFAULT_BLOCK_SIZE),
         MAKE_LONG_OPT_ENTRY(CONF_SUBGROUP_DEFAULT_WINDOW_SIZE),
+        MAKE_LONG_OPT_ENTRY(CONF_SUBGROUP_DEFAULT_SMC_RING_SIZE),
         // [RDMA]
         MAKE_LONG_OPT_ENTRY(CONF_RDMA_PROVIDER),
         MAKE_LONG_OPT_ENTRY(CONF_RDMA_DOMAIN),
@@ -57,6 +73,9 @@ struct option Conf::long_options[] = {
         MAKE_LONG_OPT_ENTRY(CONF_PERS_RESET),
         MAKE_LONG_OPT_ENTRY(CONF_PERS_MAX_LOG_ENTRY),
         MAKE_LONG_OPT_ENTRY(CONF_PERS_MAX_DATA_SIZE),
+        MAKE_LONG_OPT_ENTRY(CONF_PERS_WRITE_MODE),
+        MAKE_LONG_OPT_ENTRY(CONF_PERS_SEGMENT_SIZE),
+        MAKE_LONG_OPT_ENTRY(CONF_PERS_DIRECT_BUFFER_SIZE),
         {0, 0, 0, 0}};
 
 void Conf::initialize(int argc, char* argv[], const char* conf_file) {
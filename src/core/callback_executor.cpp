@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <string>
+
+#include <derecho/core/detail/callback_executor.hpp>
+#include <derecho/utils/logger.hpp>
+
+namespace derecho {
+
+namespace rpc {
+
+CallbackExecutor::CallbackExecutor(uint32_t num_threads)
+        : num_threads(std::max(num_threads, 1u)) {}
+
+CallbackExecutor::~CallbackExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        shutdown = true;
+        tasks.clear();
+    }
+    tasks_cv.notify_all();
+    for(auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void CallbackExecutor::post(std::function<void()> task) {
+    std::call_once(threads_started, [this]() {
+        for(uint32_t worker_num = 0; worker_num < num_threads; ++worker_num) {
+            threads.emplace_back(&CallbackExecutor::worker_loop, this, worker_num);
+        }
+    });
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        if(shutdown) {
+            return;
+        }
+        tasks.emplace_back(std::move(task));
+    }
+    tasks_cv.notify_one();
+}
+
+void CallbackExecutor::worker_loop(uint32_t worker_num) {
+    pthread_setname_np(pthread_self(), worker_num == 0 ? "rpc_callbacks"
+                                                       : ("rpc_callbacks_" + std::to_string(worker_num)).c_str());
+    while(true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(tasks_mutex);
+            tasks_cv.wait(lock, [this]() { return shutdown || !tasks.empty(); });
+            if(shutdown) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        try {
+            task();
+        } catch(const std::exception& e) {
+            dbg_default_error("An RPC callback threw an exception: {}", e.what());
+        } catch(...) {
+            dbg_default_error("An RPC callback threw an exception");
+        }
+    }
+}
+
+}  // namespace rpc
+}  // namespace derecho
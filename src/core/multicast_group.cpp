@@ -43,28 +43,29 @@ MulticastGroup::MulticastGroup(
           subgroup_settings_map(subgroup_settings_by_id),
           received_intervals(sst->num_received.size(), {-1, -1}),
           rdmc_group_num_offset(0),
-          future_message_indices(total_num_subgroups, 0),
-          next_sends(total_num_subgroups),
-          pending_sends(total_num_subgroups),
-          current_sends(total_num_subgroups),
-          next_message_to_deliver(total_num_subgroups),
           sender_timeout(sender_timeout),
+          max_delivery_batch_size(getConfUInt32(CONF_DERECHO_MAX_DELIVERY_BATCH_SIZE)),
+          smc_packing_max_bytes(getConfUInt64(CONF_DERECHO_SMC_PACKING_MAX_BYTES)),
+          smc_packing_max_delay_ns(getConfUInt64(CONF_DERECHO_SMC_PACKING_MAX_DELAY_US) * 1000),
           sst(sst),
           sst_multicast_group_ptrs(total_num_subgroups),
-          last_transfer_medium(total_num_subgroups),
           post_next_version_callback(post_next_version_callback),
           persistence_manager_callbacks(persistence_manager_callbacks) {
     for(uint i = 0; i < num_members; ++i) {
         node_id_to_sst_index[members[i]] = i;
     }
 
+    for(subgroup_id_t subgroup_num = 0; subgroup_num < total_num_subgroups; ++subgroup_num) {
+        subgroup_states.emplace_back(std::make_unique<SubgroupMessageState>());
+    }
     for(const auto p : subgroup_settings_by_id) {
         subgroup_id_t id = p.first;
         const SubgroupSettings& settings = p.second;
         auto num_shard_members = settings.members.size();
-        while(free_message_buffers[id].size() < settings.profile.window_size * num_shard_members) {
-            free_message_buffers[id].emplace_back(settings.profile.max_msg_size);
+        while(subgroup_states[id]->free_message_buffers.size() < settings.profile.window_size * num_shard_members) {
+            subgroup_states[id]->free_message_buffers.emplace_back(settings.profile.max_msg_size);
         }
+        initialize_message_stores(id, settings);
     }
 
     initialize_sst_row();
@@ -104,15 +105,12 @@ MulticastGroup::MulticastGroup(
           received_intervals(sst->num_received.size(), {-1, -1}),
           rpc_callback(old_group.rpc_callback),
           rdmc_group_num_offset(old_group.rdmc_group_num_offset + old_group.num_members),
-          future_message_indices(total_num_subgroups, 0),
-          next_sends(total_num_subgroups),
-          pending_sends(total_num_subgroups),
-          current_sends(total_num_subgroups),
-          next_message_to_deliver(total_num_subgroups),
           sender_timeout(old_group.sender_timeout),
+          max_delivery_batch_size(old_group.max_delivery_batch_size),
+          smc_packing_max_bytes(old_group.smc_packing_max_bytes),
+          smc_packing_max_delay_ns(old_group.smc_packing_max_delay_ns),
           sst(sst),
           sst_multicast_group_ptrs(total_num_subgroups),
-          last_transfer_medium(total_num_subgroups),
           post_next_version_callback(post_next_version_callback),
           persistence_manager_callbacks(persistence_manager_callbacks) {
     // Make sure rdmc_group_num_offset didn't overflow.
@@ -124,12 +122,15 @@ MulticastGroup::MulticastGroup(
     for(uint i = 0; i < num_members; ++i) {
         node_id_to_sst_index[members[i]] = i;
     }
+    for(subgroup_id_t subgroup_num = 0; subgroup_num < total_num_subgroups; ++subgroup_num) {
+        subgroup_states.emplace_back(std::make_unique<SubgroupMessageState>());
+    }
 
     // Convience function that takes a msg from the old group and
     // produces one suitable for this group.
     auto convert_msg = [this](RDMCMessage& msg, subgroup_id_t subgroup_num) {
         msg.sender_id = members[member_index];
-        msg.index = future_message_indices[subgroup_num]++;
+        msg.index = subgroup_states[subgroup_num]->future_message_index++;
         return std::move(msg);
     };
 
@@ -137,7 +138,7 @@ MulticastGroup::MulticastGroup(
     // produces one suitable for this group.
     auto convert_sst_msg = [this](SSTMessage& msg, subgroup_id_t subgroup_num) {
         msg.sender_id = members[member_index];
-        msg.index = future_message_indices[subgroup_num]++;
+        msg.index = subgroup_states[subgroup_num]->future_message_index++;
         return std::move(msg);
     };
 
@@ -145,83 +146,83 @@ MulticastGroup::MulticastGroup(
         subgroup_id_t id = p.first;
         const SubgroupSettings& settings = p.second;
         auto num_shard_members = settings.members.size();
-        while(free_message_buffers[id].size() < settings.profile.window_size * num_shard_members) {
-            free_message_buffers[id].emplace_back(settings.profile.max_msg_size);
+        while(subgroup_states[id]->free_message_buffers.size() < settings.profile.window_size * num_shard_members) {
+            subgroup_states[id]->free_message_buffers.emplace_back(settings.profile.max_msg_size);
         }
+        initialize_message_stores(id, settings);
     }
 
     // Reclaim RDMCMessageBuffers from the old group, and supplement them with
     // additional if the group has grown.
-    std::lock_guard<std::mutex> lock(old_group.msg_state_mtx);
+    std::vector<std::unique_lock<std::mutex>> old_group_locks;
+    for(auto& old_state : old_group.subgroup_states) {
+        old_group_locks.emplace_back(old_state->mutex);
+    }
     for(const auto p : subgroup_settings_by_id) {
         const subgroup_id_t subgroup_num = p.first;
         const SubgroupSettings& settings = p.second;
         auto num_shard_members = settings.members.size();
+        auto& free_message_buffers = subgroup_states[subgroup_num]->free_message_buffers;
         // for later: don't move extra message buffers
-        free_message_buffers[subgroup_num].swap(old_group.free_message_buffers[subgroup_num]);
-        while(free_message_buffers[subgroup_num].size() < settings.profile.window_size * num_shard_members) {
-            free_message_buffers[subgroup_num].emplace_back(settings.profile.max_msg_size);
+        if(old_group.subgroup_states.size() > subgroup_num) {
+            free_message_buffers.swap(old_group.subgroup_states[subgroup_num]->free_message_buffers);
+        }
+        while(free_message_buffers.size() < settings.profile.window_size * num_shard_members) {
+            free_message_buffers.emplace_back(settings.profile.max_msg_size);
         }
     }
 
-    for(auto& msg : old_group.current_receives) {
-        free_message_buffers[msg.first.first].push_back(std::move(msg.second.message_buffer));
-    }
-    old_group.current_receives.clear();
-
-    // Assume that any locally stable messages failed. If we were the sender
-    // than re-attempt, otherwise discard. TODO: Presumably the ragged edge
-    // cleanup will want the chance to deliver some of these.
-    for(auto& p : old_group.locally_stable_rdmc_messages) {
-        if(p.second.size() == 0) {
-            continue;
+    for(subgroup_id_t subgroup_num = 0; subgroup_num < old_group.subgroup_states.size(); ++subgroup_num) {
+        SubgroupMessageState& old_state = *old_group.subgroup_states[subgroup_num];
+        SubgroupMessageState& state = *subgroup_states[subgroup_num];
+        for(auto& msg : old_state.current_receives) {
+            state.free_message_buffers.push_back(std::move(msg.second.message_buffer));
         }
-
-        for(auto& q : p.second) {
-            if(q.second.sender_id == members[member_index]) {
-                pending_sends[p.first].push(convert_msg(q.second, p.first));
+        old_state.current_receives.clear();
+
+        // Assume that any locally stable messages failed. If we were the sender
+        // than re-attempt, otherwise discard. TODO: Presumably the ragged edge
+        // cleanup will want the chance to deliver some of these.
+        old_state.locally_stable_rdmc_messages.for_each([&](message_id_t, RDMCMessage& msg) {
+            if(msg.sender_id == members[member_index]) {
+                state.pending_sends.push(convert_msg(msg, subgroup_num));
             } else {
-                free_message_buffers[p.first].push_back(std::move(q.second.message_buffer));
+                state.free_message_buffers.push_back(std::move(msg.message_buffer));
             }
-        }
+        });
+        old_state.locally_stable_rdmc_messages.clear();
+        old_state.locally_stable_sst_messages.clear();
     }
-    old_group.locally_stable_rdmc_messages.clear();
-
-    for(auto& p : old_group.locally_stable_sst_messages) {
-        if(p.second.size() == 0) {
-            continue;
-        }
-    }
-    old_group.locally_stable_sst_messages.clear();
 
     // Any messages that were being sent should be re-attempted.
     for(const auto& p : subgroup_settings_by_id) {
         auto subgroup_num = p.first;
-        if(old_group.current_sends.size() > subgroup_num && old_group.current_sends[subgroup_num]) {
-            pending_sends[subgroup_num].push(convert_msg(*old_group.current_sends[subgroup_num], subgroup_num));
+        if(old_group.subgroup_states.size() <= subgroup_num) {
+            continue;
         }
-
-        if(old_group.pending_sends.size() > subgroup_num) {
-            while(!old_group.pending_sends[subgroup_num].empty()) {
-                pending_sends[subgroup_num].push(convert_msg(old_group.pending_sends[subgroup_num].front(), subgroup_num));
-                old_group.pending_sends[subgroup_num].pop();
-            }
+        SubgroupMessageState& old_state = *old_group.subgroup_states[subgroup_num];
+        SubgroupMessageState& state = *subgroup_states[subgroup_num];
+        if(old_state.current_send) {
+            state.pending_sends.push(convert_msg(*old_state.current_send, subgroup_num));
         }
 
-        if(old_group.next_sends.size() > subgroup_num && old_group.next_sends[subgroup_num]) {
-            next_sends[subgroup_num] = convert_msg(*old_group.next_sends[subgroup_num], subgroup_num);
+        while(!old_state.pending_sends.empty()) {
+            state.pending_sends.push(convert_msg(old_state.pending_sends.front(), subgroup_num));
+            old_state.pending_sends.pop();
         }
 
-        for(auto& entry : old_group.non_persistent_messages[subgroup_num]) {
-            non_persistent_messages[subgroup_num].emplace(entry.first,
-                                                          convert_msg(entry.second, subgroup_num));
-        }
-        old_group.non_persistent_messages.clear();
-        for(auto& entry : old_group.non_persistent_sst_messages[subgroup_num]) {
-            non_persistent_sst_messages[subgroup_num].emplace(entry.first,
-                                                              convert_sst_msg(entry.second, subgroup_num));
+        if(old_state.next_send) {
+            state.next_send = convert_msg(*old_state.next_send, subgroup_num);
         }
-        old_group.non_persistent_sst_messages.clear();
+
+        old_state.non_persistent_messages.for_each([&](message_id_t seq_num, RDMCMessage& msg) {
+            state.non_persistent_messages.insert(seq_num, convert_msg(msg, subgroup_num));
+        });
+        old_state.non_persistent_messages.clear();
+        old_state.non_persistent_sst_messages.for_each([&](message_id_t seq_num, SSTMessage& msg) {
+            state.non_persistent_sst_messages.insert(seq_num, convert_sst_msg(msg, subgroup_num));
+        });
+        old_state.non_persistent_sst_messages.clear();
     }
 
     initialize_sst_row();
@@ -253,9 +254,34 @@ bool MulticastGroup::create_rdmc_sst_groups() {
         uint32_t num_shard_senders = get_num_senders(shard_senders);
         auto shard_sst_indices = get_shard_sst_indices(subgroup_num);
 
+        // In byte-ring mode a message's bytes may only be reused once every member
+        // has delivered it (or, in unordered mode, made its upcall), since the
+        // receivers keep pointers into the ring until then. Records are keyed by
+        // the index of the last message they carry, so this returns an index too.
+        std::function<long long int()> num_released;
+        if(subgroup_settings.profile.sst_ring_size && subgroup_settings.sender_rank >= 0) {
+            num_released = [this, subgroup_num, subgroup_settings, num_shard_senders, shard_sst_indices]() -> long long int {
+                const int32_t sender_rank = subgroup_settings.sender_rank;
+                if(subgroup_settings.mode == Mode::UNORDERED) {
+                    int32_t min_received = std::numeric_limits<int32_t>::max();
+                    for(auto index : shard_sst_indices) {
+                        min_received = std::min(min_received, (int32_t)sst->num_received[index][subgroup_settings.num_received_offset + sender_rank]);
+                    }
+                    return min_received;
+                }
+                int32_t min_delivered = std::numeric_limits<int32_t>::max();
+                for(auto index : shard_sst_indices) {
+                    min_delivered = std::min(min_delivered, (int32_t)sst->delivered_num[index][subgroup_num]);
+                }
+                return min_delivered < sender_rank ? -1 : (min_delivered - sender_rank) / (int32_t)num_shard_senders;
+            };
+        }
         sst_multicast_group_ptrs[subgroup_num] = std::make_unique<sst::multicast_group<DerechoSST>>(
                 sst, shard_sst_indices, subgroup_settings.profile.window_size, subgroup_settings.profile.sst_max_msg_size, subgroup_settings.senders,
-                subgroup_settings.num_received_offset, subgroup_settings.slot_offset);
+                subgroup_settings.num_received_offset, subgroup_settings.slot_offset,
+                subgroup_settings.profile.sst_ring_size,
+                DerechoParams::smc_ring_reserve(subgroup_settings.profile.window_size),
+                num_released);
 
         for(uint shard_rank = 0, sender_rank = -1; shard_rank < num_shard_members; ++shard_rank) {
             // don't create RDMC group if the shard member is never going to send
@@ -272,7 +298,8 @@ bool MulticastGroup::create_rdmc_sst_groups() {
                                     num_shard_senders,
                                     shard_sst_indices](char* data, size_t size) {
                 assert(this->sst);
-                std::lock_guard<std::mutex> lock(msg_state_mtx);
+                SubgroupMessageState& state = *subgroup_states[subgroup_num];
+                std::lock_guard<std::mutex> lock(state.mutex);
                 header* h = (header*)data;
                 const int32_t index = h->index;
                 message_id_t sequence_number = index * num_shard_senders + sender_rank;
@@ -281,18 +308,18 @@ bool MulticastGroup::create_rdmc_sst_groups() {
                                   subgroup_num, shard_rank, index);
                 // Move message from current_receives to locally_stable_rdmc_messages.
                 if(node_id == members[member_index]) {
-                    assert(current_sends[subgroup_num]);
-                    locally_stable_rdmc_messages[subgroup_num][sequence_number] = std::move(*current_sends[subgroup_num]);
-                    current_sends[subgroup_num] = std::nullopt;
+                    assert(state.current_send);
+                    state.locally_stable_rdmc_messages.insert(sequence_number, std::move(*state.current_send));
+                    state.current_send = std::nullopt;
                 } else {
-                    auto it = current_receives.find({subgroup_num, node_id});
-                    assert(it != current_receives.end());
+                    auto it = state.current_receives.find(node_id);
+                    assert(it != state.current_receives.end());
                     auto& msg = it->second;
                     msg.index = index;
                     // We set the size in this receive handler instead of in the incoming_message_handler
                     msg.size = size;
-                    locally_stable_rdmc_messages[subgroup_num].emplace(sequence_number, std::move(msg));
-                    current_receives.erase(it);
+                    state.locally_stable_rdmc_messages.insert(sequence_number, std::move(msg));
+                    state.current_receives.erase(it);
                 }
 
                 auto new_num_received = resolve_num_received(index, subgroup_settings.num_received_offset + sender_rank);
@@ -300,11 +327,11 @@ bool MulticastGroup::create_rdmc_sst_groups() {
                 // only if I am a sender in the subgroup and the subgroup is not in UNORDERED mode
                 if(subgroup_settings.sender_rank >= 0 && subgroup_settings.mode != Mode::UNORDERED) {
                     if(subgroup_settings.sender_rank < (int)sender_rank) {
-                        while(future_message_indices[subgroup_num] <= new_num_received) {
+                        while(state.future_message_index <= new_num_received) {
                             get_buffer_and_send_auto_null(subgroup_num);
                         }
                     } else if(subgroup_settings.sender_rank > (int)sender_rank) {
-                        while(future_message_indices[subgroup_num] < new_num_received) {
+                        while(state.future_message_index < new_num_received) {
                             get_buffer_and_send_auto_null(subgroup_num);
                         }
                     }
@@ -316,9 +343,9 @@ bool MulticastGroup::create_rdmc_sst_groups() {
                     for(int i = sst->num_received[member_index][subgroup_settings.num_received_offset + sender_rank] + 1;
                         i <= new_num_received; ++i) {
                         message_id_t seq_num = i * num_shard_senders + sender_rank;
-                        if(!locally_stable_sst_messages[subgroup_num].empty()
-                           && locally_stable_sst_messages[subgroup_num].begin()->first == seq_num) {
-                            auto& msg = locally_stable_sst_messages[subgroup_num].begin()->second;
+                        SSTMessage* sst_msg = state.locally_stable_sst_messages.find(seq_num);
+                        if(sst_msg) {
+                            auto& msg = *sst_msg;
                             char* buf = const_cast<char*>(msg.buf);
                             header* h = (header*)(buf);
                             // no delivery callback for a NULL message
@@ -329,14 +356,13 @@ bool MulticastGroup::create_rdmc_sst_groups() {
                                                                     INVALID_VERSION);
                             }
                             if(node_id == members[member_index]) {
-                                pending_message_timestamps[subgroup_num].erase(h->timestamp);
+                                state.pending_message_timestamps.erase(h->index);
                             }
-                            locally_stable_sst_messages[subgroup_num].erase(locally_stable_sst_messages[subgroup_num].begin());
+                            state.locally_stable_sst_messages.erase(seq_num);
                         } else {
-                            assert(!locally_stable_rdmc_messages[subgroup_num].empty());
-                            auto it2 = locally_stable_rdmc_messages[subgroup_num].begin();
-                            assert(it2->first == seq_num);
-                            auto& msg = it2->second;
+                            RDMCMessage* rdmc_msg = state.locally_stable_rdmc_messages.find(seq_num);
+                            assert(rdmc_msg);
+                            auto& msg = *rdmc_msg;
                             char* buf = msg.message_buffer.buffer.get();
                             header* h = (header*)(buf);
                             // no delivery for a NULL message
@@ -346,11 +372,11 @@ bool MulticastGroup::create_rdmc_sst_groups() {
                                                                     {{buf + h->header_size, msg.size - h->header_size}},
                                                                     INVALID_VERSION);
                             }
-                            free_message_buffers[subgroup_num].push_back(std::move(msg.message_buffer));
+                            state.free_message_buffers.push_back(std::move(msg.message_buffer));
                             if(node_id == members[member_index]) {
-                                pending_message_timestamps[subgroup_num].erase(h->timestamp);
+                                state.pending_message_timestamps.erase(h->index);
                             }
-                            locally_stable_rdmc_messages[subgroup_num].erase(it2);
+                            state.locally_stable_rdmc_messages.erase(seq_num);
                         }
                     }
                 }
@@ -377,7 +403,7 @@ bool MulticastGroup::create_rdmc_sst_groups() {
                     [this, rdmc_receive_handler](char* data, size_t size) {
                         rdmc_receive_handler(data, size);
                         // signal background writer thread
-                        sender_cv.notify_all();
+                        wake_sender_thread();
                     };
 
             // Create a "rotated" vector of members in which the currently selected shard member (shard_rank) is first
@@ -409,19 +435,20 @@ bool MulticastGroup::create_rdmc_sst_groups() {
                 if(!rdmc::create_group(
                            rdmc_group_num_offset, rotated_shard_members, subgroup_settings.profile.block_size, subgroup_settings.profile.rdmc_send_algorithm,
                            [this, subgroup_num, node_id](size_t length) {
-                               std::lock_guard<std::mutex> lock(msg_state_mtx);
-                               assert(!free_message_buffers[subgroup_num].empty());
+                               SubgroupMessageState& state = *subgroup_states[subgroup_num];
+                               std::lock_guard<std::mutex> lock(state.mutex);
+                               assert(!state.free_message_buffers.empty());
                                //Create a Message struct to receive the data into.
                                RDMCMessage msg;
                                msg.sender_id = node_id;
                                // The length variable is not the exact size of the msg,
                                // but it is the nearest multiple of the block size greater then the size
                                // so we will set the size in the receive handler
-                               msg.message_buffer = std::move(free_message_buffers[subgroup_num].back());
-                               free_message_buffers[subgroup_num].pop_back();
+                               msg.message_buffer = std::move(state.free_message_buffers.back());
+                               state.free_message_buffers.pop_back();
 
                                rdmc::receive_destination ret{msg.message_buffer.mr, 0};
-                               current_receives[{subgroup_num, node_id}] = std::move(msg);
+                               state.current_receives[node_id] = std::move(msg);
 
                                assert(ret.mr->buffer != nullptr);
                                return ret;
@@ -436,6 +463,19 @@ bool MulticastGroup::create_rdmc_sst_groups() {
     return true;
 }
 
+void MulticastGroup::initialize_message_stores(subgroup_id_t subgroup_num, const SubgroupSettings& subgroup_settings) {
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
+    // flow control keeps undelivered sequence numbers within one window per sender
+    const std::size_t window_slots = subgroup_settings.profile.window_size
+                                     * std::max(get_num_senders(subgroup_settings.senders), 1u);
+    state.locally_stable_rdmc_messages = SequenceRing<RDMCMessage>(window_slots);
+    state.locally_stable_sst_messages = SequenceRing<SSTMessage>(window_slots);
+    state.non_persistent_messages = SequenceRing<RDMCMessage>(window_slots);
+    state.non_persistent_sst_messages = SequenceRing<SSTMessage>(window_slots);
+    state.pending_message_timestamps = SequenceRing<uint64_t>(window_slots);
+    state.smc_ring_read_offsets.assign(get_num_senders(subgroup_settings.senders), 0);
+}
+
 void MulticastGroup::initialize_sst_row() {
     auto num_received_size = sst->num_received.size();
     auto seq_num_size = sst->seq_num.size();
@@ -498,15 +538,21 @@ void MulticastGroup::deliver_message(SSTMessage& msg, const subgroup_id_t& subgr
 }
 
 bool MulticastGroup::version_message(RDMCMessage& msg, const subgroup_id_t& subgroup_num,
+                                     const message_id_t seq_num,
                                      const persistent::version_t& version, const uint64_t& msg_timestamp) {
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
     char* buf = msg.message_buffer.buffer.get();
     header* h = (header*)(buf);
     // null message filter
     if(msg.size == h->header_size) {
+        // a null message is never persisted, so its timestamp can be released right away
+        if(msg.sender_id == members[member_index]) {
+            state.pending_message_timestamps.erase(h->index);
+        }
         return false;
     }
     if(msg.sender_id == members[member_index]) {
-        pending_persistence[subgroup_num][locally_stable_rdmc_messages[subgroup_num].begin()->first] = msg_timestamp;
+        state.pending_persistence[seq_num] = h->index;
     }
     // make a version for persistent<t>/volatile<t>
     uint64_t msg_ts_us = msg_timestamp / 1e3;
@@ -520,15 +566,21 @@ bool MulticastGroup::version_message(RDMCMessage& msg, const subgroup_id_t& subg
 }
 
 bool MulticastGroup::version_message(SSTMessage& msg, const subgroup_id_t& subgroup_num,
+                                     const message_id_t seq_num,
                                      const persistent::version_t& version, const uint64_t& msg_timestamp) {
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
     char* buf = const_cast<char*>(msg.buf);
     header* h = (header*)(buf);
     // null message filter
     if(msg.size == h->header_size) {
+        // a null message is never persisted, so its timestamp can be released right away
+        if(msg.sender_id == members[member_index]) {
+            state.pending_message_timestamps.erase(h->index);
+        }
         return false;
     }
     if(msg.sender_id == members[member_index]) {
-        pending_persistence[subgroup_num][locally_stable_sst_messages[subgroup_num].begin()->first] = msg_timestamp;
+        state.pending_persistence[seq_num] = h->index;
     }
     // make a version for persistent<t>/volatile<t>
     uint64_t msg_ts_us = msg_timestamp / 1e3;
@@ -544,9 +596,10 @@ bool MulticastGroup::version_message(SSTMessage& msg, const subgroup_id_t& subgr
 void MulticastGroup::deliver_messages_upto(
         const std::vector<int32_t>& max_indices_for_senders,
         subgroup_id_t subgroup_num, uint32_t num_shard_senders) {
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
     bool non_null_msgs_delivered = false;
     assert(max_indices_for_senders.size() == (size_t)num_shard_senders);
-    std::lock_guard<std::mutex> lock(msg_state_mtx);
+    std::lock_guard<std::mutex> lock(state.mutex);
     int32_t curr_seq_num = sst->delivered_num[member_index][subgroup_num];
     int32_t max_seq_num = curr_seq_num;
     for(uint sender = 0; sender < num_shard_senders; sender++) {
@@ -561,27 +614,29 @@ void MulticastGroup::deliver_messages_upto(
         if(index > max_indices_for_senders[sender_rank]) {
             continue;
         }
-        auto rdmc_msg_ptr = locally_stable_rdmc_messages[subgroup_num].find(seq_num);
+        RDMCMessage* rdmc_msg_ptr = state.locally_stable_rdmc_messages.find(seq_num);
         assigned_version = persistent::combine_int32s(sst->vid[member_index], seq_num);
-        if(rdmc_msg_ptr != locally_stable_rdmc_messages[subgroup_num].end()) {
-            auto& msg = rdmc_msg_ptr->second;
+        if(rdmc_msg_ptr) {
+            auto& msg = *rdmc_msg_ptr;
             char* buf = msg.message_buffer.buffer.get();
             uint64_t msg_ts = ((header*)buf)->timestamp;
             //Note: deliver_message frees the RDMC buffer in msg, which is why the timestamp must be saved before calling this
             deliver_message(msg, subgroup_num, assigned_version, msg_ts/1000);
-            non_null_msgs_delivered |= version_message(msg, subgroup_num, assigned_version, msg_ts);
+            non_null_msgs_delivered |= version_message(msg, subgroup_num, seq_num, assigned_version, msg_ts);
             // free the message buffer only after it version_message has been called
-            free_message_buffers[subgroup_num].push_back(std::move(msg.message_buffer));
-            locally_stable_rdmc_messages[subgroup_num].erase(rdmc_msg_ptr);
+            state.free_message_buffers.push_back(std::move(msg.message_buffer));
+            state.locally_stable_rdmc_messages.erase(seq_num);
         } else {
             dbg_default_trace("Subgroup {}, deliver_messages_upto delivering an SST message with seq_num = {}",
                               subgroup_num, seq_num);
-            auto& msg = locally_stable_sst_messages[subgroup_num].at(seq_num);
+            SSTMessage* sst_msg_ptr = state.locally_stable_sst_messages.find(seq_num);
+            assert(sst_msg_ptr);
+            auto& msg = *sst_msg_ptr;
             char* buf = (char*)msg.buf;
             uint64_t msg_ts = ((header*)buf)->timestamp;
             deliver_message(msg, subgroup_num, assigned_version, msg_ts/1000);
-            non_null_msgs_delivered |= version_message(msg, subgroup_num, assigned_version, msg_ts);
-            locally_stable_sst_messages[subgroup_num].erase(seq_num);
+            non_null_msgs_delivered |= version_message(msg, subgroup_num, seq_num, assigned_version, msg_ts);
+            state.locally_stable_sst_messages.erase(seq_num);
         }
     }
     gmssst::set(sst->delivered_num[member_index][subgroup_num], max_seq_num);
@@ -627,11 +682,22 @@ int32_t MulticastGroup::resolve_num_received(int32_t index, uint32_t num_receive
     return *std::next(received_intervals[num_received_entry].begin());
 }
 
-bool MulticastGroup::receiver_predicate(const SubgroupSettings& subgroup_settings,
+bool MulticastGroup::receiver_predicate(subgroup_id_t subgroup_num, const SubgroupSettings& subgroup_settings,
                                         const std::map<uint32_t, uint32_t>& shard_ranks_by_sender_rank,
                                         uint32_t num_shard_senders, const DerechoSST& sst) {
     for(uint sender_count = 0; sender_count < num_shard_senders; ++sender_count) {
         int32_t num_received = sst.num_received_sst[member_index][subgroup_settings.num_received_offset + sender_count] + 1;
+        if(subgroup_settings.profile.sst_ring_size) {
+            const uint32_t sender_sst_index = node_id_to_sst_index.at(
+                    subgroup_settings.members[shard_ranks_by_sender_rank.at(sender_count)]);
+            if(sst::ring_layout::find_record(const_cast<volatile char*>(&sst.slots[sender_sst_index][subgroup_settings.slot_offset]),
+                                             subgroup_states[subgroup_num]->smc_ring_read_offsets[sender_count],
+                                             num_received)
+               >= 0) {
+                return true;
+            }
+            continue;
+        }
         uint32_t slot = num_received % subgroup_settings.profile.window_size;
         if(static_cast<long long int>((uint64_t&)sst.slots[node_id_to_sst_index.at(subgroup_settings.members[shard_ranks_by_sender_rank.at(sender_count)])]
                                                           [subgroup_settings.slot_offset + (subgroup_settings.profile.sst_max_msg_size + 2 * sizeof(uint64_t)) * (slot + 1) - sizeof(uint64_t)])
@@ -646,24 +712,39 @@ void MulticastGroup::sst_receive_handler(subgroup_id_t subgroup_num, const Subgr
                                          const std::map<uint32_t, uint32_t>& shard_ranks_by_sender_rank,
                                          uint32_t num_shard_senders, uint32_t sender_rank,
                                          volatile char* data, uint64_t size) {
-    header* h = (header*)data;
-    const int32_t index = h->index;
-
-    message_id_t sequence_number = index * num_shard_senders + sender_rank;
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
     node_id_t node_id = subgroup_settings.members[shard_ranks_by_sender_rank.at(sender_rank)];
 
-    locally_stable_sst_messages[subgroup_num][sequence_number] = {node_id, index, size, data};
-
-    auto new_num_received = resolve_num_received(index, subgroup_settings.num_received_offset + sender_rank);
+    // A slot holds either a single message or a pack of messages with
+    // consecutive indices, each header pointing to the next one
+    int32_t new_num_received;
+    uint64_t offset = 0;
+    while(true) {
+        header* h = (header*)(data + offset);
+        const int32_t index = h->index;
+        const uint64_t next_offset = h->header_size >= sizeof(packed_header)
+                                             ? ((packed_header*)h)->packed_next_offset
+                                             : 0;
+        const uint64_t msg_size = next_offset ? next_offset : size - offset;
+
+        message_id_t sequence_number = index * num_shard_senders + sender_rank;
+        state.locally_stable_sst_messages.insert(sequence_number, {node_id, index, msg_size, data + offset});
+
+        new_num_received = resolve_num_received(index, subgroup_settings.num_received_offset + sender_rank);
+        if(!next_offset) {
+            break;
+        }
+        offset += next_offset;
+    }
     /* NULL Send Scheme */
     // only if I am a sender in the subgroup and the subgroup is not in UNORDERED mode
     if(subgroup_settings.sender_rank >= 0 && subgroup_settings.mode != Mode::UNORDERED) {
         if(subgroup_settings.sender_rank < (int)sender_rank) {
-            while(future_message_indices[subgroup_num] <= new_num_received) {
+            while(state.future_message_index <= new_num_received) {
                 get_buffer_and_send_auto_null(subgroup_num);
             }
         } else if(subgroup_settings.sender_rank > (int)sender_rank) {
-            while(future_message_indices[subgroup_num] < new_num_received) {
+            while(state.future_message_index < new_num_received) {
                 get_buffer_and_send_auto_null(subgroup_num);
             }
         }
@@ -673,9 +754,9 @@ void MulticastGroup::sst_receive_handler(subgroup_id_t subgroup_num, const Subgr
         // issue stability upcalls for the recently sequenced messages
         for(int i = sst->num_received[member_index][subgroup_settings.num_received_offset + sender_rank] + 1; i <= new_num_received; ++i) {
             message_id_t seq_num = i * num_shard_senders + sender_rank;
-            if(!locally_stable_sst_messages[subgroup_num].empty()
-               && locally_stable_sst_messages[subgroup_num].begin()->first == seq_num) {
-                auto& msg = locally_stable_sst_messages[subgroup_num].begin()->second;
+            SSTMessage* sst_msg = state.locally_stable_sst_messages.find(seq_num);
+            if(sst_msg) {
+                auto& msg = *sst_msg;
                 char* buf = const_cast<char*>(msg.buf);
                 header* h = (header*)(buf);
                 if(msg.size > h->header_size && callbacks.global_stability_callback) {
@@ -685,14 +766,13 @@ void MulticastGroup::sst_receive_handler(subgroup_id_t subgroup_num, const Subgr
                                                         INVALID_VERSION);
                 }
                 if(node_id == members[member_index]) {
-                    pending_message_timestamps[subgroup_num].erase(h->timestamp);
+                    state.pending_message_timestamps.erase(h->index);
                 }
-                locally_stable_sst_messages[subgroup_num].erase(locally_stable_sst_messages[subgroup_num].begin());
+                state.locally_stable_sst_messages.erase(seq_num);
             } else {
-                assert(!locally_stable_rdmc_messages[subgroup_num].empty());
-                auto it2 = locally_stable_rdmc_messages[subgroup_num].begin();
-                assert(it2->first == seq_num);
-                auto& msg = it2->second;
+                RDMCMessage* rdmc_msg = state.locally_stable_rdmc_messages.find(seq_num);
+                assert(rdmc_msg);
+                auto& msg = *rdmc_msg;
                 char* buf = msg.message_buffer.buffer.get();
                 header* h = (header*)(buf);
                 if(msg.size > h->header_size && callbacks.global_stability_callback) {
@@ -701,11 +781,11 @@ void MulticastGroup::sst_receive_handler(subgroup_id_t subgroup_num, const Subgr
                                                         {{buf + h->header_size, msg.size - h->header_size}},
                                                         INVALID_VERSION);
                 }
-                free_message_buffers[subgroup_num].push_back(std::move(msg.message_buffer));
+                state.free_message_buffers.push_back(std::move(msg.message_buffer));
                 if(node_id == members[member_index]) {
-                    pending_message_timestamps[subgroup_num].erase(h->timestamp);
+                    state.pending_message_timestamps.erase(h->index);
                 }
-                locally_stable_rdmc_messages[subgroup_num].erase(it2);
+                state.locally_stable_rdmc_messages.erase(seq_num);
             }
         }
     }
@@ -716,25 +796,41 @@ void MulticastGroup::receiver_function(subgroup_id_t subgroup_num, const Subgrou
                                        const std::map<uint32_t, uint32_t>& shard_ranks_by_sender_rank,
                                        uint32_t num_shard_senders, DerechoSST& sst, unsigned int batch_size,
                                        const std::function<void(uint32_t, volatile char*, uint32_t)>& sst_receive_handler_lambda) {
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
     DerechoParams profile = subgroup_settings.profile;
     const uint64_t slot_width = profile.sst_max_msg_size + 2 * sizeof(uint64_t);
-    std::lock_guard<std::mutex> lock(msg_state_mtx);
+    std::lock_guard<std::mutex> lock(state.mutex);
     for(uint i = 0; i < batch_size; ++i) {
         for(uint sender_count = 0; sender_count < num_shard_senders; ++sender_count) {
             auto num_received = sst.num_received_sst[member_index][subgroup_settings.num_received_offset + sender_count] + 1;
-            const uint32_t slot = num_received % profile.window_size;
             const uint32_t sender_sst_index = node_id_to_sst_index.at(
                     subgroup_settings.members[shard_ranks_by_sender_rank.at(sender_count)]);
+            if(profile.sst_ring_size) {
+                volatile char* ring = &sst.slots[sender_sst_index][subgroup_settings.slot_offset];
+                uint64_t& read_offset = state.smc_ring_read_offsets[sender_count];
+                const int64_t record = sst::ring_layout::find_record(ring, read_offset, num_received);
+                if(record >= 0) {
+                    const uint64_t msg_size = (uint64_t&)ring[record + sst::ring_layout::size_offset];
+                    dbg_default_trace("receiver_trig calling sst_receive_handler_lambda. num_received = {}, sender rank = {}. Reading from SST row {}, ring offset {}",
+                                      num_received, sender_count, sender_sst_index, record);
+                    sst_receive_handler_lambda(sender_count, ring + record + sst::ring_layout::data_offset, msg_size);
+                    sst.num_received_sst[member_index][subgroup_settings.num_received_offset + sender_count] = num_received;
+                    read_offset = (record + sst::ring_layout::record_size(msg_size)) % profile.sst_ring_size;
+                }
+                continue;
+            }
+            const uint32_t slot = num_received % profile.window_size;
             const message_id_t next_seq = (uint64_t&)sst.slots[sender_sst_index]
                                                               [subgroup_settings.slot_offset + slot_width * (slot + 1) - sizeof(uint64_t)];
             if(next_seq == num_received / static_cast<int32_t>(profile.window_size) + 1) {
                 dbg_default_trace("receiver_trig calling sst_receive_handler_lambda. next_seq = {}, num_received = {}, sender rank = {}. Reading from SST row {}, slot {}",
                                   next_seq, num_received, sender_count, sender_sst_index, subgroup_settings.slot_offset + slot_width * slot);
+                // the slot holds the message size, then the message, then the sequence number
                 sst_receive_handler_lambda(sender_count,
                                            &sst.slots[sender_sst_index]
-                                                     [subgroup_settings.slot_offset + slot_width * slot],
+                                                     [subgroup_settings.slot_offset + slot_width * slot + sizeof(uint64_t)],
                                            (uint64_t&)sst.slots[sender_sst_index]
-                                                               [subgroup_settings.slot_offset + slot_width * (slot + 1) - 2 * sizeof(uint64_t)]);
+                                                               [subgroup_settings.slot_offset + slot_width * slot]);
                 sst.num_received_sst[member_index][subgroup_settings.num_received_offset + sender_count] = num_received;
             }
         }
@@ -757,7 +853,8 @@ void MulticastGroup::receiver_function(subgroup_id_t subgroup_num, const Subgrou
 
 void MulticastGroup::delivery_trigger(subgroup_id_t subgroup_num, const SubgroupSettings& subgroup_settings,
                                       const uint32_t num_shard_members, DerechoSST& sst) {
-    std::lock_guard<std::mutex> lock(msg_state_mtx);
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
+    std::lock_guard<std::mutex> lock(state.mutex);
     // compute the min of the seq_num
     message_id_t min_stable_num
             = sst.seq_num[node_id_to_sst_index.at(subgroup_settings.members[0])][subgroup_num];
@@ -767,56 +864,52 @@ void MulticastGroup::delivery_trigger(subgroup_id_t subgroup_num, const Subgroup
         min_stable_num = std::min(min_stable_num, stable_num_copy);
     }
 
-    bool update_sst = false;
+    auto& rdmc_messages = state.locally_stable_rdmc_messages;
+    auto& sst_messages = state.locally_stable_sst_messages;
+    // Walk the stable prefix of both message stores in sequence-number order,
+    // delivering up to max_delivery_batch_size messages. Every sequence number
+    // is held by exactly one of the two stores, so each one is a direct lookup.
+    uint32_t num_delivered = 0;
+    message_id_t last_delivered_seq_num = sst.delivered_num[member_index][subgroup_num];
     bool non_null_msgs_delivered = false;
     persistent::version_t assigned_version = INVALID_VERSION;
-    while(true) {
-        if(locally_stable_rdmc_messages[subgroup_num].empty() && locally_stable_sst_messages[subgroup_num].empty()) {
-            break;
-        }
-        int32_t least_undelivered_rdmc_seq_num, least_undelivered_sst_seq_num;
-        least_undelivered_rdmc_seq_num = least_undelivered_sst_seq_num = std::numeric_limits<int32_t>::max();
-        if(!locally_stable_rdmc_messages[subgroup_num].empty()) {
-            least_undelivered_rdmc_seq_num = locally_stable_rdmc_messages[subgroup_num].begin()->first;
-        }
-        if(!locally_stable_sst_messages[subgroup_num].empty()) {
-            least_undelivered_sst_seq_num = locally_stable_sst_messages[subgroup_num].begin()->first;
-        }
-        if(least_undelivered_rdmc_seq_num < least_undelivered_sst_seq_num && least_undelivered_rdmc_seq_num <= min_stable_num) {
-            update_sst = true;
+    for(message_id_t seq_num = last_delivered_seq_num + 1;
+        seq_num <= min_stable_num && (!max_delivery_batch_size || num_delivered < max_delivery_batch_size);
+        ++seq_num) {
+        if(RDMCMessage* rdmc_msg = rdmc_messages.find(seq_num)) {
             dbg_default_trace("Subgroup {}, can deliver a locally stable RDMC message: min_stable_num={} and least_undelivered_seq_num={}",
-                              subgroup_num, min_stable_num, least_undelivered_rdmc_seq_num);
-            RDMCMessage& msg = locally_stable_rdmc_messages[subgroup_num].begin()->second;
+                              subgroup_num, min_stable_num, seq_num);
+            RDMCMessage& msg = *rdmc_msg;
             char* buf = msg.message_buffer.buffer.get();
             uint64_t msg_ts = ((header*)buf)->timestamp;
             //Note: deliver_message frees the RDMC buffer in msg, which is why the timestamp must be saved before calling this
-            assigned_version = persistent::combine_int32s(sst.vid[member_index], least_undelivered_rdmc_seq_num);
-            deliver_message(msg, subgroup_num, assigned_version, msg_ts/1000);
-            non_null_msgs_delivered |= version_message(msg, subgroup_num, assigned_version, msg_ts);
+            assigned_version = persistent::combine_int32s(sst.vid[member_index], seq_num);
+            deliver_message(msg, subgroup_num, assigned_version, msg_ts / 1000);
+            non_null_msgs_delivered |= version_message(msg, subgroup_num, seq_num, assigned_version, msg_ts);
             // free the message buffer only after it version_message has been called
-            free_message_buffers[subgroup_num].push_back(std::move(msg.message_buffer));
-            sst.delivered_num[member_index][subgroup_num] = least_undelivered_rdmc_seq_num;
-            locally_stable_rdmc_messages[subgroup_num].erase(locally_stable_rdmc_messages[subgroup_num].begin());
-        } else if(least_undelivered_sst_seq_num < least_undelivered_rdmc_seq_num && least_undelivered_sst_seq_num <= min_stable_num) {
-            update_sst = true;
+            state.free_message_buffers.push_back(std::move(msg.message_buffer));
+            rdmc_messages.erase(seq_num);
+        } else if(SSTMessage* sst_msg = sst_messages.find(seq_num)) {
             dbg_default_trace("Subgroup {}, can deliver a locally stable SST message: min_stable_num={} and least_undelivered_seq_num={}",
-                              subgroup_num, min_stable_num, least_undelivered_sst_seq_num);
-            SSTMessage& msg = locally_stable_sst_messages[subgroup_num].begin()->second;
+                              subgroup_num, min_stable_num, seq_num);
+            SSTMessage& msg = *sst_msg;
             char* buf = (char*)msg.buf;
             uint64_t msg_ts = ((header*)buf)->timestamp;
-            assigned_version = persistent::combine_int32s(sst.vid[member_index], least_undelivered_sst_seq_num);
-            deliver_message(msg, subgroup_num, assigned_version, msg_ts/1000);
-            non_null_msgs_delivered |= version_message(msg, subgroup_num, assigned_version, msg_ts);
-            sst.delivered_num[member_index][subgroup_num] = least_undelivered_sst_seq_num;
-            locally_stable_sst_messages[subgroup_num].erase(locally_stable_sst_messages[subgroup_num].begin());
+            assigned_version = persistent::combine_int32s(sst.vid[member_index], seq_num);
+            deliver_message(msg, subgroup_num, assigned_version, msg_ts / 1000);
+            non_null_msgs_delivered |= version_message(msg, subgroup_num, seq_num, assigned_version, msg_ts);
+            sst_messages.erase(seq_num);
         } else {
             break;
         }
+        last_delivered_seq_num = seq_num;
+        num_delivered++;
     }
-    if(update_sst) {
+    if(num_delivered > 0) {
+        sst.delivered_num[member_index][subgroup_num] = last_delivered_seq_num;
         sst.put(get_shard_sst_indices(subgroup_num),
                 sst.delivered_num, subgroup_num);
-        // post persistence request for ordered mode.
+        // post a single persistence request for the whole batch in ordered mode.
         if(non_null_msgs_delivered) {
             std::get<1>(persistence_manager_callbacks)(subgroup_num, assigned_version);
         }
@@ -838,7 +931,7 @@ void MulticastGroup::register_predicates() {
         }
 
         auto receiver_pred = [=](const DerechoSST& sst) {
-            return receiver_predicate(subgroup_settings,
+            return receiver_predicate(subgroup_num, subgroup_settings,
                                       shard_ranks_by_sender_rank, num_shard_senders, sst);
         };
         auto batch_size = subgroup_settings.profile.window_size / 2;
@@ -855,40 +948,69 @@ void MulticastGroup::register_predicates() {
                               shard_ranks_by_sender_rank, num_shard_senders, sst,
                               batch_size, sst_receive_handler_lambda);
         };
+        // All of a subgroup's predicates go in the partition keyed by its subgroup number,
+        // so they are evaluated in order by one thread, while those of other subgroups
+        // may be evaluated in parallel if there is more than one predicate thread.
         receiver_pred_handles.emplace_back(sst->predicates.insert(receiver_pred, receiver_trig,
-                                                                  sst::PredicateType::RECURRENT));
+                                                                  sst::PredicateType::RECURRENT,
+                                                                  {}, subgroup_num));
 
+        // The ordered-mode predicates below declare the SST entries they read, so the
+        // predicate engine only re-evaluates them when those entries change.
+        const std::vector<uint32_t> shard_sst_indices = get_shard_sst_indices(subgroup_num);
         if(subgroup_settings.mode != Mode::UNORDERED) {
-            auto delivery_pred = [](const DerechoSST& sst) { return true; };
+            auto delivery_pred = [this, subgroup_num, shard_sst_indices](const DerechoSST& sst) {
+                // true if some received message is not yet delivered
+                const message_id_t delivered_num = sst.delivered_num[member_index][subgroup_num];
+                for(const auto i : shard_sst_indices) {
+                    if(sst.seq_num[i][subgroup_num] <= delivered_num) {
+                        return false;
+                    }
+                }
+                return true;
+            };
             auto delivery_trig = [=](DerechoSST& sst) mutable {
                 delivery_trigger(subgroup_num, subgroup_settings, num_shard_members, sst);
             };
 
-            delivery_pred_handles.emplace_back(sst->predicates.insert(delivery_pred, delivery_trig,
-                                                                      sst::PredicateType::RECURRENT));
-
-            auto persistence_pred = [](const DerechoSST& sst) { return true; };
-            auto persistence_trig = [this, subgroup_num, subgroup_settings, num_shard_members, version_seen = (persistent::version_t)INVALID_VERSION](DerechoSST& sst) mutable {
-                std::lock_guard<std::mutex> lock(msg_state_mtx);
-                // compute the min of the persisted_num
-                persistent::version_t min_persisted_num
-                        = sst.persisted_num[node_id_to_sst_index.at(subgroup_settings.members[0])][subgroup_num];
-                for(uint i = 1; i < num_shard_members; ++i) {
-                    persistent::version_t persisted_num_copy = sst.persisted_num[node_id_to_sst_index.at(subgroup_settings.members[i])][subgroup_num];
+            delivery_pred_handles.emplace_back(sst->predicates.insert(
+                    delivery_pred, delivery_trig, sst::PredicateType::RECURRENT,
+                    {sst->dependency(sst->seq_num, subgroup_num, shard_sst_indices),
+                     sst->dependency(sst->delivered_num, subgroup_num, {static_cast<uint32_t>(member_index)})},
+                    subgroup_num));
+
+            // the highest version reported to the global persistence callback
+            auto version_seen = std::make_shared<persistent::version_t>(INVALID_VERSION);
+            auto min_persisted_num = [subgroup_num, shard_sst_indices](const DerechoSST& sst) {
+                // to avoid a race condition, do not read the same SST entry twice
+                persistent::version_t min_persisted_num = sst.persisted_num[shard_sst_indices[0]][subgroup_num];
+                for(const auto i : shard_sst_indices) {
+                    persistent::version_t persisted_num_copy = sst.persisted_num[i][subgroup_num];
                     min_persisted_num = std::min(min_persisted_num, persisted_num_copy);
                 }
+                return min_persisted_num;
+            };
+            auto persistence_pred = [this, version_seen, min_persisted_num](const DerechoSST& sst) {
+                return callbacks.global_persistence_callback && *version_seen < min_persisted_num(sst);
+            };
+            auto persistence_trig = [this, subgroup_num, version_seen, min_persisted_num](DerechoSST& sst) {
+                std::lock_guard<std::mutex> lock(subgroup_states[subgroup_num]->mutex);
+                const persistent::version_t persisted_num = min_persisted_num(sst);
                 // callbacks
-                if((version_seen < min_persisted_num) && callbacks.global_persistence_callback) {
-                    callbacks.global_persistence_callback(subgroup_num, min_persisted_num);
-                    version_seen = min_persisted_num;
+                if(*version_seen < persisted_num) {
+                    callbacks.global_persistence_callback(subgroup_num, persisted_num);
+                    *version_seen = persisted_num;
                 }
             };
 
-            persistence_pred_handles.emplace_back(sst->predicates.insert(persistence_pred, persistence_trig, sst::PredicateType::RECURRENT));
+            persistence_pred_handles.emplace_back(sst->predicates.insert(
+                    persistence_pred, persistence_trig, sst::PredicateType::RECURRENT,
+                    {sst->dependency(sst->persisted_num, subgroup_num, shard_sst_indices)},
+                    subgroup_num));
 
             if(subgroup_settings.sender_rank >= 0) {
                 auto sender_pred = [this, subgroup_num, subgroup_settings, num_shard_members, num_shard_senders](const DerechoSST& sst) {
-                    message_id_t seq_num = next_message_to_deliver[subgroup_num] * num_shard_senders + subgroup_settings.sender_rank;
+                    message_id_t seq_num = subgroup_states[subgroup_num]->next_message_to_deliver * num_shard_senders + subgroup_settings.sender_rank;
                     for(uint i = 0; i < num_shard_members; ++i) {
                         if(sst.delivered_num[node_id_to_sst_index.at(subgroup_settings.members[i])][subgroup_num] < seq_num
                            || (sst.persisted_num[node_id_to_sst_index.at(subgroup_settings.members[i])][subgroup_num] < seq_num)) {
@@ -898,11 +1020,15 @@ void MulticastGroup::register_predicates() {
                     return true;
                 };
                 auto sender_trig = [this, subgroup_num](DerechoSST& sst) {
-                    sender_cv.notify_all();
-                    next_message_to_deliver[subgroup_num]++;
+                    wake_sender_thread();
+                    subgroup_states[subgroup_num]->next_message_to_deliver++;
                 };
-                sender_pred_handles.emplace_back(sst->predicates.insert(sender_pred, sender_trig,
-                                                                        sst::PredicateType::RECURRENT));
+                // next_message_to_deliver is only changed by sender_trig, so the SST entries are the only other inputs
+                sender_pred_handles.emplace_back(sst->predicates.insert(
+                        sender_pred, sender_trig, sst::PredicateType::RECURRENT,
+                        {sst->dependency(sst->delivered_num, subgroup_num, shard_sst_indices),
+                         sst->dependency(sst->persisted_num, subgroup_num, shard_sst_indices)},
+                        subgroup_num));
             }
         } else {
             //This subgroup is in UNORDERED mode
@@ -911,19 +1037,62 @@ void MulticastGroup::register_predicates() {
                     for(uint i = 0; i < num_shard_members; ++i) {
                         uint32_t num_received_offset = subgroup_settings.num_received_offset;
                         if(sst.num_received[node_id_to_sst_index.at(subgroup_settings.members[i])][num_received_offset + subgroup_settings.sender_rank]
-                           < static_cast<int32_t>(future_message_indices[subgroup_num] - 1 - subgroup_settings.profile.window_size)) {
+                           < static_cast<int32_t>(subgroup_states[subgroup_num]->future_message_index - 1 - subgroup_settings.profile.window_size)) {
                             return false;
                         }
                     }
                     return true;
                 };
                 auto sender_trig = [this](DerechoSST& sst) {
-                    sender_cv.notify_all();
+                    wake_sender_thread();
                 };
                 sender_pred_handles.emplace_back(sst->predicates.insert(sender_pred, sender_trig,
-                                                                        sst::PredicateType::RECURRENT));
+                                                                        sst::PredicateType::RECURRENT,
+                                                                        {}, subgroup_num));
             }
         }
+
+        if(subgroup_settings.sender_rank >= 0) {
+            // Wakes up the sends that are waiting for a free buffer once the send window has room,
+            // and, if the last send could not get an SST multicast buffer, once one that size is free.
+            // It reads num_waiting_sends, which is not in the SST, so it cannot declare dependencies.
+            auto send_space_pred = [this, subgroup_num, subgroup_settings](const DerechoSST& sst) {
+                const SubgroupMessageState& state = *subgroup_states[subgroup_num];
+                if(state.num_waiting_sends == 0 || !send_window_open(subgroup_num, subgroup_settings)) {
+                    return false;
+                }
+                const uint64_t blocked_size = state.smc_blocked_size;
+                return blocked_size == 0 || sst_multicast_group_ptrs[subgroup_num]->has_room(blocked_size);
+            };
+            auto send_space_trig = [this, subgroup_num](DerechoSST& sst) {
+                SubgroupMessageState& state = *subgroup_states[subgroup_num];
+                std::lock_guard<std::mutex> lock(state.mutex);
+                send_queued_async(subgroup_num);
+                state.send_space_cv.notify_all();
+            };
+            sender_pred_handles.emplace_back(sst->predicates.insert(send_space_pred, send_space_trig,
+                                                                    sst::PredicateType::RECURRENT,
+                                                                    {}, subgroup_num));
+        }
+
+        if(subgroup_settings.sender_rank >= 0 && packs_smc_messages(subgroup_settings)) {
+            // Sends a pack of small messages that has waited smc_packing_max_delay_us
+            // without filling up; like send_space_pred it depends on the clock, not the SST
+            auto pack_flush_pred = [this, subgroup_num](const DerechoSST& sst) {
+                const SubgroupMessageState& state = *subgroup_states[subgroup_num];
+                return state.pack_is_open && get_time() - state.open_pack_start_time >= smc_packing_max_delay_ns;
+            };
+            auto pack_flush_trig = [this, subgroup_num](DerechoSST& sst) {
+                SubgroupMessageState& state = *subgroup_states[subgroup_num];
+                std::lock_guard<std::mutex> lock(state.mutex);
+                if(state.open_pack && get_time() - state.open_pack_start_time >= smc_packing_max_delay_ns) {
+                    flush_pack(subgroup_num);
+                }
+            };
+            sender_pred_handles.emplace_back(sst->predicates.insert(pack_flush_pred, pack_flush_trig,
+                                                                    sst::PredicateType::RECURRENT,
+                                                                    {}, subgroup_num));
+        }
     }
 }
 
@@ -958,11 +1127,29 @@ void MulticastGroup::wedge() {
         handle_iter = persistence_pred_handles.erase(handle_iter);
     }
 
+    // Send any open packs, since their messages already have indices, and release
+    // the sends that are waiting for a buffer; they will be retried in the next view
+    for(subgroup_id_t subgroup_num = 0; subgroup_num < subgroup_states.size(); ++subgroup_num) {
+        auto& state = subgroup_states[subgroup_num];
+        std::lock_guard<std::mutex> lock(state->mutex);
+        flush_pack(subgroup_num);
+        while(!state->async_sends.empty()) {
+            state->async_sends.front().on_done(false);
+            state->async_sends.pop();
+            state->num_waiting_sends--;
+        }
+        state->send_space_cv.notify_all();
+    }
+
+    // The predicates are gone, but other partitions' detect threads may still be
+    // running one of their triggers; wait for those before tearing anything down
+    sst->predicates.wait_for_triggers();
+
     for(uint i = 0; i < num_members; ++i) {
         rdmc::destroy_group(i + rdmc_group_num_offset);
     }
 
-    sender_cv.notify_all();
+    wake_sender_thread();
     if(sender_thread.joinable()) {
         sender_thread.join();
     }
@@ -975,10 +1162,11 @@ void MulticastGroup::send_loop() {
         if(!rdmc_sst_groups_created) {
             return false;
         }
-        if(pending_sends[subgroup_num].empty()) {
+        SubgroupMessageState& state = *subgroup_states[subgroup_num];
+        if(state.pending_sends.empty()) {
             return false;
         }
-        RDMCMessage& msg = pending_sends[subgroup_num].front();
+        RDMCMessage& msg = state.pending_sends.front();
         const SubgroupSettings& subgroup_settings = subgroup_settings_map.at(subgroup_num);
 
         int shard_sender_index = subgroup_settings.sender_rank;
@@ -1004,7 +1192,7 @@ void MulticastGroup::send_loop() {
             for(uint i = 0; i < num_shard_members; ++i) {
                 auto num_received_offset = subgroup_settings.num_received_offset;
                 if(sst->num_received[node_id_to_sst_index.at(shard_members[i])][num_received_offset + shard_sender_index]
-                   < static_cast<int32_t>(future_message_indices[subgroup_num] - 1 - subgroup_settings.profile.window_size)) {
+                   < static_cast<int32_t>(state.future_message_index - 1 - subgroup_settings.profile.window_size)) {
                     return false;
                 }
             }
@@ -1012,34 +1200,52 @@ void MulticastGroup::send_loop() {
 
         return true;
     };
-    auto should_send = [&]() {
-        for(uint i = 1; i <= total_num_subgroups; ++i) {
+    // Checks each subgroup in turn, under that subgroup's lock, and sends the first
+    // message that is ready. Returns false if no subgroup had a message to send.
+    auto send_next = [&]() {
+        for(uint i = 1; i <= total_num_subgroups && !thread_shutdown; ++i) {
             auto subgroup_num = (subgroup_to_send + i) % total_num_subgroups;
-            if(should_send_to_subgroup(subgroup_num)) {
-                subgroup_to_send = subgroup_num;
-                return true;
+            SubgroupMessageState& state = *subgroup_states[subgroup_num];
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if(!should_send_to_subgroup(subgroup_num)) {
+                continue;
+            }
+            subgroup_to_send = subgroup_num;
+            state.current_send = std::move(state.pending_sends.front());
+            dbg_default_trace("Calling send in subgroup {} on message {} from sender {}",
+                              subgroup_num, state.current_send->index, state.current_send->sender_id);
+            if(!rdmc::send(subgroup_to_rdmc_group[subgroup_num],
+                           state.current_send->message_buffer.mr, 0,
+                           state.current_send->size)) {
+                throw std::runtime_error("rdmc::send returned false");
             }
+            state.pending_sends.pop();
+            return true;
         }
         return false;
     };
-    auto should_wake = [&]() { return thread_shutdown || should_send(); };
-    std::unique_lock<std::mutex> lock(msg_state_mtx);
+    std::unique_lock<std::mutex> sender_lock(sender_mtx);
     while(!thread_shutdown) {
-        sender_cv.wait(lock, should_wake);
-        if(!thread_shutdown) {
-            current_sends[subgroup_to_send] = std::move(pending_sends[subgroup_to_send].front());
-            dbg_default_trace("Calling send in subgroup {} on message {} from sender {}",
-                              subgroup_to_send, current_sends[subgroup_to_send]->index, current_sends[subgroup_to_send]->sender_id);
-            if(!rdmc::send(subgroup_to_rdmc_group[subgroup_to_send],
-                           current_sends[subgroup_to_send]->message_buffer.mr, 0,
-                           current_sends[subgroup_to_send]->size)) {
-                throw std::runtime_error("rdmc::send returned false");
-            }
-            pending_sends[subgroup_to_send].pop();
+        // Any wakeup after this point makes the wait below return, so a message
+        // that becomes ready while the subgroups are being checked is not missed.
+        const uint64_t wakeups_seen = sender_wakeups;
+        sender_lock.unlock();
+        const bool sent = send_next();
+        sender_lock.lock();
+        if(!sent) {
+            sender_cv.wait(sender_lock, [&]() { return thread_shutdown || sender_wakeups != wakeups_seen; });
         }
     }
 }
 
+void MulticastGroup::wake_sender_thread() {
+    {
+        std::lock_guard<std::mutex> lock(sender_mtx);
+        sender_wakeups++;
+    }
+    sender_cv.notify_all();
+}
+
 uint64_t MulticastGroup::get_time() {
     struct timespec start_time;
     clock_gettime(CLOCK_REALTIME, &start_time);
@@ -1061,10 +1267,11 @@ void MulticastGroup::check_failures_loop() {
     while(!thread_shutdown) {
         std::this_thread::sleep_for(std::chrono::milliseconds(sender_timeout));
         if(sst) {
-            std::unique_lock<std::mutex> lock(msg_state_mtx);
             auto current_time = get_time();
             for(auto p : subgroup_settings_map) {
                 auto subgroup_num = p.first;
+                SubgroupMessageState& state = *subgroup_states[subgroup_num];
+                std::lock_guard<std::mutex> lock(state.mutex);
                 auto members = p.second.members;
                 auto sst_indices = get_shard_sst_indices(subgroup_num);
                 // clean up timestamps of persisted messages
@@ -1073,16 +1280,16 @@ void MulticastGroup::check_failures_loop() {
                     persistent::version_t persisted_num_copy = sst->persisted_num[i][subgroup_num];
                     min_persisted_num = std::min(min_persisted_num, persisted_num_copy);
                 }
-                while(!pending_persistence[subgroup_num].empty() && pending_persistence[subgroup_num].begin()->first <= min_persisted_num) {
-                    auto timestamp = pending_persistence[subgroup_num].begin()->second;
-                    pending_persistence[subgroup_num].erase(pending_persistence[subgroup_num].begin());
-                    pending_message_timestamps[subgroup_num].erase(timestamp);
+                while(!state.pending_persistence.empty() && state.pending_persistence.begin()->first <= min_persisted_num) {
+                    auto own_index = state.pending_persistence.begin()->second;
+                    state.pending_persistence.erase(state.pending_persistence.begin());
+                    state.pending_message_timestamps.erase(own_index);
                 }
-                if(pending_message_timestamps[subgroup_num].empty()) {
+                if(state.pending_message_timestamps.empty()) {
                     sst->local_stability_frontier[member_index][subgroup_num] = current_time;
                 } else {
                     sst->local_stability_frontier[member_index][subgroup_num] = std::min(current_time,
-                                                                                         *pending_message_timestamps[subgroup_num].begin());
+                                                                                         state.pending_message_timestamps.front());
                 }
             }
             sst->put_with_completion((char*)std::addressof(sst->local_stability_frontier[0][0]) - sst->getBaseAddress(),
@@ -1091,25 +1298,28 @@ void MulticastGroup::check_failures_loop() {
     }
 }
 
-// we already hold the lock on msg_state_mtx when we call this
+// we already hold the subgroup's state mutex when we call this
 void MulticastGroup::get_buffer_and_send_auto_null(subgroup_id_t subgroup_num) {
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
     // short-circuits most of the normal checks because
     // we know that we received a message and are sending a null
     long long unsigned int msg_size = sizeof(header);
     const DerechoParams& profile = subgroup_settings_map.at(subgroup_num).profile;
+    // the null message takes the next index, so the messages packed before it go first
+    flush_pack(subgroup_num);
     // very unlikely that msg_size does not fit in the max_msg_size since we are sending a NULL
     // but the user might not be interested in using SSTMC at all, then sst::max_msg_size can be zero
     if(msg_size > profile.sst_max_msg_size) {
         // Create new Message
         RDMCMessage msg;
         msg.sender_id = members[member_index];
-        msg.index = future_message_indices[subgroup_num];
+        msg.index = state.future_message_index;
         msg.size = msg_size;
-        msg.message_buffer = std::move(free_message_buffers[subgroup_num].back());
-        free_message_buffers[subgroup_num].pop_back();
+        msg.message_buffer = std::move(state.free_message_buffers.back());
+        state.free_message_buffers.pop_back();
 
         auto current_time = get_time();
-        pending_message_timestamps[subgroup_num].insert(current_time);
+        state.pending_message_timestamps.insert(state.future_message_index, current_time);
 
         // Fill header
         char* buf = msg.message_buffer.buffer.get();
@@ -1118,23 +1328,25 @@ void MulticastGroup::get_buffer_and_send_auto_null(subgroup_id_t subgroup_num) {
         ((header*)buf)->timestamp = current_time;
         ((header*)buf)->cooked_send = false;
 
-        future_message_indices[subgroup_num]++;
-        pending_sends[subgroup_num].push(std::move(msg));
-        sender_cv.notify_all();
+        state.future_message_index++;
+        state.pending_sends.push(std::move(msg));
+        wake_sender_thread();
     } else {
-        char* buf = (char*)sst_multicast_group_ptrs[subgroup_num]->get_buffer(msg_size);
+        // a null may use the part of an SMC ring reserved for nulls
+        char* buf = (char*)sst_multicast_group_ptrs[subgroup_num]->get_buffer(msg_size, true,
+                                                                               state.future_message_index);
 
         assert(buf);
 
         auto current_time = get_time();
-        pending_message_timestamps[subgroup_num].insert(current_time);
+        state.pending_message_timestamps.insert(state.future_message_index, current_time);
 
         ((header*)buf)->header_size = sizeof(header);
-        ((header*)buf)->index = future_message_indices[subgroup_num];
+        ((header*)buf)->index = state.future_message_index;
         ((header*)buf)->timestamp = current_time;
         ((header*)buf)->cooked_send = false;
 
-        future_message_indices[subgroup_num]++;
+        state.future_message_index++;
         sst_multicast_group_ptrs[subgroup_num]->send();
     }
 }
@@ -1142,6 +1354,7 @@ void MulticastGroup::get_buffer_and_send_auto_null(subgroup_id_t subgroup_num) {
 char* MulticastGroup::get_sendbuffer_ptr(subgroup_id_t subgroup_num,
                                          long long unsigned int payload_size,
                                          bool cooked_send) {
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
     long long unsigned int msg_size = payload_size + sizeof(header);
     const SubgroupSettings& subgroup_settings = subgroup_settings_map.at(subgroup_num);
     if(msg_size > subgroup_settings.profile.max_msg_size) {
@@ -1150,55 +1363,37 @@ char* MulticastGroup::get_sendbuffer_ptr(subgroup_id_t subgroup_num,
         throw derecho_exception(exp_msg);
     }
 
-    std::vector<node_id_t> shard_members = subgroup_settings.members;
-    auto num_shard_members = shard_members.size();
-    // if the current node is not a sender, shard_sender_index will be -1
-    uint32_t num_shard_senders;
-    std::vector<int> shard_senders = subgroup_settings.senders;
-    int shard_sender_index = subgroup_settings.sender_rank;
-    num_shard_senders = get_num_senders(shard_senders);
-    assert(shard_sender_index >= 0);
-
-    if(subgroup_settings.mode != Mode::UNORDERED) {
-        for(uint i = 0; i < num_shard_members; ++i) {
-            if(sst->delivered_num[node_id_to_sst_index.at(shard_members[i])][subgroup_num]
-               < static_cast<int32_t>((future_message_indices[subgroup_num] - subgroup_settings.profile.window_size) * num_shard_senders + shard_sender_index)) {
-                return nullptr;
-            }
-        }
-    } else {
-        for(uint i = 0; i < num_shard_members; ++i) {
-            auto num_received_offset = subgroup_settings.num_received_offset;
-            if(sst->num_received[node_id_to_sst_index.at(shard_members[i])][num_received_offset + shard_sender_index]
-               < static_cast<int32_t>(future_message_indices[subgroup_num] - subgroup_settings.profile.window_size)) {
-                return nullptr;
-            }
-        }
+    if(!send_window_open(subgroup_num, subgroup_settings)) {
+        return nullptr;
     }
 
-    if(msg_size > subgroup_settings.profile.sst_max_msg_size) {
+    // Only messages that may share a slot pay for the larger packed_header
+    const bool packing = packs_smc_messages(subgroup_settings);
+    const uint32_t smc_header_size = packing ? sizeof(packed_header) : sizeof(header);
+    if(payload_size + smc_header_size > subgroup_settings.profile.sst_max_msg_size) {
         if(thread_shutdown) {
             return nullptr;
         }
 
-        if(free_message_buffers[subgroup_num].empty()) {
+        if(state.free_message_buffers.empty()) {
             return nullptr;
         }
 
-        if(pending_sst_sends[subgroup_num] || next_sends[subgroup_num]) {
+        if(state.pending_sst_send || state.next_send) {
             return nullptr;
         }
+        flush_pack(subgroup_num);
 
         // Create new Message
         RDMCMessage msg;
         msg.sender_id = members[member_index];
-        msg.index = future_message_indices[subgroup_num];
+        msg.index = state.future_message_index;
         msg.size = msg_size;
-        msg.message_buffer = std::move(free_message_buffers[subgroup_num].back());
-        free_message_buffers[subgroup_num].pop_back();
+        msg.message_buffer = std::move(state.free_message_buffers.back());
+        state.free_message_buffers.pop_back();
 
         auto current_time = get_time();
-        pending_message_timestamps[subgroup_num].insert(current_time);
+        state.pending_message_timestamps.insert(state.future_message_index, current_time);
 
         // Fill header
         char* buf = msg.message_buffer.buffer.get();
@@ -1207,82 +1402,241 @@ char* MulticastGroup::get_sendbuffer_ptr(subgroup_id_t subgroup_num,
         ((header*)buf)->timestamp = current_time;
         ((header*)buf)->cooked_send = cooked_send;
 
-        next_sends[subgroup_num] = std::move(msg);
-        future_message_indices[subgroup_num]++;
+        state.next_send = std::move(msg);
+        state.future_message_index++;
 
-        last_transfer_medium[subgroup_num] = true;
+        state.last_transfer_medium = true;
         return buf + sizeof(header);
     } else {
-        if(pending_sst_sends[subgroup_num] || next_sends[subgroup_num]) {
+        if(state.pending_sst_send || state.next_send) {
             return nullptr;
         }
 
-        pending_sst_sends[subgroup_num] = true;
+        state.pending_sst_send = true;
         if(thread_shutdown) {
-            pending_sst_sends[subgroup_num] = false;
+            state.pending_sst_send = false;
             return nullptr;
         }
-        char* buf = (char*)sst_multicast_group_ptrs[subgroup_num]->get_buffer(msg_size);
+        msg_size = payload_size + smc_header_size;
+        char* buf = packing
+                            ? get_pack_buffer(subgroup_num, msg_size)
+                            : (char*)sst_multicast_group_ptrs[subgroup_num]->get_buffer(msg_size, false,
+                                                                                        state.future_message_index);
         if(!buf) {
-            pending_sst_sends[subgroup_num] = false;
+            state.smc_blocked_size = packing ? subgroup_settings.profile.sst_max_msg_size : msg_size;
+            state.pending_sst_send = false;
             return nullptr;
         }
+        state.smc_blocked_size = 0;
         auto current_time = get_time();
-        pending_message_timestamps[subgroup_num].insert(current_time);
+        state.pending_message_timestamps.insert(state.future_message_index, current_time);
 
-        ((header*)buf)->header_size = sizeof(header);
-        ((header*)buf)->index = future_message_indices[subgroup_num];
+        ((header*)buf)->header_size = smc_header_size;
+        ((header*)buf)->index = state.future_message_index;
         ((header*)buf)->timestamp = current_time;
         ((header*)buf)->cooked_send = cooked_send;
-        future_message_indices[subgroup_num]++;
+        if(packing) {
+            ((packed_header*)buf)->packed_next_offset = 0;
+        }
+        state.future_message_index++;
         dbg_default_trace("Subgroup {}: get_sendbuffer_ptr increased future_message_indices to {}",
-                          subgroup_num, future_message_indices[subgroup_num]);
+                          subgroup_num, state.future_message_index);
 
-        last_transfer_medium[subgroup_num] = false;
-        return buf + sizeof(header);
+        state.last_transfer_medium = false;
+        return buf + smc_header_size;
     }
 }
 
-bool MulticastGroup::send(subgroup_id_t subgroup_num, long long unsigned int payload_size,
-                          const std::function<void(char* buf)>& msg_generator, bool cooked_send) {
-    if(!rdmc_sst_groups_created) {
-        return false;
+bool MulticastGroup::send_window_open(subgroup_id_t subgroup_num, const SubgroupSettings& subgroup_settings) {
+    const SubgroupMessageState& state = *subgroup_states[subgroup_num];
+    const std::vector<node_id_t>& shard_members = subgroup_settings.members;
+    auto num_shard_members = shard_members.size();
+    // if the current node is not a sender, shard_sender_index will be -1
+    uint32_t num_shard_senders = get_num_senders(subgroup_settings.senders);
+    int shard_sender_index = subgroup_settings.sender_rank;
+    assert(shard_sender_index >= 0);
+
+    if(subgroup_settings.mode != Mode::UNORDERED) {
+        for(uint i = 0; i < num_shard_members; ++i) {
+            if(sst->delivered_num[node_id_to_sst_index.at(shard_members[i])][subgroup_num]
+               < static_cast<int32_t>((state.future_message_index - subgroup_settings.profile.window_size) * num_shard_senders + shard_sender_index)) {
+                return false;
+            }
+        }
+    } else {
+        for(uint i = 0; i < num_shard_members; ++i) {
+            auto num_received_offset = subgroup_settings.num_received_offset;
+            if(sst->num_received[node_id_to_sst_index.at(shard_members[i])][num_received_offset + shard_sender_index]
+               < static_cast<int32_t>(state.future_message_index - subgroup_settings.profile.window_size)) {
+                return false;
+            }
+        }
     }
-    std::unique_lock<std::mutex> lock(msg_state_mtx);
+    return true;
+}
 
+bool MulticastGroup::try_send_locked(subgroup_id_t subgroup_num, long long unsigned int payload_size,
+                                     const std::function<void(char* buf)>& msg_generator, bool cooked_send) {
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
+    // The buffer is filled and sent under the subgroup's lock: a null message sent in
+    // between would otherwise take a later index but be published first.
     char* buf = get_sendbuffer_ptr(subgroup_num, payload_size, cooked_send);
-    while(!buf) {
-        // Don't want any deadlocks. For example, this thread cannot get a buffer because delivery is lagging
-        // but the SST detect thread cannot proceed (and deliver) because it requires the same lock
-        // do not use defer_lock in the unique_lock declaration above and move unlock to the end of the loop.
-        // That will cause a bug. We want to unlock only when we are sure that buf is nullptr.
-        lock.unlock();
-        if(thread_shutdown) {
-            return false;
-        }
-        lock.lock();
-        buf = get_sendbuffer_ptr(subgroup_num, payload_size, cooked_send);
+    if(!buf) {
+        // the messages in an open pack count against the window, so send them
+        // rather than wait for the pack to time out
+        flush_pack(subgroup_num);
+        return false;
     }
 
     // call to the user supplied message generator
     msg_generator(buf);
 
-    if(last_transfer_medium[subgroup_num]) {
-        assert(next_sends[subgroup_num]);
-        pending_sends[subgroup_num].push(std::move(*next_sends[subgroup_num]));
-        next_sends[subgroup_num] = std::nullopt;
-        sender_cv.notify_all();
-        return true;
+    if(state.last_transfer_medium) {
+        assert(state.next_send);
+        state.pending_sends.push(std::move(*state.next_send));
+        state.next_send = std::nullopt;
+        wake_sender_thread();
+    } else if(state.open_pack) {
+        state.pending_sst_send = false;
+        if(state.open_pack_size >= smc_packing_max_bytes
+           || get_time() - state.open_pack_start_time >= smc_packing_max_delay_ns) {
+            flush_pack(subgroup_num);
+        }
     } else {
         sst_multicast_group_ptrs[subgroup_num]->send();
-        pending_sst_sends[subgroup_num] = false;
+        state.pending_sst_send = false;
+    }
+    return true;
+}
+
+char* MulticastGroup::get_pack_buffer(subgroup_id_t subgroup_num, uint64_t msg_size) {
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
+    const uint64_t slot_size = subgroup_settings_map.at(subgroup_num).profile.sst_max_msg_size;
+    if(state.open_pack && state.open_pack_size + msg_size > slot_size) {
+        flush_pack(subgroup_num);
+    }
+    char* buf;
+    if(!state.open_pack) {
+        buf = (char*)sst_multicast_group_ptrs[subgroup_num]->get_buffer(slot_size, false,
+                                                                         state.future_message_index);
+        if(!buf) {
+            return nullptr;
+        }
+        state.open_pack = buf;
+        state.open_pack_size = 0;
+        state.open_pack_start_time = get_time();
+        state.pack_is_open = true;
+    } else {
+        buf = state.open_pack + state.open_pack_size;
+        ((packed_header*)(state.open_pack + state.open_pack_last_offset))->packed_next_offset
+                = state.open_pack_size - state.open_pack_last_offset;
+    }
+    state.open_pack_last_offset = state.open_pack_size;
+    state.open_pack_size += msg_size;
+    return buf;
+}
+
+void MulticastGroup::flush_pack(subgroup_id_t subgroup_num) {
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
+    if(!state.open_pack) {
+        return;
+    }
+    dbg_default_trace("Subgroup {}: sending a pack of {} bytes", subgroup_num, state.open_pack_size);
+    // the pack's bytes are released along with the last message packed into it,
+    // which is the one just before the next index to be assigned
+    sst_multicast_group_ptrs[subgroup_num]->set_last_buffer_size(state.open_pack_size,
+                                                                 state.future_message_index - 1);
+    sst_multicast_group_ptrs[subgroup_num]->send();
+    state.open_pack = nullptr;
+    state.open_pack_size = 0;
+    state.open_pack_last_offset = 0;
+    state.pack_is_open = false;
+}
+
+void MulticastGroup::send_queued_async(subgroup_id_t subgroup_num) {
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
+    while(!state.async_sends.empty()) {
+        AsyncSend& request = state.async_sends.front();
+        if(!try_send_locked(subgroup_num, request.payload_size, request.msg_generator, request.cooked_send)) {
+            return;
+        }
+        request.on_done(true);
+        state.async_sends.pop();
+        state.num_waiting_sends--;
+    }
+}
+
+bool MulticastGroup::send(subgroup_id_t subgroup_num, long long unsigned int payload_size,
+                          const std::function<void(char* buf)>& msg_generator, bool cooked_send) {
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
+    if(!rdmc_sst_groups_created) {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(state.mutex);
+    if(try_send_locked(subgroup_num, payload_size, msg_generator, cooked_send)) {
         return true;
     }
+    // Park until the send-space predicate or wedge() notifies send_space_cv. Waiting
+    // releases the lock, so the SST detect thread can deliver the messages that
+    // hold up the window.
+    state.num_waiting_sends++;
+    while(!thread_shutdown) {
+        state.send_space_cv.wait(lock);
+        if(try_send_locked(subgroup_num, payload_size, msg_generator, cooked_send)) {
+            state.num_waiting_sends--;
+            return true;
+        }
+    }
+    state.num_waiting_sends--;
+    return false;
+}
+
+bool MulticastGroup::try_send(subgroup_id_t subgroup_num, long long unsigned int payload_size,
+                              const std::function<void(char* buf)>& msg_generator, bool cooked_send) {
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
+    if(!rdmc_sst_groups_created || thread_shutdown) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(state.mutex);
+    // a queued asynchronous send must go first
+    if(!state.async_sends.empty()) {
+        return false;
+    }
+    return try_send_locked(subgroup_num, payload_size, msg_generator, cooked_send);
+}
+
+std::future<bool> MulticastGroup::send_async(subgroup_id_t subgroup_num, long long unsigned int payload_size,
+                                             std::function<void(char* buf)> msg_generator, bool cooked_send) {
+    auto sent = std::make_shared<std::promise<bool>>();
+    std::future<bool> result = sent->get_future();
+    send_async(subgroup_num, payload_size, std::move(msg_generator), cooked_send,
+               [sent](bool was_sent) { sent->set_value(was_sent); });
+    return result;
+}
+
+void MulticastGroup::send_async(subgroup_id_t subgroup_num, long long unsigned int payload_size,
+                                std::function<void(char* buf)> msg_generator, bool cooked_send,
+                                std::function<void(bool)> on_done) {
+    SubgroupMessageState& state = *subgroup_states[subgroup_num];
+    if(!rdmc_sst_groups_created) {
+        on_done(false);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(state.mutex);
+    // Earlier async sends that are still queued must go first
+    if(state.async_sends.empty() && try_send_locked(subgroup_num, payload_size, msg_generator, cooked_send)) {
+        on_done(true);
+    } else if(thread_shutdown) {
+        on_done(false);
+    } else {
+        state.async_sends.push({payload_size, std::move(msg_generator), cooked_send, std::move(on_done)});
+        state.num_waiting_sends++;
+    }
 }
 
 bool MulticastGroup::check_pending_sst_sends(subgroup_id_t subgroup_num) {
-    std::lock_guard<std::mutex> lock(msg_state_mtx);
-    return pending_sst_sends[subgroup_num];
+    std::lock_guard<std::mutex> lock(subgroup_states[subgroup_num]->mutex);
+    return subgroup_states[subgroup_num]->pending_sst_send;
 }
 
 std::vector<uint32_t> MulticastGroup::get_shard_sst_indices(subgroup_id_t subgroup_num) {
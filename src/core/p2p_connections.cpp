@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <map>
 
 #include <cassert>
@@ -18,7 +19,11 @@ P2PConnections::P2PConnections(const P2PParams params)
           incoming_p2p_buffers(num_members),
           outgoing_p2p_buffers(num_members),
           res_vec(num_members),
-          p2p_buf_size(num_request_types * max_msg_size * window_size + sizeof(bool)),
+          p2p_buf_size(num_request_types * max_msg_size * window_size + (num_request_types + 1) * sizeof(uint64_t) + sizeof(bool)),
+          incoming_partial_replies(num_members),
+          claimed_request_seq_nums(num_members),
+          outgoing_doorbells(num_members),
+          incoming_doorbells(num_members),
           prev_mode(num_members) {
     //Figure out my SST index
     my_index = (uint32_t)-1;
@@ -32,6 +37,7 @@ P2PConnections::P2PConnections(const P2PParams params)
     for(auto type : p2p_request_types) {
         incoming_seq_nums_map.try_emplace(type,std::vector<std::atomic<uint64_t>>(num_members));
         outgoing_seq_nums_map.try_emplace(type,std::vector<std::atomic<uint64_t>>(num_members));
+        reported_seq_nums_map.try_emplace(type, std::vector<uint64_t>(num_members));
     }
 
     for(uint i = 0; i < num_members; ++i) {
@@ -62,7 +68,11 @@ P2PConnections::P2PConnections(P2PConnections&& old_connections, const std::vect
           incoming_p2p_buffers(num_members),
           outgoing_p2p_buffers(num_members),
           res_vec(num_members),
-          p2p_buf_size(num_request_types * max_msg_size * window_size + sizeof(bool)),
+          p2p_buf_size(num_request_types * max_msg_size * window_size + (num_request_types + 1) * sizeof(uint64_t) + sizeof(bool)),
+          incoming_partial_replies(num_members),
+          claimed_request_seq_nums(num_members),
+          outgoing_doorbells(num_members),
+          incoming_doorbells(num_members),
           prev_mode(num_members) {
     old_connections.shutdown_failures_thread();
     //Figure out my SST index
@@ -77,6 +87,7 @@ P2PConnections::P2PConnections(P2PConnections&& old_connections, const std::vect
     for(auto type : p2p_request_types) {
         incoming_seq_nums_map.try_emplace(type,std::vector<std::atomic<uint64_t>>(num_members));
         outgoing_seq_nums_map.try_emplace(type,std::vector<std::atomic<uint64_t>>(num_members));
+        reported_seq_nums_map.try_emplace(type, std::vector<uint64_t>(num_members));
     }
 
     for(uint i = 0; i < num_members; ++i) {
@@ -92,9 +103,14 @@ P2PConnections::P2PConnections(P2PConnections&& old_connections, const std::vect
             auto old_rank = old_connections.node_id_to_rank[members[i]];
             incoming_p2p_buffers[i] = std::move(old_connections.incoming_p2p_buffers[old_rank]);
             outgoing_p2p_buffers[i] = std::move(old_connections.outgoing_p2p_buffers[old_rank]);
+            incoming_partial_replies[i].store(old_connections.incoming_partial_replies[old_rank]);
+            claimed_request_seq_nums[i].store(old_connections.claimed_request_seq_nums[old_rank]);
+            outgoing_doorbells[i].store(old_connections.outgoing_doorbells[old_rank]);
+            incoming_doorbells[i] = old_connections.incoming_doorbells[old_rank];
             for(auto type : p2p_request_types) {
                 incoming_seq_nums_map[type][i].store(old_connections.incoming_seq_nums_map[type][old_rank]);
                 outgoing_seq_nums_map[type][i].store(old_connections.outgoing_seq_nums_map[type][old_rank]);
+                reported_seq_nums_map[type][i] = old_connections.reported_seq_nums_map[type][old_rank];
             }
             if(i != my_index) {
                 res_vec[i] = std::move(old_connections.res_vec[old_rank]);
@@ -132,6 +148,28 @@ uint64_t P2PConnections::getOffsetBuf(REQUEST_TYPE type, uint64_t seq_num) {
     return max_msg_size * (type * window_size + (seq_num++ % window_size));
 }
 
+// the number of messages of each type received from a node, as last reported by that node,
+// is kept after the message slots
+uint64_t P2PConnections::getOffsetConsumed(REQUEST_TYPE type) {
+    return num_request_types * max_msg_size * window_size + type * sizeof(uint64_t);
+}
+
+// the number of messages of any type sent by a node follows those counts
+uint64_t P2PConnections::getOffsetDoorbell() {
+    return num_request_types * max_msg_size * window_size + num_request_types * sizeof(uint64_t);
+}
+
+void P2PConnections::report_consumed(uint32_t rank, REQUEST_TYPE type) {
+    reported_seq_nums_map[type][rank] = incoming_seq_nums_map[type][rank];
+    (uint64_t&)outgoing_p2p_buffers[rank][getOffsetConsumed(type)] = reported_seq_nums_map[type][rank];
+    if(rank == my_index) {
+        (uint64_t&)incoming_p2p_buffers[rank][getOffsetConsumed(type)] = reported_seq_nums_map[type][rank];
+    } else {
+        res_vec[rank]->post_remote_write(getOffsetConsumed(type), sizeof(uint64_t));
+        num_rdma_writes++;
+    }
+}
+
 // check if there's a new request from some node
 char* P2PConnections::probe(uint32_t rank) {
     for(auto type : p2p_request_types) {
@@ -148,11 +186,35 @@ char* P2PConnections::probe(uint32_t rank) {
 
 void P2PConnections::update_incoming_seq_num() {
     incoming_seq_nums_map[last_type][last_rank]++;
+    incoming_doorbells[last_rank]++;
+    num_consumed++;
+    // requests are paced by their replies, but replies are only paced by what senders of chunked
+    // replies learn from these reports, which are sent every half window to keep them cheap
+    if(last_type != REQUEST_TYPE::P2P_REQUEST
+       && incoming_seq_nums_map[last_type][last_rank] - reported_seq_nums_map[last_type][last_rank]
+                  >= (window_size + 1) / 2) {
+        report_consumed(last_rank, last_type);
+    }
+}
+
+uint64_t P2PConnections::get_num_consumed() const {
+    return num_consumed;
+}
+
+void P2PConnections::mark_partial_reply() {
+    if(last_type == REQUEST_TYPE::P2P_REPLY) {
+        incoming_partial_replies[last_rank]++;
+    }
 }
 
 // check if there's a new request from any node
 std::optional<std::pair<uint32_t, char*>> P2PConnections::probe_all() {
+    const bool check_all_slots = (++num_probes % full_probe_interval == 0);
     for(uint rank = 0; rank < num_members; ++rank) {
+        if(!check_all_slots
+           && (uint64_t&)incoming_p2p_buffers[rank][getOffsetDoorbell()] <= incoming_doorbells[rank]) {
+            continue;
+        }
         auto buf = probe(rank);
         if(buf && buf[0]) {
             return std::pair<uint32_t, char*>(members[rank], buf);
@@ -167,10 +229,9 @@ std::optional<std::pair<uint32_t, char*>> P2PConnections::probe_all() {
 }
 
 char* P2PConnections::get_sendbuffer_ptr(uint32_t rank, REQUEST_TYPE type) {
+    assert(type != REQUEST_TYPE::P2P_REQUEST);
     prev_mode[rank] = type;
-    if(type != REQUEST_TYPE::P2P_REQUEST
-       || static_cast<int32_t>(incoming_seq_nums_map[REQUEST_TYPE::P2P_REPLY][rank])
-                  > static_cast<int32_t>(outgoing_seq_nums_map[REQUEST_TYPE::P2P_REQUEST][rank] - window_size)) {
+    if(remote_slot_free(rank, type)) {
         (uint64_t&)outgoing_p2p_buffers[rank][getOffsetSeqNum(type, outgoing_seq_nums_map[type][rank])]
                 = outgoing_seq_nums_map[type][rank] + 1;
         return const_cast<char*>(outgoing_p2p_buffers[rank].get())
@@ -179,24 +240,97 @@ char* P2PConnections::get_sendbuffer_ptr(uint32_t rank, REQUEST_TYPE type) {
     return nullptr;
 }
 
-void P2PConnections::send(uint32_t rank) {
+uint32_t P2PConnections::request_credits(uint32_t rank) {
+    // every request gets exactly one reply, not counting the pieces of chunked replies
+    const int64_t outstanding_requests = static_cast<int64_t>(
+            claimed_request_seq_nums[rank]
+            - (incoming_seq_nums_map[REQUEST_TYPE::P2P_REPLY][rank] - incoming_partial_replies[rank]));
+    if(outstanding_requests >= window_size) {
+        return 0;
+    }
+    return window_size - outstanding_requests;
+}
+
+uint32_t P2PConnections::claim_request_slots(uint32_t rank, uint32_t max_requests, uint64_t& first_seq_num) {
+    first_seq_num = claimed_request_seq_nums[rank];
+    while(true) {
+        const int64_t outstanding_requests = static_cast<int64_t>(
+                first_seq_num
+                - (incoming_seq_nums_map[REQUEST_TYPE::P2P_REPLY][rank] - incoming_partial_replies[rank]));
+        if(outstanding_requests >= window_size) {
+            return 0;
+        }
+        const uint32_t num_slots = std::min<uint64_t>(window_size - outstanding_requests, max_requests);
+        // on failure, first_seq_num is reloaded with the slots claimed in the meantime
+        if(claimed_request_seq_nums[rank].compare_exchange_weak(first_seq_num, first_seq_num + num_slots)) {
+            return num_slots;
+        }
+    }
+}
+
+bool P2PConnections::unclaim_request_slots(uint32_t rank, uint64_t first_seq_num, uint32_t num_slots) {
+    uint64_t expected = first_seq_num + num_slots;
+    return claimed_request_seq_nums[rank].compare_exchange_strong(expected, first_seq_num);
+}
+
+char* P2PConnections::get_request_buffer(uint32_t rank, uint64_t seq_num) {
+    assert(seq_num < claimed_request_seq_nums[rank]);
+    (uint64_t&)outgoing_p2p_buffers[rank][getOffsetSeqNum(REQUEST_TYPE::P2P_REQUEST, seq_num)] = seq_num + 1;
+    return const_cast<char*>(outgoing_p2p_buffers[rank].get())
+           + getOffsetBuf(REQUEST_TYPE::P2P_REQUEST, seq_num);
+}
+
+void P2PConnections::send_requests(uint32_t rank, uint64_t first_seq_num, const std::vector<uint64_t>& sizes) {
+    assert(sizes.size() <= window_size);
+    // the receiver reads request slots in sequence order, so batches claimed
+    // by different threads may be sent in either order
+    for(uint64_t index = 0; index < sizes.size(); ++index) {
+        write_slot(rank, REQUEST_TYPE::P2P_REQUEST, first_seq_num + index, sizes[index]);
+    }
+    if(!sizes.empty()) {
+        outgoing_seq_nums_map[REQUEST_TYPE::P2P_REQUEST][rank] += sizes.size();
+        ring_doorbell(rank, sizes.size());
+    }
+}
+
+bool P2PConnections::remote_slot_free(uint32_t rank, REQUEST_TYPE type) {
+    return outgoing_seq_nums_map[type][rank] - (uint64_t&)incoming_p2p_buffers[rank][getOffsetConsumed(type)]
+           < window_size;
+}
+
+void P2PConnections::send(uint32_t rank, uint64_t size) {
     auto type = prev_mode[rank];
+    write_slot(rank, type, outgoing_seq_nums_map[type][rank], size);
+    outgoing_seq_nums_map[type][rank]++;
+    ring_doorbell(rank, 1);
+}
+
+void P2PConnections::write_slot(uint32_t rank, REQUEST_TYPE type, uint64_t seq_num, uint64_t size) {
+    assert(size <= max_msg_size - sizeof(uint64_t));
     if(rank == my_index) {
         // there's no reason why memcpy shouldn't also copy guard and data separately
-        std::memcpy(const_cast<char*>(incoming_p2p_buffers[rank].get()) + getOffsetBuf(type, outgoing_seq_nums_map[type][rank]),
-                    const_cast<char*>(outgoing_p2p_buffers[rank].get()) + getOffsetBuf(type, outgoing_seq_nums_map[type][rank]),
-                    max_msg_size - sizeof(uint64_t));
-        std::memcpy(const_cast<char*>(incoming_p2p_buffers[rank].get()) + getOffsetSeqNum(type, outgoing_seq_nums_map[type][rank]),
-                    const_cast<char*>(outgoing_p2p_buffers[rank].get()) + getOffsetSeqNum(type, outgoing_seq_nums_map[type][rank]),
+        std::memcpy(const_cast<char*>(incoming_p2p_buffers[rank].get()) + getOffsetBuf(type, seq_num),
+                    const_cast<char*>(outgoing_p2p_buffers[rank].get()) + getOffsetBuf(type, seq_num),
+                    size);
+        std::memcpy(const_cast<char*>(incoming_p2p_buffers[rank].get()) + getOffsetSeqNum(type, seq_num),
+                    const_cast<char*>(outgoing_p2p_buffers[rank].get()) + getOffsetSeqNum(type, seq_num),
                     sizeof(uint64_t));
     } else {
-        res_vec[rank]->post_remote_write(getOffsetBuf(type, outgoing_seq_nums_map[type][rank]),
-                                         max_msg_size - sizeof(uint64_t));
-        res_vec[rank]->post_remote_write(getOffsetSeqNum(type, outgoing_seq_nums_map[type][rank]),
-                                         sizeof(uint64_t));
+        // the slot is sized for the largest payload, but only the bytes in use are written
+        res_vec[rank]->post_remote_write(getOffsetBuf(type, seq_num), size);
+        res_vec[rank]->post_remote_write(getOffsetSeqNum(type, seq_num), sizeof(uint64_t));
         num_rdma_writes++;
     }
-    outgoing_seq_nums_map[type][rank]++;
+}
+
+void P2PConnections::ring_doorbell(uint32_t rank, uint64_t num_messages) {
+    // ring the doorbell after the messages are in place
+    (uint64_t&)outgoing_p2p_buffers[rank][getOffsetDoorbell()] = outgoing_doorbells[rank] += num_messages;
+    if(rank == my_index) {
+        (uint64_t&)incoming_p2p_buffers[rank][getOffsetDoorbell()] = outgoing_doorbells[rank];
+    } else {
+        res_vec[rank]->post_remote_write(getOffsetDoorbell(), sizeof(uint64_t));
+    }
 }
 
 void P2PConnections::check_failures_loop() {
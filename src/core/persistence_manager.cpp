@@ -5,6 +5,9 @@
  */
 #include "derecho/core/detail/persistence_manager.hpp"
 
+#include <algorithm>
+#include <string>
+
 namespace derecho {
 
 /** Constructor
@@ -14,97 +17,103 @@ PersistenceManager::PersistenceManager(
         std::map<subgroup_id_t, std::reference_wrapper<ReplicatedObject>>& objects_map,
         const persistence_callback_t& _persistence_callback)
         : thread_shutdown(false),
+          persistence_linger(getConfUInt64(CONF_DERECHO_PERSISTENCE_LINGER_US)),
           persistence_callback(_persistence_callback),
           objects_by_subgroup_id(objects_map) {
-    // initialize semaphore
-    if(sem_init(&persistence_request_sem, 1, 0) != 0) {
-        throw derecho_exception("Cannot initialize persistent_request_sem:errno=" + std::to_string(errno));
+    // the queues must exist before start(), since messages may be delivered before it is called
+    const uint32_t num_workers = std::max(getConfUInt32(CONF_DERECHO_PERSISTENCE_THREADS), 1u);
+    for(uint32_t worker_num = 0; worker_num < num_workers; ++worker_num) {
+        persistence_workers.emplace_back(std::make_unique<persistence_worker_state>());
     }
 }
 
 
 /** default Destructor
  */
-PersistenceManager::~PersistenceManager() {
-    sem_destroy(&persistence_request_sem);
-}
+PersistenceManager::~PersistenceManager() {}
 
 void PersistenceManager::set_view_manager(ViewManager& view_manager) {
     this->view_manager = &view_manager;
 }
 
-/** Start the persistent thread. */
+/** Start the persistent threads. */
 void PersistenceManager::start() {
     //skip for raw subgroups -- NO, DON'T
     // if(replicated_objects == nullptr) return;
 
-    this->persist_thread = std::thread{[this]() {
-        pthread_setname_np(pthread_self(), "persist");
-        do {
-            // wait for semaphore
-            sem_wait(&persistence_request_sem);
-            while(prq_lock.test_and_set(std::memory_order_acquire))  // acquire lock
-                ;                                                    // spin
-            if(this->persistence_request_queue.empty()) {
-                prq_lock.clear(std::memory_order_release);  // release lock
-                if(this->thread_shutdown) {
-                    break;
-                }
-                continue;
-            }
+    for(uint32_t worker_num = 0; worker_num < persistence_workers.size(); ++worker_num) {
+        persistence_workers[worker_num]->thread = std::thread(&PersistenceManager::persistence_worker, this, worker_num);
+    }
+}
 
-            subgroup_id_t subgroup_id = std::get<0>(persistence_request_queue.front());
-            persistent::version_t version = std::get<1>(persistence_request_queue.front());
-            persistence_request_queue.pop();
-            prq_lock.clear(std::memory_order_release);  // release lock
-
-            // persist
-            try {
-                auto search = objects_by_subgroup_id.find(subgroup_id);
-                if(search != objects_by_subgroup_id.end()) {
-                    search->second.get().persist(version);
-                }
-                // read lock the view
-                std::shared_lock<std::shared_timed_mutex> read_lock(view_manager->view_mutex);
-                // update the persisted_num in SST
-
-                View& Vc = *view_manager->curr_view;
-                Vc.gmsSST->persisted_num[Vc.gmsSST->get_local_index()][subgroup_id] = version;
-                Vc.gmsSST->put(Vc.multicast_group->get_shard_sst_indices(subgroup_id),
-                               (char*)std::addressof(Vc.gmsSST->persisted_num[0][subgroup_id]) - Vc.gmsSST->getBaseAddress(),
-                               sizeof(long long int));
-            } catch(uint64_t exp) {
-                dbg_default_debug("exception on persist():subgroup={},ver={},exp={}.", subgroup_id, version, exp);
-                std::cout << "exception on persistent:subgroup=" << subgroup_id << ",ver=" << version << "exception=0x" << std::hex << exp << std::endl;
+void PersistenceManager::persistence_worker(uint32_t worker_num) {
+    pthread_setname_np(pthread_self(), worker_num == 0 ? "persist"
+                                                       : ("persist_" + std::to_string(worker_num)).c_str());
+    persistence_worker_state& worker = *persistence_workers[worker_num];
+    // the highest requested version of each subgroup in the current batch
+    std::map<subgroup_id_t, persistent::version_t> latest_versions;
+    persistence_request_t request;
+
+    while(true) {
+        if(!worker.queue.pop(request)) {
+            // finish the queued requests before shutting down
+            if(thread_shutdown) {
+                break;
             }
+            worker.wait([this]() { return thread_shutdown.load(); });
+            continue;
+        }
+        // give the senders a chance to queue more versions behind this one,
+        // so that they are all covered by the same flush
+        if(persistence_linger.count() > 0 && !thread_shutdown) {
+            std::this_thread::sleep_for(persistence_linger);
+        }
+        // drain the queue; persisting a version persists every version before it,
+        // so only the highest version of each subgroup needs to be handled
+        do {
+            auto latest = latest_versions.emplace(std::get<0>(request), std::get<1>(request)).first;
+            latest->second = std::max(latest->second, std::get<1>(request));
+        } while(worker.queue.pop(request));
+
+        for(const auto& [subgroup_id, version] : latest_versions) {
+            persist(subgroup_id, version);
+        }
+        latest_versions.clear();
+    }
+}
 
-            // callback
-            if(this->persistence_callback != nullptr) {
-                this->persistence_callback(subgroup_id, version);
-            }
+void PersistenceManager::persist(subgroup_id_t subgroup_id, persistent::version_t version) {
+    // persist
+    try {
+        auto search = objects_by_subgroup_id.find(subgroup_id);
+        if(search != objects_by_subgroup_id.end()) {
+            search->second.get().persist(version);
+        }
+        // read lock the view
+        std::shared_lock<std::shared_timed_mutex> read_lock(view_manager->view_mutex);
+        // update the persisted_num in SST
+
+        View& Vc = *view_manager->curr_view;
+        Vc.gmsSST->persisted_num[Vc.gmsSST->get_local_index()][subgroup_id] = version;
+        Vc.gmsSST->put(Vc.multicast_group->get_shard_sst_indices(subgroup_id),
+                       (char*)std::addressof(Vc.gmsSST->persisted_num[0][subgroup_id]) - Vc.gmsSST->getBaseAddress(),
+                       sizeof(long long int));
+    } catch(uint64_t exp) {
+        dbg_default_debug("exception on persist():subgroup={},ver={},exp={}.", subgroup_id, version, exp);
+        std::cout << "exception on persistent:subgroup=" << subgroup_id << ",ver=" << version << "exception=0x" << std::hex << exp << std::endl;
+    }
 
-            if(this->thread_shutdown) {
-                while(prq_lock.test_and_set(std::memory_order_acquire))  // acquire lock
-                    ;                                                    // spin
-                if(persistence_request_queue.empty()) {
-                    prq_lock.clear(std::memory_order_release);  // release lock
-                    break;                                      // finish
-                }
-                prq_lock.clear(std::memory_order_release);  // release lock
-            }
-        } while(true);
-    }};
+    // callback
+    if(this->persistence_callback != nullptr) {
+        this->persistence_callback(subgroup_id, version);
+    }
 }
 
 /** post a persistence request */
 void PersistenceManager::post_persist_request(const subgroup_id_t& subgroup_id, const persistent::version_t& version) {
-    // request enqueue
-    while(prq_lock.test_and_set(std::memory_order_acquire))  // acquire lock
-        ;                                                    // spin
-    persistence_request_queue.push(std::make_tuple(subgroup_id, version));
-    prq_lock.clear(std::memory_order_release);  // release lock
-    // post semaphore
-    sem_post(&persistence_request_sem);
+    persistence_worker_state& worker = *persistence_workers[subgroup_id % persistence_workers.size()];
+    worker.queue.push(std::make_tuple(subgroup_id, version));
+    worker.notify();
 }
 
 /** make a version */
@@ -116,17 +125,24 @@ void PersistenceManager::make_version(const subgroup_id_t& subgroup_id,
     }
 }
 
-/** shutdown the thread 
- * @wait - wait till the thread finished or not.
+/** shutdown the threads; each one finishes the requests already queued for it first.
+ * @wait - wait till the threads finished or not.
  */
 void PersistenceManager::shutdown(bool wait) {
     // if(replicated_objects == nullptr) return;  //skip for raw subgroups - NO DON'T
 
     thread_shutdown = true;
-    sem_post(&persistence_request_sem);  // kick the persistence thread in case it is sleeping
+    // kick the persistent threads in case they are sleeping
+    for(auto& worker : persistence_workers) {
+        worker->wake();
+    }
 
     if(wait) {
-        this->persist_thread.join();
+        for(auto& worker : persistence_workers) {
+            if(worker->thread.joinable()) {
+                worker->thread.join();
+            }
+        }
     }
 }
 
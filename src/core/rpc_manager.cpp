@@ -4,8 +4,12 @@
  * @date Feb 7, 2017
  */
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <thread>
 
 #include <derecho/core/detail/rpc_manager.hpp>
 
@@ -27,7 +31,8 @@ void RPCManager::create_connections() {
 }
 
 void RPCManager::destroy_remote_invocable_class(uint32_t instance_id) {
-    //Delete receiver functions that were added by this class/subgroup
+    //Delete receiver functions that were added by this class/subgroup. A receive
+    //thread that already looked one up keeps its own copy from the dispatch table.
     for(auto receivers_iterator = receivers->begin();
         receivers_iterator != receivers->end();) {
         if(receivers_iterator->first.subgroup_id == instance_id) {
@@ -36,6 +41,7 @@ void RPCManager::destroy_remote_invocable_class(uint32_t instance_id) {
             receivers_iterator++;
         }
     }
+    dispatch_table.rebuild(*receivers);
     //Deliver a node_removed_from_shard_exception to the QueryResults for this class
     //Important: This only works because the Replicated destructor runs before the
     //wrapped_this member is destroyed; otherwise the PendingResults we're referencing
@@ -62,16 +68,16 @@ std::exception_ptr RPCManager::receive_message(
         std::size_t payload_size, const std::function<char*(int)>& out_alloc) {
     using namespace remote_invocation_utilities;
     assert(payload_size);
-    auto receiver_function_entry = receivers->find(indx);
-    if(receiver_function_entry == receivers->end()) {
+    DispatchTable::handler_ref receiver_function = dispatch_table.find(indx);
+    if(!receiver_function) {
         dbg_default_error("Received an RPC message with an invalid RPC opcode! Opcode was ({}, {}, {}, {}).",
                           indx.class_id, indx.subgroup_id, indx.function_id, indx.is_reply);
         //TODO: We should reply with some kind of "no such method" error in this case
         return std::exception_ptr{};
     }
     std::size_t reply_header_size = header_space();
-    recv_ret reply_return = receiver_function_entry->second(
-            &rdv, received_from, buf,
+    recv_ret reply_return = (*receiver_function)(
+            &dsm, received_from, buf,
             [&out_alloc, &reply_header_size](std::size_t size) {
                 return out_alloc(size + reply_header_size) + reply_header_size;
             });
@@ -109,17 +115,27 @@ void RPCManager::rpc_message_handler(subgroup_id_t subgroup_id, node_id_t sender
     //Use the reply-buffer allocation lambda to detect whether parse_and_receive generated a reply
     size_t reply_size = 0;
     char* reply_buf;
+    //Replies that do not fit in a P2P slot are built here, then sent in chunks
+    std::unique_ptr<char[]> large_reply_buf;
+    //Set if the sender was suspected while waiting for a reply slot
+    bool reply_dropped = false;
+    //The reply buffer is held from its allocation until the reply has been sent
+    std::unique_lock<std::mutex> reply_lock(rpc_reply_mutex, std::defer_lock);
     parse_and_receive(msg_buf, buffer_size,
-                      [this, &reply_buf, &reply_size, &sender_id](size_t size) -> char* {
+                      [this, &reply_buf, &large_reply_buf, &reply_size, &sender_id, &reply_lock, &reply_dropped](size_t size) -> char* {
                           reply_size = size;
+                          reply_lock.lock();
                           if(reply_size <= connections->get_max_p2p_size()) {
-                              reply_buf = (char*)connections->get_sendbuffer_ptr(
-                                      connections->get_node_rank(sender_id), sst::REQUEST_TYPE::RPC_REPLY);
-                              return reply_buf;
-                          } else {
-                              // the reply size is too large - not part of the design to handle it
-                              return nullptr;
+                              reply_buf = get_reply_buffer(sender_id, sst::REQUEST_TYPE::RPC_REPLY);
+                              if(reply_buf) {
+                                  return reply_buf;
+                              }
+                              //The reply still has to be written somewhere
+                              reply_dropped = true;
                           }
+                          large_reply_buf = std::make_unique<char[]>(reply_size);
+                          reply_buf = large_reply_buf.get();
+                          return reply_buf;
                       });
     if(sender_id == nid) {
         //This is a self-receive of an RPC message I sent, so I have a reply-map that needs fulfilling
@@ -144,16 +160,20 @@ void RPCManager::rpc_message_handler(subgroup_id_t subgroup_id, node_id_t sender
                     reply_buf, reply_size,
                     [](size_t size) -> char* { assert_always(false); });
         }
+    } else if(reply_dropped) {
+        dbg_default_debug("Dropped the reply to suspected node {}", sender_id);
+    } else if(large_reply_buf) {
+        send_chunked_reply(sender_id, sst::REQUEST_TYPE::RPC_REPLY, reply_buf);
     } else if(reply_size > 0) {
         //Otherwise, the only thing to do is send the reply (if there was one)
-        connections->send(connections->get_node_rank(sender_id));
+        connections->send(connections->get_node_rank(sender_id), reply_size);
     }
 
     // clear the thread local rpc_handler context
     _in_rpc_handler = false;
 }
 
-void RPCManager::p2p_message_handler(node_id_t sender_id, char* msg_buf, uint32_t buffer_size) {
+bool RPCManager::p2p_message_handler(node_id_t sender_id, char* msg_buf, uint32_t buffer_size) {
     using namespace remote_invocation_utilities;
     const std::size_t header_size = header_space();
     std::size_t payload_size;
@@ -163,8 +183,26 @@ void RPCManager::p2p_message_handler(node_id_t sender_id, char* msg_buf, uint32_
     retrieve_header(nullptr, msg_buf, payload_size, indx, received_from, flags);
     size_t reply_size = 0;
     if(indx.is_reply) {
+        char* payload_buf = msg_buf + header_size;
+        std::vector<char> chunked_payload;
+        if(RPC_HEADER_FLAG_TST(flags, CHUNK)) {
+            // accumulate the pieces of a large reply until all of it has arrived
+            const reply_chunk_header& chunk_header = *reinterpret_cast<reply_chunk_header*>(payload_buf);
+            const auto partial_key = std::make_pair(sender_id, chunk_header.request_type);
+            std::vector<char>& partial_reply = partial_replies[partial_key];
+            partial_reply.insert(partial_reply.end(), payload_buf + sizeof(reply_chunk_header),
+                                 payload_buf + payload_size);
+            if(partial_reply.size() < chunk_header.total_size) {
+                connections->mark_partial_reply();
+                return true;
+            }
+            chunked_payload = std::move(partial_reply);
+            partial_replies.erase(partial_key);
+            payload_buf = chunked_payload.data();
+            payload_size = chunked_payload.size();
+        }
         // REPLYs can be handled here because they do not block.
-        receive_message(indx, received_from, msg_buf + header_size, payload_size,
+        receive_message(indx, received_from, payload_buf, payload_size,
                         [this, &buffer_size, &reply_size, &sender_id](size_t _size) -> char* {
                             reply_size = _size;
                             if(reply_size <= buffer_size) {
@@ -174,7 +212,7 @@ void RPCManager::p2p_message_handler(node_id_t sender_id, char* msg_buf, uint32_
                             return nullptr;
                         });
         if(reply_size > 0) {
-            connections->send(connections->get_node_rank(sender_id));
+            connections->send(connections->get_node_rank(sender_id), reply_size);
         }
     } else if(RPC_HEADER_FLAG_TST(flags, CASCADE)) {
         // TODO: what is the lifetime of msg_buf? discuss with Sagar to make
@@ -182,11 +220,15 @@ void RPCManager::p2p_message_handler(node_id_t sender_id, char* msg_buf, uint32_
         // for cascading messages, we create a new thread.
         throw derecho::derecho_exception("Cascading P2P Send/Queries to be implemented!");
     } else {
-        // send to fifo queue.
-        std::unique_lock<std::mutex> lock(fifo_queue_mutex);
-        fifo_queue.emplace(sender_id, msg_buf, buffer_size);
-        fifo_queue_cv.notify_one();
+        // send to the fifo queue of the sender's worker. If it is full, the request
+        // stays in its slot, and the caller retries it after releasing its locks
+        fifo_worker_state& worker = *fifo_workers[sender_id % fifo_workers.size()];
+        if(!worker.queue.push(fifo_req(sender_id, msg_buf, buffer_size))) {
+            return false;
+        }
+        worker.notify();
     }
+    return true;
 }
 
 //This is always called while holding a write lock on view_manager.view_mutex
@@ -196,6 +238,16 @@ void RPCManager::new_view_callback(const View& new_view) {
         connections = std::make_unique<sst::P2PConnections>(std::move(*connections), new_view.members);
     }
     dbg_default_debug("Created new connections among the new view members");
+    // sends waiting for a credit from a node that left will now fail instead
+    p2p_credits_returned();
+    {
+        // these run once this write lock on the view is released
+        std::lock_guard<std::mutex> lock(next_view_tasks_mutex);
+        for(auto& task : next_view_tasks) {
+            callback_executor.post(std::move(task));
+        }
+        next_view_tasks.clear();
+    }
     std::lock_guard<std::mutex> lock(pending_results_mutex);
     for(auto& fulfilled_pending_results_pair : fulfilled_pending_results) {
         const subgroup_id_t subgroup_id = fulfilled_pending_results_pair.first;
@@ -227,47 +279,219 @@ bool RPCManager::finish_rpc_send(subgroup_id_t subgroup_id, PendingBase& pending
     std::lock_guard<std::mutex> lock(pending_results_mutex);
     pending_results_to_fulfill[subgroup_id].push(pending_results_handle);
     pending_results_cv.notify_all();
+    wake_p2p_receive_loop();
     return true;
 }
 
-volatile char* RPCManager::get_sendbuffer_ptr(uint32_t dest_id, sst::REQUEST_TYPE type) {
-    volatile char* buf;
-    int curr_vid = -1;
-    uint32_t dest_rank = 0;
-    do {
-        //This lock also prevents connections from being reassigned (because that happens
-        //in new_view_callback), so we don't need p2p_connections_mutex
-        std::shared_lock<std::shared_timed_mutex> view_read_lock(view_manager.view_mutex);
-        //Check to see if the view changed between iterations of the loop, and re-get the rank
-        if(curr_vid != view_manager.curr_view->vid) {
-            try {
-                dest_rank = connections->get_node_rank(dest_id);
-            } catch(std::out_of_range& map_error) {
-                throw node_removed_from_group_exception(dest_id);
-            }
-            curr_vid = view_manager.curr_view->vid;
+RPCManager::p2p_reservation RPCManager::reserve_p2p_requests(node_id_t dest_id, uint32_t max_requests) {
+    assert(max_requests > 0);
+    // register as a waiter before checking, so that a reply consumed after the check
+    // is sure to bump p2p_credit_generation
+    p2p_credit_waiters++;
+    p2p_reservation reservation;
+    while(true) {
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> lock(p2p_credit_mutex);
+            generation = p2p_credit_generation;
         }
-        buf = connections->get_sendbuffer_ptr(dest_rank, type);
-    } while(!buf);
-    return buf;
+        try {
+            reservation = try_reserve_p2p_requests(dest_id, max_requests);
+        } catch(...) {
+            p2p_credit_waiters--;
+            throw;
+        }
+        if(reservation.num_slots > 0) {
+            break;
+        }
+        // the timeout only matters if dest_id fails, in which case no reply will wake this thread
+        std::unique_lock<std::mutex> lock(p2p_credit_mutex);
+        p2p_credit_cv.wait_for(lock, std::chrono::milliseconds(1), [&]() {
+            return p2p_credit_generation != generation;
+        });
+    }
+    p2p_credit_waiters--;
+    return reservation;
 }
 
-void RPCManager::finish_p2p_send(node_id_t dest_id, subgroup_id_t dest_subgroup_id, PendingBase& pending_results_handle) {
+void RPCManager::send_with_p2p_credit(std::function<bool()> attempt) {
+    // registered as a waiter before the attempt, so that a credit returned after
+    // it is sure to bump p2p_credit_generation
+    p2p_credit_waiters++;
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(p2p_credit_mutex);
+        generation = p2p_credit_generation;
+    }
+    if(attempt()) {
+        p2p_credit_waiters--;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(p2p_credit_mutex);
+        if(p2p_credit_generation == generation) {
+            // still counted as a waiter until p2p_credits_returned takes it
+            p2p_credit_retries.emplace_back(std::move(attempt));
+            return;
+        }
+    }
+    // a credit came back during the attempt
+    p2p_credit_waiters--;
+    callback_executor.post([this, attempt = std::move(attempt)]() {
+        send_with_p2p_credit(attempt);
+    });
+}
+
+void RPCManager::p2p_credits_returned() {
+    std::vector<std::function<bool()>> retries;
+    {
+        std::lock_guard<std::mutex> lock(p2p_credit_mutex);
+        p2p_credit_generation++;
+        retries.swap(p2p_credit_retries);
+        p2p_credit_waiters -= retries.size();
+    }
+    p2p_credit_cv.notify_all();
+    if(!retries.empty()) {
+        callback_executor.post([this, retries = std::move(retries)]() {
+            for(const auto& attempt : retries) {
+                send_with_p2p_credit(attempt);
+            }
+        });
+    }
+}
+
+void RPCManager::post_after_view_change(std::function<void()> task) {
+    std::lock_guard<std::mutex> lock(next_view_tasks_mutex);
+    next_view_tasks.emplace_back(std::move(task));
+}
+
+RPCManager::p2p_reservation RPCManager::try_reserve_p2p_requests(node_id_t dest_id, uint32_t max_requests) {
+    p2p_reservation reservation{dest_id, 0, 0};
+    std::shared_lock<std::shared_timed_mutex> view_read_lock(view_manager.view_mutex);
     try {
-        //This lock also prevents connections from being reassigned (because that happens
-        //in new_view_callback), so we don't need p2p_connections_mutex
-        std::shared_lock<std::shared_timed_mutex> view_read_lock(view_manager.view_mutex);
-        connections->send(connections->get_node_rank(dest_id));
+        reservation.num_slots = connections->claim_request_slots(connections->get_node_rank(dest_id),
+                                                                 max_requests, reservation.first_seq_num);
     } catch(std::out_of_range& map_error) {
         throw node_removed_from_group_exception(dest_id);
     }
-    pending_results_handle.fulfill_map({dest_id});
-    std::lock_guard<std::mutex> lock(pending_results_mutex);
-    fulfilled_pending_results[dest_subgroup_id].push_back(pending_results_handle);
+    return reservation;
 }
 
-void RPCManager::fifo_worker() {
-    pthread_setname_np(pthread_self(), "fifo_thread");
+volatile char* RPCManager::get_batch_sendbuffer_ptr(const p2p_reservation& reservation, uint32_t index) {
+    assert(index < reservation.num_slots);
+    std::shared_lock<std::shared_timed_mutex> view_read_lock(view_manager.view_mutex);
+    try {
+        return connections->get_request_buffer(connections->get_node_rank(reservation.dest_id),
+                                               reservation.first_seq_num + index);
+    } catch(std::out_of_range& map_error) {
+        throw node_removed_from_group_exception(reservation.dest_id);
+    }
+}
+
+void RPCManager::finish_p2p_batch_send(const p2p_reservation& reservation, subgroup_id_t dest_subgroup_id,
+                                       const std::vector<uint64_t>& message_sizes,
+                                       const std::vector<PendingBase_ref>& pending_results_handles) {
+    using namespace remote_invocation_utilities;
+    assert(message_sizes.size() == pending_results_handles.size());
+    assert(message_sizes.size() <= reservation.num_slots);
+    try {
+        std::shared_lock<std::shared_timed_mutex> view_read_lock(view_manager.view_mutex);
+        const uint32_t dest_rank = connections->get_node_rank(reservation.dest_id);
+        connections->send_requests(dest_rank, reservation.first_seq_num, message_sizes);
+        const uint64_t first_unused = reservation.first_seq_num + message_sizes.size();
+        const uint32_t num_unused = reservation.num_slots - message_sizes.size();
+        if(num_unused > 0 && !connections->unclaim_request_slots(dest_rank, first_unused, num_unused)) {
+            // the payload byte keeps probe_all from taking these for null replies
+            const std::size_t noop_payload_size = 1;
+            uint32_t flags = 0;
+            RPC_HEADER_FLAG_SET(flags, NOOP);
+            for(uint32_t index = 0; index < num_unused; ++index) {
+                populate_header(connections->get_request_buffer(dest_rank, first_unused + index),
+                                noop_payload_size, Opcode{}, nid, flags);
+            }
+            connections->send_requests(dest_rank, first_unused,
+                                       std::vector<uint64_t>(num_unused, header_space() + noop_payload_size));
+        }
+    } catch(std::out_of_range& map_error) {
+        throw node_removed_from_group_exception(reservation.dest_id);
+    }
+    for(auto& pending_results_handle : pending_results_handles) {
+        pending_results_handle.get().fulfill_map({reservation.dest_id});
+    }
+    {
+        std::lock_guard<std::mutex> lock(pending_results_mutex);
+        fulfilled_pending_results[dest_subgroup_id].insert(fulfilled_pending_results[dest_subgroup_id].end(),
+                                                           pending_results_handles.begin(),
+                                                           pending_results_handles.end());
+    }
+    wake_p2p_receive_loop();
+}
+
+void RPCManager::send_chunked_reply(node_id_t dest_id, sst::REQUEST_TYPE type, const char* reply_buf) {
+    using namespace remote_invocation_utilities;
+    const std::size_t header_size = header_space();
+    std::size_t payload_size;
+    Opcode indx;
+    node_id_t received_from;
+    uint32_t flags;
+    retrieve_header(nullptr, reply_buf, payload_size, indx, received_from, flags);
+    RPC_HEADER_FLAG_SET(flags, CHUNK);
+    const reply_chunk_header chunk_header{payload_size, static_cast<uint32_t>(type)};
+    const uint32_t dest_rank = connections->get_node_rank(dest_id);
+    const std::size_t max_chunk_size = connections->get_max_p2p_size() - header_size - sizeof(reply_chunk_header);
+    dbg_default_trace("Sending a reply of {} bytes to node {} in chunks of up to {} bytes",
+                      payload_size, dest_id, max_chunk_size);
+    for(std::size_t offset = 0; offset < payload_size;) {
+        std::size_t chunk_size = std::min(max_chunk_size, payload_size - offset);
+        // a slot whose first byte is 0 is taken for a null reply by probe_all, and that
+        // first byte is the low byte of the chunk's payload size
+        if(((sizeof(reply_chunk_header) + chunk_size) & 0xff) == 0) {
+            chunk_size--;
+        }
+        char* buf = get_reply_buffer(dest_id, type);
+        if(!buf) {
+            dbg_default_debug("Dropped the rest of a chunked reply to suspected node {}", dest_id);
+            return;
+        }
+        populate_header(buf, sizeof(reply_chunk_header) + chunk_size, indx, received_from, flags);
+        memcpy(buf + header_size, &chunk_header, sizeof(reply_chunk_header));
+        memcpy(buf + header_size + sizeof(reply_chunk_header),
+               reply_buf + header_size + offset, chunk_size);
+        connections->send(dest_rank, header_size + sizeof(reply_chunk_header) + chunk_size);
+        offset += chunk_size;
+    }
+}
+
+char* RPCManager::get_reply_buffer(node_id_t dest_id, sst::REQUEST_TYPE type) {
+    const uint32_t dest_rank = connections->get_node_rank(dest_id);
+    char* buf;
+    while(!(buf = connections->get_sendbuffer_ptr(dest_rank, type))) {
+        if(node_suspected(dest_id)) {
+            return nullptr;
+        }
+        std::this_thread::yield();
+    }
+    return buf;
+}
+
+bool RPCManager::node_suspected(node_id_t node_id) {
+    const View& view = *view_manager.curr_view;
+    const int rank = view.rank_of(node_id);
+    if(rank < 0 || view.failed[rank]) {
+        return true;
+    }
+    for(int row = 0; row < view.num_members; ++row) {
+        if(view.gmsSST->suspected[row][rank]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void RPCManager::fifo_worker(uint32_t worker_num) {
+    pthread_setname_np(pthread_self(), worker_num == 0 ? "fifo_thread"
+                                                       : ("fifo_thread_" + std::to_string(worker_num)).c_str());
+    fifo_worker_state& worker = *fifo_workers[worker_num];
     using namespace remote_invocation_utilities;
     const std::size_t header_size = header_space();
     std::size_t payload_size;
@@ -275,41 +499,62 @@ void RPCManager::fifo_worker() {
     node_id_t received_from;
     uint32_t flags;
     size_t reply_size = 0;
+    //Replies that do not fit in a P2P slot are built here, then sent in chunks
+    std::unique_ptr<char[]> large_reply_buf;
+    //Set if the sender was suspected while waiting for a reply slot
+    bool reply_dropped = false;
     fifo_req request;
+    //Held from the reply's allocation until it has been sent, since new_view_callback
+    //replaces connections under the exclusive lock
+    std::shared_lock<std::shared_timed_mutex> view_read_lock(view_manager.view_mutex, std::defer_lock);
 
     while(!thread_shutdown) {
-        {
-            std::unique_lock<std::mutex> lock(fifo_queue_mutex);
-            fifo_queue_cv.wait(lock, [&]() { return !fifo_queue.empty() || thread_shutdown; });
-            if(thread_shutdown) {
-                break;
-            }
-            request = fifo_queue.front();
-            fifo_queue.pop();
+        if(!worker.queue.pop(request)) {
+            worker.wait([this]() { return thread_shutdown.load(); });
+            continue;
         }
+        reply_size = 0;
+        large_reply_buf.reset();
+        reply_dropped = false;
         retrieve_header(nullptr, request.msg_buf, payload_size, indx, received_from, flags);
         if(indx.is_reply || RPC_HEADER_FLAG_TST(flags, CASCADE)) {
             dbg_default_error("Invalid rpc message in fifo queue: is_reply={}, is_cascading={}",
                               indx.is_reply, RPC_HEADER_FLAG_TST(flags, CASCADE));
             throw derecho::derecho_exception("invalid rpc message in fifo queue...crash.");
         }
-        receive_message(indx, received_from, request.msg_buf + header_size, payload_size,
-                        [this, &reply_size, &request](size_t _size) -> char* {
-                            reply_size = _size;
-                            if(reply_size <= request.buffer_size) {
-                                return (char*)connections->get_sendbuffer_ptr(
-                                        connections->get_node_rank(request.sender_id), sst::REQUEST_TYPE::P2P_REPLY);
-                            }
-                            return nullptr;
-                        });
-        if(reply_size > 0) {
-            connections->send(connections->get_node_rank(request.sender_id));
-        } else {
+        // a no-op request only gets the null reply below
+        if(!RPC_HEADER_FLAG_TST(flags, NOOP)) {
+            receive_message(indx, received_from, request.msg_buf + header_size, payload_size,
+                            [this, &reply_size, &large_reply_buf, &request, &view_read_lock, &reply_dropped](size_t _size) -> char* {
+                                reply_size = _size;
+                                view_read_lock.lock();
+                                if(reply_size <= connections->get_max_p2p_size()) {
+                                    char* reply_buf = get_reply_buffer(request.sender_id, sst::REQUEST_TYPE::P2P_REPLY);
+                                    if(reply_buf) {
+                                        return reply_buf;
+                                    }
+                                    //The reply still has to be written somewhere
+                                    reply_dropped = true;
+                                }
+                                large_reply_buf = std::make_unique<char[]>(reply_size);
+                                return large_reply_buf.get();
+                            });
+        }
+        if(!view_read_lock.owns_lock()) {
+            view_read_lock.lock();
+        }
+        if(reply_dropped) {
+            dbg_default_debug("Dropped the reply to suspected node {}", request.sender_id);
+        } else if(large_reply_buf) {
+            send_chunked_reply(request.sender_id, sst::REQUEST_TYPE::P2P_REPLY, large_reply_buf.get());
+        } else if(reply_size > 0) {
+            connections->send(connections->get_node_rank(request.sender_id), reply_size);
+        } else if(char* buf = get_reply_buffer(request.sender_id, sst::REQUEST_TYPE::P2P_REPLY)) {
             // hack for now to "simulate" a reply for p2p_sends to functions that do not generate a reply
-            char* buf = connections->get_sendbuffer_ptr(connections->get_node_rank(request.sender_id), sst::REQUEST_TYPE::P2P_REPLY);
             buf[0] = 0;
-            connections->send(connections->get_node_rank(request.sender_id));
+            connections->send(connections->get_node_rank(request.sender_id), 1);
         }
+        view_read_lock.unlock();
     }
 }
 
@@ -324,21 +569,99 @@ void RPCManager::p2p_receive_loop() {
         thread_start_cv.wait(lock, [this]() { return thread_start; });
     }
     dbg_default_debug("P2P listening thread started");
-    // start the fifo worker thread
-    fifo_worker_thread = std::thread(&RPCManager::fifo_worker, this);
+    // start the fifo worker threads
+    const uint32_t num_fifo_workers = std::max(getConfUInt32(CONF_DERECHO_P2P_WORKER_THREADS), 1u);
+    for(uint32_t worker_num = 0; worker_num < num_fifo_workers; ++worker_num) {
+        fifo_workers.emplace_back(std::make_unique<fifo_worker_state>(fifo_queue_capacity));
+    }
+    for(uint32_t worker_num = 0; worker_num < num_fifo_workers; ++worker_num) {
+        fifo_workers[worker_num]->thread = std::thread(&RPCManager::fifo_worker, this, worker_num);
+    }
     // loop event
+    auto last_time = std::chrono::steady_clock::now();
+    uint32_t idle_backoff_us = 1;
     while(!thread_shutdown) {
-        std::lock_guard<std::mutex> connections_lock(p2p_connections_mutex);
-        auto optional_reply_pair = connections->probe_all();
-        if(optional_reply_pair) {
-            auto reply_pair = optional_reply_pair.value();
-            p2p_message_handler(reply_pair.first, (char*)reply_pair.second, max_payload_size);
-            connections->update_incoming_seq_num();
+        bool message_received = false;
+        bool message_consumed = false;
+        bool worker_queue_full = false;
+        {
+            std::lock_guard<std::mutex> connections_lock(p2p_connections_mutex);
+            const uint64_t num_consumed = connections->get_num_consumed();
+            auto optional_reply_pair = connections->probe_all();
+            if(optional_reply_pair) {
+                auto reply_pair = optional_reply_pair.value();
+                if(p2p_message_handler(reply_pair.first, (char*)reply_pair.second, max_payload_size)) {
+                    connections->update_incoming_seq_num();
+                    message_received = true;
+                } else {
+                    worker_queue_full = true;
+                }
+            }
+            // probe_all consumes null replies by itself, and those return credits too
+            message_consumed = connections->get_num_consumed() != num_consumed;
+        }
+        if(message_consumed && p2p_credit_waiters > 0) {
+            p2p_credits_returned();
         }
+        if(worker_queue_full) {
+            // let the worker catch up, without holding p2p_connections_mutex
+            std::this_thread::yield();
+        } else if(message_received) {
+            last_time = std::chrono::steady_clock::now();
+            idle_backoff_us = 1;
+        } else if(p2p_idle_policy != sst::IdlePolicy::SPIN
+                  && std::chrono::steady_clock::now() - last_time > std::chrono::microseconds(p2p_idle_spin_us)) {
+            // wait without holding p2p_connections_mutex, so a view change is not held up
+            if(p2p_idle_wait(idle_backoff_us)) {
+                last_time = std::chrono::steady_clock::now();
+            }
+        }
+    }
+    // stop fifo workers.
+    for(auto& worker : fifo_workers) {
+        worker->wake();
+        worker->thread.join();
+    }
+}
+
+bool RPCManager::p2p_idle_wait(uint32_t& idle_backoff_us) {
+    switch(p2p_idle_policy) {
+        case sst::IdlePolicy::SPIN:
+            break;
+        case sst::IdlePolicy::YIELD:
+            std::this_thread::yield();
+            break;
+        case sst::IdlePolicy::SLEEP:
+            std::this_thread::sleep_for(std::chrono::microseconds(p2p_idle_sleep_us));
+            break;
+        case sst::IdlePolicy::BACKOFF:
+            std::this_thread::sleep_for(std::chrono::microseconds(idle_backoff_us));
+            idle_backoff_us = std::min(idle_backoff_us * 2, p2p_idle_sleep_us);
+            break;
+        case sst::IdlePolicy::BLOCK: {
+            // a wakeup that came while the thread was still polling is not lost.
+            // Remote messages give no notification, so only wait for one poll interval.
+            std::unique_lock<std::mutex> lock(p2p_wakeup_mutex);
+            p2p_wakeup_cv.wait_for(lock, std::chrono::microseconds(p2p_idle_poll_us), [&]() {
+                return p2p_wakeup_generation != p2p_seen_generation || thread_shutdown;
+            });
+            const bool woken = p2p_wakeup_generation != p2p_seen_generation;
+            p2p_seen_generation = p2p_wakeup_generation;
+            return woken;
+        }
+    }
+    return false;
+}
+
+void RPCManager::wake_p2p_receive_loop() {
+    if(p2p_idle_policy != sst::IdlePolicy::BLOCK) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(p2p_wakeup_mutex);
+        p2p_wakeup_generation++;
     }
-    // stop fifo worker.
-    fifo_queue_cv.notify_one();
-    fifo_worker_thread.join();
+    p2p_wakeup_cv.notify_one();
 }
 
 bool in_rpc_handler() {
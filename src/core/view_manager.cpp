@@ -1015,7 +1015,7 @@ void ViewManager::terminate_epoch(DerechoSST& gmsSST) {
         gmsSST.sync_with_members(
                 curr_view->multicast_group->get_shard_sst_indices(subgroup_id));
         while(curr_view->multicast_group->receiver_predicate(
-                curr_subgroup_settings, shard_ranks_by_sender_rank,
+                subgroup_id, curr_subgroup_settings, shard_ranks_by_sender_rank,
                 num_shard_senders, gmsSST)) {
             auto sst_receive_handler_lambda =
                     [this, subgroup_id, curr_subgroup_settings,
@@ -1600,7 +1600,9 @@ std::pair<uint32_t, uint32_t> ViewManager::derive_subgroup_settings(View& view,
             max_shard_senders = std::max(shard_view.num_senders(), max_shard_senders);
 
             const DerechoParams& profile = DerechoParams::from_profile(shard_view.profile);
-            uint32_t slot_size_for_shard = profile.window_size * (profile.sst_max_msg_size + 2 * sizeof(uint64_t));
+            uint32_t slot_size_for_shard = profile.sst_ring_size
+                                                   ? profile.sst_ring_size
+                                                   : profile.window_size * (profile.sst_max_msg_size + 2 * sizeof(uint64_t));
             uint64_t payload_size = profile.max_msg_size - sizeof(header);
             max_payload_size = std::max(payload_size, max_payload_size);
             slot_size_for_subgroup = std::max(slot_size_for_shard, slot_size_for_subgroup);
@@ -3,7 +3,7 @@
 namespace objectstore{
 
     Blob::Blob(const char* const b, const decltype(size) s) :
-        bytes(nullptr), size(0) {
+        is_temporary(false), bytes(nullptr), size(0) {
         if(s > 0) {
             bytes = new char[s];
             memcpy(bytes, b, s);
@@ -11,8 +11,16 @@ namespace objectstore{
         }
     }
 
+    Blob::Blob(char* const b, const decltype(size) s, bool temporary) :
+        is_temporary(temporary), bytes(b), size(s) {
+        if(!temporary && s > 0) {
+            bytes = new char[s];
+            memcpy(bytes, b, s);
+        }
+    }
+
     Blob::Blob(const Blob& other) :
-        bytes(nullptr), size(0) {
+        is_temporary(false), bytes(nullptr), size(0) {
         if(other.size > 0) {
             bytes = new char[other.size];
             memcpy(bytes, other.bytes, other.size);
@@ -21,31 +29,35 @@ namespace objectstore{
     }
 
     Blob::Blob(Blob&& other) : 
-        bytes(other.bytes), size(other.size) {
+        is_temporary(other.is_temporary), bytes(other.bytes), size(other.size) {
         other.bytes = nullptr;
         other.size = 0;
     }
 
-    Blob::Blob() : bytes(nullptr), size(0) {}
+    Blob::Blob() : is_temporary(false), bytes(nullptr), size(0) {}
 
     Blob::~Blob() {
-        if(bytes) delete bytes;
+        if(bytes && !is_temporary) delete[] bytes;
     }
 
     Blob& Blob::operator=(Blob&& other) {
         char* swp_bytes = other.bytes;
         std::size_t swp_size = other.size;
+        bool swp_is_temporary = other.is_temporary;
         other.bytes = bytes;
         other.size = size;
+        other.is_temporary = is_temporary;
         bytes = swp_bytes;
         size = swp_size;
+        is_temporary = swp_is_temporary;
         return *this;
     }
 
     Blob& Blob::operator=(const Blob& other) {
-        if(bytes != nullptr) {
-            delete bytes;
+        if(bytes != nullptr && !is_temporary) {
+            delete[] bytes;
         }
+        is_temporary = false;
         size = other.size;
         if(size > 0) {
             bytes = new char[size];
@@ -73,9 +85,12 @@ namespace objectstore{
         f(bytes, size);
     }
 
-    // from_bytes_noalloc() implementation borrowed from mutils-serialization.
     mutils::context_ptr<Blob> Blob::from_bytes_noalloc(mutils::DeserializationManager* ctx, const char* const v, mutils::context_ptr<Blob> ) {
-        return mutils::context_ptr<Blob>{from_bytes(ctx, v).release()};
+        return mutils::context_ptr<Blob>{new Blob(const_cast<char*>(v) + sizeof(std::size_t), ((std::size_t*)(v))[0], true)};
+    }
+
+    mutils::context_ptr<const Blob> Blob::from_bytes_noalloc_const(mutils::DeserializationManager* ctx, const char* const v, mutils::context_ptr<const Blob> ) {
+        return mutils::context_ptr<const Blob>{new Blob(const_cast<char*>(v) + sizeof(std::size_t), ((std::size_t*)(v))[0], true)};
     }
 
     std::unique_ptr<Blob> Blob::from_bytes(mutils::DeserializationManager*, const char* const v) {
@@ -98,6 +113,9 @@ namespace objectstore{
     // constructor 0.5 : copy constructor
     Object::Object(const std::tuple<persistent::version_t,uint64_t> _ver, const OID& _oid, const Blob& _blob) : ver(_ver), oid(_oid), blob(_blob) {}
 
+    // constructor 0.75 : move the blob in
+    Object::Object(const std::tuple<persistent::version_t,uint64_t> _ver, const OID& _oid, Blob&& _blob) : ver(_ver), oid(_oid), blob(std::move(_blob)) {}
+
     // constructor 1 : copy consotructor
     Object::Object(const uint64_t _oid, const char* const _b, const std::size_t _s) : ver(INVALID_VERSION,0),
                                                                               oid(_oid),
@@ -115,4 +133,16 @@ namespace objectstore{
                                   blob(other.blob) {}
     // constructor 4 : default invalid constructor
     Object::Object() : ver(INVALID_VERSION,0), oid(INV_OID) {}
+
+    mutils::context_ptr<Object> Object::from_bytes_noalloc(mutils::DeserializationManager* ctx, const char* const v, mutils::context_ptr<Object> ) {
+        auto ver_ptr = mutils::from_bytes<std::tuple<persistent::version_t,uint64_t>>(ctx, v);
+        std::size_t offset = mutils::bytes_size(*ver_ptr);
+        const OID oid = ((OID*)(v + offset))[0];
+        offset += sizeof(oid);
+        return mutils::context_ptr<Object>{new Object(*ver_ptr, oid, std::move(*Blob::from_bytes_noalloc(ctx, v + offset)))};
+    }
+
+    mutils::context_ptr<const Object> Object::from_bytes_noalloc_const(mutils::DeserializationManager* ctx, const char* const v, mutils::context_ptr<const Object> ) {
+        return mutils::context_ptr<const Object>{from_bytes_noalloc(ctx, v).release()};
+    }
 }
@@ -1,6 +1,7 @@
 #include <derecho/persistent/detail/FilePersistLog.hpp>
 #include <derecho/persistent/detail/util.hpp>
 #include <derecho/conf/conf.hpp>
+#include <cstddef>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -38,10 +39,10 @@ FilePersistLog::FilePersistLog(const string& name, const string& dataPath) noexc
                                                                                              m_sDataFile(dataPath + "/" + name + "." + DATA_FILE_SUFFIX),
                                                                                              m_iMaxLogEntry(derecho::getConfUInt64(CONF_PERS_MAX_LOG_ENTRY)),
                                                                                              m_iMaxDataSize(derecho::getConfUInt64(CONF_PERS_MAX_DATA_SIZE)),
-                                                                                             m_iLogFileDesc(-1),
-                                                                                             m_iDataFileDesc(-1),
-                                                                                             m_pLog(MAP_FAILED),
-                                                                                             m_pData(MAP_FAILED) {
+                                                                                             m_bDirectIO(getPersDirectIO()),
+                                                                                             m_iDirectBufferSize(derecho::getConfUInt64(CONF_PERS_DIRECT_BUFFER_SIZE)),
+                                                                                             m_iSegmentSize(derecho::getConfUInt64(CONF_PERS_SEGMENT_SIZE)),
+                                                                                             m_iMetaFileDesc(-1) {
     if(pthread_rwlock_init(&this->m_rwlock, NULL) != 0) {
         throw PERSIST_EXP_RWLOCK_INIT(errno);
     }
@@ -63,14 +64,16 @@ void FilePersistLog::reset() noexcept(false) {
             dbg_default_error("{0} reset failed to remove the file:{1}", this->m_sName, this->m_sMetaFile);
             throw PERSIST_EXP_REMOVE_FILE(errno);
         }
-        if(!fs::remove(this->m_sLogFile)) {
+        if(fs::exists(this->m_sLogFile) && !fs::remove(this->m_sLogFile)) {
             dbg_default_error("{0} reset failed to remove the file:{1}", this->m_sName, this->m_sLogFile);
             throw PERSIST_EXP_REMOVE_FILE(errno);
         }
-        if(!fs::remove(this->m_sDataFile)) {
+        if(fs::exists(this->m_sDataFile) && !fs::remove(this->m_sDataFile)) {
             dbg_default_error("{0} reset failed to remove the file:{1}", this->m_sName, this->m_sDataFile);
             throw PERSIST_EXP_REMOVE_FILE(errno);
         }
+        SegmentedLogStorage::removeFiles(this->m_sDataPath, this->m_sName + "." + LOG_FILE_SUFFIX);
+        SegmentedLogStorage::removeFiles(this->m_sDataPath, this->m_sName + "." + DATA_FILE_SUFFIX);
     }
     dbg_default_trace("{0} reset state...done", this->m_sName);
 }
@@ -80,52 +83,40 @@ void FilePersistLog::load() noexcept(false) {
     // STEP 0: check if data path exists
     checkOrCreateDir(this->m_sDataPath);
     dbg_default_trace("{0}:checkOrCreateDir passed.", this->m_sName);
-    // STEP 1: check and create files.
-    bool bCreate = checkOrCreateMetaFile();
-    checkOrCreateLogFile();
-    checkOrCreateDataFile();
-    dbg_default_trace("{0}:checkOrCreateDataFile passed.", this->m_sName);
+    // STEP 1: check the meta file. A new one is only written once the log and
+    // data storage are ready, so its presence means the log was initialized.
+    bool bCreate = !checkRegularFile(this->m_sMetaFile);
+    dbg_default_trace("{0}:checkRegularFile passed.", this->m_sName);
     // STEP 2: open files
-    this->m_iLogFileDesc = open(this->m_sLogFile.c_str(), O_RDWR);
-    if(this->m_iLogFileDesc == -1) {
-        throw PERSIST_EXP_OPEN_FILE(errno);
-    }
-    this->m_iDataFileDesc = open(this->m_sDataFile.c_str(), O_RDWR);
-    if(this->m_iDataFileDesc == -1) {
-        throw PERSIST_EXP_OPEN_FILE(errno);
-    }
-    // STEP 3: mmap to memory
-    //// we map the log entry and data twice to faciliate the search and data
-    //// retrieving then the data is rewinding across the buffer end as follow:
-    //// [1][2][3][4][5][6][1][2][3][4][5][6]
-    this->m_pLog = mmap(NULL, MAX_LOG_SIZE << 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if(this->m_pLog == MAP_FAILED) {
-        dbg_default_error("{0}:reserve map space for log failed.", this->m_sName);
-        throw PERSIST_EXP_MMAP_FILE(errno);
-    }
-    if(mmap(this->m_pLog, MAX_LOG_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, this->m_iLogFileDesc, 0) == MAP_FAILED) {
-        dbg_default_error("{0}:map ringbuffer space for the first half of log failed. Is the size of log ringbuffer aligned to page?", this->m_sName);
-        throw PERSIST_EXP_MMAP_FILE(errno);
-    }
-    if(mmap((void*)((uint64_t)this->m_pLog + MAX_LOG_SIZE), MAX_LOG_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, this->m_iLogFileDesc, 0) == MAP_FAILED) {
-        dbg_default_error("{0}:map ringbuffer space for the second half of log failed. Is the size of log ringbuffer aligned to page?", this->m_sName);
-        throw PERSIST_EXP_MMAP_FILE(errno);
-    }
-    //// data ringbuffer
-    this->m_pData = mmap(NULL, (size_t)(MAX_DATA_SIZE << 1), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if(this->m_pData == MAP_FAILED) {
-        dbg_default_error("{0}:reserve map space for data failed.", this->m_sName);
-        throw PERSIST_EXP_MMAP_FILE(errno);
-    }
-    if(mmap(this->m_pData, (size_t)(MAX_DATA_SIZE), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, this->m_iDataFileDesc, 0) == MAP_FAILED) {
-        dbg_default_error("{0}:map ringbuffer space for the first half of data failed. Is the size of data ringbuffer aligned to page?", this->m_sName);
-        throw PERSIST_EXP_MMAP_FILE(errno);
-    }
-    if(mmap((void*)((uint64_t)this->m_pData + MAX_DATA_SIZE), (size_t)MAX_DATA_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, this->m_iDataFileDesc, 0) == MAP_FAILED) {
-        dbg_default_error("{0}:map ringbuffer space for the second half of data failed. Is the size of data ringbuffer aligned to page?", this->m_sName);
-        throw PERSIST_EXP_MMAP_FILE(errno);
-    }
-    dbg_default_trace("{0}:data/meta file mapped to memory", this->m_sName);
+    if(!bCreate) {
+        this->m_iMetaFileDesc = open(this->m_sMetaFile.c_str(), O_RDWR);
+        if(this->m_iMetaFileDesc == -1) {
+            throw PERSIST_EXP_OPEN_FILE(errno);
+        }
+    }
+    // STEP 3: map the log and data to memory
+    if(m_iSegmentSize == 0) {
+        if(SegmentedLogStorage::hasFiles(this->m_sDataPath, this->m_sName + "." + LOG_FILE_SUFFIX)) {
+            dbg_default_error("{0}:found log segment files, which cannot be read without a segment size.",
+                              this->m_sName);
+            throw PERSIST_EXP_INV_FILE;
+        }
+        this->m_pLogStorage = std::make_unique<RingLogStorage>(this->m_sLogFile, MAX_LOG_SIZE, m_bDirectIO, m_iDirectBufferSize);
+        this->m_pDataStorage = std::make_unique<RingLogStorage>(this->m_sDataFile, MAX_DATA_SIZE, m_bDirectIO, m_iDirectBufferSize);
+    } else {
+        if(checkRegularFile(this->m_sLogFile)) {
+            dbg_default_error("{0}:found the ring buffer log file {1}, which cannot be read with a segment size.",
+                              this->m_sName, this->m_sLogFile);
+            throw PERSIST_EXP_INV_FILE;
+        }
+        this->m_pLogStorage = std::make_unique<SegmentedLogStorage>(
+                this->m_sDataPath, this->m_sName + "." + LOG_FILE_SUFFIX, m_iSegmentSize, m_bDirectIO,
+                m_iDirectBufferSize);
+        this->m_pDataStorage = std::make_unique<SegmentedLogStorage>(
+                this->m_sDataPath, this->m_sName + "." + DATA_FILE_SUFFIX, m_iSegmentSize, m_bDirectIO,
+                m_iDirectBufferSize);
+    }
+    dbg_default_trace("{0}:log/data storage is ready", this->m_sName);
     // STEP 4: initialize the header for new created Metafile
     if(bCreate) {
         META_HEADER->fields.head = 0ll;
@@ -134,12 +125,13 @@ void FilePersistLog::load() noexcept(false) {
         META_HEADER_PERS->fields.head = -1ll;  // -1 means uninitialized
         META_HEADER_PERS->fields.tail = -1ll;  // -1 means uninitialized
         META_HEADER_PERS->fields.ver = INVALID_VERSION;
+        META_HEADER_PERS->fields.seq = 0ull;
         // persist the header
         FPL_RDLOCK;
         FPL_PERS_LOCK;
 
         try {
-            persistMetaHeaderAtomically(META_HEADER);
+            writeMetaFile();
         } catch(uint64_t e) {
             FPL_PERS_UNLOCK;
             FPL_UNLOCK;
@@ -152,17 +144,28 @@ void FilePersistLog::load() noexcept(false) {
         FPL_WRLOCK;
         FPL_PERS_LOCK;
         try {
-            int fd = open(this->m_sMetaFile.c_str(), O_RDONLY);
-            if(fd == -1) {
-                throw PERSIST_EXP_OPEN_FILE(errno);
-            }
-            ssize_t nRead = read(fd, (void*)META_HEADER_PERS, sizeof(MetaHeader));
-            if(nRead != sizeof(MetaHeader)) {
-                close(fd);
-                throw PERSIST_EXP_READ_FILE(errno);
+            if(!readMetaHeader(this->m_iMetaFileDesc, *META_HEADER_PERS)) {
+                dbg_default_error("{0}:the meta file {1} has no valid header.", this->m_sName, this->m_sMetaFile);
+                throw PERSIST_EXP_INV_FILE;
             }
-            close(fd);
             *META_HEADER = *META_HEADER_PERS;
+            // load the persisted log entries and their data
+            this->m_pLogStorage->load(LOG_ENTRY_OFST(META_HEADER->fields.head),
+                                      LOG_ENTRY_OFST(META_HEADER->fields.tail));
+            if(NUM_USED_SLOTS > 0) {
+                // an empty record still takes a byte of storage
+                const LogEntry* latest = LOG_ENTRY_AT(CURR_LOG_IDX);
+                this->m_pDataStorage->load(LOG_ENTRY_AT(META_HEADER->fields.head)->fields.ofst,
+                                           latest->fields.ofst + MAX(latest->fields.dlen, (uint64_t)1));
+            } else {
+                this->m_pDataStorage->load(0, 0);
+            }
+            release();
+            if(META_HEADER_PERS->fields.seq == 0) {
+                // an old-format meta file: replace it with one in the new format
+                dbg_default_info("{0}:converting the meta file to the double-buffered format.", this->m_sName);
+                writeMetaFile();
+            }
             // update mhlc index
             for(int64_t idx = META_HEADER->fields.head; idx < META_HEADER->fields.tail; idx++) {
                 struct hlc_index_entry _ent;
@@ -194,19 +197,8 @@ void FilePersistLog::load() noexcept(false) {
 FilePersistLog::~FilePersistLog() noexcept(true) {
     pthread_rwlock_destroy(&this->m_rwlock);
     pthread_mutex_destroy(&this->m_perslock);
-    if(this->m_pData != MAP_FAILED) {
-        munmap(m_pData, (size_t)(MAX_DATA_SIZE << 1));
-    }
-    this->m_pData = nullptr;  // prevent ~MemLog() destructor to release it again.
-    if(this->m_pLog != MAP_FAILED) {
-        munmap(m_pLog, MAX_LOG_SIZE);
-    }
-    this->m_pLog = nullptr;  // prevent ~MemLog() destructor to release it again.
-    if(this->m_iLogFileDesc != -1) {
-        close(this->m_iLogFileDesc);
-    }
-    if(this->m_iDataFileDesc != -1) {
-        close(this->m_iDataFileDesc);
+    if(this->m_iMetaFileDesc != -1) {
+        close(this->m_iMetaFileDesc);
     }
 }
 
@@ -257,13 +249,21 @@ void FilePersistLog::append(const void* pdat, const uint64_t& size, const int64_
     dbg_default_trace("{0} append:validate check2 Finished.", this->m_sName);
 
     // copy data
-    memcpy(NEXT_DATA, pdat, size);
+    uint64_t ofst;
+    try {
+        this->m_pLogStorage->place(LOG_ENTRY_OFST(META_HEADER->fields.tail), sizeof(LogEntry));
+        ofst = this->m_pDataStorage->place(NEXT_DATA_OFST, size);
+    } catch(uint64_t e) {
+        FPL_UNLOCK;
+        throw e;
+    }
+    memcpy(this->m_pDataStorage->at(ofst), pdat, size);
     dbg_default_trace("{0} append:data is copied to log.", this->m_sName);
 
     // fill the log entry
     NEXT_LOG_ENTRY->fields.ver = ver;
     NEXT_LOG_ENTRY->fields.dlen = size;
-    NEXT_LOG_ENTRY->fields.ofst = NEXT_DATA_OFST;
+    NEXT_LOG_ENTRY->fields.ofst = ofst;
     NEXT_LOG_ENTRY->fields.hlc_r = mhlc.m_rtc_us;
     NEXT_LOG_ENTRY->fields.hlc_l = mhlc.m_logic;
     /* No Sync required here.
@@ -324,17 +324,17 @@ const int64_t FilePersistLog::persist(const bool preLocked) noexcept(false) {
     dbg_default_trace("{0} flush data,log,and meta.", this->m_sName);
     try {
         // shadow the current state
-        void *flush_dstart = nullptr, *flush_lstart = nullptr;
-        size_t flush_dlen = 0, flush_llen = 0;
+        uint64_t flush_dstart = 0, flush_dend = 0, flush_lstart = 0, flush_lend = 0;
         MetaHeader shadow_header = *META_HEADER;
-        if((NUM_USED_SLOTS > 0) && (NEXT_LOG_ENTRY > NEXT_LOG_ENTRY_PERS)) {
-            flush_dlen = (LOG_ENTRY_AT(CURR_LOG_IDX)->fields.ofst + LOG_ENTRY_AT(CURR_LOG_IDX)->fields.dlen - NEXT_LOG_ENTRY_PERS->fields.ofst);
+        // the first log entry not persisted yet
+        int64_t pers_tail = MAX(META_HEADER_PERS->fields.tail, META_HEADER->fields.head);
+        if((NUM_USED_SLOTS > 0) && (META_HEADER->fields.tail > pers_tail)) {
             // flush data
-            flush_dstart = ALIGN_TO_PAGE(NEXT_DATA_PERS);
-            flush_dlen += ((int64_t)NEXT_DATA_PERS) % PAGE_SIZE;
+            flush_dstart = LOG_ENTRY_AT(pers_tail)->fields.ofst;
+            flush_dend = NEXT_DATA_OFST;
             // flush log
-            flush_lstart = ALIGN_TO_PAGE(NEXT_LOG_ENTRY_PERS);
-            flush_llen = ((size_t)NEXT_LOG_ENTRY - (size_t)NEXT_LOG_ENTRY_PERS) + ((int64_t)NEXT_LOG_ENTRY_PERS) % PAGE_SIZE;
+            flush_lstart = LOG_ENTRY_OFST(pers_tail);
+            flush_lend = LOG_ENTRY_OFST(META_HEADER->fields.tail);
         }
         if(NUM_USED_SLOTS > 0) {
             //get the latest flushed version
@@ -344,15 +344,11 @@ const int64_t FilePersistLog::persist(const bool preLocked) noexcept(false) {
         if(!preLocked) {
             FPL_UNLOCK;
         }
-        if(flush_dlen > 0) {
-            if(msync(flush_dstart, flush_dlen, MS_SYNC) != 0) {
-                throw PERSIST_EXP_MSYNC(errno);
-            }
+        if(flush_dend > flush_dstart) {
+            this->m_pDataStorage->flush(flush_dstart, flush_dend);
         }
-        if(flush_llen > 0) {
-            if(msync(flush_lstart, flush_llen, MS_SYNC) != 0) {
-                throw PERSIST_EXP_MSYNC(errno);
-            }
+        if(flush_lend > flush_lstart) {
+            this->m_pLogStorage->flush(flush_lstart, flush_lend);
         }
         // flush meta data
         this->persistMetaHeaderAtomically(&shadow_header);
@@ -403,7 +399,7 @@ version_t FilePersistLog::getEarliestVersion() noexcept(false) {
 version_t FilePersistLog::getLatestVersion() noexcept(false) {
     FPL_RDLOCK;
     int64_t idx = CURR_LOG_IDX;
-    version_t ver = (idx == INVALID_INDEX) ? INVALID_VERSION : (LOG_ENTRY_AT(idx)->fields.ver);
+    version_t ver = (idx == -1) ? INVALID_VERSION : (LOG_ENTRY_AT(idx)->fields.ver);
     FPL_UNLOCK;
     return ver;
 }
@@ -440,6 +436,15 @@ int64_t FilePersistLog::getVersionIndex(const version_t& ver) {
     return l_idx;
 }
 
+void FilePersistLog::pinEntries() noexcept(false) {
+    // the log entries are only read with the lock held
+    this->m_pDataStorage->pin();
+}
+
+void FilePersistLog::unpinEntries() noexcept(false) {
+    this->m_pDataStorage->unpin();
+}
+
 const void* FilePersistLog::getEntryByIndex(const int64_t& eidx) noexcept(false) {
     FPL_RDLOCK;
     dbg_default_trace("{0}-getEntryByIndex-head:{1},tail:{2},eidx:{3}",
@@ -451,7 +456,6 @@ const void* FilePersistLog::getEntryByIndex(const int64_t& eidx) noexcept(false)
         FPL_UNLOCK;
         throw PERSIST_EXP_INV_ENTRY_IDX(eidx);
     }
-    FPL_UNLOCK;
 
     dbg_default_trace("{0} getEntryByIndex at idx:{1} ver:{2} time:({3},{4})",
                       this->m_sName,
@@ -460,7 +464,9 @@ const void* FilePersistLog::getEntryByIndex(const int64_t& eidx) noexcept(false)
                       (LOG_ENTRY_AT(ridx))->fields.hlc_r,
                       (LOG_ENTRY_AT(ridx))->fields.hlc_l);
 
-    return LOG_ENTRY_DATA(LOG_ENTRY_AT(ridx));
+    const void* pdat = LOG_ENTRY_DATA(LOG_ENTRY_AT(ridx));
+    FPL_UNLOCK;
+    return pdat;
 }
 
 /** MOVED TO .hpp
@@ -528,16 +534,17 @@ const void* FilePersistLog::getEntry(const int64_t& ver) noexcept(false) {
     ple = (l_idx == -1) ? nullptr : LOG_ENTRY_AT(l_idx);
     dbg_default_trace("{0} - end binary search.", this->m_sName);
 
-    FPL_UNLOCK;
-
     // no object exists before the requested timestamp.
     if(ple == nullptr) {
+        FPL_UNLOCK;
         return nullptr;
     }
 
     dbg_default_trace("{0} getEntry at ({1},{2})", this->m_sName, ple->fields.hlc_r, ple->fields.hlc_l);
 
-    return LOG_ENTRY_DATA(ple);
+    const void* pdat = LOG_ENTRY_DATA(ple);
+    FPL_UNLOCK;
+    return pdat;
 }
 
 int64_t FilePersistLog::getHLCIndex(const HLC& rhlc) noexcept(false) {
@@ -581,7 +588,6 @@ const void* FilePersistLog::getEntry(const HLC& rhlc) noexcept(false) {
     dbg_default_trace("getEntry for hlc({0},{1})", rhlc.m_rtc_us, rhlc.m_logic);
     struct hlc_index_entry skey(rhlc, 0);
     auto key = this->hidx.upper_bound(skey);
-    FPL_UNLOCK;
 
 #ifndef NDEBUG
     dbg_default_trace("hidx.size = {}", this->hidx.size());
@@ -599,12 +605,15 @@ const void* FilePersistLog::getEntry(const HLC& rhlc) noexcept(false) {
 
     // no object exists before the requested timestamp.
     if(ple == nullptr) {
+        FPL_UNLOCK;
         return nullptr;
     }
 
     dbg_default_trace("{0} getEntry at ({1},{2})", this->m_sName, ple->fields.hlc_r, ple->fields.hlc_l);
 
-    return LOG_ENTRY_DATA(ple);
+    const void* pdat = LOG_ENTRY_DATA(ple);
+    FPL_UNLOCK;
+    return pdat;
 }
 
 // trim by index
@@ -629,6 +638,7 @@ void FilePersistLog::trimByIndex(const int64_t& idx) noexcept(false) {
     META_HEADER->fields.head = idx + 1;
     try {
         persist(true);
+        release();
     } catch(uint64_t e) {
         FPL_UNLOCK;
         FPL_PERS_UNLOCK;
@@ -663,27 +673,98 @@ void FilePersistLog::trim(const HLC& hlc) noexcept(false) {
 }
 
 void FilePersistLog::persistMetaHeaderAtomically(MetaHeader* pShadowHeader) noexcept(false) {
-    // STEP 1: get file name
-    const string swpFile = this->m_sMetaFile + "." + SWAP_FILE_SUFFIX;
-
-    // STEP 2: write current meta header to swap file
-    int fd = open(swpFile.c_str(), O_RDWR | O_CREAT, S_IWUSR | S_IRUSR | S_IRGRP | S_IWGRP | S_IROTH);
-    if(fd == -1) {
-        throw PERSIST_EXP_OPEN_FILE(errno);
-    }
-    ssize_t nWrite = write(fd, pShadowHeader, sizeof(MetaHeader));
+    // STEP 1: stamp the header with the next sequence number and its CRC
+    MetaHeader slot;
+    memset(&slot, 0, sizeof(MetaHeader));
+    slot.fields.head = pShadowHeader->fields.head;
+    slot.fields.tail = pShadowHeader->fields.tail;
+    slot.fields.ver = pShadowHeader->fields.ver;
+    slot.fields.seq = META_HEADER_PERS->fields.seq + 1;
+    slot.fields.crc = computeCRC32(&slot, offsetof(MetaHeader, fields.crc));
+
+    // STEP 2: overwrite the older slot, leaving the newest valid one intact
+    // until this write is durable. The file size never changes, so
+    // fdatasync() does not need to update any file system metadata.
+    off_t offset = (slot.fields.seq % NUM_META_SLOTS) * META_SIZE;
+    ssize_t nWrite = pwrite(this->m_iMetaFileDesc, &slot, sizeof(MetaHeader), offset);
     if(nWrite != sizeof(MetaHeader)) {
         throw PERSIST_EXP_WRITE_FILE(errno);
     }
-    close(fd);
+    if(fdatasync(this->m_iMetaFileDesc) != 0) {
+        throw PERSIST_EXP_FSYNC(errno);
+    }
+
+    // STEP 3: update the persisted header in memory
+    *META_HEADER_PERS = slot;
+}
 
-    // STEP 3: atomically update the meta file
+void FilePersistLog::release() noexcept(false) {
+    // the data of the trimmed entries ends where the data of the head starts
+    uint64_t data_head = (NUM_USED_SLOTS > 0) ? LOG_ENTRY_AT(META_HEADER->fields.head)->fields.ofst : UINT64_MAX;
+    this->m_pLogStorage->release(LOG_ENTRY_OFST(META_HEADER->fields.head));
+    this->m_pDataStorage->release(data_head);
+}
+
+void FilePersistLog::writeMetaFile() noexcept(false) {
+    // STEP 1: fill both slots of a new file under a temporary name, so a crash
+    // can never leave a meta file without a valid slot behind
+    const string swpFile = this->m_sMetaFile + "." + SWAP_FILE_SUFFIX;
+    int fd = open(swpFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if(fd == -1) {
+        throw PERSIST_EXP_CREATE_FILE(errno);
+    }
+    if(ftruncate(fd, META_FILE_SIZE) != 0) {
+        int err = errno;
+        close(fd);
+        throw PERSIST_EXP_TRUNCATE_FILE(err);
+    }
+    if(this->m_iMetaFileDesc != -1) {
+        close(this->m_iMetaFileDesc);
+    }
+    this->m_iMetaFileDesc = fd;
+    META_HEADER_PERS->fields.seq = 0ull;
+    for(uint32_t slot = 0; slot < NUM_META_SLOTS; slot++) {
+        persistMetaHeaderAtomically(META_HEADER);
+    }
+    // STEP 2: replace the meta file with it
     if(rename(swpFile.c_str(), this->m_sMetaFile.c_str()) != 0) {
         throw PERSIST_EXP_RENAME_FILE(errno);
     }
+    syncDir(this->m_sDataPath);
+}
 
-    // STEP 4: update the persisted header in memory
-    *META_HEADER_PERS = *pShadowHeader;
+bool FilePersistLog::readMetaHeader(int fd, MetaHeader& header) noexcept(true) {
+    struct stat sb;
+    if(fstat(fd, &sb) != 0) {
+        return false;
+    }
+    MetaHeader slots[NUM_META_SLOTS];
+    if(sb.st_size == (off_t)META_SIZE) {
+        // an old-format file, with a single header and no sequence number or CRC
+        if(pread(fd, slots, META_SIZE, 0) != (ssize_t)META_SIZE) {
+            return false;
+        }
+        header = slots[0];
+        header.fields.seq = 0;
+        return true;
+    }
+    if(sb.st_size != (off_t)META_FILE_SIZE
+       || pread(fd, slots, META_FILE_SIZE, 0) != (ssize_t)META_FILE_SIZE) {
+        return false;
+    }
+    const MetaHeader* newest = nullptr;
+    for(uint32_t i = 0; i < NUM_META_SLOTS; i++) {
+        if(slots[i].fields.seq != 0
+           && slots[i].fields.crc == computeCRC32(&slots[i], offsetof(MetaHeader, fields.crc))
+           && (newest == nullptr || slots[i].fields.seq > newest->fields.seq)) {
+            newest = &slots[i];
+        }
+    }
+    if(newest == nullptr) {
+        return false;
+    }
+    header = *newest;
+    return true;
 }
 
 int64_t FilePersistLog::getMinimumIndexBeyondVersion(const int64_t& ver) noexcept(false) {
@@ -849,9 +930,11 @@ size_t FilePersistLog::mergeLogEntryFromByteArray(const char* ba) noexcept(false
         throw PERSIST_EXP_NOSPACE_DATA;
     }
     // 2) merge it!
-    memcpy(NEXT_DATA, (const void*)(ba + sizeof(LogEntry)), cple->fields.dlen);
+    this->m_pLogStorage->place(LOG_ENTRY_OFST(META_HEADER->fields.tail), sizeof(LogEntry));
+    uint64_t ofst = this->m_pDataStorage->place(NEXT_DATA_OFST, cple->fields.dlen);
+    memcpy(this->m_pDataStorage->at(ofst), (const void*)(ba + sizeof(LogEntry)), cple->fields.dlen);
     memcpy(NEXT_LOG_ENTRY, cple, sizeof(LogEntry));
-    NEXT_LOG_ENTRY->fields.ofst = NEXT_DATA_OFST;
+    NEXT_LOG_ENTRY->fields.ofst = ofst;
     this->hidx.insert(hlc_index_entry{HLC{cple->fields.hlc_r, cple->fields.hlc_l}, META_HEADER->fields.tail});
     META_HEADER->fields.tail++;
     META_HEADER->fields.ver = cple->fields.ver;
@@ -904,41 +987,25 @@ size_t FilePersistLog::mergeLogEntryFromByteArray(const char* ba) noexcept(false
     return bCreate;
   }
 */
-bool FilePersistLog::checkOrCreateMetaFile() noexcept(false) {
-    return checkOrCreateFileWithSize(this->m_sMetaFile, META_SIZE);
-}
-
-bool FilePersistLog::checkOrCreateLogFile() noexcept(false) {
-    return checkOrCreateFileWithSize(this->m_sLogFile, MAX_LOG_SIZE);
-}
-
-bool FilePersistLog::checkOrCreateDataFile() noexcept(false) {
-    return checkOrCreateFileWithSize(this->m_sDataFile, MAX_DATA_SIZE);
-}
-
 void FilePersistLog::truncate(const int64_t& ver) noexcept(false) {
     dbg_default_trace("{0} truncate at version: {1}.", this->m_sName, ver);
     FPL_WRLOCK;
     // STEP 1: search for the log entry
     // TODO
     //binary search
-    int64_t head = META_HEADER->fields.head % MAX_LOG_ENTRY;
-    int64_t tail = META_HEADER->fields.tail % MAX_LOG_ENTRY;
-    if(tail < head) tail += MAX_LOG_ENTRY;
     dbg_default_trace("{0} - begin binary search.", this->m_sName);
     int64_t l_idx = binarySearch<int64_t>(
             [&](const LogEntry* ple) {
                 return ple->fields.ver;
             },
-            ver, head, tail);
+            ver, META_HEADER->fields.head, META_HEADER->fields.tail);
     dbg_default_trace("{0} - end binary search.", this->m_sName);
     // STEP 2: update META_HEADER
     if(l_idx == -1) {  // not adequate log found. We need to remove all logs.
         // TODO: this may not be safe in case the log has been trimmed beyond 'ver' !!!
         META_HEADER->fields.tail = META_HEADER->fields.head;
     } else {
-        int64_t _idx = (META_HEADER->fields.head + l_idx - head) + ((head > l_idx) ? MAX_LOG_ENTRY : 0);
-        META_HEADER->fields.tail = _idx + 1;
+        META_HEADER->fields.tail = l_idx + 1;
     }
     if(META_HEADER->fields.ver > ver)
         META_HEADER->fields.ver = ver;
@@ -981,8 +1048,7 @@ const uint64_t FilePersistLog::getMinimumLatestPersistedVersion(const std::strin
                                  __FILE__, __func__, errno, strerror(errno));
                 continue;
             }
-            int nRead = read(fd, (void*)&mh, sizeof(mh));
-            if(nRead != sizeof(mh)) {
+            if(!readMetaHeader(fd, mh)) {
                 dbg_default_warn("{}:{} cannot load meta header from file:{}, errno={}, err={}",
                                  __FILE__, __func__, errno, strerror(errno));
                 close(fd);
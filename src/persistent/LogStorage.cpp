@@ -0,0 +1,689 @@
+#include <derecho/persistent/PersistException.hpp>
+#include <derecho/persistent/detail/LogStorage.hpp>
+#include <derecho/persistent/detail/util.hpp>
+#include <derecho/utils/logger.hpp>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace persistent {
+
+/////////////////////////
+// internal structures //
+/////////////////////////
+
+#define PAGE_SIZE (getpagesize())
+#define ROUND_DOWN(x, a) ((x) / (a) * (a))
+#define ROUND_UP(x, a) (((x) + (a)-1) / (a) * (a))
+// the suffix of a segment file that is being created
+#define SEGMENT_SWAP_SUFFIX "swp"
+
+// open a file for writing. With direct I/O, every write is durable when it
+// returns, so flush() needs no fsync(); directIO is cleared if the file
+// system does not support O_DIRECT.
+static int openForWrite(const string& file, bool& directIO, bool create) noexcept(false) {
+    int flags = O_RDWR;
+    if(create) {
+        flags |= O_CREAT | O_TRUNC;
+    }
+    if(directIO) {
+        flags |= O_DIRECT | O_DSYNC;
+    }
+    int fd = open(file.c_str(), flags, S_IWUSR | S_IRUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if(fd == -1 && directIO && errno == EINVAL) {
+        dbg_default_warn("{0}:the file system does not support O_DIRECT, using buffered writes.", file);
+        directIO = false;
+        fd = open(file.c_str(), flags & ~O_DIRECT, S_IWUSR | S_IRUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    }
+    if(fd == -1) {
+        throw PERSIST_EXP_OPEN_FILE(errno);
+    }
+    return fd;
+}
+
+// the alignment O_DIRECT needs for the offsets, sizes and addresses of the
+// writes to a file, or a page if the file system does not tell
+static uint64_t directIOAlignment(int fd) {
+    uint64_t alignment = PAGE_SIZE;
+#ifdef STATX_DIOALIGN
+    struct statx stx;
+    if(statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 && (stx.stx_mask & STATX_DIOALIGN)
+       && stx.stx_dio_offset_align > 0) {
+        alignment = MAX(stx.stx_dio_offset_align, stx.stx_dio_mem_align);
+    }
+#endif
+    return alignment;
+}
+
+// write len bytes from buf to a file at ofst
+static void writeAll(int fd, const void* buf, uint64_t len, uint64_t ofst) noexcept(false) {
+    while(len > 0) {
+        ssize_t nWrite = pwrite(fd, buf, len, ofst);
+        if(nWrite <= 0) {
+            throw PERSIST_EXP_WRITE_FILE(errno);
+        }
+        buf = (const uint8_t*)buf + nWrite;
+        ofst += nWrite;
+        len -= nWrite;
+    }
+}
+
+// read len bytes of a file at ofst into buf
+static void readAll(int fd, void* buf, uint64_t len, uint64_t ofst) noexcept(false) {
+    while(len > 0) {
+        ssize_t nRead = pread(fd, buf, len, ofst);
+        if(nRead <= 0) {
+            throw PERSIST_EXP_READ_FILE(errno);
+        }
+        buf = (uint8_t*)buf + nRead;
+        ofst += nRead;
+        len -= nRead;
+    }
+}
+
+////////////////
+// LogStorage //
+////////////////
+
+void LogStorage::pin() {
+    std::lock_guard<std::mutex> lock(m_pinMutex);
+    m_iPins++;
+}
+
+void LogStorage::unpin() {
+    std::vector<std::shared_ptr<void>> retired;
+    {
+        std::lock_guard<std::mutex> lock(m_pinMutex);
+        if(--m_iPins == 0) {
+            retired.swap(m_retired);
+        }
+    }
+    // freed here, out of the lock
+}
+
+bool LogStorage::pinned() {
+    std::lock_guard<std::mutex> lock(m_pinMutex);
+    return m_iPins > 0;
+}
+
+void LogStorage::retire(std::shared_ptr<void> memory) {
+    std::lock_guard<std::mutex> lock(m_pinMutex);
+    if(m_iPins > 0) {
+        m_retired.emplace_back(std::move(memory));
+    }
+}
+
+///////////////////////
+// DirectWriteBuffer //
+///////////////////////
+
+DirectWriteBuffer::DirectWriteBuffer(const uint64_t& capacity, const uint64_t& blockSize,
+                                     const file_io_t& writeFile, const file_io_t& readFile) noexcept(false)
+        : m_iCapacity(ROUND_UP(MAX(capacity, blockSize), blockSize)),
+          m_iBlockSize(blockSize),
+          m_writeFile(writeFile),
+          m_readFile(readFile),
+          m_pBuffer(allocate(m_iCapacity)),
+          m_iBufferSize(m_iCapacity),
+          m_iStart(0),
+          m_iEnd(0),
+          m_iClean(0) {}
+
+shared_ptr<uint8_t> DirectWriteBuffer::allocate(const uint64_t& size) noexcept(false) {
+    void* buf = nullptr;
+    // O_DIRECT needs aligned addresses as well
+    int ret = posix_memalign(&buf, PAGE_SIZE, size);
+    if(ret != 0) {
+        throw PERSIST_EXP_ALLOC(ret);
+    }
+    return shared_ptr<uint8_t>((uint8_t*)buf, free);
+}
+
+void* DirectWriteBuffer::at(const uint64_t& ofst) const {
+    if(ofst < m_iStart || ofst - m_iStart >= m_iBufferSize) {
+        return nullptr;
+    }
+    return (void*)(m_pBuffer.get() + (ofst - m_iStart));
+}
+
+shared_ptr<uint8_t> DirectWriteBuffer::place(const uint64_t& ofst, const uint64_t& len, bool pinned) noexcept(false) {
+    if(ofst >= m_iStart && ofst + len <= m_iStart + m_iBufferSize) {
+        // after a truncate, the record replaces bytes that may be written already
+        m_iClean = MIN(m_iClean, ofst);
+        m_iEnd = ofst + len;
+        return nullptr;
+    }
+    // write out what is left, and move the buffer to the block holding ofst
+    if(m_iEnd > m_iClean) {
+        uint64_t from = ROUND_DOWN(m_iClean, m_iBlockSize);
+        m_writeFile(from, m_pBuffer.get() + (from - m_iStart), ROUND_UP(m_iEnd, m_iBlockSize) - from);
+    }
+    uint64_t start = ROUND_DOWN(ofst, m_iBlockSize);
+    // go back to the capacity after a large record
+    uint64_t size = MAX(m_iCapacity, ROUND_UP(ofst + len - start, m_iBlockSize));
+    shared_ptr<uint8_t> buffer = (size == m_iBufferSize && !pinned) ? m_pBuffer : allocate(size);
+    if(start < ofst) {
+        // the bytes before ofst in its block are rewritten with it
+        if(start >= m_iStart && ofst <= m_iEnd) {
+            memmove(buffer.get(), m_pBuffer.get() + (start - m_iStart), ofst - start);
+        } else {
+            m_readFile(start, buffer.get(), m_iBlockSize);
+        }
+    }
+    m_iBufferSize = size;
+    m_iStart = start;
+    m_iClean = ofst;
+    m_iEnd = ofst + len;
+    if(buffer == m_pBuffer) {
+        return nullptr;
+    }
+    m_pBuffer.swap(buffer);
+    return buffer;
+}
+
+void DirectWriteBuffer::flush(const uint64_t& begin, const uint64_t& end) noexcept(false) {
+    // the offsets below the buffer are written already
+    if(end <= begin || end <= m_iStart) {
+        return;
+    }
+    uint64_t from = MAX(ROUND_DOWN(begin, m_iBlockSize), m_iStart);
+    uint64_t to = MIN(ROUND_UP(end, m_iBlockSize), m_iStart + m_iBufferSize);
+    m_writeFile(from, m_pBuffer.get() + (from - m_iStart), to - from);
+    if(from <= m_iClean) {
+        m_iClean = MAX(m_iClean, end);
+    }
+}
+
+void DirectWriteBuffer::load(const uint64_t& end) noexcept(false) {
+    m_iStart = ROUND_DOWN(end, m_iBlockSize);
+    if(m_iStart < end) {
+        m_readFile(m_iStart, m_pBuffer.get(), m_iBlockSize);
+    }
+    m_iClean = end;
+    m_iEnd = end;
+}
+
+////////////////////
+// RingLogStorage //
+////////////////////
+
+RingLogStorage::RingLogStorage(const string& file, const uint64_t& size, bool directIO,
+                               const uint64_t& bufferSize) noexcept(false)
+        : m_sFile(file),
+          m_iSize(size),
+          m_bDirectIO(directIO),
+          m_iFileDesc(-1),
+          m_pBase(MAP_FAILED),
+          m_iReleased(0) {
+    checkOrCreateFileWithSize(file, size);
+    this->m_iFileDesc = openForWrite(file, this->m_bDirectIO, false);
+    //// with direct I/O, the records are written from the buffer, and the
+    //// mappings are only for reading
+    int prot = PROT_READ;
+    if(m_bDirectIO) {
+        this->m_pBuffer = make_unique<DirectWriteBuffer>(
+                MIN(bufferSize, size), directIOAlignment(this->m_iFileDesc),
+                [this](const uint64_t& ofst, void* buf, const uint64_t& len) { writeFile(ofst, buf, len); },
+                [this](const uint64_t& ofst, void* buf, const uint64_t& len) { readFile(ofst, buf, len); });
+    } else {
+        prot |= PROT_WRITE;
+    }
+    //// we map the ring buffer twice to faciliate the search and data
+    //// retrieving then the data is rewinding across the buffer end as follow:
+    //// [1][2][3][4][5][6][1][2][3][4][5][6]
+    this->m_pBase = mmap(NULL, size << 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(this->m_pBase == MAP_FAILED) {
+        dbg_default_error("{0}:reserve map space for ringbuffer failed.", file);
+        throw PERSIST_EXP_MMAP_FILE(errno);
+    }
+    if(mmap(this->m_pBase, size, prot, MAP_SHARED | MAP_FIXED, this->m_iFileDesc, 0) == MAP_FAILED) {
+        dbg_default_error("{0}:map ringbuffer space for the first half failed. Is the size of ringbuffer aligned to page?", file);
+        throw PERSIST_EXP_MMAP_FILE(errno);
+    }
+    if(mmap((void*)((uint64_t)this->m_pBase + size), size, prot, MAP_SHARED | MAP_FIXED, this->m_iFileDesc, 0) == MAP_FAILED) {
+        dbg_default_error("{0}:map ringbuffer space for the second half failed. Is the size of ringbuffer aligned to page?", file);
+        throw PERSIST_EXP_MMAP_FILE(errno);
+    }
+}
+
+RingLogStorage::~RingLogStorage() noexcept(true) {
+    if(this->m_pBase != MAP_FAILED) {
+        munmap(this->m_pBase, m_iSize << 1);
+    }
+    if(this->m_iFileDesc != -1) {
+        close(this->m_iFileDesc);
+    }
+}
+
+void RingLogStorage::readFile(uint64_t ofst, void* buf, uint64_t len) noexcept(false) {
+    while(len > 0) {
+        // stop at the end of the file, and continue from its start
+        uint64_t nBytes = MIN(len, m_iSize - ofst % m_iSize);
+        readAll(this->m_iFileDesc, buf, nBytes, ofst % m_iSize);
+        buf = (uint8_t*)buf + nBytes;
+        ofst += nBytes;
+        len -= nBytes;
+    }
+}
+
+void RingLogStorage::writeFile(uint64_t ofst, const void* buf, uint64_t len) noexcept(false) {
+    while(len > 0) {
+        uint64_t nBytes = MIN(len, m_iSize - ofst % m_iSize);
+        writeAll(this->m_iFileDesc, buf, nBytes, ofst % m_iSize);
+        buf = (const uint8_t*)buf + nBytes;
+        ofst += nBytes;
+        len -= nBytes;
+    }
+}
+
+void* RingLogStorage::at(const uint64_t& ofst) {
+    if(m_pBuffer != nullptr) {
+        void* addr = m_pBuffer->at(ofst);
+        if(addr != nullptr) {
+            return addr;
+        }
+    }
+    return (void*)((uint8_t*)this->m_pBase + ofst % m_iSize);
+}
+
+uint64_t RingLogStorage::place(const uint64_t& ofst, const uint64_t& len) noexcept(false) {
+    if(m_pBuffer != nullptr) {
+        // an empty record still needs a writable address
+        std::lock_guard<std::mutex> lock(m_mutex);
+        retire(m_pBuffer->place(ofst, MAX(len, (uint64_t)1), pinned()));
+    }
+    return ofst;
+}
+
+void RingLogStorage::flush(const uint64_t& begin, const uint64_t& end) noexcept(false) {
+    if(end <= begin) {
+        return;
+    }
+    if(m_pBuffer != nullptr) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pBuffer->flush(begin, end);
+        return;
+    }
+    // msync() needs whole pages; the bytes after the range in the last page
+    // are not persisted yet, and will be rewritten later. The second mapping
+    // covers a range running past the end of the ring.
+    uint64_t ofst = ROUND_DOWN(begin, PAGE_SIZE) % m_iSize;
+    uint64_t len = MIN(ROUND_UP(end, PAGE_SIZE) - ROUND_DOWN(begin, PAGE_SIZE), m_iSize);
+    if(msync((uint8_t*)this->m_pBase + ofst, len, MS_SYNC) != 0) {
+        throw PERSIST_EXP_MSYNC(errno);
+    }
+}
+
+void RingLogStorage::load(const uint64_t& begin, const uint64_t& end) noexcept(false) {
+    // the mapping of the file already holds its content
+    this->m_iReleased = begin;
+    if(m_pBuffer != nullptr) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pBuffer->load(end);
+    }
+}
+
+void RingLogStorage::release(const uint64_t& ofst) noexcept(false) {
+    // the space is reused when the ring wraps around, but the memory of the
+    // trimmed pages is given back now; they are persisted already, so the
+    // page cache only drops them
+    uint64_t begin = ROUND_UP(this->m_iReleased, PAGE_SIZE);
+    uint64_t end = ROUND_DOWN(ofst, PAGE_SIZE);
+    this->m_iReleased = ofst;
+    if(end <= begin) {
+        return;
+    }
+    begin = MAX(begin, end - MIN(end, m_iSize));
+    while(begin < end) {
+        uint64_t pos = begin % m_iSize;
+        uint64_t len = MIN(end - begin, m_iSize - pos);
+        madvise((uint8_t*)this->m_pBase + pos, len, MADV_DONTNEED);
+        madvise((uint8_t*)this->m_pBase + m_iSize + pos, len, MADV_DONTNEED);
+        posix_fadvise(this->m_iFileDesc, pos, len, POSIX_FADV_DONTNEED);
+        begin += len;
+    }
+}
+
+/////////////////////////
+// SegmentedLogStorage //
+/////////////////////////
+
+SegmentedLogStorage::Segment::~Segment() {
+    if(base != MAP_FAILED) {
+        munmap(base, length);
+    }
+    if(fileDesc != -1) {
+        close(fileDesc);
+    }
+}
+
+SegmentedLogStorage::SegmentedLogStorage(const string& dataPath, const string& fileName,
+                                         const uint64_t& segmentSize, bool directIO,
+                                         const uint64_t& bufferSize) noexcept(false)
+        : m_sDataPath(dataPath),
+          m_sFileName(fileName),
+          m_iSegmentSize(ROUND_UP(segmentSize, (uint64_t)PAGE_SIZE)),
+          m_bDirectIO(directIO),
+          m_iBufferSize(bufferSize),
+          m_iFirstSlot(0),
+          m_bDirDirty(false) {}
+
+shared_ptr<SegmentedLogStorage::Segment> SegmentedLogStorage::find(const uint64_t& ofst) const {
+    uint64_t slot = ofst / m_iSegmentSize;
+    if(slot < m_iFirstSlot || slot - m_iFirstSlot >= m_segments.size()) {
+        return nullptr;
+    }
+    return m_segments[slot - m_iFirstSlot];
+}
+
+shared_ptr<SegmentedLogStorage::Segment> SegmentedLogStorage::openSegment(const uint64_t& start, const uint64_t& length,
+                                                                           bool create) noexcept(false) {
+    auto segment = make_shared<Segment>();
+    segment->start = start;
+    segment->length = length;
+    segment->file = m_sDataPath + "/" + m_sFileName + "." + to_string(start / m_iSegmentSize);
+    segment->fileDesc = -1;
+    segment->base = MAP_FAILED;
+    if(create) {
+        // give the file its full size, durably, before it gets its real name
+        const string swpFile = m_sDataPath + "/" + m_sFileName + "." + SEGMENT_SWAP_SUFFIX;
+        segment->fileDesc = openForWrite(swpFile, this->m_bDirectIO, true);
+        if(ftruncate(segment->fileDesc, length) != 0) {
+            throw PERSIST_EXP_TRUNCATE_FILE(errno);
+        }
+        if(fsync(segment->fileDesc) != 0) {
+            throw PERSIST_EXP_FSYNC(errno);
+        }
+        if(rename(swpFile.c_str(), segment->file.c_str()) != 0) {
+            throw PERSIST_EXP_RENAME_FILE(errno);
+        }
+    } else {
+        segment->fileDesc = openForWrite(segment->file, this->m_bDirectIO, false);
+    }
+    if(m_bDirectIO && m_pBuffer == nullptr) {
+        m_pBuffer = make_unique<DirectWriteBuffer>(
+                MIN(m_iBufferSize, m_iSegmentSize), directIOAlignment(segment->fileDesc),
+                [this](const uint64_t& ofst, void* buf, const uint64_t& len) { writeFile(ofst, buf, len); },
+                [this](const uint64_t& ofst, void* buf, const uint64_t& len) { readFile(ofst, buf, len); });
+    }
+    // with direct I/O, the records are written from the buffer
+    segment->base = mmap(NULL, length, m_bDirectIO ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, segment->fileDesc, 0);
+    if(segment->base == MAP_FAILED) {
+        dbg_default_error("{0}:map segment failed.", segment->file);
+        throw PERSIST_EXP_MMAP_FILE(errno);
+    }
+    return segment;
+}
+
+void SegmentedLogStorage::insertSegment(const shared_ptr<Segment>& segment) {
+    uint64_t first = segment->start / m_iSegmentSize;
+    uint64_t last = (segment->start + segment->length - 1) / m_iSegmentSize;
+    if(m_segments.empty()) {
+        m_iFirstSlot = first;
+    }
+    while(first < m_iFirstSlot) {
+        m_segments.push_front(nullptr);
+        m_iFirstSlot--;
+    }
+    while(m_iFirstSlot + m_segments.size() <= last) {
+        m_segments.push_back(nullptr);
+    }
+    for(uint64_t slot = first; slot <= last; slot++) {
+        m_segments[slot - m_iFirstSlot] = segment;
+    }
+}
+
+void SegmentedLogStorage::removeSegments(const uint64_t& begin, const uint64_t& end) noexcept(false) {
+    for(uint64_t ofst = ROUND_DOWN(begin, m_iSegmentSize); ofst < end; ofst += m_iSegmentSize) {
+        shared_ptr<Segment> segment = find(ofst);
+        if(segment == nullptr) {
+            continue;
+        }
+        for(uint64_t slot = segment->start / m_iSegmentSize;
+            slot < (segment->start + segment->length) / m_iSegmentSize; slot++) {
+            m_segments[slot - m_iFirstSlot] = nullptr;
+        }
+        retireSegment(segment);
+    }
+}
+
+void SegmentedLogStorage::retireSegment(const shared_ptr<Segment>& segment) noexcept(false) {
+    if(unlink(segment->file.c_str()) != 0) {
+        throw PERSIST_EXP_REMOVE_FILE(errno);
+    }
+    retire(segment);
+}
+
+void SegmentedLogStorage::readFile(uint64_t ofst, void* buf, uint64_t len) noexcept(false) {
+    while(len > 0) {
+        shared_ptr<Segment> segment = find(ofst);
+        uint64_t nBytes;
+        if(segment == nullptr) {
+            nBytes = MIN(len, ROUND_DOWN(ofst, m_iSegmentSize) + m_iSegmentSize - ofst);
+            memset(buf, 0, nBytes);
+        } else {
+            nBytes = MIN(len, segment->start + segment->length - ofst);
+            readAll(segment->fileDesc, buf, nBytes, ofst - segment->start);
+        }
+        buf = (uint8_t*)buf + nBytes;
+        ofst += nBytes;
+        len -= nBytes;
+    }
+}
+
+void SegmentedLogStorage::writeFile(uint64_t ofst, const void* buf, uint64_t len) noexcept(false) {
+    while(len > 0) {
+        shared_ptr<Segment> segment = find(ofst);
+        uint64_t nBytes;
+        if(segment == nullptr) {
+            // the bytes of a removed segment, or of a gap left before a record
+            nBytes = MIN(len, ROUND_DOWN(ofst, m_iSegmentSize) + m_iSegmentSize - ofst);
+        } else {
+            nBytes = MIN(len, segment->start + segment->length - ofst);
+            writeAll(segment->fileDesc, buf, nBytes, ofst - segment->start);
+        }
+        buf = (const uint8_t*)buf + nBytes;
+        ofst += nBytes;
+        len -= nBytes;
+    }
+}
+
+void* SegmentedLogStorage::at(const uint64_t& ofst) {
+    if(m_pBuffer != nullptr) {
+        void* addr = m_pBuffer->at(ofst);
+        if(addr != nullptr) {
+            return addr;
+        }
+    }
+    uint64_t slot = ofst / m_iSegmentSize;
+    if(slot < m_iFirstSlot || slot - m_iFirstSlot >= m_segments.size() || !m_segments[slot - m_iFirstSlot]) {
+        return nullptr;
+    }
+    const Segment& segment = *m_segments[slot - m_iFirstSlot];
+    return (void*)((uint8_t*)segment.base + (ofst - segment.start));
+}
+
+uint64_t SegmentedLogStorage::place(const uint64_t& ofst, const uint64_t& len) noexcept(false) {
+    // an empty record still needs a valid address
+    uint64_t size = MAX(len, (uint64_t)1);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t start = ofst;
+    shared_ptr<Segment> segment = find(ofst);
+    if(segment == nullptr || ofst + size > segment->start + segment->length) {
+        // the record goes to the start of the next segment
+        start = (segment != nullptr) ? segment->start + segment->length : ROUND_UP(ofst, m_iSegmentSize);
+        shared_ptr<Segment> next = find(start);
+        if(next == nullptr || next->start != start || size > next->length) {
+            // a large record gets a segment of several times the segment size
+            uint64_t length = MAX(m_iSegmentSize, ROUND_UP(size, m_iSegmentSize));
+            // remove what is left of the segments there from before a truncate or a crash
+            removeSegments(start, start + length);
+            insertSegment(openSegment(start, length, true));
+            m_bDirDirty = true;
+            dbg_default_trace("{0}:created segment {1}.", m_sFileName, start / m_iSegmentSize);
+        }
+    }
+    if(m_pBuffer != nullptr) {
+        retire(m_pBuffer->place(start, size, pinned()));
+    }
+    return start;
+}
+
+void SegmentedLogStorage::flush(const uint64_t& begin, const uint64_t& end) noexcept(false) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_bDirDirty) {
+        // make the new segment files durable along with their contents
+        syncDir(m_sDataPath);
+        m_bDirDirty = false;
+    }
+    if(m_bDirectIO) {
+        if(m_pBuffer != nullptr) {
+            m_pBuffer->flush(begin, end);
+        }
+        return;
+    }
+    uint64_t ofst = ROUND_DOWN(begin, PAGE_SIZE);
+    while(ofst < end) {
+        shared_ptr<Segment> segment = find(ofst);
+        if(segment == nullptr) {
+            ofst = ROUND_DOWN(ofst, m_iSegmentSize) + m_iSegmentSize;
+            continue;
+        }
+        // segments are made of whole pages, as msync() needs
+        uint64_t segmentEnd = segment->start + segment->length;
+        uint64_t flushEnd = MIN(ROUND_UP(end, PAGE_SIZE), segmentEnd);
+        if(msync((uint8_t*)segment->base + (ofst - segment->start), flushEnd - ofst, MS_SYNC) != 0) {
+            throw PERSIST_EXP_MSYNC(errno);
+        }
+        ofst = flushEnd;
+    }
+}
+
+void SegmentedLogStorage::load(const uint64_t& begin, const uint64_t& end) noexcept(false) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    DIR* dir = opendir(m_sDataPath.c_str());
+    if(dir == NULL) {
+        throw PERSIST_EXP_OPEN_FILE(errno);
+    }
+    // a segment that was being created when the process stopped
+    const string swpFile = m_sDataPath + "/" + m_sFileName + "." + SEGMENT_SWAP_SUFFIX;
+    if(unlink(swpFile.c_str()) != 0 && errno != ENOENT) {
+        closedir(dir);
+        throw PERSIST_EXP_REMOVE_FILE(errno);
+    }
+    struct dirent* dent;
+    uint64_t number;
+    while((dent = readdir(dir)) != NULL) {
+        if(!isSegmentFile(dent->d_name, m_sFileName, number)) {
+            continue;
+        }
+        const string file = m_sDataPath + "/" + dent->d_name;
+        struct stat sb;
+        if(stat(file.c_str(), &sb) != 0) {
+            closedir(dir);
+            throw PERSIST_EXP_OPEN_FILE(errno);
+        }
+        uint64_t start = number * m_iSegmentSize;
+        uint64_t length = sb.st_size;
+        if(start + length <= begin || start >= end) {
+            // trimmed or truncated before the segment was unlinked, or
+            // created for records that were never persisted
+            dbg_default_debug("{0}:removing unused segment {1}.", m_sFileName, number);
+            if(unlink(file.c_str()) != 0) {
+                closedir(dir);
+                throw PERSIST_EXP_REMOVE_FILE(errno);
+            }
+            continue;
+        }
+        if(length == 0 || length % m_iSegmentSize != 0) {
+            dbg_default_error("{0}:segment {1} in use has a size of {2} bytes.", m_sFileName, number, length);
+            closedir(dir);
+            throw PERSIST_EXP_INV_FILE;
+        }
+        insertSegment(openSegment(start, length, false));
+    }
+    closedir(dir);
+    // every offset in use must be in a segment
+    for(uint64_t ofst = ROUND_DOWN(begin, m_iSegmentSize); ofst < end; ofst += m_iSegmentSize) {
+        if(find(ofst) == nullptr) {
+            dbg_default_error("{0}:segment {1} is missing.", m_sFileName, ofst / m_iSegmentSize);
+            throw PERSIST_EXP_INV_FILE;
+        }
+    }
+    if(m_pBuffer != nullptr) {
+        m_pBuffer->load(end);
+    }
+}
+
+void SegmentedLogStorage::release(const uint64_t& ofst) noexcept(false) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while(!m_segments.empty()
+          && (m_segments.front() == nullptr
+              || m_segments.front()->start + m_segments.front()->length <= ofst)) {
+        shared_ptr<Segment> segment = m_segments.front();
+        m_segments.pop_front();
+        m_iFirstSlot++;
+        // the segment is removed with its last slot
+        if(segment != nullptr && (m_segments.empty() || m_segments.front() != segment)) {
+            dbg_default_trace("{0}:removing trimmed segment {1}.", m_sFileName, segment->start / m_iSegmentSize);
+            retireSegment(segment);
+        }
+    }
+}
+
+bool SegmentedLogStorage::isSegmentFile(const string& name, const string& fileName, uint64_t& number) {
+    if(name.length() <= fileName.length() + 1
+       || name.compare(0, fileName.length(), fileName) != 0
+       || name[fileName.length()] != '.'
+       || name.find_first_not_of("0123456789", fileName.length() + 1) != string::npos) {
+        return false;
+    }
+    number = stoull(name.substr(fileName.length() + 1));
+    return true;
+}
+
+bool SegmentedLogStorage::hasFiles(const string& dataPath, const string& fileName) noexcept(false) {
+    DIR* dir = opendir(dataPath.c_str());
+    if(dir == NULL) {
+        return false;
+    }
+    struct dirent* dent;
+    uint64_t number;
+    bool bRet = false;
+    while(!bRet && (dent = readdir(dir)) != NULL) {
+        bRet = isSegmentFile(dent->d_name, fileName, number);
+    }
+    closedir(dir);
+    return bRet;
+}
+
+void SegmentedLogStorage::removeFiles(const string& dataPath, const string& fileName) noexcept(false) {
+    const string swpFile = dataPath + "/" + fileName + "." + SEGMENT_SWAP_SUFFIX;
+    if(unlink(swpFile.c_str()) != 0 && errno != ENOENT) {
+        throw PERSIST_EXP_REMOVE_FILE(errno);
+    }
+    DIR* dir = opendir(dataPath.c_str());
+    if(dir == NULL) {
+        return;
+    }
+    struct dirent* dent;
+    uint64_t number;
+    while((dent = readdir(dir)) != NULL) {
+        if(isSegmentFile(dent->d_name, fileName, number)) {
+            const string file = dataPath + "/" + dent->d_name;
+            if(unlink(file.c_str()) != 0) {
+                closedir(dir);
+                throw PERSIST_EXP_REMOVE_FILE(errno);
+            }
+        }
+    }
+    closedir(dir);
+}
+}  // namespace persistent
@@ -143,6 +143,7 @@ printhelp() {
     cout << "\tdelta-sub <op> <version>" << endl;
     cout << "\tdelta-getbyidx <index>" << endl;
     cout << "\tdelta-getbyver <version>" << endl;
+    cout << "\tsegment-test <num> <datasize>" << endl;
     cout << "NOTICE: test can crash if <datasize> is too large(>8MB).\n"
          << "This is probably due to the stack size is limited. Try \n"
          << "  \"ulimit -s unlimited\"\n"
@@ -189,6 +190,7 @@ static void nologload() {
 }
 
 static void test_hlc();
+static bool test_segments(int num, std::size_t dsize);
 template <StorageType st = ST_FILE>
 static void eval_write(std::size_t osize, int nops, bool batch) {
     VariableBytes writeMe;
@@ -217,7 +219,8 @@ static void eval_write(std::size_t osize, int nops, bool batch) {
     dbg_default_warn("nanosecond={}\n", nsec);
     double thp_MBPS = (double)osize * nops / (double)nsec * 1000;
     double lat_us = (double)nsec / nops / 1000;
-    cout << "WRITE TEST(st=" << st << ", size=" << osize << " byte, ops=" << nops << ")" << endl;
+    cout << "WRITE TEST(st=" << st << ", write_mode=" << derecho::getConfString(CONF_PERS_WRITE_MODE)
+         << ", size=" << osize << " byte, ops=" << nops << ")" << endl;
     cout << "throughput:\t" << thp_MBPS << " MB/s" << endl;
     cout << "latency:\t" << lat_us << " microseconds" << endl;
 }
@@ -434,6 +437,12 @@ int main(int argc, char** argv) {
         } else if(strcmp(argv[1], "delta-getbyver") == 0) {
             int64_t version = std::stoi(argv[1]);
             cout << "dx[idx:" << version << "] = " << dx[version]->value << endl;
+        } else if(strcmp(argv[1], "segment-test") == 0) {
+            // reading an unmapped segment must fail the test instead of looping in sig_handler
+            signal(SIGSEGV, SIG_DFL);
+            bool passed = test_segments(atoi(argv[2]), atoi(argv[3]));
+            cout << (passed ? "PASSED" : "FAILED") << endl;
+            return passed ? 0 : 1;
         } else {
             cout << "unknown command: " << argv[1] << endl;
             printhelp();
@@ -484,3 +493,115 @@ void test_hlc() {
     cout << "h1<=h2\t" << (h1 <= h2) << endl;
     cout << "h1==h2\t" << (h1 == h2) << endl;
 }
+
+// the data of version ver in test_segments()
+static std::vector<char> segment_test_data(int64_t ver, std::size_t dsize) {
+    return std::vector<char>(dsize, (char)('a' + ver % 26));
+}
+
+// check that a log holds exactly the versions [first, last] of test_segments()
+static bool check_segment_test_log(FilePersistLog& log, int64_t first, int64_t last, std::size_t dsize) {
+    if(log.getEarliestVersion() != first || log.getLatestVersion() != last) {
+        cout << "the log holds versions [" << log.getEarliestVersion() << "," << log.getLatestVersion()
+             << "], expected [" << first << "," << last << "]" << endl;
+        return false;
+    }
+    for(int64_t ver = first; ver <= last; ver++) {
+        const char* pdat = (const char*)log.getEntry(ver);
+        if(pdat == nullptr || memcmp(pdat, segment_test_data(ver, dsize).data(), dsize) != 0) {
+            cout << "version " << ver << " is missing or corrupted" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Checks the segmented log storage (PERS/segment_size > 0): trimming, a
+// restart after a trim and a truncate, and a restart with the files a crash
+// can leave behind.
+static bool test_segments(int num, std::size_t dsize) {
+    const uint64_t segment_size = derecho::getConfUInt64(CONF_PERS_SEGMENT_SIZE);
+    if(segment_size == 0) {
+        cout << "segment-test needs PERS/segment_size to be set" << endl;
+        return false;
+    }
+    const std::string name = "segment_test";
+    const std::string path = getPersFilePath();
+    const std::string log_name = name + "." + LOG_FILE_SUFFIX;
+    const std::string data_name = name + "." + DATA_FILE_SUFFIX;
+    unlink((path + "/" + name + "." + META_FILE_SUFFIX).c_str());
+    SegmentedLogStorage::removeFiles(path, log_name);
+    SegmentedLogStorage::removeFiles(path, data_name);
+    bool passed = true;
+
+    // STEP 1: fill a new log and trim half of it
+    {
+        FilePersistLog log(name);
+        for(int64_t ver = 0; ver < num; ver++) {
+            log.append(segment_test_data(ver, dsize).data(), dsize, ver, HLC(ver + 1, 0));
+        }
+        log.persist();
+        // a pointer taken before the trim stays readable while pinned
+        {
+            EntryPin pin(log);
+            const char* trimmed = (const char*)log.getEntry(0);
+            log.trim((int64_t)num / 2 - 1);
+            passed = passed && trimmed[0] == segment_test_data(0, dsize)[0];
+            passed = passed && !checkRegularFile(path + "/" + data_name + ".0");
+        }
+        passed = passed && check_segment_test_log(log, num / 2, num - 1, dsize);
+    }
+    cout << "trim:\t" << (passed ? "ok" : "failed") << endl;
+
+    // STEP 2: restart after the trim, then append and truncate, which leaves
+    // segments behind the end of the log
+    {
+        FilePersistLog log(name);
+        passed = passed && check_segment_test_log(log, num / 2, num - 1, dsize);
+        for(int64_t ver = num; ver < 2 * num; ver++) {
+            log.append(segment_test_data(ver, dsize).data(), dsize, ver, HLC(ver + 1, 0));
+        }
+        log.persist();
+        log.truncate(num + num / 2);
+        passed = passed && check_segment_test_log(log, num / 2, num + num / 2, dsize);
+    }
+    cout << "restart after trim:\t" << (passed ? "ok" : "failed") << endl;
+
+    // STEP 3: leave what a crash can leave behind, and restart: a segment
+    // being created, empty and short segment files, and a full segment
+    // after the end of the log
+    // every record takes at most dsize / segment_size + 1 segments
+    const uint64_t past_end = 2 * (uint64_t)num * (dsize / segment_size + 1) + 2;
+    const std::vector<std::pair<std::string, uint64_t>> leftovers = {
+            {path + "/" + data_name + ".swp", segment_size / 2},
+            {path + "/" + log_name + "." + std::to_string(past_end), 0},
+            {path + "/" + data_name + "." + std::to_string(past_end), segment_size / 2},
+            {path + "/" + data_name + "." + std::to_string(past_end + 1), segment_size}};
+    for(const auto& leftover : leftovers) {
+        int fd = open(leftover.first.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+        if(fd < 0 || ftruncate(fd, leftover.second) != 0) {
+            cout << "cannot create " << leftover.first << endl;
+            return false;
+        }
+        close(fd);
+    }
+    {
+        FilePersistLog log(name);
+        passed = passed && check_segment_test_log(log, num / 2, num + num / 2, dsize);
+        for(const auto& leftover : leftovers) {
+            if(checkRegularFile(leftover.first)) {
+                cout << leftover.first << " was not removed" << endl;
+                passed = false;
+            }
+        }
+        const int64_t ver = num + num / 2 + 1;
+        log.append(segment_test_data(ver, dsize).data(), dsize, ver, HLC(ver + 1, 0));
+        log.persist();
+    }
+    {
+        FilePersistLog log(name);
+        passed = passed && check_segment_test_log(log, num / 2, num + num / 2 + 1, dsize);
+    }
+    cout << "restart after a crash:\t" << (passed ? "ok" : "failed") << endl;
+    return passed;
+}